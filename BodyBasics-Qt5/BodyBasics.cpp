@@ -1,8 +1,23 @@
 #include "stdafx.h"
 #include "BodyBasics.h"
 
+// Bones as pairs of JointType values, the same set the SDK's BodyBasics sample draws
+static const int Bones[][2] =
+{
+	// Torso
+	{ 3, 2 }, { 2, 20 }, { 20, 1 }, { 1, 0 }, { 20, 8 }, { 20, 4 }, { 0, 16 }, { 0, 12 },
+	// Right Arm
+	{ 8, 9 }, { 9, 10 }, { 10, 11 }, { 11, 23 }, { 10, 24 },
+	// Left Arm
+	{ 4, 5 }, { 5, 6 }, { 6, 7 }, { 7, 21 }, { 6, 22 },
+	// Right Leg
+	{ 16, 17 }, { 17, 18 }, { 18, 19 },
+	// Left Leg
+	{ 12, 13 }, { 13, 14 }, { 14, 15 }
+};
+
 BodyBasics::BodyBasics(QWidget *parent)
-	: QWidget(parent)
+	: QWidget(parent), bodies()
 {
 	ui.setupUi(this);
 }
@@ -11,3 +26,51 @@ BodyBasics::~BodyBasics()
 {
 
 }
+
+void BodyBasics::setBodyFrame(const QKinectBodyFrame &frame)
+{
+	bodies = frame;
+	update();
+}
+
+void BodyBasics::paintEvent(QPaintEvent *)
+{
+	QPainter painter(this);
+	painter.fillRect(rect(), Qt::black);
+	painter.setRenderHint(QPainter::Antialiasing);
+
+	// joints are drawn in depth space, scaled to the widget
+	const qreal sx = width() / 512.0;
+	const qreal sy = height() / 424.0;
+
+	for (int b = 0; b < QKinectBodyFrame::BodyCount; ++b)
+	{
+		if (!bodies.isTracked(b))
+			continue;
+
+		for (int i = 0; i < int(sizeof(Bones) / sizeof(Bones[0])); ++i)
+		{
+			const int j0 = QKinectBodyFrame::index(b, Bones[i][0]);
+			const int j1 = QKinectBodyFrame::index(b, Bones[i][1]);
+
+			// don't draw if neither joint is tracked, draw thin if one is only inferred
+			if (bodies.TrackingState[j0] == QKinectBodyFrame::NotTracked || bodies.TrackingState[j1] == QKinectBodyFrame::NotTracked)
+				continue;
+
+			const bool tracked = bodies.TrackingState[j0] == QKinectBodyFrame::Tracked && bodies.TrackingState[j1] == QKinectBodyFrame::Tracked;
+			painter.setPen(QPen(tracked ? Qt::green : Qt::gray, tracked ? 6 : 1));
+			painter.drawLine(QPointF(bodies.DepthX[j0] * sx, bodies.DepthY[j0] * sy), QPointF(bodies.DepthX[j1] * sx, bodies.DepthY[j1] * sy));
+		}
+
+		for (int j = 0; j < QKinectBodyFrame::JointCount; ++j)
+		{
+			const int i = QKinectBodyFrame::index(b, j);
+			if (bodies.TrackingState[i] == QKinectBodyFrame::NotTracked)
+				continue;
+
+			painter.setPen(Qt::NoPen);
+			painter.setBrush(bodies.TrackingState[i] == QKinectBodyFrame::Tracked ? QColor(68, 192, 68) : Qt::yellow);
+			painter.drawEllipse(QPointF(bodies.DepthX[i] * sx, bodies.DepthY[i] * sy), 3, 3);
+		}
+	}
+}
@@ -1,6 +1,7 @@
 #pragma once
 #include <QtWidgets/QWidget>
 #include "ui_BodyBasics.h"
+#include "QKinectBodyFrame.h"
 
 class BodyBasics : public QWidget
 {
@@ -10,6 +11,13 @@ public:
 	BodyBasics(QWidget *parent = 0);
 	~BodyBasics();
 
+public slots:
+	void setBodyFrame(const QKinectBodyFrame &bodies);
+
+protected:
+	void paintEvent(QPaintEvent *event);
+
 private:
 	Ui::BodyBasicsClass ui;
+	QKinectBodyFrame bodies;
 };
@@ -12,5 +12,10 @@ int main(int argc, char *argv[])
 	k.setUseBodyFrame(true);
 	k.start();
 
+	BodyBasics bodyWidget;
+	bodyWidget.setMinimumSize(512, 424);
+	bodyWidget.show();
+	QApplication::connect(&k, SIGNAL(bodyFrame(QKinectBodyFrame)), &bodyWidget, SLOT(setBodyFrame(QKinectBodyFrame)));
+
 	return a.exec();
 }
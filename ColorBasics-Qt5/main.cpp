@@ -2,6 +2,7 @@
 #include "ColorBasics.h"
 #include <QtWidgets/QApplication>
 #include "QKinectGrabber.h"
+#include "QKinectFrameMailbox.h"
 #include "QImageWidget.h"
 #include "QD2DWidget.h"
 
@@ -21,7 +22,10 @@ int main(int argc, char *argv[])
 	QImageWidget colorWidget;
 	colorWidget.setMinimumSize(1920, 1080);
 	colorWidget.show();
-	QApplication::connect(&k, SIGNAL(colorImage(QImage)), &colorWidget, SLOT(setImage(QImage)));
+	// the widget only ever gets the newest image, however far behind the GUI thread is
+	QKinectFrameMailbox mailbox;
+	k.addMailbox(&mailbox);
+	QApplication::connect(&mailbox, SIGNAL(colorImage(QImage)), &colorWidget, SLOT(setImage(QImage)));
 
 	return a.exec();
 }
@@ -2,6 +2,7 @@
 #include "DepthBasics.h"
 #include <QtWidgets/QApplication>
 #include "QKinectGrabber.h"
+#include "QKinectFrameMailbox.h"
 #include "QImageWidget.h"
 
 int main(int argc, char *argv[])
@@ -15,7 +16,10 @@ int main(int argc, char *argv[])
 	QImageWidget depthWidget;
 	depthWidget.setMinimumSize(512, 424);
 	depthWidget.show();
-	QApplication::connect(&k, SIGNAL(depthImage(QImage)), &depthWidget, SLOT(setImage(QImage)));
+	// the widget only ever gets the newest image, however far behind the GUI thread is
+	QKinectFrameMailbox mailbox;
+	k.addMailbox(&mailbox);
+	QApplication::connect(&mailbox, SIGNAL(depthImage(QImage)), &depthWidget, SLOT(setImage(QImage)));
 
 	return a.exec();
 }
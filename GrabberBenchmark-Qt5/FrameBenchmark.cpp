@@ -0,0 +1,936 @@
+#include "stdafx.h"
+#include "FrameBenchmark.h"
+#include "ImageEmitter.h"
+#include "QKinectGrabber.h"
+#include "QImageWidget.h"
+#include "QSyntheticFrameSource.h"
+#include "QFrameKernels.h"
+#include "QColorDownscaler.h"
+#include "QInfraredToneMapper.h"
+#include "QDepthFilter.h"
+#include "QDepthCodec.h"
+#include "QFrameRecordingReader.h"
+#include "QFrameRecorder.h"
+#include "QFrameRegistration.h"
+#include "QVoxelGrid.h"
+#include <algorithm>
+#include <deque>
+#include <unordered_map>
+#include <cstring>
+#include <cmath>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+
+// Time between two frames fed to the widget at the sensor's rate, in ms
+#define SensorFrameInterval 33
+
+
+
+/// <summary>
+/// Synthetic source noting when each frame was read, so its delivery can be timed
+/// </summary>
+class TimedSource : public QSyntheticFrameSource
+{
+public:
+	enum { ColorSlot, DepthSlot, InfraredSlot, SlotCount };
+
+	explicit TimedSource(const QElapsedTimer& clock) : Clock(clock)
+	{
+		for (int slot = 0; slot < SlotCount; ++slot)
+			Skipped[slot] = 0;
+	}
+
+	bool readColor(QKinectColorFrame& frame, QFramePool& pool) Q_DECL_OVERRIDE
+	{
+		return stamp(ColorSlot, QSyntheticFrameSource::readColor(frame, pool));
+	}
+
+	bool readDepth(QKinectDepthFrame& frame) Q_DECL_OVERRIDE
+	{
+		return stamp(DepthSlot, QSyntheticFrameSource::readDepth(frame));
+	}
+
+	bool readInfrared(QKinectInfraredFrame& frame) Q_DECL_OVERRIDE
+	{
+		return stamp(InfraredSlot, QSyntheticFrameSource::readInfrared(frame));
+	}
+
+	/// <summary>
+	/// Read time of the oldest frame of a stream that was not delivered yet, -1 if none.
+	/// The grabber emits the frames it reads in order, except those its queue dropped,
+	/// which are the oldest waiting: with skipped frames dropped so far, reads and
+	/// deliveries pair up.
+	/// </summary>
+	qint64 delivered(int slot, quint64 skipped)
+	{
+		QMutexLocker lock(&StampMutex);
+		for (; Skipped[slot] < skipped && !Stamps[slot].empty(); ++Skipped[slot])
+			Stamps[slot].pop_front();
+
+		if (Stamps[slot].empty())
+			return -1;
+
+		const qint64 read = Stamps[slot].front();
+		Stamps[slot].pop_front();
+		return read;
+	}
+
+private:
+	bool stamp(int slot, bool read)
+	{
+		if (read)
+		{
+			QMutexLocker lock(&StampMutex);
+			Stamps[slot].push_back(Clock.nsecsElapsed());
+		}
+		return read;
+	}
+
+	const QElapsedTimer&	Clock;
+	QMutex					StampMutex;
+	std::deque<qint64>		Stamps[SlotCount];
+	quint64					Skipped[SlotCount];
+};
+
+
+/// <summary>
+/// One frame of every image stream, as the grabber gets them from a source
+/// </summary>
+static void SyntheticFrames(QSyntheticFrameSource& source, QFramePool& pool, QKinectColorFrame& color, QKinectDepthFrame& depth, QKinectInfraredFrame& infrared)
+{
+	source.setPaced(false);
+	source.open(QFrameSource::ColorStream | QFrameSource::DepthStream | QFrameSource::InfraredStream);
+	source.wait(0);
+	source.readColor(color, pool);
+	source.readDepth(depth);
+	source.readInfrared(infrared);
+	source.close();
+}
+
+
+/// <summary>
+/// The voxel grid as it is usually first written: a std::unordered_map from the voxel's
+/// cell to its point sums, on one thread. The baseline QVoxelGrid is measured against;
+/// cells are computed the same way, so both find the same voxels.
+/// </summary>
+static int UnorderedMapVoxels(const QKinectDepthFrame& depth, const float* table, float leafSize, std::vector<float>& points)
+{
+	struct Sums
+	{
+		double	X, Y, Z;
+		int		Count;
+	};
+	std::unordered_map<quint64, Sums> voxels;
+
+	const float inverseLeaf = 1.0f / leafSize;
+	const int count = depth.Width * depth.Height;
+
+	for (int i = 0; i < count; ++i)
+	{
+		if (depth.Buffer[i] == 0)
+			continue;
+
+		const float z = depth.Buffer[i] * 0.001f;
+		const float x = table[2 * i] * z;
+		const float y = table[2 * i + 1] * z;
+		if (x != x || y != y)
+			continue;
+
+		const quint64 key = ((static_cast<quint64>(static_cast<qint64>(std::floor(x * inverseLeaf)) + (1 << 20)) & 0x1FFFFF) << 42) |
+			((static_cast<quint64>(static_cast<qint64>(std::floor(y * inverseLeaf)) + (1 << 20)) & 0x1FFFFF) << 21) |
+			(static_cast<quint64>(static_cast<qint64>(std::floor(z * inverseLeaf)) + (1 << 20)) & 0x1FFFFF);
+
+		Sums& sums = voxels[key];
+		sums.X += x;
+		sums.Y += y;
+		sums.Z += z;
+		++sums.Count;
+	}
+
+	points.resize(3 * voxels.size());
+	float* point = points.data();
+	for (std::unordered_map<quint64, Sums>::const_iterator it = voxels.begin(); it != voxels.end(); ++it, point += 3)
+	{
+		point[0] = static_cast<float>(it->second.X / it->second.Count);
+		point[1] = static_cast<float>(it->second.Y / it->second.Count);
+		point[2] = static_cast<float>(it->second.Z / it->second.Count);
+	}
+
+	return static_cast<int>(voxels.size());
+}
+
+
+
+FrameBenchmark::FrameBenchmark(double seconds, const QString& filter, const QString& recording) :
+	Seconds(qMax(seconds, 0.01)),
+	Filter(filter),
+	Recording(recording)
+{
+}
+
+void FrameBenchmark::run()
+{
+	runKernels();
+	runCodec();
+	runSignal();
+	runWidget();
+	runGrabber(false);
+	runGrabber(true);
+	runRecording(false);
+	runRecording(true);
+}
+
+bool FrameBenchmark::selected(const QString& stage) const
+{
+	return Filter.isEmpty() || stage.contains(Filter);
+}
+
+
+/// <summary>
+/// Time iteration back to back until the stage's time is up
+/// </summary>
+void FrameBenchmark::measure(const QString& stage, const QString& variant, qint64 pixels, const std::function<void()>& iteration, double ratio)
+{
+	if (!selected(stage))
+		return;
+
+	// one untimed pass warms the caches and anything built on first use
+	iteration();
+
+	BenchmarkResult result;
+	result.Stage = stage;
+	result.Variant = variant;
+	result.Pixels = pixels;
+	result.Ratio = ratio;
+
+	QElapsedTimer clock;
+	clock.start();
+
+	const qint64 end = static_cast<qint64>(Seconds * 1e9);
+	qint64 now = 0;
+
+	while (now < end)
+	{
+		const qint64 start = now;
+		iteration();
+		now = clock.nsecsElapsed();
+
+		result.Latencies.push_back(now - start);
+	}
+
+	result.Frames = static_cast<qint64>(result.Latencies.size());
+	result.Elapsed = now;
+	report(result);
+}
+
+void FrameBenchmark::report(BenchmarkResult& result)
+{
+	std::sort(result.Latencies.begin(), result.Latencies.end());
+
+	const size_t count = result.Latencies.size();
+	const double p50 = count ? result.Latencies[(count - 1) / 2] / 1000.0 : 0.0;
+	const double p99 = count ? result.Latencies[(count - 1) * 99 / 100] / 1000.0 : 0.0;
+	const double elapsed = static_cast<double>(qMax<qint64>(result.Elapsed, 1));
+	const double pixels = static_cast<double>(qMax<qint64>(result.Frames * result.Pixels, 1));
+
+	QString line = QString("{\"stage\":\"%1\",\"variant\":\"%2\",\"pixels\":%3,\"frames\":%4,"
+		"\"ns_per_pixel\":%5,\"frames_per_s\":%6,\"p50_us\":%7,\"p99_us\":%8")
+		.arg(result.Stage)
+		.arg(result.Variant)
+		.arg(result.Pixels)
+		.arg(result.Frames)
+		.arg(elapsed / pixels, 0, 'f', 4)
+		.arg(result.Frames * 1e9 / elapsed, 0, 'f', 1)
+		.arg(p50, 0, 'f', 1)
+		.arg(p99, 0, 'f', 1);
+
+	if (result.Dropped >= 0)
+		line += QString(",\"dropped\":%1").arg(result.Dropped);
+
+	if (result.CpuPercent >= 0)
+		line += QString(",\"gui_cpu_percent\":%1").arg(result.CpuPercent, 0, 'f', 1);
+
+	if (result.Ratio >= 0)
+		line += QString(",\"compression_ratio\":%1").arg(result.Ratio, 0, 'f', 2);
+
+	if (result.WriteRate >= 0)
+		line += QString(",\"write_mb_per_s\":%1").arg(result.WriteRate, 0, 'f', 1);
+
+	std::cout << qPrintable(line) << "}" << std::endl;
+}
+
+
+void FrameBenchmark::runKernels()
+{
+	QSyntheticFrameSource source;
+	QFramePool pool(4, 0);
+	QKinectColorFrame color;
+	QKinectDepthFrame depth;
+	QKinectInfraredFrame infrared;
+	SyntheticFrames(source, pool, color, depth, infrared);
+
+	const int colorPixels = color.Width * color.Height;
+	const int depthPixels = depth.Width * depth.Height;
+
+	// the sensor source copies every frame out of the SDK into a pool buffer
+	measure("color_copy", "bgra32", colorPixels, [&]()
+	{
+		QFrameHandle buffer = pool.acquire();
+		memcpy(buffer.data(), color.Buffer.data(), colorPixels * QKinectColorFrame::Channels);
+	});
+
+	measure("color_image", "argb32", colorPixels, [&]()
+	{
+		QImage image = color.Buffer.toImage(color.Width, color.Height, color.Width * QKinectColorFrame::Channels, QImage::Format_ARGB32);
+	});
+
+	// the grabber's reduced color output: 1/2, 1/3 (box filter) and an arbitrary size (area filter)
+	static const char* const isaNames[] = { "scalar", "sse2", "avx2" };
+	static const int scaledSizes[][2] = { { 960, 540 }, { 640, 360 }, { 800, 450 } };
+
+	for (int s = 0; s < 3; ++s)
+	{
+		QColorDownscaler downscaler;
+		QImage scaled(scaledSizes[s][0], scaledSizes[s][1], QImage::Format_ARGB32);
+
+		for (int isa = QFrameKernels::Scalar; isa <= QFrameKernels::instructionSet(); ++isa)
+		{
+			measure("color_downscale", QString("%1x%2_%3").arg(scaled.width()).arg(scaled.height()).arg(isaNames[isa]), colorPixels, [&]()
+			{
+				downscaler.process(color.Buffer.data(), color.Width, color.Height, color.Width * QKinectColorFrame::Channels,
+					scaled.bits(), scaled.width(), scaled.height(), scaled.bytesPerLine(), static_cast<QFrameKernels::InstructionSet>(isa));
+			});
+		}
+	}
+
+	// raw color: YUY2 to BGRA and to its luma on one thread, then in row bands over the thread pool
+	QSyntheticFrameSource rawSource;
+	QFramePool rawPool(2, 0);
+	QKinectColorFrame yuy2;
+	rawSource.setRawColor(true);
+	rawSource.setPaced(false);
+	rawSource.open(QFrameSource::ColorStream);
+	rawSource.wait(0);
+	rawSource.readColor(yuy2, rawPool);
+	rawSource.close();
+
+	QImage converted(yuy2.Width, yuy2.Height, QImage::Format_ARGB32);
+	QImage luma(yuy2.Width, yuy2.Height, QImage::Format_Indexed8);
+
+	for (int isa = QFrameKernels::Scalar; isa <= QFrameKernels::instructionSet(); ++isa)
+	{
+		measure("color_yuy2", QString("bgra_%1").arg(isaNames[isa]), colorPixels, [&]()
+		{
+			QFrameKernels::yuy2ToBgra(yuy2.Buffer.data(), yuy2.Width, yuy2.Height, yuy2.bytesPerLine(),
+				converted.bits(), converted.bytesPerLine(), static_cast<QFrameKernels::InstructionSet>(isa), 0);
+		});
+
+		measure("color_yuy2", QString("gray8_%1").arg(isaNames[isa]), colorPixels, [&]()
+		{
+			QFrameKernels::yuy2ToGray8(yuy2.Buffer.data(), yuy2.Width, yuy2.Height, yuy2.bytesPerLine(),
+				luma.bits(), luma.bytesPerLine(), static_cast<QFrameKernels::InstructionSet>(isa), 0);
+		});
+	}
+
+	measure("color_yuy2", "bgra_bands", colorPixels, [&]()
+	{
+		QFrameKernels::yuy2ToBgra(yuy2.Buffer.data(), yuy2.Width, yuy2.Height, yuy2.bytesPerLine(), converted.bits(), converted.bytesPerLine());
+	});
+
+	measure("color_yuy2", "gray8_bands", colorPixels, [&]()
+	{
+		QFrameKernels::yuy2ToGray8(yuy2.Buffer.data(), yuy2.Width, yuy2.Height, yuy2.bytesPerLine(), luma.bits(), luma.bytesPerLine());
+	});
+
+	QVector<QRgb> colorTable;
+	for (int i = 0; i < 256; ++i)
+		colorTable.push_back(qRgb(i, i, i));
+
+	measure("depth_image", "indexed8", depthPixels, [&]()
+	{
+		QImage image(depth.Width, depth.Height, QImage::Format_Indexed8);
+		image.setColorTable(colorTable);
+	});
+
+	QImage gray(depth.Width, depth.Height, QImage::Format_Indexed8);
+
+	for (int isa = QFrameKernels::Scalar; isa <= QFrameKernels::instructionSet(); ++isa)
+	{
+		measure("depth_gray8", isaNames[isa], depthPixels, [&]()
+		{
+			QFrameKernels::depthToGray8(depth.Buffer.data(), depth.Width, depth.Height, depth.MaxDistance,
+				gray.bits(), gray.bytesPerLine(), static_cast<QFrameKernels::InstructionSet>(isa));
+		});
+	}
+
+	for (int adaptive = 0; adaptive < 2; ++adaptive)
+	{
+		QInfraredToneMapper mapper;
+		mapper.setAdaptive(adaptive != 0);
+
+		measure("infrared_tonemap", adaptive ? "adaptive" : "fixed", depthPixels, [&]()
+		{
+			mapper.map(infrared.Buffer.data(), infrared.Width, infrared.Height, gray.bits(), gray.bytesPerLine());
+		});
+	}
+
+	// temporal filter and hole fill of a depth frame, on one thread per instruction set, then in row bands over the thread pool
+	std::vector<unsigned short> filtered(depthPixels);
+
+	for (int mode = QDepthFilter::Exponential; mode <= QDepthFilter::Median; ++mode)
+	{
+		const QString modeName = mode == QDepthFilter::Median ? "median" : "exponential";
+		QDepthFilter filter;
+		filter.setMode(static_cast<QDepthFilter::Mode>(mode));
+
+		for (int isa = QFrameKernels::Scalar; isa <= QFrameKernels::instructionSet(); ++isa)
+		{
+			measure("depth_filter", QString("%1_%2").arg(modeName).arg(isaNames[isa]), depthPixels, [&]()
+			{
+				filter.process(depth.Buffer.data(), depth.Width, depth.Height, filtered.data(), static_cast<QFrameKernels::InstructionSet>(isa), 0);
+			});
+		}
+
+		measure("depth_filter", QString("%1_bands").arg(modeName), depthPixels, [&]()
+		{
+			filter.process(depth.Buffer.data(), depth.Width, depth.Height, filtered.data());
+		});
+	}
+
+	std::vector<float> cameraSpaceTable;
+	source.depthToCameraSpaceTable(cameraSpaceTable);
+	std::vector<float> points(3 * depthPixels);
+	std::vector<unsigned char> mask(depthPixels);
+
+	measure("point_cloud", "planar", depthPixels, [&]()
+	{
+		QFrameKernels::depthToPoints(depth.Buffer.data(), cameraSpaceTable.data(), depthPixels,
+			points.data(), points.data() + depthPixels, points.data() + 2 * depthPixels, mask.data());
+	});
+
+	measure("point_cloud", "interleaved", depthPixels, [&]()
+	{
+		QFrameKernels::depthToPointsInterleaved(depth.Buffer.data(), cameraSpaceTable.data(), depthPixels, points.data(), mask.data());
+	});
+
+	std::vector<float> registrationTable;
+	source.depthToColorTable(registrationTable);
+	QFrameRegistration registration;
+	QImage colorInDepth(depth.Width, depth.Height, QImage::Format_ARGB32);
+
+	for (int mode = QFrameRegistration::Parallel; mode <= QFrameRegistration::Reference; ++mode)
+	{
+		measure("registration", mode == QFrameRegistration::Parallel ? "parallel" : "reference", depthPixels, [&]()
+		{
+			registration.process(depth.Buffer.data(), depth.Width, depth.Height, registrationTable.data(),
+				color.Buffer.data(), color.Width, color.Height, color.Width * QKinectColorFrame::Channels,
+				reinterpret_cast<QRgb*>(colorInDepth.bits()), NULL, static_cast<QFrameRegistration::Mode>(mode));
+		});
+	}
+
+	// downsampled clouds, per leaf size: in row bands over the thread pool and on one thread, with the
+	// registered color, and through the naive map; the full cloud's buffers hold any voxel count
+	static const float leafSizes[] = { 0.01f, 0.02f, 0.05f };
+	const QRgb* pointColors = reinterpret_cast<const QRgb*>(colorInDepth.constBits());
+	std::vector<QRgb> voxelColors(depthPixels);
+	std::vector<float> mapPoints;
+
+	for (int l = 0; l < 3; ++l)
+	{
+		const QString leaf = QString("%1cm").arg(qRound(leafSizes[l] * 100));
+		QVoxelGrid grid;
+		grid.setLeafSize(leafSizes[l]);
+
+		for (int mode = QVoxelGrid::Centroid; mode <= QVoxelGrid::FirstPoint; ++mode)
+		{
+			const QString modeName = mode == QVoxelGrid::FirstPoint ? "first" : "centroid";
+			grid.setMode(static_cast<QVoxelGrid::Mode>(mode));
+
+			measure("voxel_grid", QString("%1_%2_bands").arg(modeName).arg(leaf), depthPixels, [&]()
+			{
+				grid.process(depth.Buffer.data(), depth.Width, depth.Height, cameraSpaceTable.data());
+				grid.points(points.data());
+			});
+
+			measure("voxel_grid", QString("%1_%2_single").arg(modeName).arg(leaf), depthPixels, [&]()
+			{
+				grid.process(depth.Buffer.data(), depth.Width, depth.Height, cameraSpaceTable.data(), NULL, 0);
+				grid.points(points.data());
+			});
+		}
+
+		grid.setMode(QVoxelGrid::Centroid);
+		measure("voxel_grid", QString("centroid_%1_color").arg(leaf), depthPixels, [&]()
+		{
+			grid.process(depth.Buffer.data(), depth.Width, depth.Height, cameraSpaceTable.data(), pointColors);
+			grid.points(points.data());
+			grid.colors(voxelColors.data());
+		});
+
+		measure("voxel_grid", QString("unordered_map_%1").arg(leaf), depthPixels, [&]()
+		{
+			UnorderedMapVoxels(depth, cameraSpaceTable.data(), leafSizes[l], mapPoints);
+		});
+	}
+}
+
+
+/// <summary>
+/// Depth and infrared frames coded with QDepthCodec and decoded back, lossless and
+/// quantized, on one thread per instruction set
+/// </summary>
+void FrameBenchmark::runCodec()
+{
+	if (!selected("depth_codec"))
+		return;
+
+	struct CodecFrame
+	{
+		QString						Name;
+		std::vector<unsigned short>	Pixels;
+	};
+	std::vector<CodecFrame> frames;
+
+	QSyntheticFrameSource source;
+	QFramePool pool(4, 0);
+	QKinectColorFrame color;
+	QKinectDepthFrame depth;
+	QKinectInfraredFrame infrared;
+	SyntheticFrames(source, pool, color, depth, infrared);
+
+	CodecFrame syntheticDepth = { "synthetic_depth", depth.Buffer };
+	CodecFrame syntheticInfrared = { "synthetic_infrared", infrared.Buffer };
+	frames.push_back(syntheticDepth);
+	frames.push_back(syntheticInfrared);
+
+	// sensor noise is what the codec is for, take a real frame of each stream when there is one
+	QFrameRecordingReader reader;
+	if (!Recording.isEmpty() && reader.open(Recording))
+	{
+		const int wanted[] = { QFrameSource::DepthStream, QFrameSource::InfraredStream };
+		const char* const names[] = { "recorded_depth", "recorded_infrared" };
+
+		for (int w = 0; w < 2; ++w)
+		{
+			for (int i = 0; i < reader.count(); ++i)
+			{
+				const QFrameRecording::ChunkHeader& chunk = reader.chunk(i);
+				if (static_cast<int>(chunk.Stream) != wanted[w])
+					continue;
+
+				CodecFrame recorded;
+				recorded.Name = names[w];
+				recorded.Pixels.resize(chunk.Width * chunk.Height);
+
+				if (chunk.Format == QFrameRecording::Gray16Rvl)
+					QDepthCodec::decode(reader.payload(i), static_cast<int>(chunk.Size), recorded.Pixels.data(), static_cast<int>(recorded.Pixels.size()));
+				else
+					memcpy(recorded.Pixels.data(), reader.payload(i), qMin<size_t>(chunk.Size, recorded.Pixels.size() * sizeof(unsigned short)));
+
+				frames.push_back(recorded);
+				break;
+			}
+		}
+	}
+	else if (!Recording.isEmpty())
+	{
+		std::cerr << "<Warning> Could not open recording " << Recording.toStdString() << ", synthetic frames only" << std::endl;
+	}
+
+	static const char* const isaNames[] = { "scalar", "sse2", "avx2" };
+	static const int quantizations[] = { 0, 2 };
+
+	for (size_t f = 0; f < frames.size(); ++f)
+	{
+		const std::vector<unsigned short>& pixels = frames[f].Pixels;
+		const int count = static_cast<int>(pixels.size());
+		std::vector<unsigned char> coded(QDepthCodec::maxEncodedSize(count));
+		std::vector<unsigned short> decoded(count);
+
+		for (int q = 0; q < 2; ++q)
+		{
+			QDepthCodec codec;
+			codec.setQuantization(quantizations[q]);
+
+			const int size = codec.encode(pixels.data(), count, coded.data(), static_cast<int>(coded.size()));
+			const double ratio = size > 0 ? count * sizeof(unsigned short) / static_cast<double>(size) : 0.0;
+
+			// the SSE2 level runs the scalar coder, only the levels that differ are timed
+			for (int isa = QFrameKernels::Scalar; isa <= QFrameKernels::instructionSet(); isa += 2)
+			{
+				const QFrameKernels::InstructionSet set = static_cast<QFrameKernels::InstructionSet>(isa);
+				const QString variant = QString("%1_q%2_%3").arg(frames[f].Name).arg(quantizations[q]).arg(isaNames[isa]);
+
+				measure("depth_codec", "encode_" + variant, count, [&]()
+				{
+					codec.encode(pixels.data(), count, coded.data(), static_cast<int>(coded.size()), set);
+				}, ratio);
+
+				measure("depth_codec", "decode_" + variant, count, [&]()
+				{
+					QDepthCodec::decode(coded.data(), size, decoded.data(), count, set);
+				}, ratio);
+			}
+		}
+	}
+}
+
+
+/// <summary>
+/// A color image sent from another thread to a receiver in this one, through a queued
+/// connection like the grabber's signals
+/// </summary>
+void FrameBenchmark::runSignal()
+{
+	if (!selected("signal_queued"))
+		return;
+
+	QImage image(1920, 1080, QImage::Format_ARGB32);
+	image.fill(Qt::black);
+
+	BenchmarkResult result;
+	result.Stage = "signal_queued";
+	result.Variant = "qimage";
+	result.Pixels = image.width() * image.height();
+
+	ImageEmitter emitter(image, Seconds);
+
+	{
+		QObject receiver;
+		QObject::connect(&emitter, &ImageEmitter::image, &receiver, [&](const QImage&, qint64 sent)
+		{
+			result.Latencies.push_back(emitter.now() - sent);
+			emitter.acknowledge();
+		}, Qt::QueuedConnection);
+
+		QEventLoop loop;
+		QObject::connect(&emitter, SIGNAL(finished()), &loop, SLOT(quit()));
+
+		const qint64 start = emitter.now();
+		emitter.start();
+		loop.exec();
+		emitter.wait();
+		result.Elapsed = emitter.now() - start;
+	}
+
+	result.Frames = static_cast<qint64>(result.Latencies.size());
+	report(result);
+}
+
+
+/// <summary>
+/// CPU time used by the calling thread so far, in ns
+/// </summary>
+static qint64 ThreadCpuTime()
+{
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user);
+	const quint64 kernelTicks = (static_cast<quint64>(kernel.dwHighDateTime) << 32) | kernel.dwLowDateTime;
+	const quint64 userTicks = (static_cast<quint64>(user.dwHighDateTime) << 32) | user.dwLowDateTime;
+	return static_cast<qint64>((kernelTicks + userTicks) * 100);
+#else
+	timespec time;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+	return time.tv_sec * Q_INT64_C(1000000000) + time.tv_nsec;
+#endif
+}
+
+
+/// <summary>
+/// The display path QImageWidget replaced: every frame becomes a pixmap, scaled to the label
+/// </summary>
+class LabelImageWidget : public QLabel
+{
+public:
+	void setImage(const QImage& image)
+	{
+		setPixmap(QPixmap::fromImage(image).scaled(width(), height(), Qt::KeepAspectRatio));
+	}
+};
+
+
+/// <summary>
+/// Widget noting how long each of its paint events took
+/// </summary>
+template <typename Widget>
+class PaintTimedWidget : public Widget
+{
+public:
+	PaintTimedWidget(const QElapsedTimer& clock, std::vector<qint64>& durations) :
+		Clock(clock),
+		Durations(durations)
+	{
+	}
+
+protected:
+	void paintEvent(QPaintEvent* event) Q_DECL_OVERRIDE
+	{
+		const qint64 start = Clock.nsecsElapsed();
+		Widget::paintEvent(event);
+		Durations.push_back(Clock.nsecsElapsed() - start);
+	}
+
+private:
+	const QElapsedTimer&	Clock;
+	std::vector<qint64>&	Durations;
+};
+
+
+/// <summary>
+/// Feed the images alternately to a Widget of the given size every feedInterval ms, for seconds
+/// </summary>
+template <typename Widget>
+static BenchmarkResult PaintWidget(const QImage images[2], const QSize& size, int feedInterval, double seconds)
+{
+	QElapsedTimer clock;
+	clock.start();
+
+	BenchmarkResult result;
+	result.Pixels = images[0].width() * images[0].height();
+
+	PaintTimedWidget<Widget> widget(clock, result.Latencies);
+	widget.resize(size);
+	widget.show();
+	QCoreApplication::processEvents();
+	result.Latencies.clear();
+
+	int fed = 0;
+	QTimer feed;
+	feed.setTimerType(Qt::PreciseTimer);
+	feed.setInterval(feedInterval);
+	QObject::connect(&feed, &QTimer::timeout, [&]()
+	{
+		widget.setImage(images[fed++ % 2]);
+	});
+
+	QEventLoop loop;
+	QTimer::singleShot(static_cast<int>(seconds * 1000), &loop, SLOT(quit()));
+
+	const qint64 start = clock.nsecsElapsed();
+	const qint64 startCpu = ThreadCpuTime();
+	feed.start();
+	loop.exec();
+	feed.stop();
+	result.Elapsed = clock.nsecsElapsed() - start;
+
+	result.CpuPercent = 100.0 * (ThreadCpuTime() - startCpu) / qMax<qint64>(result.Elapsed, 1);
+	result.Frames = static_cast<qint64>(result.Latencies.size());
+	result.Dropped = qMax<qint64>(fed - result.Frames, 0);
+	return result;
+}
+
+
+/// <summary>
+/// 1080p color frames shown by QImageWidget and by the label it replaced, in a widget of
+/// the frame's size (no scaling) and of half of it, fed at the sensor's 30 fps and as fast
+/// as the event loop turns. Gives the frames painted per second, the time of each paint
+/// and the GUI thread's CPU load. Run with -platform offscreen where there is no display.
+/// </summary>
+void FrameBenchmark::runWidget()
+{
+	if (!selected("widget_paint"))
+		return;
+
+	QSyntheticFrameSource source;
+	source.setPaced(false);
+	QFramePool pool(4, 0);
+
+	// two frames, so every image fed is a new one to the widget
+	QImage images[2];
+	for (int i = 0; i < 2; ++i)
+	{
+		QKinectColorFrame color;
+		QKinectDepthFrame depth;
+		QKinectInfraredFrame infrared;
+		SyntheticFrames(source, pool, color, depth, infrared);
+		images[i] = color.Buffer.toImage(color.Width, color.Height, color.Width * QKinectColorFrame::Channels, QImage::Format_ARGB32);
+	}
+
+	const QSize sizes[] = { images[0].size(), images[0].size() / 2 };
+	const int feedIntervals[] = { SensorFrameInterval, 0 };
+
+	for (int s = 0; s < 2; ++s)
+	{
+		for (int f = 0; f < 2; ++f)
+		{
+			const QString variant = QString("%1x%2_%3").arg(sizes[s].width()).arg(sizes[s].height()).arg(feedIntervals[f] ? "30fps" : "flood");
+
+			BenchmarkResult label = PaintWidget<LabelImageWidget>(images, sizes[s], feedIntervals[f], Seconds);
+			label.Stage = "widget_paint";
+			label.Variant = "label_" + variant;
+			report(label);
+
+			BenchmarkResult widget = PaintWidget<QImageWidget>(images, sizes[s], feedIntervals[f], Seconds);
+			widget.Stage = "widget_paint";
+			widget.Variant = "widget_" + variant;
+			report(widget);
+		}
+	}
+}
+
+
+/// <summary>
+/// The whole grabber loop on synthetic color, depth and infrared, with the images received
+/// in this thread. Paced runs at the sensor's 30 fps and shows the delivery latency;
+/// unpaced the source never waits, which gives the loop's throughput.
+/// </summary>
+void FrameBenchmark::runGrabber(bool paced)
+{
+	const QString stage = paced ? "grabber_paced" : "grabber_unpaced";
+	if (!selected(stage))
+		return;
+
+	QElapsedTimer clock;
+	clock.start();
+
+	TimedSource source(clock);
+	source.setPaced(paced);
+
+	QKinectGrabber grabber;
+	grabber.setFrameSource(&source);
+	grabber.setUseColorFrame(true);
+	grabber.setUseDepthFrame(true);
+	grabber.setUseInfraredFrame(true);
+
+	BenchmarkResult results[TimedSource::SlotCount];
+	static const char* const streamNames[] = { "color", "depth", "infrared" };
+
+	for (int slot = 0; slot < TimedSource::SlotCount; ++slot)
+	{
+		results[slot].Stage = stage;
+		results[slot].Variant = streamNames[slot];
+	}
+
+	// frames the stream's worker fell too far behind for
+	auto queueDropped = [&](int slot) -> quint64
+	{
+		const QKinectFrameStatistics statistics = grabber.statistics();
+		const QKinectStreamStatistics* const streams[] = { &statistics.Color, &statistics.Depth, &statistics.Infrared };
+		return streams[slot]->QueueDropped;
+	};
+
+	auto delivered = [&](int slot, const QImage& image)
+	{
+		const qint64 read = source.delivered(slot, queueDropped(slot));
+		if (read >= 0)
+			results[slot].Latencies.push_back(clock.nsecsElapsed() - read);
+		results[slot].Pixels = image.width() * image.height();
+	};
+
+	qint64 elapsed = 0;
+
+	{
+		// destroyed before the results, taking the deliveries still queued for it along
+		QObject receiver;
+		QObject::connect(&grabber, &QKinectGrabber::colorImage, &receiver, [&](const QImage& image) { delivered(TimedSource::ColorSlot, image); }, Qt::QueuedConnection);
+		QObject::connect(&grabber, &QKinectGrabber::depthImage, &receiver, [&](const QImage& image) { delivered(TimedSource::DepthSlot, image); }, Qt::QueuedConnection);
+		QObject::connect(&grabber, &QKinectGrabber::infraredImage, &receiver, [&](const QImage& image) { delivered(TimedSource::InfraredSlot, image); }, Qt::QueuedConnection);
+
+		QEventLoop loop;
+		QTimer::singleShot(static_cast<int>(Seconds * 1000), &loop, SLOT(quit()));
+
+		const qint64 start = clock.nsecsElapsed();
+		grabber.start();
+		loop.exec();
+		grabber.stop();
+		elapsed = clock.nsecsElapsed() - start;
+	}
+
+	for (int slot = 0; slot < TimedSource::SlotCount; ++slot)
+	{
+		results[slot].Frames = static_cast<qint64>(results[slot].Latencies.size());
+		results[slot].Elapsed = elapsed;
+	}
+
+	for (int slot = 0; slot < TimedSource::SlotCount; ++slot)
+		results[slot].Dropped = static_cast<qint64>(queueDropped(slot));
+
+	results[TimedSource::ColorSlot].Dropped += static_cast<qint64>(grabber.colorPoolExhaustedCount());
+
+	for (int slot = 0; slot < TimedSource::SlotCount; ++slot)
+		report(results[slot]);
+}
+
+
+/// <summary>
+/// A frame of every stream written through QFrameRecorder::write() as the grabber thread
+/// does, back to back or at the sensor's rate. The latencies are of the write() calls of
+/// one frame set, which only copy into the ring; the disk shows in the write rate and in
+/// the frames dropped once the ring is full.
+/// </summary>
+void FrameBenchmark::runRecording(bool paced)
+{
+	if (!selected("recording"))
+		return;
+
+	QSyntheticFrameSource source;
+	QFramePool pool(4, 0);
+	QKinectColorFrame color;
+	QKinectDepthFrame depth;
+	QKinectInfraredFrame infrared;
+	QKinectBodyFrame body;
+	SyntheticFrames(source, pool, color, depth, infrared);
+
+	const QString fileName = QDir::temp().filePath("GrabberBenchmark.qkrec");
+	QFrameRecorder recorder;
+	if (!recorder.open(fileName))
+	{
+		std::cerr << "<Warning> Could not create " << fileName.toStdString() << ", no recording stage" << std::endl;
+		return;
+	}
+
+	const QFrameRecording::Format colorFormat = color.Format == QKinectColorFrame::Yuy2 ? QFrameRecording::Yuy2 : QFrameRecording::Bgra32;
+	const int colorSize = color.bytesPerLine() * color.Height;
+	const int depthSize = static_cast<int>(depth.Buffer.size() * sizeof(unsigned short));
+	const int infraredSize = static_cast<int>(infrared.Buffer.size() * sizeof(unsigned short));
+
+	BenchmarkResult result;
+	result.Stage = "recording";
+	result.Variant = paced ? "all_streams_paced" : "all_streams_unpaced";
+	result.Pixels = color.Width * color.Height + static_cast<qint64>(depth.Buffer.size() + infrared.Buffer.size());
+
+	QElapsedTimer clock;
+	clock.start();
+
+	const qint64 end = static_cast<qint64>(Seconds * 1e9);
+	qint64 time = 0;
+
+	for (qint64 now = 0; now < end; now = clock.nsecsElapsed())
+	{
+		recorder.write(QFrameSource::ColorStream, colorFormat, color.Width, color.Height, time, color.Buffer.data(), colorSize);
+		recorder.write(QFrameSource::DepthStream, QFrameRecording::Gray16, depth.Width, depth.Height, time, depth.Buffer.data(), depthSize);
+		recorder.write(QFrameSource::InfraredStream, QFrameRecording::Gray16, infrared.Width, infrared.Height, time, infrared.Buffer.data(), infraredSize);
+		recorder.write(QFrameSource::BodyStream, QFrameRecording::BodyFrame, QKinectBodyFrame::BodyCount, QKinectBodyFrame::JointCount, time,
+			&body, sizeof(body));
+		result.Latencies.push_back(clock.nsecsElapsed() - now);
+
+		// RelativeTime of the next sensor tick
+		time += 333333;
+
+		if (paced)
+		{
+			const qint64 next = now + SensorFrameInterval * Q_INT64_C(1000000);
+			const qint64 left = next - clock.nsecsElapsed();
+			if (left > 0)
+				QThread::usleep(static_cast<unsigned long>(left / 1000));
+		}
+	}
+
+	result.Elapsed = clock.nsecsElapsed();
+
+	// everything queued reaches the file before the rate is read
+	recorder.close();
+
+	// frame sets, while the recorder counts the frames of each stream it dropped
+	result.Frames = static_cast<qint64>(result.Latencies.size());
+	result.Dropped = static_cast<qint64>(recorder.droppedCount());
+	result.WriteRate = recorder.writeRate();
+	report(result);
+
+	QFile::remove(fileName);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <QString>
+#include <vector>
+#include <functional>
+
+
+/// <summary>
+/// Outcome of one benchmarked stage.
+/// Kernel stages time every iteration, so Latencies holds one duration per frame;
+/// the end-to-end stages hold the time from reading a frame to its delivery instead.
+/// </summary>
+struct BenchmarkResult
+{
+	BenchmarkResult() :
+		Pixels(0),
+		Frames(0),
+		Elapsed(0),
+		Dropped(-1),
+		CpuPercent(-1),
+		Ratio(-1),
+		WriteRate(-1)
+	{
+	}
+
+	QString					Stage;
+	QString					Variant;
+	qint64					Pixels;			// per frame
+	qint64					Frames;
+	qint64					Elapsed;		// ns
+	std::vector<qint64>		Latencies;		// ns
+	qint64					Dropped;		// -1 where it does not apply
+	double					CpuPercent;		// of the measuring thread over Elapsed, -1 where it does not apply
+	double					Ratio;			// raw over coded size, -1 where it does not apply
+	double					WriteRate;		// MB/s the recorder's writer thread reached the disk at, -1 where it does not apply
+};
+
+
+/// <summary>
+/// Times the grabber's per-frame stages on synthetic frames, each for a fixed time,
+/// and prints one JSON object per stage on stdout. The codec stage also runs on the
+/// first depth and infrared frames of a recording, when one is given. The recording stage
+/// writes to a file in the temporary directory and deletes it afterwards.
+/// </summary>
+class FrameBenchmark
+{
+public:
+	FrameBenchmark(double seconds, const QString& filter, const QString& recording = QString());
+
+	void run();
+
+private:
+	bool selected(const QString& stage) const;
+	void measure(const QString& stage, const QString& variant, qint64 pixels, const std::function<void()>& iteration, double ratio = -1);
+	void report(BenchmarkResult& result);
+
+	void runKernels();
+	void runCodec();
+	void runSignal();
+	void runWidget();
+	void runGrabber(bool paced);
+	void runRecording(bool paced);
+
+	double					Seconds;
+	QString					Filter;
+	QString					Recording;
+};
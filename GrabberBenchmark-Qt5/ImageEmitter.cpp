@@ -0,0 +1,42 @@
+#include "stdafx.h"
+#include "ImageEmitter.h"
+
+
+// Give up on a receiver that stopped acknowledging
+#define AcknowledgeTimeout 1000
+
+
+
+ImageEmitter::ImageEmitter(const QImage& image, double seconds, QObject *parent) :
+	QThread(parent),
+	Image(image),
+	Seconds(seconds)
+{
+	Clock.start();
+}
+
+qint64 ImageEmitter::now() const
+{
+	return Clock.nsecsElapsed();
+}
+
+void ImageEmitter::acknowledge()
+{
+	Acknowledged.release();
+}
+
+void ImageEmitter::run()
+{
+	const qint64 end = now() + static_cast<qint64>(Seconds * 1e9);
+
+	while (now() < end)
+	{
+		emit image(Image, now());
+
+		if (!Acknowledged.tryAcquire(1, AcknowledgeTimeout))
+		{
+			std::cerr << "<Warning> Queued image was not delivered" << std::endl;
+			return;
+		}
+	}
+}
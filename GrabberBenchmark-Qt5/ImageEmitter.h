@@ -0,0 +1,35 @@
+#pragma once
+
+#include <QThread>
+#include <QImage>
+#include <QSemaphore>
+#include <QElapsedTimer>
+
+
+/// <summary>
+/// Emits the same image from its own thread, one at a time, for as long as it is told.
+/// Each emission waits until the receiver called acknowledge(), so every queued
+/// delivery is timed on its own rather than behind a backlog.
+/// </summary>
+class ImageEmitter : public QThread
+{
+	Q_OBJECT
+
+public:
+	ImageEmitter(const QImage& image, double seconds, QObject *parent = 0);
+
+	qint64 now() const;				// ns since the emitter started
+	void acknowledge();
+
+signals:
+	void image(const QImage& image, qint64 sent);
+
+protected:
+	void run() Q_DECL_OVERRIDE;
+
+private:
+	QImage			Image;
+	double			Seconds;
+	QElapsedTimer	Clock;
+	QSemaphore		Acknowledged;
+};
@@ -0,0 +1,27 @@
+#include "stdafx.h"
+#include "FrameBenchmark.h"
+#include <QtWidgets/QApplication>
+
+int main(int argc, char *argv[])
+{
+	// the widget stage needs a QApplication; run with -platform offscreen where there is no display
+	QApplication a(argc, argv);
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Times the grabber's per-frame stages on synthetic frames, no sensor needed. "
+		"Prints one JSON object per stage and variant.");
+	parser.addHelpOption();
+
+	QCommandLineOption secondsOption("seconds", "Time spent on each stage (default 2).", "seconds", "2");
+	QCommandLineOption stageOption("stage", "Only run the stages whose name contains <name>.", "name");
+	QCommandLineOption recordingOption("recording", "Also run the codec stage on the frames of this recording.", "file");
+	parser.addOption(secondsOption);
+	parser.addOption(stageOption);
+	parser.addOption(recordingOption);
+	parser.process(a);
+
+	FrameBenchmark benchmark(parser.value(secondsOption).toDouble(), parser.value(stageOption), parser.value(recordingOption));
+	benchmark.run();
+
+	return 0;
+}
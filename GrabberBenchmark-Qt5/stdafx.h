@@ -0,0 +1,4 @@
+#include <QtWidgets>
+#include <iostream>
+
+typedef unsigned char BYTE;		// named by QKinectGrabber.h, the same type as the one windows.h declares
@@ -2,6 +2,7 @@
 #include "InfraredBasics.h"
 #include <QtWidgets/QApplication>
 #include "QKinectGrabber.h"
+#include "QKinectFrameMailbox.h"
 #include "QImageWidget.h"
 
 
@@ -16,7 +17,10 @@ int main(int argc, char *argv[])
 	QImageWidget infraredWidget;
 	infraredWidget.setMinimumSize(512, 424);
 	infraredWidget.show();
-	QApplication::connect(&k, SIGNAL(infraredImage(QImage)), &infraredWidget, SLOT(setImage(QImage)));
+	// the widget only ever gets the newest image, however far behind the GUI thread is
+	QKinectFrameMailbox mailbox;
+	k.addMailbox(&mailbox);
+	QApplication::connect(&mailbox, SIGNAL(infraredImage(QImage)), &infraredWidget, SLOT(setImage(QImage)));
 
 
 	return a.exec();
@@ -0,0 +1,415 @@
+#include "stdafx.h"
+#include "QColorDownscaler.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define QCOLORDOWNSCALER_X86
+#include <immintrin.h>
+#endif
+
+// MSVC compiles any intrinsic anywhere, gcc and clang need the target spelled out per function
+#if defined(QCOLORDOWNSCALER_X86) && !defined(_MSC_VER)
+#define QCOLORDOWNSCALER_AVX2 __attribute__((target("avx2")))
+#else
+#define QCOLORDOWNSCALER_AVX2
+#endif
+
+
+using QFrameKernels::InstructionSet;
+
+
+
+//
+// Box filter: sums of k x k blocks in 16 bits, at most 16 * 255
+//
+
+/// <summary>
+/// Vertical sums of k rows, one per byte of the row
+/// </summary>
+static void BoxRowsScalar(const unsigned char* src, int srcStride, int k, int count, unsigned short* sums)
+{
+	for (int i = 0; i < count; ++i)
+	{
+		unsigned short sum = 0;
+		for (int j = 0; j < k; ++j)
+			sum += src[j * srcStride + i];
+		sums[i] = sum;
+	}
+}
+
+/// <summary>
+/// Horizontal sums of k pixels of the vertical sums, divided by k * k and rounded
+/// </summary>
+static void BoxColumnsScalar(const unsigned short* sums, int k, int dstWidth, unsigned char* dst)
+{
+	const unsigned int n = k * k;
+
+	for (int x = 0; x < dstWidth; ++x)
+	{
+		for (int c = 0; c < QColorDownscaler::Channels; ++c)
+		{
+			unsigned int sum = 0;
+			for (int i = 0; i < k; ++i)
+				sum += sums[(x * k + i) * QColorDownscaler::Channels + c];
+			dst[x * QColorDownscaler::Channels + c] = static_cast<unsigned char>((sum + n / 2) / n);
+		}
+	}
+}
+
+#ifdef QCOLORDOWNSCALER_X86
+static void BoxRowsSse2(const unsigned char* src, int srcStride, int k, int count, unsigned short* sums)
+{
+	const __m128i zero = _mm_setzero_si128();
+
+	int i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		__m128i lo = zero;
+		__m128i hi = zero;
+
+		for (int j = 0; j < k; ++j)
+		{
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + j * srcStride + i));
+			lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(v, zero));
+			hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(v, zero));
+		}
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(sums + i), lo);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(sums + i + 8), hi);
+	}
+
+	BoxRowsScalar(src + i, srcStride, k, count - i, sums + i);
+}
+
+QCOLORDOWNSCALER_AVX2
+static void BoxRowsAvx2(const unsigned char* src, int srcStride, int k, int count, unsigned short* sums)
+{
+	int i = 0;
+	for (; i + 32 <= count; i += 32)
+	{
+		__m256i lo = _mm256_setzero_si256();
+		__m256i hi = _mm256_setzero_si256();
+
+		for (int j = 0; j < k; ++j)
+		{
+			const unsigned char* row = src + j * srcStride + i;
+			lo = _mm256_add_epi16(lo, _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row))));
+			hi = _mm256_add_epi16(hi, _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + 16))));
+		}
+
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(sums + i), lo);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(sums + i + 16), hi);
+	}
+
+	BoxRowsSse2(src + i, srcStride, k, count - i, sums + i);
+}
+
+static void BoxColumnsSse2(const unsigned short* sums, int k, int dstWidth, unsigned char* dst)
+{
+	// (sum + n / 2) * ceil(65536 / n) >> 16 is the rounded sum / n for every block sum when n <= 16
+	const int n = k * k;
+	const __m128i half = _mm_set1_epi16(static_cast<short>(n / 2));
+	const __m128i reciprocal = _mm_set1_epi16(static_cast<short>((65536 + n - 1) / n));
+	const int step = k * QColorDownscaler::Channels;
+
+	int x = 0;
+	for (; x + 4 <= dstWidth; x += 4)
+	{
+		const unsigned short* p = sums + x * step;
+		__m128i a = _mm_setzero_si128();
+		__m128i b = _mm_setzero_si128();
+
+		// a pixel of four 16 bit sums is 64 bits: two destination pixels per register
+		for (int i = 0; i < k; ++i)
+		{
+			const unsigned short* q = p + i * QColorDownscaler::Channels;
+			a = _mm_add_epi16(a, _mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(q)),
+				_mm_loadl_epi64(reinterpret_cast<const __m128i*>(q + step))));
+			b = _mm_add_epi16(b, _mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(q + 2 * step)),
+				_mm_loadl_epi64(reinterpret_cast<const __m128i*>(q + 3 * step))));
+		}
+
+		a = _mm_mulhi_epu16(_mm_add_epi16(a, half), reciprocal);
+		b = _mm_mulhi_epu16(_mm_add_epi16(b, half), reciprocal);
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * QColorDownscaler::Channels), _mm_packus_epi16(a, b));
+	}
+
+	BoxColumnsScalar(sums + x * step, k, dstWidth - x, dst + x * QColorDownscaler::Channels);
+}
+#endif
+
+
+
+//
+// Area filter: weighted sums in float, the same operations in the same order on every path
+//
+
+/// <summary>
+/// One row of the count source rows from src, each byte weighted with its row's weight
+/// </summary>
+static void AreaRowsScalar(const unsigned char* src, int srcStride, int rows, const float* weights, int count, float* acc)
+{
+	for (int i = 0; i < count; ++i)
+	{
+		float sum = 0.f;
+		for (int j = 0; j < rows; ++j)
+			sum += weights[j] * static_cast<float>(src[j * srcStride + i]);
+		acc[i] = sum;
+	}
+}
+
+static inline unsigned char AreaPixel(float value)
+{
+	// the weights add up to 1, so value never reaches 255.5
+	return static_cast<unsigned char>(static_cast<int>(value + 0.5f));
+}
+
+static void AreaColumnsScalar(const float* acc, const int* first, const int* count, const int* offset, const float* weights, int dstWidth, unsigned char* dst)
+{
+	for (int x = 0; x < dstWidth; ++x)
+	{
+		const float* p = acc + first[x] * QColorDownscaler::Channels;
+		const float* w = weights + offset[x];
+
+		for (int c = 0; c < QColorDownscaler::Channels; ++c)
+		{
+			float sum = 0.f;
+			for (int i = 0; i < count[x]; ++i)
+				sum += w[i] * p[i * QColorDownscaler::Channels + c];
+			dst[x * QColorDownscaler::Channels + c] = AreaPixel(sum);
+		}
+	}
+}
+
+#ifdef QCOLORDOWNSCALER_X86
+static void AreaRowsSse2(const unsigned char* src, int srcStride, int rows, const float* weights, int count, float* acc)
+{
+	const __m128i zero = _mm_setzero_si128();
+
+	int i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		__m128 a0 = _mm_setzero_ps();
+		__m128 a1 = _mm_setzero_ps();
+		__m128 a2 = _mm_setzero_ps();
+		__m128 a3 = _mm_setzero_ps();
+
+		for (int j = 0; j < rows; ++j)
+		{
+			const __m128 w = _mm_set1_ps(weights[j]);
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + j * srcStride + i));
+			__m128i lo = _mm_unpacklo_epi8(v, zero);
+			__m128i hi = _mm_unpackhi_epi8(v, zero);
+
+			a0 = _mm_add_ps(a0, _mm_mul_ps(w, _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero))));
+			a1 = _mm_add_ps(a1, _mm_mul_ps(w, _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero))));
+			a2 = _mm_add_ps(a2, _mm_mul_ps(w, _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero))));
+			a3 = _mm_add_ps(a3, _mm_mul_ps(w, _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero))));
+		}
+
+		_mm_storeu_ps(acc + i, a0);
+		_mm_storeu_ps(acc + i + 4, a1);
+		_mm_storeu_ps(acc + i + 8, a2);
+		_mm_storeu_ps(acc + i + 12, a3);
+	}
+
+	AreaRowsScalar(src + i, srcStride, rows, weights, count - i, acc + i);
+}
+
+QCOLORDOWNSCALER_AVX2
+static void AreaRowsAvx2(const unsigned char* src, int srcStride, int rows, const float* weights, int count, float* acc)
+{
+	int i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		__m256 a0 = _mm256_setzero_ps();
+		__m256 a1 = _mm256_setzero_ps();
+
+		for (int j = 0; j < rows; ++j)
+		{
+			const __m256 w = _mm256_set1_ps(weights[j]);
+			const unsigned char* row = src + j * srcStride + i;
+
+			a0 = _mm256_add_ps(a0, _mm256_mul_ps(w, _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(row))))));
+			a1 = _mm256_add_ps(a1, _mm256_mul_ps(w, _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(row + 8))))));
+		}
+
+		_mm256_storeu_ps(acc + i, a0);
+		_mm256_storeu_ps(acc + i + 8, a1);
+	}
+
+	AreaRowsScalar(src + i, srcStride, rows, weights, count - i, acc + i);
+}
+
+static inline __m128i AreaPixelSse2(const float* p, int count, const float* w)
+{
+	// the four channels of a pixel side by side, each summed like the scalar code
+	__m128 sum = _mm_setzero_ps();
+	for (int i = 0; i < count; ++i)
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(w[i]), _mm_loadu_ps(p + i * QColorDownscaler::Channels)));
+
+	return _mm_cvttps_epi32(_mm_add_ps(sum, _mm_set1_ps(0.5f)));
+}
+
+static void AreaColumnsSse2(const float* acc, const int* first, const int* count, const int* offset, const float* weights, int dstWidth, unsigned char* dst)
+{
+	int x = 0;
+	for (; x + 4 <= dstWidth; x += 4)
+	{
+		__m128i p0 = AreaPixelSse2(acc + first[x] * QColorDownscaler::Channels, count[x], weights + offset[x]);
+		__m128i p1 = AreaPixelSse2(acc + first[x + 1] * QColorDownscaler::Channels, count[x + 1], weights + offset[x + 1]);
+		__m128i p2 = AreaPixelSse2(acc + first[x + 2] * QColorDownscaler::Channels, count[x + 2], weights + offset[x + 2]);
+		__m128i p3 = AreaPixelSse2(acc + first[x + 3] * QColorDownscaler::Channels, count[x + 3], weights + offset[x + 3]);
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * QColorDownscaler::Channels),
+			_mm_packus_epi16(_mm_packs_epi32(p0, p1), _mm_packs_epi32(p2, p3)));
+	}
+
+	AreaColumnsScalar(acc, first + x, count + x, offset + x, weights, dstWidth - x, dst + x * QColorDownscaler::Channels);
+}
+#endif
+
+
+
+QColorDownscaler::QColorDownscaler() :
+	SrcWidth(0),
+	SrcHeight(0),
+	DstWidth(0),
+	DstHeight(0)
+{
+}
+
+int QColorDownscaler::boxFactor(int srcWidth, int srcHeight, int dstWidth, int dstHeight)
+{
+	if (dstWidth <= 0 || dstHeight <= 0)
+		return 0;
+
+	const int k = srcWidth / dstWidth;
+	if (k < 2 || k > MaxBoxFactor || dstWidth * k != srcWidth || dstHeight * k != srcHeight)
+		return 0;
+
+	return k;
+}
+
+/// <summary>
+/// Destination pixel d covers [d * srcSize, (d + 1) * srcSize) and source pixel i covers
+/// [i * dstSize, (i + 1) * dstSize), both in 1 / dstSize source pixels: the overlap of the
+/// two over srcSize is the weight of i in d, and the weights of d add up to 1.
+/// </summary>
+void QColorDownscaler::buildTaps(int srcSize, int dstSize, Taps& taps)
+{
+	taps.First.resize(dstSize);
+	taps.Count.resize(dstSize);
+	taps.Offset.resize(dstSize);
+	taps.Weights.clear();
+
+	for (int d = 0; d < dstSize; ++d)
+	{
+		const qint64 begin = static_cast<qint64>(d) * srcSize;
+		const qint64 end = begin + srcSize;
+		const int first = static_cast<int>(begin / dstSize);
+		const int last = static_cast<int>((end - 1) / dstSize);
+
+		taps.First[d] = first;
+		taps.Count[d] = last - first + 1;
+		taps.Offset[d] = static_cast<int>(taps.Weights.size());
+
+		for (int i = first; i <= last; ++i)
+		{
+			const qint64 overlap = qMin<qint64>(static_cast<qint64>(i + 1) * dstSize, end) - qMax<qint64>(static_cast<qint64>(i) * dstSize, begin);
+			taps.Weights.push_back(static_cast<float>(static_cast<double>(overlap) / srcSize));
+		}
+	}
+}
+
+void QColorDownscaler::resize(int srcWidth, int srcHeight, int dstWidth, int dstHeight)
+{
+	SrcWidth = srcWidth;
+	SrcHeight = srcHeight;
+	DstWidth = dstWidth;
+	DstHeight = dstHeight;
+
+	if (boxFactor(srcWidth, srcHeight, dstWidth, dstHeight) != 0)
+	{
+		BoxRow.resize(srcWidth * Channels);
+		return;
+	}
+
+	buildTaps(srcWidth, dstWidth, Columns);
+	buildTaps(srcHeight, dstHeight, Rows);
+	AreaRow.resize(srcWidth * Channels);
+}
+
+void QColorDownscaler::process(const unsigned char* src, int srcWidth, int srcHeight, int srcStride,
+	unsigned char* dst, int dstWidth, int dstHeight, int dstStride, InstructionSet isa)
+{
+	if (dstWidth <= 0 || dstHeight <= 0 || dstWidth > srcWidth || dstHeight > srcHeight)
+		return;
+
+	if (dstWidth == srcWidth && dstHeight == srcHeight)
+	{
+		for (int y = 0; y < dstHeight; ++y)
+			memcpy(dst + y * dstStride, src + y * srcStride, dstWidth * Channels);
+		return;
+	}
+
+	if (srcWidth != SrcWidth || srcHeight != SrcHeight || dstWidth != DstWidth || dstHeight != DstHeight)
+		resize(srcWidth, srcHeight, dstWidth, dstHeight);
+
+	const int rowBytes = srcWidth * Channels;
+	const int k = boxFactor(srcWidth, srcHeight, dstWidth, dstHeight);
+
+	if (k != 0)
+	{
+		typedef void(*RowsKernel)(const unsigned char*, int, int, int, unsigned short*);
+		typedef void(*ColumnsKernel)(const unsigned short*, int, int, unsigned char*);
+
+		RowsKernel rows = BoxRowsScalar;
+		ColumnsKernel columns = BoxColumnsScalar;
+#ifdef QCOLORDOWNSCALER_X86
+		if (isa == QFrameKernels::Avx2)
+			rows = BoxRowsAvx2;
+		else if (isa == QFrameKernels::Sse2)
+			rows = BoxRowsSse2;
+
+		// two destination pixels fill a 128 bit register, wider ones gain nothing here
+		if (isa == QFrameKernels::Avx2 || isa == QFrameKernels::Sse2)
+			columns = BoxColumnsSse2;
+#endif
+
+		for (int y = 0; y < dstHeight; ++y)
+		{
+			rows(src + y * k * srcStride, srcStride, k, rowBytes, BoxRow.data());
+			columns(BoxRow.data(), k, dstWidth, dst + y * dstStride);
+		}
+		return;
+	}
+
+	typedef void(*AreaRowsKernel)(const unsigned char*, int, int, const float*, int, float*);
+	typedef void(*AreaColumnsKernel)(const float*, const int*, const int*, const int*, const float*, int, unsigned char*);
+
+	AreaRowsKernel rows = AreaRowsScalar;
+	AreaColumnsKernel columns = AreaColumnsScalar;
+#ifdef QCOLORDOWNSCALER_X86
+	if (isa == QFrameKernels::Avx2)
+		rows = AreaRowsAvx2;
+	else if (isa == QFrameKernels::Sse2)
+		rows = AreaRowsSse2;
+
+	// one pixel's four channels fill a 128 bit register
+	if (isa == QFrameKernels::Avx2 || isa == QFrameKernels::Sse2)
+		columns = AreaColumnsSse2;
+#endif
+
+	for (int y = 0; y < dstHeight; ++y)
+	{
+		rows(src + Rows.First[y] * srcStride, srcStride, Rows.Count[y], Rows.Weights.data() + Rows.Offset[y], rowBytes, AreaRow.data());
+		columns(AreaRow.data(), Columns.First.data(), Columns.Count.data(), Columns.Offset.data(), Columns.Weights.data(), dstWidth, dst + y * dstStride);
+	}
+}
+
+void QColorDownscaler::process(const unsigned char* src, int srcWidth, int srcHeight, int srcStride,
+	unsigned char* dst, int dstWidth, int dstHeight, int dstStride)
+{
+	process(src, srcWidth, srcHeight, srcStride, dst, dstWidth, dstHeight, dstStride, QFrameKernels::instructionSet());
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "QFrameKernels.h"
+#include <vector>
+
+
+/// <summary>
+/// Shrinks 32 bit color frames (BGRA, or any four 8 bit channels) by area averaging:
+/// every destination pixel is the mean of the source area it covers, a source pixel cut
+/// by its edge counting for the part inside.
+///
+/// When both sizes are the same integer factor apart (1/2, 1/3, 1/4) this is a box
+/// filter run in 16 bit integers, giving the exactly rounded mean of every block. Any
+/// other size goes through a separable filter with float weights. Both run on the
+/// widest instruction set given and match their scalar version bit for bit.
+///
+/// The weights and the scratch row are kept between frames and only rebuilt when the
+/// sizes change, so shrinking a stream of frames allocates nothing.
+/// </summary>
+class QColorDownscaler
+{
+public:
+	enum { Channels = 4, MaxBoxFactor = 4 };
+
+	QColorDownscaler();
+
+	/// <summary>
+	/// src is srcWidth x srcHeight pixels with rows srcStride bytes apart, dst gets
+	/// dstWidth x dstHeight pixels with rows dstStride bytes apart. The destination must
+	/// not be larger than the source in either direction.
+	/// </summary>
+	void process(const unsigned char* src, int srcWidth, int srcHeight, int srcStride,
+		unsigned char* dst, int dstWidth, int dstHeight, int dstStride);
+	void process(const unsigned char* src, int srcWidth, int srcHeight, int srcStride,
+		unsigned char* dst, int dstWidth, int dstHeight, int dstStride, QFrameKernels::InstructionSet isa);
+
+	/// <summary>
+	/// Factor of the box filter used for these sizes, 0 when they need the area filter
+	/// </summary>
+	static int boxFactor(int srcWidth, int srcHeight, int dstWidth, int dstHeight);
+
+private:
+	// source span and weights of every destination column or row
+	struct Taps
+	{
+		std::vector<int>	First;
+		std::vector<int>	Count;
+		std::vector<int>	Offset;			// of the span's first weight in Weights
+		std::vector<float>	Weights;
+	};
+
+	static void buildTaps(int srcSize, int dstSize, Taps& taps);
+	void resize(int srcWidth, int srcHeight, int dstWidth, int dstHeight);
+
+	int							SrcWidth;
+	int							SrcHeight;
+	int							DstWidth;
+	int							DstHeight;
+
+	Taps						Columns;
+	Taps						Rows;
+	std::vector<unsigned short>	BoxRow;			// vertical block sums of one destination row
+	std::vector<float>			AreaRow;		// vertically weighted source row
+};
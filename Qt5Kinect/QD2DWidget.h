@@ -1,5 +1,7 @@
 #pragma once
 
+#include "QKinectSdk.h"
+
 class QD2DWidgetPrivate;
 class QD2DWidget : public QWidget
 {
@@ -22,7 +24,7 @@ protected:
 	void beginDraw();
 	HRESULT endDraw();
 
-public slots:
+public slots:
 	void setColorBuffer(const BYTE* pBuf);
 
 protected:
@@ -0,0 +1,497 @@
+#include "stdafx.h"
+#include "QDepthCodec.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define QDEPTHCODEC_X86
+#include <immintrin.h>
+#endif
+
+// MSVC compiles any intrinsic anywhere, gcc and clang need the target spelled out per function
+#if defined(QDEPTHCODEC_X86) && !defined(_MSC_VER)
+#define QDEPTHCODEC_AVX2 __attribute__((target("avx2")))
+#else
+#define QDEPTHCODEC_AVX2
+#endif
+
+// Longest varint of a run length
+#define MaxRunBytes 5
+// Shortest run of zeros coded as a run; shorter ones are cheaper as differences, which
+// keeps the runs long. The vector scan below assumes it is QDepthCodec::GroupSize.
+#define MinZeroRun 8
+// Bytes a group reads or writes past its control byte with a 16 byte shuffle
+#define GroupVectorBytes 16
+
+
+using QFrameKernels::InstructionSet;
+
+
+/// <summary>
+/// Shuffles between eight 16 bit differences and their packed bytes, indexed by the
+/// control byte. Built during static initialization, before any thread can code.
+/// </summary>
+struct GroupShuffles
+{
+	GroupShuffles()
+	{
+		for (int control = 0; control < 256; ++control)
+		{
+			int packed = 0;
+			for (int k = 0; k < QDepthCodec::GroupSize; ++k)
+			{
+				const bool wide = (control >> k) & 1;
+
+				Unpack[control][2 * k] = static_cast<unsigned char>(packed);
+				Unpack[control][2 * k + 1] = wide ? static_cast<unsigned char>(packed + 1) : 0x80;
+
+				Pack[control][packed++] = static_cast<unsigned char>(2 * k);
+				if (wide)
+					Pack[control][packed++] = static_cast<unsigned char>(2 * k + 1);
+			}
+
+			for (int b = packed; b < 16; ++b)
+				Pack[control][b] = 0x80;
+
+			Bytes[control] = static_cast<unsigned char>(packed);
+		}
+	}
+
+	unsigned char	Pack[256][16];		// differences to bytes
+	unsigned char	Unpack[256][16];	// bytes to differences, 0x80 zeroes the high byte
+	unsigned char	Bytes[256];			// bytes of a full group after the control byte
+};
+
+static const GroupShuffles Shuffles;
+
+
+
+static inline unsigned char* PutVarint(unsigned char* p, quint32 v)
+{
+	while (v >= 0x80)
+	{
+		*p++ = static_cast<unsigned char>(v | 0x80);
+		v >>= 7;
+	}
+
+	*p++ = static_cast<unsigned char>(v);
+	return p;
+}
+
+/// <summary>
+/// Read a varint of at most MaxRunBytes bytes. Returns NULL if it runs past end or is
+/// longer than that.
+/// </summary>
+static inline const unsigned char* GetVarint(const unsigned char* p, const unsigned char* end, quint32& v)
+{
+	v = 0;
+
+	for (int shift = 0; shift < 7 * MaxRunBytes; shift += 7)
+	{
+		if (p == end)
+			return NULL;
+
+		const quint32 b = *p++;
+		v |= (b & 0x7F) << shift;
+
+		if (b < 0x80)
+			return p;
+	}
+
+	return NULL;
+}
+
+static inline unsigned short Quantize(unsigned short v, int half, int shift)
+{
+	// rounding up past 0xFFFF gives the largest step, as saturation does
+	return static_cast<unsigned short>(qMin(v + half, 0xFFFF) >> shift);
+}
+
+// differences are taken modulo 2^16 and folded so that small ones of either sign are small
+static inline unsigned short Zigzag(unsigned short delta)
+{
+	return static_cast<unsigned short>((delta << 1) ^ (0u - (delta >> 15)));
+}
+
+static inline unsigned short Unzigzag(unsigned short v)
+{
+	return static_cast<unsigned short>((v >> 1) ^ (0u - (v & 1)));
+}
+
+
+
+//
+// One group of up to GroupSize differences
+//
+
+static unsigned char* PutGroupScalar(const unsigned short* src, int count, int half, int shift, unsigned short& previous, unsigned char* p)
+{
+	unsigned char* control = p++;
+	unsigned int bits = 0;
+
+	for (int k = 0; k < count; ++k)
+	{
+		const unsigned short value = Quantize(src[k], half, shift);
+		const unsigned short folded = Zigzag(static_cast<unsigned short>(value - previous));
+		previous = value;
+
+		*p++ = static_cast<unsigned char>(folded);
+		if (folded > 0xFF)
+		{
+			*p++ = static_cast<unsigned char>(folded >> 8);
+			bits |= 1u << k;
+		}
+	}
+
+	*control = static_cast<unsigned char>(bits);
+	return p;
+}
+
+static void GetGroupScalar(const unsigned char* p, unsigned int control, int count, int shift, unsigned short& previous, unsigned short* dst)
+{
+	for (int k = 0; k < count; ++k)
+	{
+		unsigned short folded = *p++;
+		if ((control >> k) & 1)
+			folded |= static_cast<unsigned short>(*p++ << 8);
+
+		previous = static_cast<unsigned short>(previous + Unzigzag(folded));
+		dst[k] = static_cast<unsigned short>(previous << shift);
+	}
+}
+
+#ifdef QDEPTHCODEC_X86
+/// <summary>
+/// A full group: the differences of eight pixels at once, packed with the control
+/// byte's shuffle. Writes GroupVectorBytes after the control byte whatever the group's size.
+/// </summary>
+QDEPTHCODEC_AVX2 static unsigned char* PutGroupSsse3(const unsigned short* src, int half, int shift, unsigned short& previous, unsigned char* p)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i raw = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+	const __m128i value = _mm_srl_epi16(_mm_adds_epu16(raw, _mm_set1_epi16(static_cast<short>(half))), _mm_cvtsi32_si128(shift));
+
+	// each pixel minus the one before it, the first minus the last of the previous group
+	const __m128i before = _mm_or_si128(_mm_slli_si128(value, 2), _mm_cvtsi32_si128(previous));
+	const __m128i delta = _mm_sub_epi16(value, before);
+	const __m128i folded = _mm_xor_si128(_mm_slli_epi16(delta, 1), _mm_srai_epi16(delta, 15));
+
+	const __m128i narrow = _mm_cmpeq_epi16(_mm_srli_epi16(folded, 8), zero);
+	const unsigned int control = ~_mm_movemask_epi8(_mm_packs_epi16(narrow, zero)) & 0xFF;
+
+	*p = static_cast<unsigned char>(control);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(p + 1),
+		_mm_shuffle_epi8(folded, _mm_loadu_si128(reinterpret_cast<const __m128i*>(Shuffles.Pack[control]))));
+
+	previous = static_cast<unsigned short>(_mm_extract_epi16(value, 7));
+	return p + 1 + Shuffles.Bytes[control];
+}
+
+/// <summary>
+/// A full group, reading GroupVectorBytes after the control byte: unpack, unfold and
+/// add up the differences with a prefix sum
+/// </summary>
+QDEPTHCODEC_AVX2 static void GetGroupSsse3(const unsigned char* p, unsigned int control, int shift, unsigned short& previous, unsigned short* dst)
+{
+	const __m128i one = _mm_set1_epi16(1);
+	const __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+	const __m128i folded = _mm_shuffle_epi8(packed, _mm_loadu_si128(reinterpret_cast<const __m128i*>(Shuffles.Unpack[control])));
+	__m128i delta = _mm_xor_si128(_mm_srli_epi16(folded, 1), _mm_sub_epi16(_mm_setzero_si128(), _mm_and_si128(folded, one)));
+
+	delta = _mm_add_epi16(delta, _mm_slli_si128(delta, 2));
+	delta = _mm_add_epi16(delta, _mm_slli_si128(delta, 4));
+	delta = _mm_add_epi16(delta, _mm_slli_si128(delta, 8));
+
+	const __m128i value = _mm_add_epi16(delta, _mm_set1_epi16(static_cast<short>(previous)));
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_sll_epi16(value, _mm_cvtsi32_si128(shift)));
+
+	previous = static_cast<unsigned short>(_mm_extract_epi16(value, 7));
+}
+
+/// <summary>
+/// End of the zero run from i on: the first pixel at or above threshold, the smallest
+/// value not quantized to 0
+/// </summary>
+QDEPTHCODEC_AVX2 static int ZeroRunEndSsse3(const unsigned short* src, int i, int count, unsigned short threshold)
+{
+	const __m128i limit = _mm_set1_epi16(static_cast<short>(threshold - 1));
+	const __m128i zero = _mm_setzero_si128();
+
+	for (; i + QDepthCodec::GroupSize <= count; i += QDepthCodec::GroupSize)
+	{
+		const __m128i below = _mm_cmpeq_epi16(_mm_subs_epu16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)), limit), zero);
+		if (_mm_movemask_epi8(below) != 0xFFFF)
+			break;
+	}
+
+	while (i < count && src[i] < threshold)
+		++i;
+
+	return i;
+}
+
+/// <summary>
+/// End of the value run from i on, as ValueRunEndScalar(), eight pixels at a time: a
+/// run of MinZeroRun zeros lies within two consecutive blocks, so it shows up in the 16
+/// bit zero mask of the last two
+/// </summary>
+QDEPTHCODEC_AVX2 static int ValueRunEndSsse3(const unsigned short* src, int i, int count, unsigned short threshold)
+{
+	const __m128i limit = _mm_set1_epi16(static_cast<short>(threshold - 1));
+	const __m128i zero = _mm_setzero_si128();
+	unsigned int previousMask = 0;
+
+	for (; i + QDepthCodec::GroupSize <= count; i += QDepthCodec::GroupSize)
+	{
+		const __m128i below = _mm_cmpeq_epi16(_mm_subs_epu16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)), limit), zero);
+		const unsigned int mask = _mm_movemask_epi8(_mm_packs_epi16(below, zero));
+		if ((mask | previousMask) == 0)
+			continue;
+
+		// bit j of starts: pixels j to j + 7 of the two blocks are all zero
+		const unsigned int window = previousMask | (mask << 8);
+		unsigned int starts = window & (window >> 1);
+		starts &= starts >> 2;
+		starts &= starts >> 4;
+
+		if (starts)
+		{
+			int start = i - QDepthCodec::GroupSize;
+			while (!(starts & 1))
+			{
+				starts >>= 1;
+				++start;
+			}
+
+			return start;
+		}
+
+		previousMask = mask;
+	}
+
+	// the zeros closing the last block carry over into the remaining pixels
+	int zeros = 0;
+	while (zeros < QDepthCodec::GroupSize && (previousMask >> (QDepthCodec::GroupSize - 1 - zeros)) & 1)
+		++zeros;
+
+	for (; i < count; ++i)
+	{
+		zeros = src[i] < threshold ? zeros + 1 : 0;
+		if (zeros == MinZeroRun)
+			return i + 1 - MinZeroRun;
+	}
+
+	return count;
+}
+#endif
+
+static int ZeroRunEndScalar(const unsigned short* src, int i, int count, unsigned short threshold)
+{
+	while (i < count && src[i] < threshold)
+		++i;
+
+	return i;
+}
+
+/// <summary>
+/// End of the value run from i on, which is not a zero: the start of the first
+/// MinZeroRun zeros, or count. Fewer zeros stay in the run.
+/// </summary>
+static int ValueRunEndScalar(const unsigned short* src, int i, int count, unsigned short threshold)
+{
+	int zeros = 0;
+
+	for (; i < count; ++i)
+	{
+		zeros = src[i] < threshold ? zeros + 1 : 0;
+		if (zeros == MinZeroRun)
+			return i + 1 - MinZeroRun;
+	}
+
+	return count;
+}
+
+
+
+QDepthCodec::QDepthCodec() :
+	Quantization(0)
+{
+}
+
+int QDepthCodec::quantization() const
+{
+	return Quantization;
+}
+
+void QDepthCodec::setQuantization(int shift)
+{
+	Quantization = qBound(0, shift, static_cast<int>(MaxQuantization));
+}
+
+
+int QDepthCodec::maxEncodedSize(int count)
+{
+	// a pixel takes at most three bytes with the runs and control bytes around it, except
+	// at the open and close of the frame; the last group's shuffle may store past its end
+	return static_cast<int>(sizeof(Header)) + 3 * qMax(count, 0) + 4 * MaxRunBytes + GroupVectorBytes;
+}
+
+
+int QDepthCodec::encode(const unsigned short* src, int count, unsigned char* dst, int capacity, InstructionSet isa) const
+{
+	if (count < 0 || capacity < maxEncodedSize(count))
+		return -1;
+
+	Header header;
+	header.Magic = Magic;
+	header.Count = static_cast<quint32>(count);
+	header.Quantization = static_cast<quint32>(Quantization);
+	memcpy(dst, &header, sizeof(header));
+
+	const int shift = Quantization;
+	const int half = (1 << shift) >> 1;
+	const unsigned short threshold = static_cast<unsigned short>((1 << shift) - half);	// the smallest value not quantized to 0
+
+	bool vector = false;
+#ifdef QDEPTHCODEC_X86
+	vector = isa == QFrameKernels::Avx2;
+#else
+	Q_UNUSED(isa);
+#endif
+
+	unsigned char* p = dst + sizeof(header);
+	unsigned short previous = 0;
+
+	int i = 0;
+	while (i < count)
+	{
+		const int zeroStart = i;
+#ifdef QDEPTHCODEC_X86
+		i = vector ? ZeroRunEndSsse3(src, i, count, threshold) : ZeroRunEndScalar(src, i, count, threshold);
+#else
+		i = ZeroRunEndScalar(src, i, count, threshold);
+#endif
+		p = PutVarint(p, static_cast<quint32>(i - zeroStart));
+
+		const int valueStart = i;
+#ifdef QDEPTHCODEC_X86
+		i = vector ? ValueRunEndSsse3(src, i, count, threshold) : ValueRunEndScalar(src, i, count, threshold);
+#else
+		i = ValueRunEndScalar(src, i, count, threshold);
+#endif
+		p = PutVarint(p, static_cast<quint32>(i - valueStart));
+
+		int j = valueStart;
+#ifdef QDEPTHCODEC_X86
+		if (vector)
+		{
+			for (; j + GroupSize <= i; j += GroupSize)
+				p = PutGroupSsse3(src + j, half, shift, previous, p);
+		}
+#endif
+		for (; j < i; j += GroupSize)
+			p = PutGroupScalar(src + j, qMin(static_cast<int>(GroupSize), i - j), half, shift, previous, p);
+	}
+
+	return static_cast<int>(p - dst);
+}
+
+int QDepthCodec::encode(const unsigned short* src, int count, unsigned char* dst, int capacity) const
+{
+	return encode(src, count, dst, capacity, QFrameKernels::instructionSet());
+}
+
+int QDepthCodec::encode(const unsigned short* src, int count, std::vector<unsigned char>& dst) const
+{
+	// sized for the worst case, then trimmed: a steady stream keeps the vector's capacity
+	dst.resize(maxEncodedSize(count));
+
+	const int size = encode(src, count, dst.data(), static_cast<int>(dst.size()));
+	dst.resize(qMax(size, 0));
+	return size;
+}
+
+
+int QDepthCodec::decodedCount(const unsigned char* src, int size)
+{
+	Header header;
+	if (!src || size < static_cast<int>(sizeof(header)))
+		return -1;
+
+	memcpy(&header, src, sizeof(header));
+	if (header.Magic != Magic || header.Quantization > MaxQuantization || header.Count > 0x7FFFFFFF)
+		return -1;
+
+	return static_cast<int>(header.Count);
+}
+
+
+bool QDepthCodec::decode(const unsigned char* src, int size, unsigned short* dst, int count, InstructionSet isa)
+{
+	if (count < 0 || decodedCount(src, size) != count)
+		return false;
+
+	Header header;
+	memcpy(&header, src, sizeof(header));
+	const int shift = static_cast<int>(header.Quantization);
+
+	bool vector = false;
+#ifdef QDEPTHCODEC_X86
+	vector = isa == QFrameKernels::Avx2;
+#else
+	Q_UNUSED(isa);
+#endif
+
+	const unsigned char* p = src + sizeof(header);
+	const unsigned char* end = src + size;
+	unsigned short previous = 0;
+
+	int i = 0;
+	while (i < count)
+	{
+		quint32 zeros, values;
+
+		p = GetVarint(p, end, zeros);
+		if (!p || zeros > static_cast<quint32>(count - i))
+			return false;
+
+		memset(dst + i, 0, zeros * sizeof(unsigned short));
+		i += zeros;
+
+		p = GetVarint(p, end, values);
+		if (!p || values > static_cast<quint32>(count - i) || zeros + values == 0)
+			return false;
+
+		for (int remaining = static_cast<int>(values); remaining > 0; remaining -= GroupSize)
+		{
+			const int groupCount = qMin(remaining, static_cast<int>(GroupSize));
+			if (p == end)
+				return false;
+
+			// a short group has no bits past its pixels
+			const unsigned int control = *p;
+			if (control >> groupCount)
+				return false;
+
+			// Bytes[] is for a full group, a short one lacks the narrow bytes of its missing pixels
+			const int groupBytes = 1 + Shuffles.Bytes[control] - (GroupSize - groupCount);
+			if (end - p < groupBytes)
+				return false;
+
+#ifdef QDEPTHCODEC_X86
+			if (vector && groupCount == GroupSize && end - p > GroupVectorBytes)
+				GetGroupSsse3(p + 1, control, shift, previous, dst + i);
+			else
+#endif
+				GetGroupScalar(p + 1, control, groupCount, shift, previous, dst + i);
+
+			p += groupBytes;
+			i += groupCount;
+		}
+	}
+
+	return p == end;
+}
+
+bool QDepthCodec::decode(const unsigned char* src, int size, unsigned short* dst, int count)
+{
+	return decode(src, size, dst, count, QFrameKernels::instructionSet());
+}
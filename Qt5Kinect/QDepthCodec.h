@@ -0,0 +1,80 @@
+#pragma once
+
+#include "QFrameKernels.h"
+#include <vector>
+
+
+/// <summary>
+/// Lossless codec for 16 bit depth and infrared frames, after RVL (Wilson, 2017).
+///
+/// A frame is coded as alternating runs: the length of a run of zero pixels and the length
+/// of the run of pixels that follows, as little endian base-128 varints, then each of
+/// those pixels as its difference to the previous coded pixel, zigzag folded. Only runs
+/// of eight zeros or more are coded as runs; the scattered holes of a depth frame stay
+/// in the pixel runs, which keeps those long. Differences are written in groups of eight
+/// behind a control byte whose bit k tells whether difference k takes one byte or two,
+/// so the smooth surfaces of a depth frame cost about one byte per pixel. The groups
+/// replace RVL's nibble codes: a little less compression, and a whole group is packed or
+/// unpacked with one byte shuffle.
+///
+/// An optional quantization drops the low bits of every pixel before coding (rounded,
+/// max error 2^(shift-1)), which shortens the differences of noisy surfaces. It is
+/// deterministic: every machine and instruction set decodes the same frame. Values below
+/// 2^(shift-1) become 0.
+///
+/// A coded frame starts with a Header, so decode() needs nothing but the bytes. Nothing
+/// is allocated: the raw APIs code between buffers of the caller, the vector overload
+/// only grows the vector it is given. The shuffles need SSSE3, which every AVX2 processor
+/// has; below that the scalar coder runs, producing the same bytes.
+/// </summary>
+class QDepthCodec
+{
+public:
+	enum
+	{
+		MaxQuantization = 8,
+		GroupSize = 8
+	};
+
+	struct Header
+	{
+		quint32		Magic;
+		quint32		Count;			// pixels
+		quint32		Quantization;	// shift the pixels were coded with
+	};
+
+	static const quint32 Magic = 0x4C56524B;		// "KRVL"
+
+	QDepthCodec();
+
+	int quantization() const;
+	void setQuantization(int shift);			// 0 for lossless, up to MaxQuantization
+
+	/// <summary>
+	/// Largest coded size of count pixels, the capacity encode() needs
+	/// </summary>
+	static int maxEncodedSize(int count);
+
+	/// <summary>
+	/// Code count pixels into dst, which holds capacity bytes. Returns the coded size,
+	/// or -1 if capacity is below maxEncodedSize(count).
+	/// </summary>
+	int encode(const unsigned short* src, int count, unsigned char* dst, int capacity) const;
+	int encode(const unsigned short* src, int count, unsigned char* dst, int capacity, QFrameKernels::InstructionSet isa) const;
+	int encode(const unsigned short* src, int count, std::vector<unsigned char>& dst) const;
+
+	/// <summary>
+	/// Pixels held by a coded frame, -1 if src is not one
+	/// </summary>
+	static int decodedCount(const unsigned char* src, int size);
+
+	/// <summary>
+	/// Decode a frame of exactly count pixels into dst. Returns false, with dst partly
+	/// written, if src is corrupt, truncated or holds another count.
+	/// </summary>
+	static bool decode(const unsigned char* src, int size, unsigned short* dst, int count);
+	static bool decode(const unsigned char* src, int size, unsigned short* dst, int count, QFrameKernels::InstructionSet isa);
+
+private:
+	int		Quantization;
+};
@@ -0,0 +1,519 @@
+#include "stdafx.h"
+#include "QDepthFilter.h"
+#include "QParallel.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define QDEPTHFILTER_X86
+#include <immintrin.h>
+#endif
+
+// MSVC compiles any intrinsic anywhere, gcc and clang need the target spelled out per function
+#if defined(QDEPTHFILTER_X86) && !defined(_MSC_VER)
+#define QDEPTHFILTER_AVX2 __attribute__((target("avx2")))
+#else
+#define QDEPTHFILTER_AVX2
+#endif
+
+// Rows per band, 14 bands for a 424 row frame
+#define DepthFilterBandRows 32
+
+#define DefaultSmoothing 2
+#define DefaultMotionThreshold 30
+
+
+using QFrameKernels::InstructionSet;
+
+struct TemporalParameters
+{
+	int		Shift;
+	int		Round;			// half of 1 << Shift, rounds the exponential step
+	int		Threshold;
+};
+
+typedef void(*TemporalKernel)(const unsigned short* src, unsigned short* newest, unsigned short* older1, unsigned short* older2,
+	unsigned short* state, unsigned short* dst, int count, const TemporalParameters& p);
+typedef void(*FillKernel)(const unsigned short* above, const unsigned short* row, const unsigned short* below, unsigned short* dst, int width);
+
+
+
+//
+// Temporal filter. The state is the filtered depth in 1/4 mm; every value stays below
+// 32768, so the vector versions compare and shift as signed 16 bit.
+//
+
+static inline int Median3(int a, int b, int c)
+{
+	return qMax(qMin(a, b), qMin(qMax(a, b), c));
+}
+
+static inline void ExponentialPixel(unsigned short raw, unsigned short& newest, unsigned short older1, unsigned short older2,
+	unsigned short& state, unsigned short& dst, const TemporalParameters& p)
+{
+	const int d = qMin<int>(raw, QDepthFilter::MaxDepth);
+	const int s = state;
+	const int previous = (s + 2) >> 2;
+	const bool motion = qAbs(d - previous) > p.Threshold + (previous >> QDepthFilter::MotionShift);
+	const bool recent = older1 != 0 || older2 != 0;
+
+	int next;
+	if (d == 0)
+		next = recent ? s : 0;
+	else if (s == 0 || motion)
+		next = d << 2;
+	else
+		next = s + (((d << 2) - s + p.Round) >> p.Shift);
+
+	newest = static_cast<unsigned short>(d);
+	state = static_cast<unsigned short>(next);
+	dst = static_cast<unsigned short>((next + 2) >> 2);
+}
+
+static inline void MedianPixel(unsigned short raw, unsigned short& newest, unsigned short& older1, unsigned short& older2,
+	unsigned short& state, unsigned short& dst, const TemporalParameters& p)
+{
+	const int d = qMin<int>(raw, QDepthFilter::MaxDepth);
+	const int s = state;
+	const int previous = (s + 2) >> 2;
+	const bool motion = qAbs(d - previous) > p.Threshold + (previous >> QDepthFilter::MotionShift);
+	const bool recent = older1 != 0 || older2 != 0;
+
+	int next;
+	if (d != 0 && (s == 0 || motion))
+	{
+		// restart the whole ring, else the older samples would win the median back
+		older1 = static_cast<unsigned short>(d);
+		older2 = static_cast<unsigned short>(d);
+		next = d << 2;
+	}
+	else if (d == 0 && !recent)
+	{
+		next = 0;
+	}
+	else
+	{
+		// missing samples count as the filtered value
+		next = Median3(d ? d : previous, older1 ? older1 : previous, older2 ? older2 : previous) << 2;
+	}
+
+	newest = static_cast<unsigned short>(d);
+	state = static_cast<unsigned short>(next);
+	dst = static_cast<unsigned short>((next + 2) >> 2);
+}
+
+static void ExponentialScalar(const unsigned short* src, unsigned short* newest, unsigned short* older1, unsigned short* older2,
+	unsigned short* state, unsigned short* dst, int count, const TemporalParameters& p)
+{
+	for (int i = 0; i < count; ++i)
+		ExponentialPixel(src[i], newest[i], older1[i], older2[i], state[i], dst[i], p);
+}
+
+static void MedianScalar(const unsigned short* src, unsigned short* newest, unsigned short* older1, unsigned short* older2,
+	unsigned short* state, unsigned short* dst, int count, const TemporalParameters& p)
+{
+	for (int i = 0; i < count; ++i)
+		MedianPixel(src[i], newest[i], older1[i], older2[i], state[i], dst[i], p);
+}
+
+#ifdef QDEPTHFILTER_X86
+static inline __m128i SelectSse2(__m128i mask, __m128i a, __m128i b)
+{
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+static void ExponentialSse2(const unsigned short* src, unsigned short* newest, unsigned short* older1, unsigned short* older2,
+	unsigned short* state, unsigned short* dst, int count, const TemporalParameters& p)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i two = _mm_set1_epi16(2);
+	const __m128i maxDepth = _mm_set1_epi16(QDepthFilter::MaxDepth);
+	const __m128i threshold = _mm_set1_epi16(static_cast<short>(p.Threshold));
+	const __m128i round = _mm_set1_epi16(static_cast<short>(p.Round));
+	const __m128i shift = _mm_cvtsi32_si128(p.Shift);
+	const __m128i motionShift = _mm_cvtsi32_si128(QDepthFilter::MotionShift);
+
+	int i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		const __m128i raw = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+		const __m128i d = _mm_sub_epi16(raw, _mm_subs_epu16(raw, maxDepth));
+		const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(state + i));
+		const __m128i r1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(older1 + i));
+		const __m128i r2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(older2 + i));
+
+		const __m128i previous = _mm_srli_epi16(_mm_add_epi16(s, two), 2);
+		const __m128i difference = _mm_or_si128(_mm_subs_epu16(d, previous), _mm_subs_epu16(previous, d));
+		const __m128i motion = _mm_cmpgt_epi16(difference, _mm_add_epi16(threshold, _mm_srl_epi16(previous, motionShift)));
+		const __m128i stale = _mm_and_si128(_mm_cmpeq_epi16(r1, zero), _mm_cmpeq_epi16(r2, zero));
+		const __m128i hole = _mm_cmpeq_epi16(d, zero);
+		const __m128i restart = _mm_or_si128(_mm_cmpeq_epi16(s, zero), motion);
+
+		const __m128i d4 = _mm_slli_epi16(d, 2);
+		const __m128i smoothed = _mm_add_epi16(s, _mm_sra_epi16(_mm_add_epi16(_mm_sub_epi16(d4, s), round), shift));
+		const __m128i next = SelectSse2(hole, _mm_andnot_si128(stale, s), SelectSse2(restart, d4, smoothed));
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(newest + i), d);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(state + i), next);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_srli_epi16(_mm_add_epi16(next, two), 2));
+	}
+
+	ExponentialScalar(src + i, newest + i, older1 + i, older2 + i, state + i, dst + i, count - i, p);
+}
+
+static void MedianSse2(const unsigned short* src, unsigned short* newest, unsigned short* older1, unsigned short* older2,
+	unsigned short* state, unsigned short* dst, int count, const TemporalParameters& p)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i two = _mm_set1_epi16(2);
+	const __m128i maxDepth = _mm_set1_epi16(QDepthFilter::MaxDepth);
+	const __m128i threshold = _mm_set1_epi16(static_cast<short>(p.Threshold));
+	const __m128i motionShift = _mm_cvtsi32_si128(QDepthFilter::MotionShift);
+
+	int i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		const __m128i raw = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+		const __m128i d = _mm_sub_epi16(raw, _mm_subs_epu16(raw, maxDepth));
+		const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(state + i));
+		const __m128i r1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(older1 + i));
+		const __m128i r2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(older2 + i));
+
+		const __m128i previous = _mm_srli_epi16(_mm_add_epi16(s, two), 2);
+		const __m128i difference = _mm_or_si128(_mm_subs_epu16(d, previous), _mm_subs_epu16(previous, d));
+		const __m128i motion = _mm_cmpgt_epi16(difference, _mm_add_epi16(threshold, _mm_srl_epi16(previous, motionShift)));
+		const __m128i missing1 = _mm_cmpeq_epi16(r1, zero);
+		const __m128i missing2 = _mm_cmpeq_epi16(r2, zero);
+		const __m128i hole = _mm_cmpeq_epi16(d, zero);
+		const __m128i restart = _mm_andnot_si128(hole, _mm_or_si128(_mm_cmpeq_epi16(s, zero), motion));
+		const __m128i lost = _mm_and_si128(hole, _mm_and_si128(missing1, missing2));
+
+		const __m128i a = SelectSse2(hole, previous, d);
+		const __m128i b = SelectSse2(missing1, previous, r1);
+		const __m128i c = SelectSse2(missing2, previous, r2);
+		const __m128i median = _mm_max_epi16(_mm_min_epi16(a, b), _mm_min_epi16(_mm_max_epi16(a, b), c));
+
+		const __m128i d4 = _mm_slli_epi16(d, 2);
+		const __m128i next = SelectSse2(restart, d4, _mm_andnot_si128(lost, _mm_slli_epi16(median, 2)));
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(newest + i), d);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(older1 + i), SelectSse2(restart, d, r1));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(older2 + i), SelectSse2(restart, d, r2));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(state + i), next);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_srli_epi16(_mm_add_epi16(next, two), 2));
+	}
+
+	MedianScalar(src + i, newest + i, older1 + i, older2 + i, state + i, dst + i, count - i, p);
+}
+
+QDEPTHFILTER_AVX2 static inline __m256i SelectAvx2(__m256i mask, __m256i a, __m256i b)
+{
+	return _mm256_blendv_epi8(b, a, mask);
+}
+
+QDEPTHFILTER_AVX2 static void ExponentialAvx2(const unsigned short* src, unsigned short* newest, unsigned short* older1, unsigned short* older2,
+	unsigned short* state, unsigned short* dst, int count, const TemporalParameters& p)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i two = _mm256_set1_epi16(2);
+	const __m256i maxDepth = _mm256_set1_epi16(QDepthFilter::MaxDepth);
+	const __m256i threshold = _mm256_set1_epi16(static_cast<short>(p.Threshold));
+	const __m256i round = _mm256_set1_epi16(static_cast<short>(p.Round));
+	const __m128i shift = _mm_cvtsi32_si128(p.Shift);
+
+	int i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		const __m256i d = _mm256_min_epu16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i)), maxDepth);
+		const __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state + i));
+		const __m256i r1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(older1 + i));
+		const __m256i r2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(older2 + i));
+
+		const __m256i previous = _mm256_srli_epi16(_mm256_add_epi16(s, two), 2);
+		const __m256i difference = _mm256_abs_epi16(_mm256_sub_epi16(d, previous));
+		const __m256i motion = _mm256_cmpgt_epi16(difference, _mm256_add_epi16(threshold, _mm256_srli_epi16(previous, QDepthFilter::MotionShift)));
+		const __m256i stale = _mm256_and_si256(_mm256_cmpeq_epi16(r1, zero), _mm256_cmpeq_epi16(r2, zero));
+		const __m256i hole = _mm256_cmpeq_epi16(d, zero);
+		const __m256i restart = _mm256_or_si256(_mm256_cmpeq_epi16(s, zero), motion);
+
+		const __m256i d4 = _mm256_slli_epi16(d, 2);
+		const __m256i smoothed = _mm256_add_epi16(s, _mm256_sra_epi16(_mm256_add_epi16(_mm256_sub_epi16(d4, s), round), shift));
+		const __m256i next = SelectAvx2(hole, _mm256_andnot_si256(stale, s), SelectAvx2(restart, d4, smoothed));
+
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(newest + i), d);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(state + i), next);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_srli_epi16(_mm256_add_epi16(next, two), 2));
+	}
+
+	ExponentialScalar(src + i, newest + i, older1 + i, older2 + i, state + i, dst + i, count - i, p);
+}
+
+QDEPTHFILTER_AVX2 static void MedianAvx2(const unsigned short* src, unsigned short* newest, unsigned short* older1, unsigned short* older2,
+	unsigned short* state, unsigned short* dst, int count, const TemporalParameters& p)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i two = _mm256_set1_epi16(2);
+	const __m256i maxDepth = _mm256_set1_epi16(QDepthFilter::MaxDepth);
+	const __m256i threshold = _mm256_set1_epi16(static_cast<short>(p.Threshold));
+
+	int i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		const __m256i d = _mm256_min_epu16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i)), maxDepth);
+		const __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state + i));
+		const __m256i r1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(older1 + i));
+		const __m256i r2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(older2 + i));
+
+		const __m256i previous = _mm256_srli_epi16(_mm256_add_epi16(s, two), 2);
+		const __m256i difference = _mm256_abs_epi16(_mm256_sub_epi16(d, previous));
+		const __m256i motion = _mm256_cmpgt_epi16(difference, _mm256_add_epi16(threshold, _mm256_srli_epi16(previous, QDepthFilter::MotionShift)));
+		const __m256i missing1 = _mm256_cmpeq_epi16(r1, zero);
+		const __m256i missing2 = _mm256_cmpeq_epi16(r2, zero);
+		const __m256i hole = _mm256_cmpeq_epi16(d, zero);
+		const __m256i restart = _mm256_andnot_si256(hole, _mm256_or_si256(_mm256_cmpeq_epi16(s, zero), motion));
+		const __m256i lost = _mm256_and_si256(hole, _mm256_and_si256(missing1, missing2));
+
+		const __m256i a = SelectAvx2(hole, previous, d);
+		const __m256i b = SelectAvx2(missing1, previous, r1);
+		const __m256i c = SelectAvx2(missing2, previous, r2);
+		const __m256i median = _mm256_max_epi16(_mm256_min_epi16(a, b), _mm256_min_epi16(_mm256_max_epi16(a, b), c));
+
+		const __m256i d4 = _mm256_slli_epi16(d, 2);
+		const __m256i next = SelectAvx2(restart, d4, _mm256_andnot_si256(lost, _mm256_slli_epi16(median, 2)));
+
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(newest + i), d);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(older1 + i), SelectAvx2(restart, d, r1));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(older2 + i), SelectAvx2(restart, d, r2));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(state + i), next);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_srli_epi16(_mm256_add_epi16(next, two), 2));
+	}
+
+	MedianScalar(src + i, newest + i, older1 + i, older2 + i, state + i, dst + i, count - i, p);
+}
+#endif
+
+
+
+//
+// Hole fill: a 0 pixel takes the largest depth of its 3x3 neighbourhood, which is 0
+// only when every neighbour is a hole too. Rows and columns past the frame repeat the
+// edge.
+//
+
+static inline unsigned short FillPixel(const unsigned short* above, const unsigned short* row, const unsigned short* below, int x, int width)
+{
+	if (row[x] != 0)
+		return row[x];
+
+	const int left = qMax(x - 1, 0);
+	const int right = qMin(x + 1, width - 1);
+
+	unsigned short farthest = 0;
+	for (int i = left; i <= right; ++i)
+		farthest = qMax(farthest, qMax(above[i], qMax(row[i], below[i])));
+
+	return farthest;
+}
+
+static void FillRowScalar(const unsigned short* above, const unsigned short* row, const unsigned short* below, unsigned short* dst, int width)
+{
+	for (int x = 0; x < width; ++x)
+		dst[x] = FillPixel(above, row, below, x, width);
+}
+
+#ifdef QDEPTHFILTER_X86
+static void FillRowSse2(const unsigned short* above, const unsigned short* row, const unsigned short* below, unsigned short* dst, int width)
+{
+	const __m128i zero = _mm_setzero_si128();
+
+	dst[0] = FillPixel(above, row, below, 0, width);
+
+	// depths are below 32768, the signed maximum is the unsigned one
+	int x = 1;
+	for (; x + 8 < width; x += 8)
+	{
+		const __m128i left = _mm_max_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(above + x - 1)),
+			_mm_max_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x - 1)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(below + x - 1))));
+		const __m128i center = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x));
+		const __m128i middle = _mm_max_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(above + x)),
+			_mm_max_epi16(center, _mm_loadu_si128(reinterpret_cast<const __m128i*>(below + x))));
+		const __m128i right = _mm_max_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(above + x + 1)),
+			_mm_max_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x + 1)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(below + x + 1))));
+
+		const __m128i farthest = _mm_max_epi16(left, _mm_max_epi16(middle, right));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), SelectSse2(_mm_cmpeq_epi16(center, zero), farthest, center));
+	}
+
+	for (; x < width; ++x)
+		dst[x] = FillPixel(above, row, below, x, width);
+}
+
+QDEPTHFILTER_AVX2 static void FillRowAvx2(const unsigned short* above, const unsigned short* row, const unsigned short* below, unsigned short* dst, int width)
+{
+	const __m256i zero = _mm256_setzero_si256();
+
+	dst[0] = FillPixel(above, row, below, 0, width);
+
+	int x = 1;
+	for (; x + 16 < width; x += 16)
+	{
+		const __m256i left = _mm256_max_epu16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(above + x - 1)),
+			_mm256_max_epu16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + x - 1)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(below + x - 1))));
+		const __m256i center = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + x));
+		const __m256i middle = _mm256_max_epu16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(above + x)),
+			_mm256_max_epu16(center, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(below + x))));
+		const __m256i right = _mm256_max_epu16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(above + x + 1)),
+			_mm256_max_epu16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + x + 1)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(below + x + 1))));
+
+		const __m256i farthest = _mm256_max_epu16(left, _mm256_max_epu16(middle, right));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x), SelectAvx2(_mm256_cmpeq_epi16(center, zero), farthest, center));
+	}
+
+	for (; x < width; ++x)
+		dst[x] = FillPixel(above, row, below, x, width);
+}
+#endif
+
+
+
+QDepthFilter::QDepthFilter() :
+	FilterMode(Exponential),
+	Smoothing(DefaultSmoothing),
+	MotionThreshold(DefaultMotionThreshold),
+	HoleFilling(true),
+	Width(0),
+	Height(0),
+	Newest(0)
+{
+}
+
+QDepthFilter::Mode QDepthFilter::mode() const
+{
+	return FilterMode;
+}
+
+void QDepthFilter::setMode(Mode mode)
+{
+	FilterMode = mode;
+}
+
+int QDepthFilter::smoothing() const
+{
+	return Smoothing;
+}
+
+void QDepthFilter::setSmoothing(int shift)
+{
+	Smoothing = qBound(0, shift, 6);
+}
+
+int QDepthFilter::motionThreshold() const
+{
+	return MotionThreshold;
+}
+
+void QDepthFilter::setMotionThreshold(int mm)
+{
+	MotionThreshold = qBound(0, mm, static_cast<int>(MaxDepth));
+}
+
+bool QDepthFilter::holeFilling() const
+{
+	return HoleFilling;
+}
+
+void QDepthFilter::setHoleFilling(bool fill)
+{
+	HoleFilling = fill;
+}
+
+
+void QDepthFilter::reset()
+{
+	std::fill(History.begin(), History.end(), 0);
+	std::fill(State.begin(), State.end(), 0);
+	Newest = 0;
+}
+
+void QDepthFilter::resize(int width, int height)
+{
+	const size_t count = static_cast<size_t>(width) * height;
+
+	Width = width;
+	Height = height;
+	History.assign(HistoryFrames * count, 0);
+	State.assign(count, 0);
+	Temporal.assign(count, 0);
+	Newest = 0;
+}
+
+
+void QDepthFilter::process(const unsigned short* src, int width, int height, unsigned short* dst, InstructionSet isa, int bandRows)
+{
+	if (width <= 0 || height <= 0)
+		return;
+
+	if (width != Width || height != Height)
+		resize(width, height);
+
+	TemporalKernel temporal = FilterMode == Median ? MedianScalar : ExponentialScalar;
+	FillKernel fill = FillRowScalar;
+#ifdef QDEPTHFILTER_X86
+	if (isa == QFrameKernels::Avx2)
+	{
+		temporal = FilterMode == Median ? MedianAvx2 : ExponentialAvx2;
+		fill = FillRowAvx2;
+	}
+	else if (isa == QFrameKernels::Sse2)
+	{
+		temporal = FilterMode == Median ? MedianSse2 : ExponentialSse2;
+		fill = FillRowSse2;
+	}
+#endif
+
+	TemporalParameters parameters;
+	parameters.Shift = Smoothing;
+	parameters.Round = (1 << Smoothing) >> 1;
+	parameters.Threshold = MotionThreshold;
+
+	// the oldest plane of the ring takes the new frame
+	const size_t count = static_cast<size_t>(width) * height;
+	Newest = (Newest + 1) % HistoryFrames;
+	unsigned short* newest = History.data() + Newest * count;
+	unsigned short* older1 = History.data() + ((Newest + HistoryFrames - 1) % HistoryFrames) * count;
+	unsigned short* older2 = History.data() + ((Newest + HistoryFrames - 2) % HistoryFrames) * count;
+	unsigned short* temporalOut = HoleFilling ? Temporal.data() : dst;
+
+	auto temporalBand = [&](int begin, int end)
+	{
+		const size_t offset = static_cast<size_t>(begin) * width;
+		temporal(src + offset, newest + offset, older1 + offset, older2 + offset, State.data() + offset, temporalOut + offset,
+			(end - begin) * width, parameters);
+	};
+
+	// the fill reads the rows around its band, so it starts once every band is filtered
+	const unsigned short* filtered = Temporal.data();
+	auto fillBand = [&](int begin, int end)
+	{
+		for (int y = begin; y < end; ++y)
+		{
+			const unsigned short* row = filtered + y * width;
+			fill(y > 0 ? row - width : row, row, y + 1 < height ? row + width : row, dst + y * width, width);
+		}
+	};
+
+	if (bandRows <= 0)
+	{
+		temporalBand(0, height);
+		if (HoleFilling)
+			fillBand(0, height);
+		return;
+	}
+
+	QParallel::forTiles(height, bandRows, temporalBand);
+	if (HoleFilling)
+		QParallel::forTiles(height, bandRows, fillBand);
+}
+
+void QDepthFilter::process(const unsigned short* src, int width, int height, unsigned short* dst)
+{
+	process(src, width, height, dst, QFrameKernels::instructionSet(), DepthFilterBandRows);
+}
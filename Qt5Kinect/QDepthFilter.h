@@ -0,0 +1,79 @@
+#pragma once
+
+#include "QFrameKernels.h"
+#include <vector>
+
+
+/// <summary>
+/// Incremental depth denoising: a per-pixel temporal filter followed by a fill of small
+/// holes, run on every frame of a depth stream.
+///
+/// The temporal stage keeps the last HistoryFrames raw frames in a ring and the filtered
+/// depth in 1/4 mm, both allocated once per frame size. In Exponential mode a pixel moves
+/// towards each new sample by 1 / 2^smoothing; in Median mode it is the median of its last
+/// three samples. A sample farther than motionThreshold + depth / 2^MotionShift from the
+/// filtered value is motion and restarts the pixel from it, so moving edges do not trail.
+/// A pixel with no sample (0) holds its value while one of the older samples in the ring
+/// was valid, and drops to 0 after that.
+///
+/// The hole fill then gives every remaining 0 pixel the farthest valid depth of its 3x3
+/// neighbourhood. Holes of up to two pixels close; the shadows the sensor leaves beside
+/// foreground edges are filled from the background, so edges do not grow.
+///
+/// Both stages run on the widest instruction set given, bit-exact with their scalar
+/// version, over bands of rows on the global QThreadPool.
+/// </summary>
+class QDepthFilter
+{
+public:
+	enum Mode
+	{
+		Exponential,
+		Median
+	};
+
+	enum
+	{
+		HistoryFrames = 3,
+		MaxDepth = 8191,			// deeper samples are clamped, the state holds 4x this in 16 bits
+		MotionShift = 5				// motion threshold grows by depth / 32, the sensor's noise grows with depth
+	};
+
+	QDepthFilter();
+
+	Mode mode() const;
+	void setMode(Mode mode);
+	int smoothing() const;
+	void setSmoothing(int shift);				// a new sample weighs 1 / 2^shift in Exponential mode, 0..6
+	int motionThreshold() const;
+	void setMotionThreshold(int mm);
+	bool holeFilling() const;
+	void setHoleFilling(bool fill);
+
+	/// <summary>
+	/// Forget the history, the next frame passes unfiltered
+	/// </summary>
+	void reset();
+
+	/// <summary>
+	/// Filter the next frame of the stream into dst, which may not be src. A frame of
+	/// another size restarts the history.
+	/// </summary>
+	void process(const unsigned short* src, int width, int height, unsigned short* dst);
+	void process(const unsigned short* src, int width, int height, unsigned short* dst, QFrameKernels::InstructionSet isa, int bandRows);
+
+private:
+	void resize(int width, int height);
+
+	Mode						FilterMode;
+	int							Smoothing;
+	int							MotionThreshold;
+	bool						HoleFilling;
+
+	int							Width;
+	int							Height;
+	int							Newest;				// ring slot of the newest frame
+	std::vector<unsigned short>	History;			// HistoryFrames planes of raw depth
+	std::vector<unsigned short>	State;				// filtered depth in 1/4 mm, 0 for none
+	std::vector<unsigned short>	Temporal;			// temporal output, the hole fill's input
+};
@@ -0,0 +1,582 @@
+#include "stdafx.h"
+#include "QFrameKernels.h"
+#include "QParallel.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define QFRAMEKERNELS_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC compiles any intrinsic anywhere, gcc and clang need the target spelled out per function
+#if defined(QFRAMEKERNELS_X86) && !defined(_MSC_VER)
+#define QFRAMEKERNELS_AVX2 __attribute__((target("avx2")))
+#else
+#define QFRAMEKERNELS_AVX2
+#endif
+
+// Rows per band of the YUY2 conversions, 17 bands for a 1080 row frame
+#define Yuy2BandRows 64
+
+
+namespace QFrameKernels
+{
+
+static InstructionSet DetectInstructionSet()
+{
+#if defined(QFRAMEKERNELS_X86) && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	const int maxLeaf = info[0];
+
+	__cpuid(info, 1);
+	const bool sse2 = (info[3] & (1 << 26)) != 0;
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	const bool avx = (info[2] & (1 << 28)) != 0;
+
+	bool avx2 = false;
+	if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 0x6) == 0x6)
+	{
+		__cpuidex(info, 7, 0);
+		avx2 = (info[1] & (1 << 5)) != 0;
+	}
+
+	return avx2 ? Avx2 : sse2 ? Sse2 : Scalar;
+#elif defined(QFRAMEKERNELS_X86)
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") ? Avx2 : __builtin_cpu_supports("sse2") ? Sse2 : Scalar;
+#else
+	return Scalar;
+#endif
+}
+
+InstructionSet instructionSet()
+{
+	static const InstructionSet isa = DetectInstructionSet();
+	return isa;
+}
+
+
+
+//
+// Depth to 8 bit
+//
+
+static inline unsigned char DepthToGray(unsigned short depth, float maxDistance)
+{
+	// float to int truncation, then the low byte, which is what the original cast compiled to
+	return static_cast<unsigned char>(static_cast<int>(static_cast<float>(depth) / maxDistance * 255.f));
+}
+
+static void DepthToGray8Scalar(const unsigned short* src, unsigned char* dst, int count, float maxDistance)
+{
+	for (int i = 0; i < count; ++i)
+		dst[i] = DepthToGray(src[i], maxDistance);
+}
+
+#ifdef QFRAMEKERNELS_X86
+static void DepthToGray8Sse2(const unsigned short* src, unsigned char* dst, int count, float maxDistance)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i lowByte = _mm_set1_epi32(0xFF);
+	const __m128 divisor = _mm_set1_ps(maxDistance);
+	const __m128 scale = _mm_set1_ps(255.f);
+
+	int i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		__m128i d0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+		__m128i d1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 8));
+
+		// the same divide and multiply as the scalar code, so the results are identical
+		__m128i q0 = _mm_cvttps_epi32(_mm_mul_ps(_mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(d0, zero)), divisor), scale));
+		__m128i q1 = _mm_cvttps_epi32(_mm_mul_ps(_mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(d0, zero)), divisor), scale));
+		__m128i q2 = _mm_cvttps_epi32(_mm_mul_ps(_mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(d1, zero)), divisor), scale));
+		__m128i q3 = _mm_cvttps_epi32(_mm_mul_ps(_mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(d1, zero)), divisor), scale));
+
+		// keep the low byte before packing, the packs would saturate instead of wrapping
+		__m128i w0 = _mm_packs_epi32(_mm_and_si128(q0, lowByte), _mm_and_si128(q1, lowByte));
+		__m128i w1 = _mm_packs_epi32(_mm_and_si128(q2, lowByte), _mm_and_si128(q3, lowByte));
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(w0, w1));
+	}
+
+	DepthToGray8Scalar(src + i, dst + i, count - i, maxDistance);
+}
+
+QFRAMEKERNELS_AVX2
+static void DepthToGray8Avx2(const unsigned short* src, unsigned char* dst, int count, float maxDistance)
+{
+	const __m256i lowByte = _mm256_set1_epi32(0xFF);
+	const __m256 divisor = _mm256_set1_ps(maxDistance);
+	const __m256 scale = _mm256_set1_ps(255.f);
+
+	int i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		__m256i d0 = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+		__m256i d1 = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 8)));
+
+		__m256i q0 = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_div_ps(_mm256_cvtepi32_ps(d0), divisor), scale));
+		__m256i q1 = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_div_ps(_mm256_cvtepi32_ps(d1), divisor), scale));
+
+		// packs work per 128 bit lane: [q0 0-3, q1 0-3 | q0 4-7, q1 4-7], reorder to q0 0-7, q1 0-7
+		__m256i w = _mm256_packs_epi32(_mm256_and_si256(q0, lowByte), _mm256_and_si256(q1, lowByte));
+		w = _mm256_permute4x64_epi64(w, _MM_SHUFFLE(3, 1, 2, 0));
+
+		// bytes: [q0 0-7, q0 0-7 | q1 0-7, q1 0-7], keep the first quadword of each lane
+		__m256i b = _mm256_packus_epi16(w, w);
+		b = _mm256_permute4x64_epi64(b, _MM_SHUFFLE(3, 1, 2, 0));
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm256_castsi256_si128(b));
+	}
+
+	DepthToGray8Scalar(src + i, dst + i, count - i, maxDistance);
+}
+#endif
+
+void depthToGray8(const unsigned short* depth, int width, int height, unsigned short maxDistance, unsigned char* dst, int dstStride, InstructionSet isa)
+{
+	typedef void(*RowKernel)(const unsigned short*, unsigned char*, int, float);
+
+	if (maxDistance == 0)
+	{
+		for (int y = 0; y < height; ++y)
+			memset(dst + y * dstStride, 0, width);
+		return;
+	}
+
+	RowKernel kernel = DepthToGray8Scalar;
+#ifdef QFRAMEKERNELS_X86
+	if (isa == Avx2)
+		kernel = DepthToGray8Avx2;
+	else if (isa == Sse2)
+		kernel = DepthToGray8Sse2;
+#endif
+
+	const float divisor = static_cast<float>(maxDistance);
+
+	// contiguous rows are done in one go, so the vector loop never stops at a row end
+	if (dstStride == width)
+	{
+		kernel(depth, dst, width * height, divisor);
+		return;
+	}
+
+	for (int y = 0; y < height; ++y)
+		kernel(depth + y * width, dst + y * dstStride, width, divisor);
+}
+
+void depthToGray8(const unsigned short* depth, int width, int height, unsigned short maxDistance, unsigned char* dst, int dstStride)
+{
+	depthToGray8(depth, width, height, maxDistance, dst, dstStride, instructionSet());
+}
+
+
+
+//
+// Depth to camera space
+//
+
+// Kinect depth is in millimeters, camera space in meters
+static const float DepthToMeters = 0.001f;
+
+static void DepthToPointsScalar(const unsigned short* depth, const float* table, int count, float* x, float* y, float* z, unsigned char* mask)
+{
+	for (int i = 0; i < count; ++i)
+	{
+		const float meters = static_cast<float>(depth[i]) * DepthToMeters;
+		x[i] = table[2 * i] * meters;
+		y[i] = table[2 * i + 1] * meters;
+		z[i] = meters;
+	}
+
+	if (mask)
+	{
+		for (int i = 0; i < count; ++i)
+			mask[i] = depth[i] ? 0xFF : 0;
+	}
+}
+
+static void DepthToPointsInterleavedScalar(const unsigned short* depth, const float* table, int count, float* xyz, unsigned char* mask)
+{
+	for (int i = 0; i < count; ++i)
+	{
+		const float meters = static_cast<float>(depth[i]) * DepthToMeters;
+		xyz[3 * i] = table[2 * i] * meters;
+		xyz[3 * i + 1] = table[2 * i + 1] * meters;
+		xyz[3 * i + 2] = meters;
+	}
+
+	if (mask)
+	{
+		for (int i = 0; i < count; ++i)
+			mask[i] = depth[i] ? 0xFF : 0;
+	}
+}
+
+#ifdef QFRAMEKERNELS_X86
+// 0xFF for every non zero 32 bit lane of d, written as four bytes
+static inline void StoreValidMask4(unsigned char* mask, __m128i d)
+{
+	__m128i invalid = _mm_cmpeq_epi32(d, _mm_setzero_si128());
+	__m128i valid = _mm_andnot_si128(invalid, _mm_set1_epi32(-1));
+	__m128i bytes = _mm_packs_epi16(_mm_packs_epi32(valid, valid), _mm_setzero_si128());
+	int packed = _mm_cvtsi128_si32(bytes);
+	memcpy(mask, &packed, 4);
+}
+
+static void DepthToPointsSse2(const unsigned short* depth, const float* table, int count, float* x, float* y, float* z, unsigned char* mask)
+{
+	const __m128 toMeters = _mm_set1_ps(DepthToMeters);
+	const __m128i zero = _mm_setzero_si128();
+
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128i d = _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(depth + i)), zero);
+		__m128 meters = _mm_mul_ps(_mm_cvtepi32_ps(d), toMeters);
+
+		// table holds x0 y0 x1 y1 x2 y2 x3 y3
+		__m128 t0 = _mm_loadu_ps(table + 2 * i);
+		__m128 t1 = _mm_loadu_ps(table + 2 * i + 4);
+		__m128 tx = _mm_shuffle_ps(t0, t1, _MM_SHUFFLE(2, 0, 2, 0));
+		__m128 ty = _mm_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 1, 3, 1));
+
+		_mm_storeu_ps(x + i, _mm_mul_ps(tx, meters));
+		_mm_storeu_ps(y + i, _mm_mul_ps(ty, meters));
+		_mm_storeu_ps(z + i, meters);
+
+		if (mask)
+			StoreValidMask4(mask + i, d);
+	}
+
+	DepthToPointsScalar(depth + i, table + 2 * i, count - i, x + i, y + i, z + i, mask ? mask + i : NULL);
+}
+
+static void DepthToPointsInterleavedSse2(const unsigned short* depth, const float* table, int count, float* xyz, unsigned char* mask)
+{
+	const __m128 toMeters = _mm_set1_ps(DepthToMeters);
+	const __m128i zero = _mm_setzero_si128();
+
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128i d = _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(depth + i)), zero);
+		__m128 pz = _mm_mul_ps(_mm_cvtepi32_ps(d), toMeters);
+
+		__m128 t0 = _mm_loadu_ps(table + 2 * i);
+		__m128 t1 = _mm_loadu_ps(table + 2 * i + 4);
+		__m128 px = _mm_mul_ps(_mm_shuffle_ps(t0, t1, _MM_SHUFFLE(2, 0, 2, 0)), pz);
+		__m128 py = _mm_mul_ps(_mm_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 1, 3, 1)), pz);
+
+		// transpose four x, y, z vectors into x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3
+		__m128 xyLow = _mm_unpacklo_ps(px, py);
+		__m128 xyHigh = _mm_unpackhi_ps(px, py);
+		__m128 zx = _mm_shuffle_ps(pz, px, _MM_SHUFFLE(1, 1, 0, 0));
+		__m128 yz = _mm_shuffle_ps(py, pz, _MM_SHUFFLE(1, 1, 1, 1));
+		__m128 zxy = _mm_shuffle_ps(pz, xyHigh, _MM_SHUFFLE(3, 2, 3, 2));
+
+		_mm_storeu_ps(xyz + 3 * i, _mm_shuffle_ps(xyLow, zx, _MM_SHUFFLE(2, 0, 1, 0)));
+		_mm_storeu_ps(xyz + 3 * i + 4, _mm_shuffle_ps(yz, xyHigh, _MM_SHUFFLE(1, 0, 2, 0)));
+		_mm_storeu_ps(xyz + 3 * i + 8, _mm_shuffle_ps(zxy, zxy, _MM_SHUFFLE(1, 3, 2, 0)));
+
+		if (mask)
+			StoreValidMask4(mask + i, d);
+	}
+
+	DepthToPointsInterleavedScalar(depth + i, table + 2 * i, count - i, xyz + 3 * i, mask ? mask + i : NULL);
+}
+
+QFRAMEKERNELS_AVX2
+static void DepthToPointsAvx2(const unsigned short* depth, const float* table, int count, float* x, float* y, float* z, unsigned char* mask)
+{
+	const __m256 toMeters = _mm256_set1_ps(DepthToMeters);
+	const __m256i evenOdd = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+
+	int i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m128i d16 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(depth + i));
+		__m256 meters = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(d16)), toMeters);
+
+		// split x0 y0 ... x7 y7 into x0..x7 and y0..y7
+		__m256 t0 = _mm256_permutevar8x32_ps(_mm256_loadu_ps(table + 2 * i), evenOdd);
+		__m256 t1 = _mm256_permutevar8x32_ps(_mm256_loadu_ps(table + 2 * i + 8), evenOdd);
+		__m256 tx = _mm256_permute2f128_ps(t0, t1, 0x20);
+		__m256 ty = _mm256_permute2f128_ps(t0, t1, 0x31);
+
+		_mm256_storeu_ps(x + i, _mm256_mul_ps(tx, meters));
+		_mm256_storeu_ps(y + i, _mm256_mul_ps(ty, meters));
+		_mm256_storeu_ps(z + i, meters);
+
+		if (mask)
+		{
+			// 0xFF where depth != 0: compare to zero and flip, then narrow the 16 bit lanes to bytes
+			__m128i valid = _mm_andnot_si128(_mm_cmpeq_epi16(d16, _mm_setzero_si128()), _mm_set1_epi16(-1));
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(mask + i), _mm_packs_epi16(valid, valid));
+		}
+	}
+
+	DepthToPointsScalar(depth + i, table + 2 * i, count - i, x + i, y + i, z + i, mask ? mask + i : NULL);
+}
+#endif
+
+void depthToPoints(const unsigned short* depth, const float* table, int count, float* x, float* y, float* z, unsigned char* mask, InstructionSet isa)
+{
+#ifdef QFRAMEKERNELS_X86
+	if (isa == Avx2)
+		return DepthToPointsAvx2(depth, table, count, x, y, z, mask);
+	if (isa == Sse2)
+		return DepthToPointsSse2(depth, table, count, x, y, z, mask);
+#endif
+	DepthToPointsScalar(depth, table, count, x, y, z, mask);
+}
+
+void depthToPoints(const unsigned short* depth, const float* table, int count, float* x, float* y, float* z, unsigned char* mask)
+{
+	depthToPoints(depth, table, count, x, y, z, mask, instructionSet());
+}
+
+void depthToPointsInterleaved(const unsigned short* depth, const float* table, int count, float* xyz, unsigned char* mask, InstructionSet isa)
+{
+#ifdef QFRAMEKERNELS_X86
+	// the x, y, z transpose is done 128 bits at a time for both instruction sets
+	if (isa == Avx2 || isa == Sse2)
+		return DepthToPointsInterleavedSse2(depth, table, count, xyz, mask);
+#endif
+	DepthToPointsInterleavedScalar(depth, table, count, xyz, mask);
+}
+
+void depthToPointsInterleaved(const unsigned short* depth, const float* table, int count, float* xyz, unsigned char* mask)
+{
+	depthToPointsInterleaved(depth, table, count, xyz, mask, instructionSet());
+}
+
+
+
+//
+// YUY2 to BGRA and gray
+//
+
+// BT.601 full range in 2.14 fixed point; negative sums shift arithmetically, like _mm_srai_epi32
+enum
+{
+	Yuy2Shift = 14,
+	Yuy2Round = 1 << (Yuy2Shift - 1),
+	Yuy2RedV = 22970,		// 1.402
+	Yuy2GreenU = -5638,		// -0.344136
+	Yuy2GreenV = -11700,	// -0.714136
+	Yuy2BlueU = 29032		// 1.772
+};
+
+static inline unsigned char Clamp8(int value)
+{
+	return static_cast<unsigned char>(value < 0 ? 0 : value > 255 ? 255 : value);
+}
+
+static void Yuy2ToBgraScalar(const unsigned char* src, unsigned char* dst, int width)
+{
+	for (int i = 0; i + 2 <= width; i += 2, src += 4, dst += 8)
+	{
+		const int u = src[1] - 128;
+		const int v = src[3] - 128;
+		const int r = (Yuy2RedV * v + Yuy2Round) >> Yuy2Shift;
+		const int g = (Yuy2GreenU * u + Yuy2GreenV * v + Yuy2Round) >> Yuy2Shift;
+		const int b = (Yuy2BlueU * u + Yuy2Round) >> Yuy2Shift;
+
+		dst[0] = Clamp8(src[0] + b);
+		dst[1] = Clamp8(src[0] + g);
+		dst[2] = Clamp8(src[0] + r);
+		dst[3] = 0xFF;
+		dst[4] = Clamp8(src[2] + b);
+		dst[5] = Clamp8(src[2] + g);
+		dst[6] = Clamp8(src[2] + r);
+		dst[7] = 0xFF;
+	}
+}
+
+static void Yuy2ToGray8Scalar(const unsigned char* src, unsigned char* dst, int width)
+{
+	for (int i = 0; i < width; ++i)
+		dst[i] = src[2 * i];
+}
+
+#ifdef QFRAMEKERNELS_X86
+static void Yuy2ToBgraSse2(const unsigned char* src, unsigned char* dst, int width)
+{
+	const __m128i lowByte = _mm_set1_epi16(0xFF);
+	const __m128i bias = _mm_set1_epi16(128);
+	const __m128i round = _mm_set1_epi32(Yuy2Round);
+	const __m128i alpha = _mm_set1_epi16(0xFF);
+
+	// u, v pairs line up with these in every 32 bit lane, one madd per channel and pixel pair
+	const __m128i red = _mm_setr_epi16(0, Yuy2RedV, 0, Yuy2RedV, 0, Yuy2RedV, 0, Yuy2RedV);
+	const __m128i green = _mm_setr_epi16(Yuy2GreenU, Yuy2GreenV, Yuy2GreenU, Yuy2GreenV, Yuy2GreenU, Yuy2GreenV, Yuy2GreenU, Yuy2GreenV);
+	const __m128i blue = _mm_setr_epi16(Yuy2BlueU, 0, Yuy2BlueU, 0, Yuy2BlueU, 0, Yuy2BlueU, 0);
+
+	int i = 0;
+	for (; i + 8 <= width; i += 8)
+	{
+		// Y0 U0 Y1 V0 ... as 16 bit lanes: the low bytes are Y, the high bytes U and V
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * i));
+		__m128i y = _mm_and_si128(v, lowByte);
+		__m128i uv = _mm_sub_epi16(_mm_srli_epi16(v, 8), bias);
+
+		__m128i r = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(uv, red), round), Yuy2Shift);
+		__m128i g = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(uv, green), round), Yuy2Shift);
+		__m128i b = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(uv, blue), round), Yuy2Shift);
+
+		// one offset per pixel pair, repeated for both pixels of the pair
+		r = _mm_packs_epi32(r, r);
+		g = _mm_packs_epi32(g, g);
+		b = _mm_packs_epi32(b, b);
+		r = _mm_add_epi16(y, _mm_unpacklo_epi16(r, r));
+		g = _mm_add_epi16(y, _mm_unpacklo_epi16(g, g));
+		b = _mm_add_epi16(y, _mm_unpacklo_epi16(b, b));
+
+		// the saturating packs are the clamp: B0-7 R0-7 and G0-7 A0-7, interleaved into B G R A
+		__m128i br = _mm_packus_epi16(b, r);
+		__m128i ga = _mm_packus_epi16(g, alpha);
+		__m128i bg = _mm_unpacklo_epi8(br, ga);
+		__m128i ra = _mm_unpackhi_epi8(br, ga);
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 4 * i), _mm_unpacklo_epi16(bg, ra));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 4 * i + 16), _mm_unpackhi_epi16(bg, ra));
+	}
+
+	Yuy2ToBgraScalar(src + 2 * i, dst + 4 * i, width - i);
+}
+
+QFRAMEKERNELS_AVX2
+static void Yuy2ToBgraAvx2(const unsigned char* src, unsigned char* dst, int width)
+{
+	const __m256i lowByte = _mm256_set1_epi16(0xFF);
+	const __m256i bias = _mm256_set1_epi16(128);
+	const __m256i round = _mm256_set1_epi32(Yuy2Round);
+	const __m256i alpha = _mm256_set1_epi16(0xFF);
+	const __m256i red = _mm256_set1_epi32(static_cast<int>(static_cast<unsigned int>(Yuy2RedV) << 16));
+	const __m256i green = _mm256_set1_epi32(static_cast<int>((static_cast<unsigned int>(Yuy2GreenV) << 16) | (static_cast<unsigned int>(Yuy2GreenU) & 0xFFFF)));
+	const __m256i blue = _mm256_set1_epi32(Yuy2BlueU);
+
+	int i = 0;
+	for (; i + 16 <= width; i += 16)
+	{
+		// the same steps as Sse2 in each 128 bit lane: pixels 0-7 in the low lane, 8-15 in the high one
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 2 * i));
+		__m256i y = _mm256_and_si256(v, lowByte);
+		__m256i uv = _mm256_sub_epi16(_mm256_srli_epi16(v, 8), bias);
+
+		__m256i r = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(uv, red), round), Yuy2Shift);
+		__m256i g = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(uv, green), round), Yuy2Shift);
+		__m256i b = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(uv, blue), round), Yuy2Shift);
+
+		r = _mm256_packs_epi32(r, r);
+		g = _mm256_packs_epi32(g, g);
+		b = _mm256_packs_epi32(b, b);
+		r = _mm256_add_epi16(y, _mm256_unpacklo_epi16(r, r));
+		g = _mm256_add_epi16(y, _mm256_unpacklo_epi16(g, g));
+		b = _mm256_add_epi16(y, _mm256_unpacklo_epi16(b, b));
+
+		__m256i br = _mm256_packus_epi16(b, r);
+		__m256i ga = _mm256_packus_epi16(g, alpha);
+		__m256i bg = _mm256_unpacklo_epi8(br, ga);
+		__m256i ra = _mm256_unpackhi_epi8(br, ga);
+
+		// [0-3 | 8-11] and [4-7 | 12-15], back to pixel order
+		__m256i low = _mm256_unpacklo_epi16(bg, ra);
+		__m256i high = _mm256_unpackhi_epi16(bg, ra);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 4 * i), _mm256_permute2x128_si256(low, high, 0x20));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 4 * i + 32), _mm256_permute2x128_si256(low, high, 0x31));
+	}
+
+	Yuy2ToBgraSse2(src + 2 * i, dst + 4 * i, width - i);
+}
+
+static void Yuy2ToGray8Sse2(const unsigned char* src, unsigned char* dst, int width)
+{
+	const __m128i lowByte = _mm_set1_epi16(0xFF);
+
+	int i = 0;
+	for (; i + 16 <= width; i += 16)
+	{
+		__m128i a = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * i)), lowByte);
+		__m128i b = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * i + 16)), lowByte);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(a, b));
+	}
+
+	Yuy2ToGray8Scalar(src + 2 * i, dst + i, width - i);
+}
+
+QFRAMEKERNELS_AVX2
+static void Yuy2ToGray8Avx2(const unsigned char* src, unsigned char* dst, int width)
+{
+	const __m256i lowByte = _mm256_set1_epi16(0xFF);
+
+	int i = 0;
+	for (; i + 32 <= width; i += 32)
+	{
+		__m256i a = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 2 * i)), lowByte);
+		__m256i b = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 2 * i + 32)), lowByte);
+
+		// packs work per 128 bit lane: [a 0-7, b 0-7 | a 8-15, b 8-15], reorder to a, b
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), _MM_SHUFFLE(3, 1, 2, 0)));
+	}
+
+	Yuy2ToGray8Sse2(src + 2 * i, dst + i, width - i);
+}
+#endif
+
+typedef void(*Yuy2RowKernel)(const unsigned char*, unsigned char*, int);
+
+static void Yuy2Rows(Yuy2RowKernel kernel, const unsigned char* src, int width, int height, int srcStride, unsigned char* dst, int dstStride, int bandRows)
+{
+	auto band = [&](int begin, int end)
+	{
+		for (int y = begin; y < end; ++y)
+			kernel(src + y * srcStride, dst + y * dstStride, width);
+	};
+
+	if (bandRows <= 0)
+		band(0, height);
+	else
+		QParallel::forTiles(height, bandRows, band);
+}
+
+void yuy2ToBgra(const unsigned char* src, int width, int height, int srcStride, unsigned char* dst, int dstStride, InstructionSet isa, int bandRows)
+{
+	Yuy2RowKernel kernel = Yuy2ToBgraScalar;
+#ifdef QFRAMEKERNELS_X86
+	if (isa == Avx2)
+		kernel = Yuy2ToBgraAvx2;
+	else if (isa == Sse2)
+		kernel = Yuy2ToBgraSse2;
+#endif
+	Yuy2Rows(kernel, src, width, height, srcStride, dst, dstStride, bandRows);
+}
+
+void yuy2ToBgra(const unsigned char* src, int width, int height, int srcStride, unsigned char* dst, int dstStride)
+{
+	yuy2ToBgra(src, width, height, srcStride, dst, dstStride, instructionSet(), Yuy2BandRows);
+}
+
+void yuy2ToGray8(const unsigned char* src, int width, int height, int srcStride, unsigned char* dst, int dstStride, InstructionSet isa, int bandRows)
+{
+	Yuy2RowKernel kernel = Yuy2ToGray8Scalar;
+#ifdef QFRAMEKERNELS_X86
+	if (isa == Avx2)
+		kernel = Yuy2ToGray8Avx2;
+	else if (isa == Sse2)
+		kernel = Yuy2ToGray8Sse2;
+#endif
+	Yuy2Rows(kernel, src, width, height, srcStride, dst, dstStride, bandRows);
+}
+
+void yuy2ToGray8(const unsigned char* src, int width, int height, int srcStride, unsigned char* dst, int dstStride)
+{
+	yuy2ToGray8(src, width, height, srcStride, dst, dstStride, instructionSet(), Yuy2BandRows);
+}
+
+}
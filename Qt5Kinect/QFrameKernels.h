@@ -0,0 +1,66 @@
+#pragma once
+
+
+/// <summary>
+/// Per-frame pixel kernels shared by the grabber stages.
+/// Every kernel works on plain buffers so it can be benchmarked without a sensor,
+/// and picks the widest instruction set the CPU supports at runtime.
+/// </summary>
+namespace QFrameKernels
+{
+	enum InstructionSet
+	{
+		Scalar,
+		Sse2,
+		Avx2
+	};
+
+	/// <summary>
+	/// Best instruction set supported by this CPU (detected once)
+	/// </summary>
+	InstructionSet instructionSet();
+
+	/// <summary>
+	/// Depth (mm) to 8 bit gray, bit-exact with
+	/// static_cast<unsigned char>((float)depth / (float)maxDistance * 255.f):
+	/// the float result is truncated and only its low byte kept, so depths beyond
+	/// maxDistance wrap around. A maxDistance of 0 gives a black image.
+	/// dst rows are dstStride bytes apart, e.g. QImage::scanLine(0) and bytesPerLine().
+	/// </summary>
+	void depthToGray8(const unsigned short* depth, int width, int height, unsigned short maxDistance, unsigned char* dst, int dstStride);
+	void depthToGray8(const unsigned short* depth, int width, int height, unsigned short maxDistance, unsigned char* dst, int dstStride, InstructionSet isa);
+
+	/// <summary>
+	/// Depth (mm) to camera space points (m) through a depth-to-camera-space table,
+	/// i.e. the PointF array of ICoordinateMapper::GetDepthFrameToCameraSpaceTable given
+	/// as interleaved x, y floats: point = (x * z, y * z, z) with z = depth / 1000.
+	/// depthToPoints writes separate x, y and z arrays, depthToPointsInterleaved writes
+	/// x, y, z triplets. mask is optional (may be NULL) and gets 0xFF where depth is valid
+	/// and 0 where it is 0; points of invalid pixels are (0, 0, 0), except where the table
+	/// has no ray (NaN), whose x and y are NaN at any depth.
+	/// </summary>
+	void depthToPoints(const unsigned short* depth, const float* table, int count, float* x, float* y, float* z, unsigned char* mask);
+	void depthToPoints(const unsigned short* depth, const float* table, int count, float* x, float* y, float* z, unsigned char* mask, InstructionSet isa);
+	void depthToPointsInterleaved(const unsigned short* depth, const float* table, int count, float* xyz, unsigned char* mask);
+	void depthToPointsInterleaved(const unsigned short* depth, const float* table, int count, float* xyz, unsigned char* mask, InstructionSet isa);
+
+	/// <summary>
+	/// YUY2 (Y0 U Y1 V per pixel pair, full range BT.601 as the sensor's JPEG decoder gives
+	/// it) to BGRA with opaque alpha. The integer math is the reference for every instruction
+	/// set: with u = U - 128 and v = V - 128,
+	///   R = Y + (22970 v + 8192) >> 14
+	///   G = Y + (-5638 u - 11700 v + 8192) >> 14
+	///   B = Y + (29032 u + 8192) >> 14
+	/// clamped to 0..255. width must be even.
+	/// The rows are converted in bands of bandRows over the global QThreadPool, the calling
+	/// thread taking its share; a bandRows of 0 keeps the whole frame on the calling thread.
+	/// </summary>
+	void yuy2ToBgra(const unsigned char* src, int width, int height, int srcStride, unsigned char* dst, int dstStride);
+	void yuy2ToBgra(const unsigned char* src, int width, int height, int srcStride, unsigned char* dst, int dstStride, InstructionSet isa, int bandRows);
+
+	/// <summary>
+	/// The Y of every YUY2 pixel as 8 bit gray, in bands like yuy2ToBgra
+	/// </summary>
+	void yuy2ToGray8(const unsigned char* src, int width, int height, int srcStride, unsigned char* dst, int dstStride);
+	void yuy2ToGray8(const unsigned char* src, int width, int height, int srcStride, unsigned char* dst, int dstStride, InstructionSet isa, int bandRows);
+}
@@ -0,0 +1,230 @@
+#include "stdafx.h"
+#include "QFrameLatency.h"
+#include "QFrameSource.h"
+#include <QElapsedTimer>
+#include <atomic>
+
+
+// Started during static initialization, before any thread can ask for the time
+static QElapsedTimer StartedClock()
+{
+	QElapsedTimer clock;
+	clock.start();
+	return clock;
+}
+
+static const QElapsedTimer LatencyClock = StartedClock();
+
+
+
+void QLatencyHistogram::record(qint64 ns)
+{
+	Counts[bucket(ns)].fetchAndAddRelaxed(1);
+}
+
+void QLatencyHistogram::reset()
+{
+	for (int i = 0; i < BucketCount; ++i)
+		Counts[i].store(0);
+}
+
+quint64 QLatencyHistogram::count() const
+{
+	quint64 total = 0;
+	for (int i = 0; i < BucketCount; ++i)
+		total += static_cast<unsigned int>(Counts[i].load());
+	return total;
+}
+
+qint64 QLatencyHistogram::percentile(double p) const
+{
+	unsigned int counts[BucketCount];
+	quint64 total = 0;
+
+	// one snapshot, so the rank and the walk agree even while frames are recorded
+	for (int i = 0; i < BucketCount; ++i)
+	{
+		counts[i] = static_cast<unsigned int>(Counts[i].load());
+		total += counts[i];
+	}
+
+	if (total == 0)
+		return 0;
+
+	const quint64 rank = qMax<quint64>(static_cast<quint64>(qBound(0.0, p, 100.0) / 100.0 * total + 0.5), 1);
+
+	quint64 seen = 0;
+	for (int i = 0; i < BucketCount; ++i)
+	{
+		seen += counts[i];
+		if (seen >= rank)
+			return upperBound(i);
+	}
+
+	return upperBound(BucketCount - 1);
+}
+
+qint64 QLatencyHistogram::maximum() const
+{
+	for (int i = BucketCount - 1; i >= 0; --i)
+	{
+		if (Counts[i].load() != 0)
+			return upperBound(i);
+	}
+
+	return 0;
+}
+
+/// <summary>
+/// Values below SubBuckets have a bucket each; above, the bucket is the position of the
+/// highest set bit and the SubBucketBits bits below it
+/// </summary>
+int QLatencyHistogram::bucket(qint64 ns)
+{
+	const quint64 value = static_cast<quint64>(qBound<qint64>(0, ns, (Q_INT64_C(1) << MaxExponent) - 1));
+
+	if (value < SubBuckets)
+		return static_cast<int>(value);
+
+	int shift = 0;
+	while ((value >> shift) >= 2 * SubBuckets)
+		++shift;
+
+	return (shift + 1) * SubBuckets + static_cast<int>((value >> shift) & (SubBuckets - 1));
+}
+
+qint64 QLatencyHistogram::upperBound(int bucket)
+{
+	if (bucket < SubBuckets)
+		return bucket;
+
+	const int shift = bucket / SubBuckets - 1;
+	const qint64 lower = static_cast<qint64>(SubBuckets + bucket % SubBuckets) << shift;
+	return lower + (Q_INT64_C(1) << shift) - 1;
+}
+
+
+
+QFrameLatency::QFrameLatency()
+{
+	for (int s = 0; s < StreamCount; ++s)
+		NextPending[s] = 0;
+}
+
+qint64 QFrameLatency::now()
+{
+	return LatencyClock.nsecsElapsed();
+}
+
+const QLatencyHistogram& QFrameLatency::histogram(int stream, Stage stage) const
+{
+	return Histograms[slot(stream)][stage];
+}
+
+void QFrameLatency::reset()
+{
+	for (int s = 0; s < StreamCount; ++s)
+	{
+		for (int stage = 0; stage < StageCount; ++stage)
+			Histograms[s][stage].reset();
+	}
+}
+
+void QFrameLatency::emitted(int stream, qint64 imageKey, qint64 arrived, qint64 read, qint64 emitted)
+{
+	const int s = slot(stream);
+
+	Histograms[s][Acquire].record(read - arrived);
+	Histograms[s][Process].record(emitted - read);
+
+	const int id = imageId(imageKey);
+	if (id == 0)
+		return;
+
+	// the key is cleared while the times change, so presented() never pairs it with half of them
+	PendingFrame& frame = Pending[s][NextPending[s]];
+	NextPending[s] = (NextPending[s] + 1) % PendingCount;
+
+	// ordered: the times below are not written before the key is seen cleared
+	frame.Key.fetchAndStoreOrdered(0);
+	frame.Arrived = arrived;
+	frame.Emitted = emitted;
+	frame.Key.storeRelease(id);
+}
+
+void QFrameLatency::presented(int stream, qint64 imageKey, qint64 received, qint64 done)
+{
+	const int s = slot(stream);
+	const int id = imageId(imageKey);
+
+	if (id == 0)
+		return;
+
+	for (int i = 0; i < PendingCount; ++i)
+	{
+		PendingFrame& frame = Pending[s][i];
+		if (frame.Key.loadAcquire() != id)
+			continue;
+
+		const qint64 arrived = frame.Arrived;
+		const qint64 emitted = frame.Emitted;
+
+		// overwritten by a newer frame meanwhile; the fence keeps the reads above before the second look
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (frame.Key.load() != id)
+			return;
+
+		Histograms[s][Queue].record(received - emitted);
+		Histograms[s][Present].record(done - received);
+		Histograms[s][Total].record(done - arrived);
+		return;
+	}
+}
+
+QString QFrameLatency::report() const
+{
+	static const char* const streamNames[StreamCount] = { "color", "depth", "infrared", "body" };
+	static const char* const stageNames[StageCount] = { "acquire", "process", "queue", "present", "total" };
+
+	QString text;
+
+	for (int s = 0; s < StreamCount; ++s)
+	{
+		for (int stage = 0; stage < StageCount; ++stage)
+		{
+			const QLatencyHistogram& histogram = Histograms[s][stage];
+			const quint64 count = histogram.count();
+			if (count == 0)
+				continue;
+
+			text += QString("%1 %2: %3 frames, p50 %4 ms, p99 %5 ms, max %6 ms\n")
+				.arg(streamNames[s], -8)
+				.arg(stageNames[stage], -7)
+				.arg(count)
+				.arg(histogram.percentile(50) / 1e6, 0, 'f', 2)
+				.arg(histogram.percentile(99) / 1e6, 0, 'f', 2)
+				.arg(histogram.maximum() / 1e6, 0, 'f', 2);
+		}
+	}
+
+	return text;
+}
+
+int QFrameLatency::slot(int stream)
+{
+	switch (stream)
+	{
+		case QFrameSource::ColorStream:		return 0;
+		case QFrameSource::DepthStream:		return 1;
+		case QFrameSource::InfraredStream:	return 2;
+		default:							return 3;
+	}
+}
+
+/// <summary>
+/// The image's serial number, which is what tells images apart in QImage::cacheKey()
+/// </summary>
+int QFrameLatency::imageId(qint64 imageKey)
+{
+	return static_cast<int>(imageKey >> 32);
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <QAtomicInt>
+#include <QString>
+
+
+/// <summary>
+/// Histogram of durations in nanoseconds with log-linear buckets: 16 buckets per power
+/// of two, so every bucket is within 1/16 (6%) of its value, from 1 ns to about 36 min.
+/// record() is wait-free and may be called from any thread at the same time as the
+/// queries; a query sees each recorded value either entirely or not at all.
+/// </summary>
+class QLatencyHistogram
+{
+public:
+	enum
+	{
+		SubBucketBits = 4,
+		SubBuckets = 1 << SubBucketBits,
+		MaxExponent = 41,
+		BucketCount = (MaxExponent - SubBucketBits + 1) * SubBuckets
+	};
+
+	void record(qint64 ns);
+	void reset();
+
+	quint64 count() const;
+	qint64 percentile(double p) const;		// upper bound of the bucket holding percentile p (0..100), 0 when empty
+	qint64 maximum() const;					// upper bound of the highest bucket in use
+
+private:
+	static int bucket(qint64 ns);
+	static qint64 upperBound(int bucket);
+
+	QAtomicInt			Counts[BucketCount];
+};
+
+
+/// <summary>
+/// Always-on latency accounting of every frame the grabber emits, per stream and stage.
+///
+/// Times are taken from one monotonic clock, now(). A frame is followed from the moment
+/// its source reported it (the SDK's RelativeTime is on the sensor's clock and cannot be
+/// compared with it) through the read, the conversion and the signal, and, for image
+/// streams whose receiver reports back with presented() (see QImageWidget::setLatency()),
+/// through the queued connection and the receiver's own work.
+/// </summary>
+class QFrameLatency
+{
+public:
+	enum Stage
+	{
+		Acquire,		// source reported the frame -> frame read from the source
+		Process,		// frame read -> signal emitted: wait in the stream's queue, conversion, image
+		Queue,			// signal emitted -> receiver got the image
+		Present,		// receiver got the image -> receiver done with it
+		Total,			// source reported the frame -> receiver done with it
+		StageCount
+	};
+
+	enum { StreamCount = 4 };		// color, depth, infrared, body
+
+	QFrameLatency();
+
+	/// <summary>
+	/// Nanoseconds on the clock every stage is measured with, the same in every thread
+	/// </summary>
+	static qint64 now();
+
+	/// <summary>
+	/// stream is a QFrameSource::Stream flag
+	/// </summary>
+	const QLatencyHistogram& histogram(int stream, Stage stage) const;
+	void reset();
+
+	/// <summary>
+	/// Grabber side, from the thread emitting the stream: the frame was emitted, as image (imageKey = QImage::cacheKey(), 0 for
+	/// frames that are not images) after it arrived and was read at the given times
+	/// </summary>
+	void emitted(int stream, qint64 imageKey, qint64 arrived, qint64 read, qint64 emitted);
+
+	/// <summary>
+	/// Receiver side: an emitted image was received and done with at the given times.
+	/// Images that are not among the last few emitted on the stream are ignored.
+	/// </summary>
+	void presented(int stream, qint64 imageKey, qint64 received, qint64 done);
+
+	/// <summary>
+	/// p50, p99 and maximum of every stage with samples, one line per stream and stage
+	/// </summary>
+	QString report() const;
+
+private:
+	enum { PendingCount = 8 };
+
+	// emitted image waiting for presented(); Key is 0 while the entry is written
+	struct PendingFrame
+	{
+		QAtomicInt		Key;
+		qint64			Arrived;
+		qint64			Emitted;
+	};
+
+	static int slot(int stream);
+	static int imageId(qint64 imageKey);
+
+	QLatencyHistogram	Histograms[StreamCount][StageCount];
+	PendingFrame		Pending[StreamCount][PendingCount];
+	int					NextPending[StreamCount];		// each written by its stream's worker only
+};
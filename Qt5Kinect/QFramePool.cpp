@@ -0,0 +1,237 @@
+#include "stdafx.h"
+#include "QFramePool.h"
+
+
+struct QFramePoolSlot
+{
+	QFramePoolData*				Pool;
+	QAtomicInt					Ref;
+	int							Index;
+	std::vector<unsigned char>	Buffer;
+};
+
+
+// Shared between the owning QFramePool and every buffer handed out, so that images
+// still held by consumers stay valid after the pool (or the grabber) is gone.
+class QFramePoolData
+{
+public:
+	QFramePoolData(int bufferCount, int bufferSize);
+	~QFramePoolData();
+
+	QFrameHandle acquire();
+	void recycle(QFramePoolSlot* slot);
+	void release();
+
+	QAtomicInt						Ref;
+	mutable QMutex					Mutex;
+	std::vector<QFramePoolSlot*>	Slots;
+	std::vector<int>				FreeList;
+	int								BufferSize;
+	quint64							Exhausted;
+};
+
+
+QFramePoolData::QFramePoolData(int bufferCount, int bufferSize) :
+	Ref(1),
+	BufferSize(bufferSize),
+	Exhausted(0)
+{
+	Slots.resize(bufferCount);
+	FreeList.reserve(bufferCount);
+
+	for (int i = 0; i < bufferCount; ++i)
+	{
+		Slots[i] = new QFramePoolSlot;
+		Slots[i]->Pool = this;
+		Slots[i]->Index = i;
+		Slots[i]->Buffer.resize(bufferSize, 0);
+		FreeList.push_back(i);
+	}
+}
+
+QFramePoolData::~QFramePoolData()
+{
+	for (size_t i = 0; i < Slots.size(); ++i)
+		delete Slots[i];
+}
+
+QFrameHandle QFramePoolData::acquire()
+{
+	QMutexLocker lock(&Mutex);
+
+	if (FreeList.empty())
+	{
+		++Exhausted;
+		return QFrameHandle();
+	}
+
+	QFramePoolSlot* slot = Slots[FreeList.back()];
+	FreeList.pop_back();
+
+	// every buffer out of the pool keeps the pool alive
+	Ref.ref();
+	slot->Ref.store(1);
+
+	return QFrameHandle(slot);
+}
+
+void QFramePoolData::recycle(QFramePoolSlot* slot)
+{
+	{
+		QMutexLocker lock(&Mutex);
+		FreeList.push_back(slot->Index);
+	}
+
+	release();
+}
+
+void QFramePoolData::release()
+{
+	if (!Ref.deref())
+		delete this;
+}
+
+
+
+static void ReleaseSlot(QFramePoolSlot* slot)
+{
+	if (slot && !slot->Ref.deref())
+		slot->Pool->recycle(slot);
+}
+
+static void ReleaseImageSlot(void* info)
+{
+	ReleaseSlot(static_cast<QFramePoolSlot*>(info));
+}
+
+
+QFrameHandle::QFrameHandle() : Slot(NULL)
+{
+}
+
+QFrameHandle::QFrameHandle(QFramePoolSlot* slot) : Slot(slot)
+{
+}
+
+QFrameHandle::QFrameHandle(const QFrameHandle& other) : Slot(other.Slot)
+{
+	if (Slot)
+		Slot->Ref.ref();
+}
+
+QFrameHandle::~QFrameHandle()
+{
+	ReleaseSlot(Slot);
+}
+
+QFrameHandle& QFrameHandle::operator=(const QFrameHandle& other)
+{
+	if (other.Slot)
+		other.Slot->Ref.ref();
+
+	ReleaseSlot(Slot);
+	Slot = other.Slot;
+	return *this;
+}
+
+bool QFrameHandle::isNull() const
+{
+	return Slot == NULL;
+}
+
+bool QFrameHandle::isShared() const
+{
+	return Slot && Slot->Ref.load() > 1;
+}
+
+void QFrameHandle::reset()
+{
+	ReleaseSlot(Slot);
+	Slot = NULL;
+}
+
+unsigned char* QFrameHandle::data() const
+{
+	return Slot ? Slot->Buffer.data() : NULL;
+}
+
+int QFrameHandle::size() const
+{
+	return Slot ? static_cast<int>(Slot->Buffer.size()) : 0;
+}
+
+QImage QFrameHandle::toImage(int width, int height, int bytesPerLine, QImage::Format format) const
+{
+	if (!Slot)
+		return QImage();
+
+	Slot->Ref.ref();
+
+	// const data: a consumer that writes to the image detaches instead of touching the pool
+	return QImage(const_cast<const uchar*>(Slot->Buffer.data()), width, height, bytesPerLine, format, ReleaseImageSlot, Slot);
+}
+
+
+
+QFramePool::QFramePool(int bufferCount, int bufferSize) :
+	Data(new QFramePoolData(bufferCount, bufferSize)),
+	RetiredExhausted(0)
+{
+}
+
+QFramePool::~QFramePool()
+{
+	Data->release();
+}
+
+void QFramePool::reset(int bufferCount, int bufferSize)
+{
+	// allocated before taking the lock, the readers never wait for it
+	QFramePoolData* data = new QFramePoolData(bufferCount, bufferSize);
+	QFramePoolData* previous = NULL;
+
+	{
+		QMutexLocker lock(&Mutex);
+		previous = Data;
+
+		{
+			QMutexLocker dataLock(&previous->Mutex);
+			RetiredExhausted += previous->Exhausted;
+		}
+
+		Data = data;
+	}
+
+	// readers only touch Data under Mutex, none is left on the previous one
+	previous->release();
+}
+
+QFrameHandle QFramePool::acquire()
+{
+	return Data->acquire();
+}
+
+int QFramePool::bufferCount() const
+{
+	return static_cast<int>(Data->Slots.size());
+}
+
+int QFramePool::bufferSize() const
+{
+	return Data->BufferSize;
+}
+
+int QFramePool::available() const
+{
+	QMutexLocker lock(&Mutex);
+	QMutexLocker dataLock(&Data->Mutex);
+	return static_cast<int>(Data->FreeList.size());
+}
+
+quint64 QFramePool::exhaustedCount() const
+{
+	QMutexLocker lock(&Mutex);
+	QMutexLocker dataLock(&Data->Mutex);
+	return RetiredExhausted + Data->Exhausted;
+}
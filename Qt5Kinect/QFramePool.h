@@ -0,0 +1,79 @@
+#pragma once
+
+#include <QImage>
+#include <QMutex>
+#include <vector>
+
+
+class QFramePoolData;
+struct QFramePoolSlot;
+
+
+/// <summary>
+/// Reference counted handle to one buffer of a QFramePool.
+/// The buffer goes back to the pool when the last handle, or the last QImage built
+/// with toImage(), is released.
+/// </summary>
+class QFrameHandle
+{
+public:
+	QFrameHandle();
+	QFrameHandle(const QFrameHandle& other);
+	~QFrameHandle();
+	QFrameHandle& operator=(const QFrameHandle& other);
+
+	bool isNull() const;
+	bool isShared() const;
+	void reset();
+
+	unsigned char* data() const;
+	int size() const;
+
+	/// <summary>
+	/// Wrap the buffer in a read-only QImage without copying it.
+	/// The image keeps the buffer out of the pool until it is destroyed.
+	/// </summary>
+	QImage toImage(int width, int height, int bytesPerLine, QImage::Format format) const;
+
+private:
+	friend class QFramePoolData;
+	explicit QFrameHandle(QFramePoolSlot* slot);
+
+	QFramePoolSlot*	Slot;
+};
+
+
+/// <summary>
+/// Fixed set of preallocated frame buffers handed out as QFrameHandle.
+/// Nothing is allocated after construction (or reset()); when every buffer is in use
+/// acquire() returns a null handle and the miss is counted.
+///
+/// reset(), acquire(), bufferCount() and bufferSize() belong to the thread that owns the
+/// pool; available() and exhaustedCount() may be called from any thread, also while the
+/// owner resets the pool.
+/// </summary>
+class QFramePool
+{
+public:
+	QFramePool(int bufferCount = 0, int bufferSize = 0);
+	~QFramePool();
+
+	/// <summary>
+	/// Replace the buffers. Handles still alive keep their old buffer until released.
+	/// </summary>
+	void reset(int bufferCount, int bufferSize);
+
+	QFrameHandle acquire();
+
+	int bufferCount() const;
+	int bufferSize() const;
+	int available() const;
+	quint64 exhaustedCount() const;			// since construction, across reset()
+
+private:
+	mutable QMutex	Mutex;					// guards the swap of Data against the readers on other threads
+	QFramePoolData*	Data;
+	quint64			RetiredExhausted;		// misses of the buffer sets reset() replaced
+
+	Q_DISABLE_COPY(QFramePool);
+};
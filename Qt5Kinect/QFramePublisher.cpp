@@ -0,0 +1,199 @@
+#include "stdafx.h"
+#include "QFramePublisher.h"
+#include "QFrameSource.h"
+#include <QSharedMemory>
+#include <atomic>
+
+
+using namespace QFrameSharedRing;
+
+
+QFramePublisher::QFramePublisher() :
+	Open(false),
+	SlotCount(DefaultSlotCount),
+	Published(0),
+	Dropped(0)
+{
+	for (int s = 0; s < StreamCount; ++s)
+	{
+		Segments[s] = NULL;
+		Failed[s] = false;
+	}
+}
+
+QFramePublisher::~QFramePublisher()
+{
+	close();
+}
+
+
+bool QFramePublisher::open(const QString& name, int slotCount)
+{
+	close();
+
+	if (name.isEmpty())
+	{
+		std::cerr << "<Error> A shared frame ring needs a name" << std::endl;
+		return false;
+	}
+
+	QMutexLocker lock(&Mutex);
+
+	Name = name;
+	SlotCount = qMax(slotCount, 2);
+	Published = 0;
+	Dropped = 0;
+	Open = true;
+	return true;
+}
+
+void QFramePublisher::close()
+{
+	QMutexLocker lock(&Mutex);
+
+	// a segment outlives the publisher while readers are attached to it
+	for (int s = 0; s < StreamCount; ++s)
+	{
+		delete Segments[s];
+		Segments[s] = NULL;
+		Failed[s] = false;
+	}
+
+	Open = false;
+}
+
+bool QFramePublisher::isOpen() const
+{
+	QMutexLocker lock(&Mutex);
+	return Open;
+}
+
+QString QFramePublisher::name() const
+{
+	QMutexLocker lock(&Mutex);
+	return Name;
+}
+
+
+/// <summary>
+/// The stream's segment, created for frames of size bytes on its first frame
+/// </summary>
+QSharedMemory* QFramePublisher::segment(int stream, int size)
+{
+	const int s = slot(stream);
+	if (s < 0 || Failed[s])
+		return NULL;
+
+	if (Segments[s])
+		return Segments[s];
+
+	QSharedMemory* memory = new QSharedMemory(key(Name, stream));
+	const quint32 slotSize = static_cast<quint32>(aligned(size));
+
+	if (memory->create(static_cast<int>(segmentSize(SlotCount, slotSize))))
+	{
+		memset(memory->data(), 0, memory->size());
+
+		Header* header = static_cast<Header*>(memory->data());
+		header->Version = Version;
+		header->Stream = static_cast<quint32>(stream);
+		header->SlotCount = static_cast<quint32>(SlotCount);
+		header->SlotSize = slotSize;
+		header->Published.storeRelease(0);
+
+		// readers may attach as soon as the segment exists, Magic tells them the header is complete
+		std::atomic_thread_fence(std::memory_order_release);
+		header->Magic = Magic;
+	}
+	else if (memory->error() == QSharedMemory::AlreadyExists && memory->attach())
+	{
+		// left by an earlier publisher; its readers keep their place if the frames still fit
+		const Header* header = static_cast<const Header*>(memory->data());
+		if (memory->size() < static_cast<int>(sizeof(Header)) || header->Magic != Magic || header->Version != Version ||
+			header->Stream != static_cast<quint32>(stream) || header->SlotSize < static_cast<quint32>(size) ||
+			memory->size() < static_cast<int>(segmentSize(header->SlotCount, header->SlotSize)))
+		{
+			std::cerr << "<Error> Shared frame ring " << memory->key().toStdString() << " exists with another layout" << std::endl;
+			delete memory;
+			Failed[s] = true;
+			return NULL;
+		}
+	}
+	else
+	{
+		std::cerr << "<Error> Could not create shared frame ring " << memory->key().toStdString() << ": "
+			<< memory->errorString().toStdString() << std::endl;
+		delete memory;
+		Failed[s] = true;
+		return NULL;
+	}
+
+	Segments[s] = memory;
+	return memory;
+}
+
+
+bool QFramePublisher::publish(int stream, QFrameRecording::Format format, int width, int height, qint64 time, const void* data, int size)
+{
+	QMutexLocker lock(&Mutex);
+
+	if (!Open)
+	{
+		return false;
+	}
+
+	QSharedMemory* memory = segment(stream, size);
+	Header* header = memory ? static_cast<Header*>(memory->data()) : NULL;
+
+	if (!header || size < 0 || static_cast<quint32>(size) > header->SlotSize)
+	{
+		++Dropped;
+		return false;
+	}
+
+	// only this side writes Published, a relaxed load sees its own last store
+	const quint32 n = static_cast<quint32>(header->Published.load());
+	Slot* target = QFrameSharedRing::slot(header, n % header->SlotCount);
+
+	// odd first, with a full barrier: no reader sees the new payload under the old Sequence
+	target->Sequence.fetchAndStoreOrdered(static_cast<int>(2 * n + 1));
+
+	target->Format = format;
+	target->Width = width;
+	target->Height = height;
+	target->Time = time;
+	target->Size = static_cast<quint32>(size);
+	memcpy(payload(target), data, size);
+
+	target->Sequence.storeRelease(static_cast<int>(2 * n + 2));
+	header->Published.storeRelease(static_cast<int>(n + 1));
+
+	++Published;
+	return true;
+}
+
+
+quint64 QFramePublisher::publishedCount() const
+{
+	QMutexLocker lock(&Mutex);
+	return Published;
+}
+
+quint64 QFramePublisher::droppedCount() const
+{
+	QMutexLocker lock(&Mutex);
+	return Dropped;
+}
+
+
+int QFramePublisher::slot(int stream)
+{
+	switch (stream)
+	{
+		case QFrameSource::ColorStream:		return 0;
+		case QFrameSource::DepthStream:		return 1;
+		case QFrameSource::InfraredStream:	return 2;
+		case QFrameSource::BodyStream:		return 3;
+		default:							return -1;
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "QFrameSharedRing.h"
+#include "QFrameRecording.h"
+#include <QString>
+#include <QMutex>
+
+class QSharedMemory;
+
+
+/// <summary>
+/// Writes every frame into a named QFrameSharedRing per stream, for QFrameSharedReader
+/// in other processes: several applications on one machine share the sensor that only
+/// one of them can open.
+///
+/// A stream's segment is created on its first frame, with slots of that frame's size;
+/// a larger frame later is dropped and counted. A segment left by an earlier publisher
+/// of the same name, kept alive by readers still attached, is reused as it is when its
+/// slots are large enough, so those readers carry on. publish() copies the frame into its
+/// slot and returns; it never waits for a reader. One publisher per name.
+/// </summary>
+class QFramePublisher
+{
+public:
+	enum { StreamCount = 4 };
+
+	QFramePublisher();
+	~QFramePublisher();
+
+	bool open(const QString& name, int slotCount = QFrameSharedRing::DefaultSlotCount);
+	void close();
+	bool isOpen() const;
+	QString name() const;
+
+	/// <summary>
+	/// Copy one frame into the ring of its stream. Returns false if it was dropped:
+	/// not open, no segment or larger than the segment's slots.
+	/// </summary>
+	bool publish(int stream, QFrameRecording::Format format, int width, int height, qint64 time, const void* data, int size);
+
+	quint64 publishedCount() const;
+	quint64 droppedCount() const;
+
+private:
+	QSharedMemory* segment(int stream, int size);
+	static int slot(int stream);
+
+	mutable QMutex		Mutex;
+	bool				Open;
+	QString				Name;
+	int					SlotCount;
+	QSharedMemory*		Segments[StreamCount];
+	bool				Failed[StreamCount];	// the segment could not be created, not retried until the next open()
+	quint64				Published;
+	quint64				Dropped;
+
+	Q_DISABLE_COPY(QFramePublisher);
+};
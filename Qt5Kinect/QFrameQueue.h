@@ -0,0 +1,200 @@
+#pragma once
+
+#include <QMutex>
+#include <QWaitCondition>
+#include <vector>
+
+
+/// <summary>
+/// Bounded queue of frames between one producer and one consumer thread, dropping the
+/// oldest frame when full.
+///
+/// Frames live in capacity + 2 preallocated slots, so both sides work on a slot in place
+/// and nothing is copied or allocated per frame: the producer fills the slot it got from
+/// acquire() and push()es it, the consumer pop()s the oldest queued slot and release()s
+/// it when done. A push() into a full queue hands its oldest frame back to the free slots
+/// and counts it as dropped, so the producer is never blocked by a slow consumer and the
+/// consumer never works more than capacity frames behind.
+/// </summary>
+template <typename T>
+class QFrameQueue
+{
+public:
+	enum { DefaultCapacity = 2 };
+
+	QFrameQueue() :
+		Head(0),
+		Count(0),
+		Woken(false),
+		Dropped(0),
+		Pushed(0)
+	{
+		reset(DefaultCapacity);
+	}
+
+	/// <summary>
+	/// Replace the slots. Only safe while neither side is running.
+	/// </summary>
+	void reset(int capacity)
+	{
+		capacity = qMax(capacity, 1);
+
+		Slots.assign(capacity + 2, T());
+		Queue.assign(capacity, static_cast<T*>(NULL));
+		Free.clear();
+		for (size_t i = 0; i < Slots.size(); ++i)
+			Free.push_back(&Slots[i]);
+
+		Head = 0;
+		Count = 0;
+		Woken = false;
+	}
+
+	/// <summary>
+	/// Calls f on every slot. Only safe while neither side is running.
+	/// </summary>
+	template <typename Func>
+	void initialize(Func f)
+	{
+		for (size_t i = 0; i < Slots.size(); ++i)
+			f(Slots[i]);
+	}
+
+	int capacity() const
+	{
+		return static_cast<int>(Queue.size());
+	}
+
+	/// <summary>
+	/// Producer: a free slot to fill. There always is one, the consumer holding at most
+	/// one slot and the queue at most capacity.
+	/// </summary>
+	T* acquire()
+	{
+		QMutexLocker lock(&Mutex);
+		T* slot = Free.back();
+		Free.pop_back();
+		return slot;
+	}
+
+	/// <summary>
+	/// Producer: queue a filled slot, dropping the oldest queued frame if the queue is full
+	/// </summary>
+	void push(T* slot)
+	{
+		QMutexLocker lock(&Mutex);
+
+		if (Count == capacity())
+		{
+			Free.push_back(Queue[Head]);
+			Head = (Head + 1) % capacity();
+			--Count;
+			++Dropped;
+		}
+
+		Queue[(Head + Count) % capacity()] = slot;
+		++Count;
+		++Pushed;
+		NotEmpty.wakeOne();
+	}
+
+	/// <summary>
+	/// Either side: give back a slot that was acquired or popped
+	/// </summary>
+	void release(T* slot)
+	{
+		QMutexLocker lock(&Mutex);
+		Free.push_back(slot);
+	}
+
+	/// <summary>
+	/// Consumer: the oldest queued frame, waiting up to timeoutMs for one. NULL on timeout
+	/// or when wake() was called.
+	/// </summary>
+	T* pop(unsigned long timeoutMs)
+	{
+		QMutexLocker lock(&Mutex);
+
+		if (Count == 0 && !Woken)
+			NotEmpty.wait(&Mutex, timeoutMs);
+
+		if (Woken)
+		{
+			Woken = false;
+			return NULL;
+		}
+
+		if (Count == 0)
+			return NULL;
+
+		T* slot = Queue[Head];
+		Head = (Head + 1) % capacity();
+		--Count;
+		return slot;
+	}
+
+	/// <summary>
+	/// Make a pending or the next pop() return NULL. May be called from any thread.
+	/// </summary>
+	void wake()
+	{
+		QMutexLocker lock(&Mutex);
+		Woken = true;
+		NotEmpty.wakeAll();
+	}
+
+	/// <summary>
+	/// Drop every queued frame without counting it, e.g. once the consumer stopped
+	/// </summary>
+	void clear()
+	{
+		QMutexLocker lock(&Mutex);
+
+		for (; Count > 0; --Count)
+		{
+			Free.push_back(Queue[Head]);
+			Head = (Head + 1) % capacity();
+		}
+
+		Woken = false;
+	}
+
+	int depth() const
+	{
+		QMutexLocker lock(&Mutex);
+		return Count;
+	}
+
+	quint64 droppedCount() const
+	{
+		QMutexLocker lock(&Mutex);
+		return Dropped;
+	}
+
+	quint64 pushedCount() const
+	{
+		QMutexLocker lock(&Mutex);
+		return Pushed;
+	}
+
+	void resetCounts()
+	{
+		QMutexLocker lock(&Mutex);
+		Dropped = 0;
+		Pushed = 0;
+	}
+
+private:
+	mutable QMutex		Mutex;
+	QWaitCondition		NotEmpty;
+	std::vector<T>		Slots;
+	std::vector<T*>		Queue;			// ring of capacity entries, Count of them from Head
+	std::vector<T*>		Free;
+	int					Head;
+	int					Count;
+	bool				Woken;
+	quint64				Dropped;
+	quint64				Pushed;
+
+	Q_DISABLE_COPY(QFrameQueue);
+};
@@ -0,0 +1,298 @@
+#include "stdafx.h"
+#include "QFrameRecorder.h"
+#include <QElapsedTimer>
+#include <cstring>
+
+
+// How long the writer waits for a full block to accumulate before writing what it has
+#define PartialBlockTimeout 50
+
+// Index entries reserved up front, a few minutes of every stream at 30 fps
+#define IndexReserve 32768
+
+
+
+class QFrameRecorderThread : public QThread
+{
+public:
+	QFrameRecorderThread(QFrameRecorder* recorder) : Recorder(recorder)
+	{
+	}
+
+protected:
+	void run() Q_DECL_OVERRIDE
+	{
+		Recorder->drain();
+	}
+
+private:
+	QFrameRecorder*	Recorder;
+};
+
+
+
+QFrameRecorder::QFrameRecorder() :
+	Writer(NULL),
+	Open(false),
+	Closing(false),
+	Failed(false),
+	BlockSize(DefaultBlockSize),
+	Head(0),
+	Tail(0),
+	WriteNanoseconds(0),
+	Frames(0),
+	Dropped(0)
+{
+}
+
+QFrameRecorder::~QFrameRecorder()
+{
+	close();
+}
+
+bool QFrameRecorder::open(const QString& fileName, int ringSize, int blockSize)
+{
+	QMutexLocker api(&WriteMutex);
+
+	finish();
+
+	File.setFileName(fileName);
+	if (!File.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered))
+	{
+		std::cerr << "<Error> Could not create recording " << fileName.toStdString() << std::endl;
+		return false;
+	}
+
+	QFrameRecording::Header header;
+	memcpy(header.Magic, QFrameRecording::HeaderMagic, sizeof(header.Magic));
+	header.Version = QFrameRecording::Version;
+	header.Reserved = 0;
+
+	if (File.write(reinterpret_cast<const char*>(&header), sizeof(header)) != sizeof(header))
+	{
+		std::cerr << "<Error> Could not write recording " << fileName.toStdString() << std::endl;
+		File.close();
+		return false;
+	}
+
+	// allocated (and touched) once here, so the first frames do not page fault
+	if (static_cast<int>(Ring.size()) != ringSize)
+	{
+		Ring.clear();
+		Ring.resize(qMax(ringSize, blockSize), 0);
+	}
+
+	Index.clear();
+	Index.reserve(IndexReserve);
+
+	{
+		QMutexLocker lock(&Mutex);
+		BlockSize = qMax(blockSize, 4096);
+		Head = sizeof(header);
+		Tail = sizeof(header);
+		WriteNanoseconds = 0;
+		Frames = 0;
+		Dropped = 0;
+		Closing = false;
+		Failed = false;
+		Open = true;
+	}
+
+	Writer = new QFrameRecorderThread(this);
+	Writer->start();
+	return true;
+}
+
+void QFrameRecorder::close()
+{
+	QMutexLocker api(&WriteMutex);
+	finish();
+}
+
+void QFrameRecorder::finish()
+{
+	if (!Writer)
+		return;
+
+	{
+		QMutexLocker lock(&Mutex);
+		Closing = true;
+		Pending.wakeOne();
+	}
+
+	Writer->wait();
+	delete Writer;
+	Writer = NULL;
+
+	// the writer is gone, the file is ours again
+	if (!Failed)
+	{
+		QFrameRecording::Footer footer;
+		footer.IndexOffset = Tail;
+		footer.IndexCount = Index.size();
+		footer.Magic = QFrameRecording::FooterMagic;
+		footer.Version = QFrameRecording::Version;
+
+		const qint64 indexBytes = static_cast<qint64>(Index.size() * sizeof(QFrameRecording::IndexEntry));
+
+		if ((indexBytes && File.write(reinterpret_cast<const char*>(Index.data()), indexBytes) != indexBytes) ||
+			File.write(reinterpret_cast<const char*>(&footer), sizeof(footer)) != sizeof(footer))
+		{
+			std::cerr << "<Error> Could not write the recording index" << std::endl;
+		}
+	}
+
+	File.close();
+
+	QMutexLocker lock(&Mutex);
+	Open = false;
+}
+
+bool QFrameRecorder::isOpen() const
+{
+	QMutexLocker lock(&Mutex);
+	return Open;
+}
+
+bool QFrameRecorder::write(int stream, QFrameRecording::Format format, int width, int height, qint64 time, const void* data, int size)
+{
+	QMutexLocker api(&WriteMutex);
+
+	const quint64 padded = QFrameRecording::paddedSize(size);
+	const quint64 chunkSize = sizeof(QFrameRecording::ChunkHeader) + padded;
+
+	{
+		QMutexLocker lock(&Mutex);
+
+		if (!Open || Failed)
+			return false;
+
+		// never wait for the disk, a full ring costs a frame
+		if (chunkSize > Ring.size() - (Head - Tail))
+		{
+			++Dropped;
+			return false;
+		}
+	}
+
+	// only this side moves Head, and the writer does not read past it
+	const quint64 offset = Head;
+
+	QFrameRecording::ChunkHeader header;
+	header.Magic = QFrameRecording::ChunkMagic;
+	header.Stream = stream;
+	header.Format = format;
+	header.Size = size;
+	header.Width = width;
+	header.Height = height;
+	header.Time = time;
+
+	static const char padding[QFrameRecording::ChunkAlignment] = { 0 };
+
+	copyToRing(offset, &header, sizeof(header));
+	copyToRing(offset + sizeof(header), data, size);
+	copyToRing(offset + sizeof(header) + size, padding, padded - size);
+
+	QFrameRecording::IndexEntry entry;
+	entry.Time = time;
+	entry.Offset = offset;
+	entry.Stream = stream;
+	entry.Size = size;
+	Index.push_back(entry);
+
+	QMutexLocker lock(&Mutex);
+	Head = offset + chunkSize;
+	++Frames;
+	Pending.wakeOne();
+	return true;
+}
+
+void QFrameRecorder::copyToRing(quint64 offset, const void* data, quint64 size)
+{
+	const quint64 ringSize = Ring.size();
+	const quint64 position = offset % ringSize;
+	const quint64 first = qMin(size, ringSize - position);
+
+	memcpy(&Ring[position], data, first);
+	if (first < size)
+		memcpy(&Ring[0], static_cast<const char*>(data) + first, size - first);
+}
+
+/// <summary>
+/// Writer thread: hands the ring to the file a block at a time
+/// </summary>
+void QFrameRecorder::drain()
+{
+	QElapsedTimer timer;
+	const quint64 ringSize = Ring.size();
+
+	for (;;)
+	{
+		quint64 tail;
+		quint64 pending;
+		{
+			QMutexLocker lock(&Mutex);
+
+			while (Head == Tail && !Closing)
+				Pending.wait(&Mutex);
+
+			// small writes are what makes a disk fall behind, give the block a chance to fill
+			timer.start();
+			while (Head - Tail < static_cast<quint64>(BlockSize) && !Closing && timer.elapsed() < PartialBlockTimeout)
+				Pending.wait(&Mutex, PartialBlockTimeout - timer.elapsed());
+
+			if (Head == Tail)
+			{
+				if (Closing)
+					return;
+				continue;
+			}
+
+			tail = Tail;
+			pending = Head - Tail;
+		}
+
+		const quint64 position = tail % ringSize;
+		const qint64 size = static_cast<qint64>(qMin(qMin(pending, ringSize - position), static_cast<quint64>(BlockSize)));
+
+		timer.start();
+		const bool written = File.write(&Ring[position], size) == size;
+		const qint64 elapsed = timer.nsecsElapsed();
+
+		QMutexLocker lock(&Mutex);
+
+		if (!written)
+		{
+			std::cerr << "<Error> Recording write failed, recording stopped: " << File.errorString().toStdString() << std::endl;
+			Failed = true;
+			return;
+		}
+
+		Tail += size;
+		WriteNanoseconds += elapsed;
+	}
+}
+
+quint64 QFrameRecorder::frameCount() const
+{
+	QMutexLocker lock(&Mutex);
+	return Frames;
+}
+
+quint64 QFrameRecorder::droppedCount() const
+{
+	QMutexLocker lock(&Mutex);
+	return Dropped;
+}
+
+quint64 QFrameRecorder::bytesWritten() const
+{
+	QMutexLocker lock(&Mutex);
+	return Tail;
+}
+
+double QFrameRecorder::writeRate() const
+{
+	QMutexLocker lock(&Mutex);
+	return WriteNanoseconds ? (Tail * 1000.0) / WriteNanoseconds : 0.0;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "QFrameRecording.h"
+#include <QString>
+#include <QFile>
+#include <QMutex>
+#include <QWaitCondition>
+#include <vector>
+
+
+class QFrameRecorderThread;
+
+
+/// <summary>
+/// Appends raw frames to a QFrameRecording file.
+///
+/// write() only copies the frame into a preallocated ring buffer and returns; a writer
+/// thread drains the ring to the file in large sequential writes, so the caller never
+/// waits for the disk. If the disk falls behind far enough to fill the ring, frames are
+/// dropped and counted instead of stalling the caller. close() flushes the ring and
+/// appends the index.
+/// </summary>
+class QFrameRecorder
+{
+public:
+	enum
+	{
+		DefaultRingSize = 256 * 1024 * 1024,		// about 30 frames of every stream, 1 s at 30 fps
+		DefaultBlockSize = 4 * 1024 * 1024
+	};
+
+	QFrameRecorder();
+	~QFrameRecorder();
+
+	/// <summary>
+	/// Create (or truncate) the file and start the writer thread
+	/// </summary>
+	bool open(const QString& fileName, int ringSize = DefaultRingSize, int blockSize = DefaultBlockSize);
+	void close();
+	bool isOpen() const;
+
+	/// <summary>
+	/// Queue one frame. Returns false if it was dropped because the ring is full,
+	/// or if the recorder is not open.
+	/// </summary>
+	bool write(int stream, QFrameRecording::Format format, int width, int height, qint64 time, const void* data, int size);
+
+	quint64 frameCount() const;
+	quint64 droppedCount() const;
+	quint64 bytesWritten() const;		// reached the file so far
+	double writeRate() const;			// MB/s of the writer thread while writing
+
+private:
+	friend class QFrameRecorderThread;
+
+	void copyToRing(quint64 offset, const void* data, quint64 size);
+	void drain();
+	void finish();
+
+	QMutex								WriteMutex;		// serializes write(), open() and close()
+	mutable QMutex						Mutex;			// ring positions, flags and counters
+	QWaitCondition						Pending;
+	QFile								File;
+	QFrameRecorderThread*				Writer;
+	bool								Open;
+	bool								Closing;
+	bool								Failed;
+
+	std::vector<char>					Ring;
+	int									BlockSize;
+	quint64								Head;			// bytes queued since open, also the file offset of the next chunk
+	quint64								Tail;			// bytes written to the file
+	qint64								WriteNanoseconds;
+
+	std::vector<QFrameRecording::IndexEntry> Index;	// touched by write() and close() only
+	quint64								Frames;
+	quint64								Dropped;
+
+	Q_DISABLE_COPY(QFrameRecorder);
+};
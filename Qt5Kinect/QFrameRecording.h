@@ -0,0 +1,79 @@
+#pragma once
+
+#include <QtGlobal>
+
+
+/// <summary>
+/// On-disk layout of a recorded session, written by QFrameRecorder.
+///
+///   QFrameRecordingHeader
+///   QFrameChunkHeader, payload (padded to ChunkAlignment)   one per frame, in arrival order
+///   ...
+///   QFrameIndexEntry x IndexCount                           time -> offset of every chunk
+///   QFrameRecordingFooter
+///
+/// Every field is little endian and naturally aligned. The file is append-only: a
+/// recording that was cut short has no index and footer, but every complete chunk
+/// before the cut can still be found by walking the chunk headers.
+/// </summary>
+namespace QFrameRecording
+{
+	enum
+	{
+		Version = 1,
+		ChunkAlignment = 8
+	};
+
+	enum Format
+	{
+		Bgra32,			// 4 bytes per pixel, QImage::Format_ARGB32 byte order
+		Yuy2,			// raw color, 2 bytes per pixel
+		Gray16,			// depth (mm) or infrared
+		BodyFrame,		// one QKinectBodyFrame
+		Gray16Rvl		// Gray16 coded with QDepthCodec
+	};
+
+	// "QKREC" + version
+	static const char HeaderMagic[8] = { 'Q', 'K', 'R', 'E', 'C', 0, 0, 1 };
+	static const quint32 ChunkMagic = 0x4843514B;		// "KQCH"
+	static const quint32 FooterMagic = 0x5844494B;		// "KIDX"
+
+	struct Header
+	{
+		char		Magic[8];
+		quint32		Version;
+		quint32		Reserved;
+	};
+
+	struct ChunkHeader
+	{
+		quint32		Magic;
+		quint32		Stream;			// QFrameSource::Stream
+		quint32		Format;			// QFrameRecording::Format
+		quint32		Size;			// payload bytes, without padding
+		qint32		Width;
+		qint32		Height;
+		qint64		Time;			// RelativeTime, 100 ns ticks
+	};
+
+	struct IndexEntry
+	{
+		qint64		Time;
+		quint64		Offset;			// of the chunk header
+		quint32		Stream;
+		quint32		Size;
+	};
+
+	struct Footer
+	{
+		quint64		IndexOffset;
+		quint64		IndexCount;
+		quint32		Magic;
+		quint32		Version;
+	};
+
+	inline quint64 paddedSize(quint64 size)
+	{
+		return (size + ChunkAlignment - 1) & ~quint64(ChunkAlignment - 1);
+	}
+}
@@ -0,0 +1,228 @@
+#include "stdafx.h"
+#include "QFrameRecordingReader.h"
+#include <cstring>
+
+
+// Length of one find() bucket in 100 ns ticks, a third of a frame period at 30 fps
+#define BucketLength 111111
+
+// The bucket table is kept below this many entries by lengthening the buckets
+#define MaxBuckets (4 * 1024 * 1024)
+
+
+
+QFrameRecordingReader::QFrameRecordingReader() :
+	Data(NULL),
+	Size(0),
+	BucketTicks(BucketLength),
+	Streams(0)
+{
+}
+
+QFrameRecordingReader::~QFrameRecordingReader()
+{
+	close();
+}
+
+bool QFrameRecordingReader::open(const QString& fileName)
+{
+	close();
+
+	File.setFileName(fileName);
+	if (!File.open(QIODevice::ReadOnly))
+	{
+		std::cerr << "<Error> Could not open recording " << fileName.toStdString() << std::endl;
+		return false;
+	}
+
+	Size = File.size();
+	Data = Size >= sizeof(QFrameRecording::Header) ? File.map(0, Size) : NULL;
+
+	if (!Data || memcmp(Data, QFrameRecording::HeaderMagic, sizeof(QFrameRecording::HeaderMagic)) != 0)
+	{
+		std::cerr << "<Error> Not a recording, or too large to map: " << fileName.toStdString() << std::endl;
+		close();
+		return false;
+	}
+
+	if (!loadIndex())
+	{
+		std::cerr << "<Warning> Recording has no index, it was probably cut short. Scanning it" << std::endl;
+		rebuildIndex();
+	}
+
+	Streams = 0;
+	for (size_t i = 0; i < Index.size(); ++i)
+		Streams |= Index[i].Stream;
+
+	buildBuckets();
+	return true;
+}
+
+void QFrameRecordingReader::close()
+{
+	if (Data)
+	{
+		File.unmap(Data);
+		Data = NULL;
+	}
+
+	File.close();
+	Size = 0;
+	Index.clear();
+	Latest.clear();
+	Buckets.clear();
+	Streams = 0;
+}
+
+bool QFrameRecordingReader::isOpen() const
+{
+	return Data != NULL;
+}
+
+int QFrameRecordingReader::count() const
+{
+	return static_cast<int>(Index.size());
+}
+
+const QFrameRecording::IndexEntry& QFrameRecordingReader::entry(int i) const
+{
+	return Index[i];
+}
+
+const QFrameRecording::ChunkHeader& QFrameRecordingReader::chunk(int i) const
+{
+	return *reinterpret_cast<const QFrameRecording::ChunkHeader*>(Data + Index[i].Offset);
+}
+
+const unsigned char* QFrameRecordingReader::payload(int i) const
+{
+	return Data + Index[i].Offset + sizeof(QFrameRecording::ChunkHeader);
+}
+
+int QFrameRecordingReader::streams() const
+{
+	return Streams;
+}
+
+qint64 QFrameRecordingReader::startTime() const
+{
+	return Index.empty() ? 0 : Index.front().Time;
+}
+
+qint64 QFrameRecordingReader::endTime() const
+{
+	return Latest.empty() ? 0 : Latest.back();
+}
+
+int QFrameRecordingReader::find(qint64 time) const
+{
+	if (Index.empty() || time <= Latest.front())
+		return 0;
+	if (time > Latest.back())
+		return count();
+
+	// the bucket gives the first chunk of its time range, the rest is a short walk within it
+	int i = Buckets[static_cast<size_t>((time - Latest.front()) / BucketTicks)];
+	while (Latest[i] < time)
+		++i;
+
+	return i;
+}
+
+
+bool QFrameRecordingReader::loadIndex()
+{
+	const quint64 headerSize = sizeof(QFrameRecording::Header);
+	if (Size < headerSize + sizeof(QFrameRecording::Footer))
+		return false;
+
+	QFrameRecording::Footer footer;
+	memcpy(&footer, Data + Size - sizeof(footer), sizeof(footer));
+
+	const quint64 indexBytes = footer.IndexCount * sizeof(QFrameRecording::IndexEntry);
+
+	if (footer.Magic != QFrameRecording::FooterMagic || footer.IndexOffset < headerSize ||
+		footer.IndexOffset + indexBytes + sizeof(footer) != Size)
+	{
+		return false;
+	}
+
+	const QFrameRecording::IndexEntry* entries = reinterpret_cast<const QFrameRecording::IndexEntry*>(Data + footer.IndexOffset);
+	Index.assign(entries, entries + footer.IndexCount);
+
+	// an index pointing outside the chunks is as good as none
+	for (size_t i = 0; i < Index.size(); ++i)
+	{
+		if (Index[i].Offset + sizeof(QFrameRecording::ChunkHeader) + Index[i].Size > footer.IndexOffset)
+		{
+			Index.clear();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void QFrameRecordingReader::rebuildIndex()
+{
+	Index.clear();
+
+	quint64 offset = sizeof(QFrameRecording::Header);
+
+	while (offset + sizeof(QFrameRecording::ChunkHeader) <= Size)
+	{
+		QFrameRecording::ChunkHeader header;
+		memcpy(&header, Data + offset, sizeof(header));
+
+		const quint64 chunkSize = sizeof(header) + QFrameRecording::paddedSize(header.Size);
+
+		if (header.Magic != QFrameRecording::ChunkMagic || offset + chunkSize > Size)
+			break;
+
+		QFrameRecording::IndexEntry entry;
+		entry.Time = header.Time;
+		entry.Offset = offset;
+		entry.Stream = header.Stream;
+		entry.Size = header.Size;
+		Index.push_back(entry);
+
+		offset += chunkSize;
+	}
+}
+
+void QFrameRecordingReader::buildBuckets()
+{
+	Latest.resize(Index.size());
+	Buckets.clear();
+
+	if (Index.empty())
+		return;
+
+	// chunks are in arrival order and streams may interleave slightly out of time order,
+	// the running maximum is what makes the search monotonic
+	qint64 latest = Index[0].Time;
+	for (size_t i = 0; i < Index.size(); ++i)
+	{
+		latest = qMax(latest, Index[i].Time);
+		Latest[i] = latest;
+	}
+
+	const qint64 span = Latest.back() - Latest.front();
+
+	BucketTicks = BucketLength;
+	while (span / BucketTicks >= MaxBuckets)
+		BucketTicks *= 2;
+
+	const size_t bucketCount = static_cast<size_t>(span / BucketTicks) + 1;
+	Buckets.resize(bucketCount);
+
+	size_t i = 0;
+	for (size_t b = 0; b < bucketCount; ++b)
+	{
+		const qint64 bucketStart = Latest.front() + static_cast<qint64>(b) * BucketTicks;
+		while (Latest[i] < bucketStart)
+			++i;
+		Buckets[b] = static_cast<int>(i);
+	}
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "QFrameRecording.h"
+#include <QString>
+#include <QFile>
+#include <vector>
+
+
+/// <summary>
+/// Read access to a QFrameRecording file.
+/// The file is memory mapped, so payload() points straight into it and stays valid until
+/// close(). The trailing index is loaded on open; a file without one (cut short while
+/// recording) is indexed by walking its chunk headers instead. find() locates a time in
+/// constant time through a table of fixed-length time buckets over the index.
+/// </summary>
+class QFrameRecordingReader
+{
+public:
+	QFrameRecordingReader();
+	~QFrameRecordingReader();
+
+	bool open(const QString& fileName);
+	void close();
+	bool isOpen() const;
+
+	int count() const;
+	const QFrameRecording::IndexEntry& entry(int i) const;
+	const QFrameRecording::ChunkHeader& chunk(int i) const;
+	const unsigned char* payload(int i) const;
+
+	int streams() const;				// QFrameSource::Stream flags present in the file
+	qint64 startTime() const;
+	qint64 endTime() const;
+
+	/// <summary>
+	/// First chunk with every chunk before it before time, so none at or after time is
+	/// skipped; count() if there is none.
+	/// </summary>
+	int find(qint64 time) const;
+
+private:
+	bool loadIndex();
+	void rebuildIndex();
+	void buildBuckets();
+
+	QFile										File;
+	unsigned char*								Data;
+	quint64										Size;
+
+	std::vector<QFrameRecording::IndexEntry>	Index;
+	std::vector<qint64>							Latest;			// running maximum of the index times
+	std::vector<int>							Buckets;		// first chunk with Latest >= bucket start
+	qint64										BucketTicks;
+	int											Streams;
+};
@@ -0,0 +1,404 @@
+#include "stdafx.h"
+#include "QFrameRegistration.h"
+#include "QParallel.h"
+#include <cmath>
+#include <algorithm>
+
+
+// Largest footprint, in color pixels per side, one depth pixel is splatted to. Only
+// reached by pixels whose neighbour could not be mapped.
+#define MaxFootprint 8
+
+// Color rows per band of the z-buffer pass, each band is splatted by a single task
+#define SplatBandRows 64
+
+// Smallest parallax, in color pixels between the near and far depth, c is fitted from
+#define MinFitParallax 1.0
+
+// Largest c taken from a fit, as a share of the near depth; beyond it the points are not
+// of a pinhole camera and c stays 0
+#define MaxFitOffset 0.5
+
+
+
+/// <summary>
+/// Color pixel of depth pixel (x, y) at depth z, and the rectangle it covers up to the
+/// color pixel of the next depth pixel at the same depth. Shared by both modes so they
+/// round identically. Returns false when the pixel does not land in the color frame.
+/// </summary>
+static inline bool MapFootprint(const float* table, int x, int y, int width, int height, unsigned short z, int colorWidth, int colorHeight, QColorFootprint& fp)
+{
+	const float* t = table + QFrameRegistration::TableStride * (y * width + x);
+	const float rz = 1.f / (z + t[4]);
+
+	const float u = t[0] + t[1] * rz;
+	const float v = t[2] + t[3] * rz;
+
+	// written so that NaN fails the test
+	if (!(u >= -0.5f && u < colorWidth - 0.5f && v >= -0.5f && v < colorHeight - 0.5f))
+		return false;
+
+	// neighbour to the right and below, or to the left and above on the last column and row;
+	// c changes slowly across the frame, the neighbours take this pixel's
+	const int stride = QFrameRegistration::TableStride;
+	const float* tx = x + 1 < width ? t + stride : t - stride;
+	const float* ty = y + 1 < height ? t + stride * width : t - stride * width;
+
+	float du = std::fabs(tx[0] + tx[1] * rz - u);
+	float dv = std::fabs(ty[2] + ty[3] * rz - v);
+
+	if (!(du >= 1.f))
+		du = 1.f;
+	if (!(dv >= 1.f))
+		dv = 1.f;
+
+	fp.X0 = static_cast<int>(u + 0.5f);
+	fp.Y0 = static_cast<int>(v + 0.5f);
+	fp.X1 = qMin(fp.X0 + MaxFootprint, qMin(colorWidth, qMax(fp.X0 + 1, static_cast<int>(u + du + 0.5f))));
+	fp.Y1 = qMin(fp.Y0 + MaxFootprint, qMin(colorHeight, qMax(fp.Y0 + 1, static_cast<int>(v + dv + 0.5f))));
+	return true;
+}
+
+static inline QRgb SampleColor(const unsigned char* color, int colorStride, int x, int y)
+{
+	// BGRA bytes are a little endian QRgb, force the alpha in case the source left it at 0
+	return reinterpret_cast<const QRgb*>(color + y * colorStride)[x] | 0xFF000000u;
+}
+
+
+
+QFrameRegistration::QFrameRegistration() :
+	Occlusion(true),
+	OcclusionTolerance(50),
+	TileRows(16),
+	Depth(NULL),
+	Table(NULL),
+	Color(NULL),
+	DepthWidth(0),
+	DepthHeight(0),
+	ColorWidth(0),
+	ColorHeight(0),
+	ColorStride(0)
+{
+}
+
+bool QFrameRegistration::occlusion() const
+{
+	return Occlusion;
+}
+
+void QFrameRegistration::setOcclusion(bool occlusion)
+{
+	Occlusion = occlusion;
+}
+
+unsigned short QFrameRegistration::occlusionTolerance() const
+{
+	return OcclusionTolerance;
+}
+
+void QFrameRegistration::setOcclusionTolerance(unsigned short mm)
+{
+	OcclusionTolerance = mm;
+}
+
+int QFrameRegistration::tileRows() const
+{
+	return TileRows;
+}
+
+void QFrameRegistration::setTileRows(int rows)
+{
+	TileRows = qMax(rows, 1);
+}
+
+
+void QFrameRegistration::fitTable(const float* nearPoints, const float* midPoints, const float* farPoints, int count,
+	float nearDepth, float midDepth, float farDepth, float* table)
+{
+	// the ratio of the steps near to mid and mid to far only depends on c
+	const double k = (static_cast<double>(midDepth) - nearDepth) / (static_cast<double>(farDepth) - midDepth);
+
+	for (int i = 0; i < count; ++i)
+	{
+		const float* n = nearPoints + 2 * i;
+		const float* m = midPoints + 2 * i;
+		const float* f = farPoints + 2 * i;
+		float* t = table + TableStride * i;
+
+		// u and v share the denominator, c comes from the axis with the larger parallax
+		const int axis = std::fabs(n[1] - f[1]) > std::fabs(n[0] - f[0]) ? 1 : 0;
+		double c = 0.;
+
+		if (std::fabs(static_cast<double>(n[axis]) - f[axis]) >= MinFitParallax)
+		{
+			const double r = (static_cast<double>(n[axis]) - m[axis]) / (static_cast<double>(m[axis]) - f[axis]);
+			c = (k * farDepth - r * nearDepth) / (r - k);
+
+			// also NaN, from a step of 0
+			if (!(std::fabs(c) <= MaxFitOffset * nearDepth))
+				c = 0.;
+		}
+
+		// u(z) = a + b / (z + c) through the near and far samples
+		const double rn = 1. / (nearDepth + c);
+		const double rf = 1. / (farDepth + c);
+
+		for (int a = 0; a < 2; ++a)
+		{
+			const double b = (static_cast<double>(n[a]) - f[a]) / (rn - rf);
+			t[2 * a] = static_cast<float>(n[a] - b * rn);
+			t[2 * a + 1] = static_cast<float>(b);
+		}
+
+		t[4] = static_cast<float>(c);
+	}
+}
+
+void QFrameRegistration::pointTable(const float* points, int count, float* table)
+{
+	for (int i = 0; i < count; ++i)
+	{
+		float* t = table + TableStride * i;
+		t[0] = points[2 * i];
+		t[1] = 0.f;
+		t[2] = points[2 * i + 1];
+		t[3] = 0.f;
+		t[4] = 0.f;
+	}
+}
+
+float QFrameRegistration::tableError(const float* table, const float* points, int count, float depth, float percentile)
+{
+	std::vector<float> errors;
+	errors.reserve(count);
+
+	for (int i = 0; i < count; ++i)
+	{
+		const float* t = table + TableStride * i;
+		const float rz = 1.f / (depth + t[4]);
+		const float du = t[0] + t[1] * rz - points[2 * i];
+		const float dv = t[2] + t[3] * rz - points[2 * i + 1];
+		const float distance = std::sqrt(du * du + dv * dv);
+
+		// non-finite on either side: a pixel one of the mappings gave up on
+		if (std::isfinite(distance))
+			errors.push_back(distance);
+	}
+
+	if (errors.empty())
+		return 0.f;
+
+	const size_t rank = qMin(errors.size() - 1, static_cast<size_t>(qBound(0.f, percentile, 1.f) * errors.size()));
+	std::nth_element(errors.begin(), errors.begin() + rank, errors.end());
+	return errors[rank];
+}
+
+
+void QFrameRegistration::process(const unsigned short* depth, int depthWidth, int depthHeight, const float* table,
+	const unsigned char* color, int colorWidth, int colorHeight, int colorStride,
+	QRgb* colorInDepth, unsigned short* depthInColor, Mode mode)
+{
+	Depth = depth;
+	Table = table;
+	Color = color;
+	DepthWidth = depthWidth;
+	DepthHeight = depthHeight;
+	ColorWidth = colorWidth;
+	ColorHeight = colorHeight;
+	ColorStride = colorStride;
+
+	if (mode == Reference)
+	{
+		processReference(colorInDepth, depthInColor);
+		return;
+	}
+
+	const bool zbuffer = Occlusion || depthInColor;
+
+	// depth rows of different tiles land on overlapping color pixels: the footprints are mapped
+	// per depth tile, then every band of color rows takes the ones landing in it, so each
+	// z-buffer pixel is only ever written by one task
+	if (zbuffer)
+	{
+		resizeZBuffer(depthWidth * depthHeight, colorWidth * colorHeight);
+		QParallel::forTiles(depthHeight, TileRows, [this](int begin, int end) { footprintRows(begin, end); });
+		QParallel::forTiles(colorHeight, SplatBandRows, [this, depthInColor](int begin, int end) { splatBand(begin, end, depthInColor); });
+	}
+
+	QParallel::forTiles(depthHeight, TileRows, [this, colorInDepth](int begin, int end) { sampleRows(begin, end, colorInDepth); });
+}
+
+
+void QFrameRegistration::resizeZBuffer(int depthSize, int colorSize)
+{
+	if (static_cast<int>(ZBuffer.size()) != colorSize)
+		ZBuffer.resize(colorSize);
+	if (static_cast<int>(Footprints.size()) != depthSize)
+		Footprints.resize(depthSize);
+
+	TileColorRows.resize(2 * ((DepthHeight + TileRows - 1) / TileRows));
+}
+
+/// <summary>
+/// Footprints of depth rows [begin, end), one tile, and the color rows they span together
+/// </summary>
+void QFrameRegistration::footprintRows(int begin, int end)
+{
+	int firstRow = ColorHeight;
+	int endRow = 0;
+
+	for (int y = begin; y < end; ++y)
+	{
+		const unsigned short* depthRow = Depth + y * DepthWidth;
+		QColorFootprint* fpRow = &Footprints[y * DepthWidth];
+
+		for (int x = 0; x < DepthWidth; ++x)
+		{
+			QColorFootprint& fp = fpRow[x];
+			const unsigned short z = depthRow[x];
+
+			if (!z || !MapFootprint(Table, x, y, DepthWidth, DepthHeight, z, ColorWidth, ColorHeight, fp))
+			{
+				// no color rows, no band takes it
+				fp.X0 = fp.Y0 = fp.X1 = fp.Y1 = 0;
+				continue;
+			}
+
+			firstRow = qMin(firstRow, fp.Y0);
+			endRow = qMax(endRow, fp.Y1);
+		}
+	}
+
+	const int tile = begin / TileRows;
+	TileColorRows[2 * tile] = firstRow;
+	TileColorRows[2 * tile + 1] = endRow;
+}
+
+/// <summary>
+/// Splat every footprint landing in color rows [begin, end) onto the z-buffer, nearest
+/// surface winning, and copy the band out to depthInColor
+/// </summary>
+void QFrameRegistration::splatBand(int begin, int end, unsigned short* depthInColor)
+{
+	unsigned short* band = &ZBuffer[begin * ColorWidth];
+	std::fill(band, band + (end - begin) * ColorWidth, 0);
+
+	const int tiles = static_cast<int>(TileColorRows.size()) / 2;
+
+	for (int tile = 0; tile < tiles; ++tile)
+	{
+		if (TileColorRows[2 * tile] >= end || TileColorRows[2 * tile + 1] <= begin)
+			continue;
+
+		const int first = tile * TileRows * DepthWidth;
+		const int last = qMin(DepthHeight, (tile + 1) * TileRows) * DepthWidth;
+
+		for (int i = first; i < last; ++i)
+		{
+			const QColorFootprint& fp = Footprints[i];
+			if (fp.Y0 >= end || fp.Y1 <= begin)
+				continue;
+
+			const unsigned short z = Depth[i];
+			const int y1 = qMin(fp.Y1, end);
+
+			for (int cy = qMax(fp.Y0, begin); cy < y1; ++cy)
+			{
+				unsigned short* zrow = &ZBuffer[cy * ColorWidth];
+				for (int cx = fp.X0; cx < fp.X1; ++cx)
+				{
+					if (!zrow[cx] || z < zrow[cx])
+						zrow[cx] = z;
+				}
+			}
+		}
+	}
+
+	if (depthInColor)
+		std::copy(band, band + (end - begin) * ColorWidth, depthInColor + begin * ColorWidth);
+}
+
+void QFrameRegistration::sampleRows(int begin, int end, QRgb* colorInDepth)
+{
+	QColorFootprint fp;
+
+	for (int y = begin; y < end; ++y)
+	{
+		const unsigned short* depthRow = Depth + y * DepthWidth;
+		QRgb* dstRow = colorInDepth + y * DepthWidth;
+
+		for (int x = 0; x < DepthWidth; ++x)
+		{
+			const unsigned short z = depthRow[x];
+			dstRow[x] = 0;
+
+			if (!z || !MapFootprint(Table, x, y, DepthWidth, DepthHeight, z, ColorWidth, ColorHeight, fp))
+				continue;
+
+			if (Occlusion)
+			{
+				if (z > ZBuffer[fp.Y0 * ColorWidth + fp.X0] + OcclusionTolerance)
+					continue;
+			}
+
+			dstRow[x] = SampleColor(Color, ColorStride, fp.X0, fp.Y0);
+		}
+	}
+}
+
+
+/// <summary>
+/// Straight single threaded version, kept independent of the tiled passes so it can be
+/// used to check them.
+/// </summary>
+void QFrameRegistration::processReference(QRgb* colorInDepth, unsigned short* depthInColor)
+{
+	const int size = ColorWidth * ColorHeight;
+	if (static_cast<int>(Nearest.size()) != size)
+		Nearest.resize(size);
+	std::fill(Nearest.begin(), Nearest.end(), 0);
+
+	QColorFootprint fp;
+
+	for (int y = 0; y < DepthHeight; ++y)
+	{
+		for (int x = 0; x < DepthWidth; ++x)
+		{
+			const unsigned short z = Depth[y * DepthWidth + x];
+			if (!z || !MapFootprint(Table, x, y, DepthWidth, DepthHeight, z, ColorWidth, ColorHeight, fp))
+				continue;
+
+			for (int cy = fp.Y0; cy < fp.Y1; ++cy)
+			{
+				for (int cx = fp.X0; cx < fp.X1; ++cx)
+				{
+					unsigned short& n = Nearest[cy * ColorWidth + cx];
+					if (!n || z < n)
+						n = z;
+				}
+			}
+		}
+	}
+
+	for (int y = 0; y < DepthHeight; ++y)
+	{
+		for (int x = 0; x < DepthWidth; ++x)
+		{
+			const unsigned short z = Depth[y * DepthWidth + x];
+			QRgb& dst = colorInDepth[y * DepthWidth + x];
+			dst = 0;
+
+			if (!z || !MapFootprint(Table, x, y, DepthWidth, DepthHeight, z, ColorWidth, ColorHeight, fp))
+				continue;
+
+			if (Occlusion && z > Nearest[fp.Y0 * ColorWidth + fp.X0] + OcclusionTolerance)
+				continue;
+
+			dst = SampleColor(Color, ColorStride, fp.X0, fp.Y0);
+		}
+	}
+
+	if (depthInColor)
+		std::copy(Nearest.begin(), Nearest.end(), depthInColor);
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <QRgb>
+#include <vector>
+
+
+/// <summary>
+/// Color pixels one depth pixel covers
+/// </summary>
+struct QColorFootprint
+{
+	int		X0;		// nearest color pixel, where color is sampled
+	int		Y0;
+	int		X1;		// exclusive end of the splatted rectangle
+	int		Y1;
+};
+
+
+/// <summary>
+/// Registers a depth frame with a color frame: color sampled at every depth pixel and,
+/// optionally, depth splatted onto every color pixel. Both go through a z-buffer at color
+/// resolution so that depth pixels hidden from the color camera get no color.
+///
+/// The mapping comes from a per depth pixel table (au, bu, av, bv, c) with the color pixel of
+/// depth z (mm) at (au + bu / (z + c), av + bv / (z + c)): the depth-dependent part of the
+/// mapping is the parallax along the camera baseline, c the color camera's offset along the
+/// pixel's ray, everything else is fixed by the calibration, so the table is built once with
+/// fitTable() and reused for every frame.
+///
+/// The Parallel mode, the default, splits the frame over the global QThreadPool: depth row
+/// tiles map their footprints, then bands of color rows each splat the footprints that land
+/// in them, so no z-buffer pixel is shared between tasks, then the depth tiles sample color.
+/// The Reference mode runs the same math in one pass on the calling thread, Parallel must
+/// match it exactly.
+/// </summary>
+class QFrameRegistration
+{
+public:
+	enum Mode
+	{
+		Parallel,
+		Reference
+	};
+
+	enum { TableStride = 5 };	// floats per depth pixel in a table
+
+	QFrameRegistration();
+
+	bool occlusion() const;
+	void setOcclusion(bool occlusion);					// give hidden depth pixels no color
+	unsigned short occlusionTolerance() const;
+	void setOcclusionTolerance(unsigned short mm);		// how far behind the nearest surface still counts as visible
+	int tileRows() const;
+	void setTileRows(int rows);
+
+	/// <summary>
+	/// Build the mapping table from the color pixels of every depth pixel at three depths,
+	/// as interleaved x, y pairs (ColorSpacePoint). table gets TableStride floats per depth
+	/// pixel and goes through all three points, which for a pinhole color camera makes it
+	/// exact at every depth. A pixel whose parallax is too small to tell c apart keeps c at 0.
+	/// Pixels the mapper could not map end up with non-finite entries and are skipped.
+	/// </summary>
+	static void fitTable(const float* nearPoints, const float* midPoints, const float* farPoints, int count,
+		float nearDepth, float midDepth, float farDepth, float* table);
+
+	/// <summary>
+	/// Table of a single frame, from the color pixel of every depth pixel at its own depth
+	/// (interleaved x, y, e.g. from the mapper's MapDepthFrameToColorSpace). Footprints then
+	/// follow the neighbours' own depths, so pixels at depth edges splat a little wider.
+	/// </summary>
+	static void pointTable(const float* points, int count, float* table);
+
+	/// <summary>
+	/// Distance, in color pixels, between where table puts the depth pixels at depth (mm)
+	/// and points, where the mapper puts them (interleaved x, y), that the given share of
+	/// the pixels stays within: 1 for the largest. Pixels either side could not map are skipped.
+	/// </summary>
+	static float tableError(const float* table, const float* points, int count, float depth, float percentile);
+
+	/// <summary>
+	/// colorInDepth gets depthWidth x depthHeight pixels, 0 where there is no visible color.
+	/// depthInColor is optional (may be NULL) and gets colorWidth x colorHeight depths in mm,
+	/// 0 where no depth pixel lands. color is 32 bit BGRA, colorStride bytes per row.
+	/// </summary>
+	void process(const unsigned short* depth, int depthWidth, int depthHeight, const float* table,
+		const unsigned char* color, int colorWidth, int colorHeight, int colorStride,
+		QRgb* colorInDepth, unsigned short* depthInColor, Mode mode = Parallel);
+
+private:
+	void resizeZBuffer(int depthSize, int colorSize);
+	void footprintRows(int begin, int end);
+	void splatBand(int begin, int end, unsigned short* depthInColor);
+	void sampleRows(int begin, int end, QRgb* colorInDepth);
+	void processReference(QRgb* colorInDepth, unsigned short* depthInColor);
+
+	bool						Occlusion;
+	unsigned short				OcclusionTolerance;
+	int							TileRows;
+
+	// frame being processed
+	const unsigned short*		Depth;
+	const float*				Table;
+	const unsigned char*		Color;
+	int							DepthWidth;
+	int							DepthHeight;
+	int							ColorWidth;
+	int							ColorHeight;
+	int							ColorStride;
+
+	// depth of the nearest surface per color pixel, 0 where empty, for the Parallel mode;
+	// every band clears its own rows before splatting
+	std::vector<unsigned short>	ZBuffer;
+	std::vector<QColorFootprint>	Footprints;		// per depth pixel, no rows where it does not land
+	std::vector<int>			TileColorRows;		// first and end color row the footprints of each depth tile span
+
+	// depth of the nearest surface per color pixel, 0 where empty, for the Reference mode;
+	// sized once, cleared at the start of every frame
+	std::vector<unsigned short>	Nearest;
+};
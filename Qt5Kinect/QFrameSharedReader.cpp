@@ -0,0 +1,217 @@
+#include "stdafx.h"
+#include "QFrameSharedReader.h"
+#include <QSharedMemory>
+#include <atomic>
+
+
+using namespace QFrameSharedRing;
+
+
+QFrameSharedReader::QFrameSharedReader() :
+	Memory(NULL),
+	Header(NULL),
+	Next(0),
+	Read(0),
+	Overruns(0),
+	Skipped(0)
+{
+}
+
+QFrameSharedReader::~QFrameSharedReader()
+{
+	detach();
+}
+
+
+bool QFrameSharedReader::attach(const QString& name, int stream)
+{
+	detach();
+
+	QSharedMemory* memory = new QSharedMemory(key(name, stream));
+	if (!memory->attach(QSharedMemory::ReadOnly))
+	{
+		delete memory;
+		return false;
+	}
+
+	const QFrameSharedRing::Header* header = static_cast<const QFrameSharedRing::Header*>(memory->constData());
+	const bool complete = memory->size() >= static_cast<int>(sizeof(QFrameSharedRing::Header)) && header->Magic != 0;
+
+	// the publisher writes Magic last, a segment without it is still being set up
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (!complete)
+	{
+		delete memory;
+		return false;
+	}
+
+	if (header->Magic != Magic || header->Version != Version ||
+		header->SlotCount == 0 || memory->size() < static_cast<int>(segmentSize(header->SlotCount, header->SlotSize)))
+	{
+		std::cerr << "<Warning> " << memory->key().toStdString() << " is not a shared frame ring" << std::endl;
+		delete memory;
+		return false;
+	}
+
+	Memory = memory;
+	Header = header;
+
+	// start with the frames published from now on
+	Next = static_cast<quint32>(Header->Published.loadAcquire());
+	Read = 0;
+	Overruns = 0;
+	Skipped = 0;
+	return true;
+}
+
+void QFrameSharedReader::detach()
+{
+	delete Memory;
+	Memory = NULL;
+	Header = NULL;
+}
+
+bool QFrameSharedReader::isAttached() const
+{
+	return Header != NULL;
+}
+
+int QFrameSharedReader::slotCount() const
+{
+	return Header ? static_cast<int>(Header->SlotCount) : 0;
+}
+
+int QFrameSharedReader::slotSize() const
+{
+	return Header ? static_cast<int>(Header->SlotSize) : 0;
+}
+
+
+int QFrameSharedReader::pending() const
+{
+	if (!Header)
+		return 0;
+
+	const qint32 behind = static_cast<qint32>(static_cast<quint32>(Header->Published.loadAcquire()) - Next);
+	return qBound(0, behind, static_cast<int>(Header->SlotCount));
+}
+
+
+bool QFrameSharedReader::next(QSharedFrameView& view)
+{
+	if (!Header)
+	{
+		return false;
+	}
+
+	// a frame is at most found SlotCount times gone, then Next has caught up with frames being written
+	for (quint32 attempt = 0; attempt <= Header->SlotCount; ++attempt)
+	{
+		const quint32 published = static_cast<quint32>(Header->Published.loadAcquire());
+		const qint32 behind = static_cast<qint32>(published - Next);
+
+		if (behind <= 0)
+		{
+			return false;
+		}
+
+		// the slots only hold the last SlotCount frames
+		if (behind > static_cast<qint32>(Header->SlotCount))
+		{
+			Overruns += behind - Header->SlotCount;
+			Next = published - Header->SlotCount;
+		}
+
+		const Slot* target = slot(Header, Next % Header->SlotCount);
+		const quint32 expected = 2 * Next + 2;
+
+		if (static_cast<quint32>(target->Sequence.loadAcquire()) != expected)
+		{
+			// already taken by a newer frame
+			++Overruns;
+			++Next;
+			continue;
+		}
+
+		view.Format = static_cast<int>(target->Format);
+		view.Width = target->Width;
+		view.Height = target->Height;
+		view.Time = target->Time;
+		view.Size = static_cast<int>(qMin(target->Size, Header->SlotSize));
+		view.Data = payload(target);
+		view.Sequence = expected;
+
+		// the header fields may have been overwritten while they were read
+		if (!isValid(view))
+		{
+			++Overruns;
+			++Next;
+			continue;
+		}
+
+		++Next;
+		++Read;
+		return true;
+	}
+
+	return false;
+}
+
+bool QFrameSharedReader::latest(QSharedFrameView& view)
+{
+	if (!Header)
+	{
+		return false;
+	}
+
+	const quint32 published = static_cast<quint32>(Header->Published.loadAcquire());
+	const qint32 behind = static_cast<qint32>(published - Next);
+
+	if (behind > 1)
+	{
+		Skipped += behind - 1;
+		Next = published - 1;
+	}
+
+	return next(view);
+}
+
+
+bool QFrameSharedReader::isValid(const QSharedFrameView& view) const
+{
+	if (!Header || !view.Data)
+		return false;
+
+	// the reads of the frame stay before the second look at its Sequence
+	std::atomic_thread_fence(std::memory_order_acquire);
+
+	const Slot* target = reinterpret_cast<const Slot*>(view.Data - aligned(sizeof(Slot)));
+	return static_cast<quint32>(target->Sequence.load()) == view.Sequence;
+}
+
+bool QFrameSharedReader::copy(const QSharedFrameView& view, void* dst)
+{
+	memcpy(dst, view.Data, view.Size);
+
+	if (isValid(view))
+		return true;
+
+	++Overruns;
+	return false;
+}
+
+
+quint64 QFrameSharedReader::readCount() const
+{
+	return Read;
+}
+
+quint64 QFrameSharedReader::overrunCount() const
+{
+	return Overruns;
+}
+
+quint64 QFrameSharedReader::skippedCount() const
+{
+	return Skipped;
+}
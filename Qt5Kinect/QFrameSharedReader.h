@@ -0,0 +1,105 @@
+#pragma once
+
+#include "QFrameSharedRing.h"
+#include <QString>
+
+class QSharedMemory;
+
+
+/// <summary>
+/// A frame in a shared ring, read in place. Data stays readable until the publisher
+/// laps the ring, so check QFrameSharedReader::isValid() after using it.
+/// </summary>
+struct QSharedFrameView
+{
+	QSharedFrameView() :
+		Format(0),
+		Width(0),
+		Height(0),
+		Time(0),
+		Data(NULL),
+		Size(0),
+		Sequence(0)
+	{
+	}
+
+	int						Format;			// QFrameRecording::Format
+	int						Width;
+	int						Height;
+	qint64					Time;
+	const unsigned char*	Data;
+	int						Size;
+	quint32					Sequence;		// of its slot while the frame is there
+};
+
+
+/// <summary>
+/// Maps the ring of one stream that a QFramePublisher, in this or another process,
+/// writes under a name, and hands out its frames without copying them.
+///
+/// next() walks the frames in order from the one published after attach(); latest()
+/// jumps to the newest. Neither ever waits, for the publisher or for a frame. A reader
+/// that falls more than the ring's slot count behind, or whose frame is overwritten while
+/// it is looked at, loses frames: they are counted by overrunCount(), never handed out
+/// torn. Not thread safe, one reader per thread.
+/// </summary>
+class QFrameSharedReader
+{
+public:
+	QFrameSharedReader();
+	~QFrameSharedReader();
+
+	/// <summary>
+	/// Map the ring of stream published under name. Fails until the publisher has
+	/// published the first frame of that stream.
+	/// </summary>
+	bool attach(const QString& name, int stream);
+	void detach();
+	bool isAttached() const;
+
+	int slotCount() const;
+	int slotSize() const;
+
+	/// <summary>
+	/// Frames published since the last one handed out, at most the slot count
+	/// </summary>
+	int pending() const;
+
+	/// <summary>
+	/// The next frame not handed out yet, or false if there is none
+	/// </summary>
+	bool next(QSharedFrameView& view);
+
+	/// <summary>
+	/// The newest frame, skipping the older ones not handed out yet, or false if there is
+	/// none newer than the last one handed out
+	/// </summary>
+	bool latest(QSharedFrameView& view);
+
+	/// <summary>
+	/// Whether the publisher left the frame of view alone so far: everything read from its
+	/// Data before this call returned true is the frame as published.
+	/// </summary>
+	bool isValid(const QSharedFrameView& view) const;
+
+	/// <summary>
+	/// Copy the frame of view to dst, which holds view.Size bytes. Returns false, and
+	/// counts an overrun, if it was overwritten before the copy was complete.
+	/// </summary>
+	bool copy(const QSharedFrameView& view, void* dst);
+
+	quint64 readCount() const;		// frames handed out
+	quint64 overrunCount() const;	// frames lost to the publisher lapping this reader
+	quint64 skippedCount() const;	// frames passed over by latest()
+
+private:
+	QSharedMemory*					Memory;			// mapped read only
+	const QFrameSharedRing::Header*	Header;
+	quint32							Next;			// number of the next frame to hand out
+
+	quint64							Read;
+	quint64							Overruns;
+	quint64							Skipped;
+
+	Q_DISABLE_COPY(QFrameSharedReader);
+};
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <QtGlobal>
+#include <QAtomicInt>
+#include <QString>
+
+
+/// <summary>
+/// Layout of the shared memory rings QFramePublisher writes and QFrameSharedReader maps,
+/// one named segment per stream:
+///
+///   Header
+///   SlotCount x (Slot, payload of SlotSize bytes, padded to SlotAlignment)
+///
+/// Frame n of the stream goes to slot n % SlotCount. Every slot is a seqlock: its
+/// Sequence is 2n + 1 while frame n is written and 2n + 2 once it is complete, so a reader
+/// that finds the same even Sequence before and after reading a slot knows it read one
+/// whole frame. The writer never waits for readers; a reader that falls more than
+/// SlotCount frames behind sees the Sequence of a newer frame and counts an overrun.
+/// Counters are 32 bit and wrap, they are only ever compared by difference.
+/// </summary>
+namespace QFrameSharedRing
+{
+	enum
+	{
+		Version = 1,
+		DefaultSlotCount = 4,
+		SlotAlignment = 64				// a cache line, the payloads never share one with a Sequence
+	};
+
+	static const quint32 Magic = 0x474E524B;		// "KRNG"
+
+	struct Header
+	{
+		quint32			Magic;
+		quint32			Version;
+		quint32			Stream;			// QFrameSource::Stream
+		quint32			SlotCount;
+		quint32			SlotSize;		// payload bytes a slot holds
+		quint32			Reserved;
+		QBasicAtomicInt	Published;		// frames published, the next frame's number
+	};
+
+	struct Slot
+	{
+		QBasicAtomicInt	Sequence;
+		quint32			Format;			// QFrameRecording::Format
+		qint32			Width;
+		qint32			Height;
+		qint64			Time;			// RelativeTime, 100 ns ticks
+		quint32			Size;			// payload bytes
+		quint32			Reserved;
+	};
+
+	inline quint64 aligned(quint64 size)
+	{
+		return (size + SlotAlignment - 1) & ~quint64(SlotAlignment - 1);
+	}
+
+	inline quint64 slotStride(quint32 slotSize)
+	{
+		return aligned(sizeof(Slot)) + aligned(slotSize);
+	}
+
+	inline quint64 segmentSize(quint32 slotCount, quint32 slotSize)
+	{
+		return aligned(sizeof(Header)) + slotCount * slotStride(slotSize);
+	}
+
+	inline Slot* slot(void* segment, quint32 index)
+	{
+		const Header* header = static_cast<const Header*>(segment);
+		return reinterpret_cast<Slot*>(static_cast<char*>(segment) + aligned(sizeof(Header)) + index * slotStride(header->SlotSize));
+	}
+
+	inline unsigned char* payload(Slot* slot)
+	{
+		return reinterpret_cast<unsigned char*>(slot) + aligned(sizeof(Slot));
+	}
+
+	inline const Slot* slot(const void* segment, quint32 index)
+	{
+		return slot(const_cast<void*>(segment), index);
+	}
+
+	inline const unsigned char* payload(const Slot* slot)
+	{
+		return reinterpret_cast<const unsigned char*>(slot) + aligned(sizeof(Slot));
+	}
+
+	/// <summary>
+	/// Name of the segment of a stream published under name
+	/// </summary>
+	inline QString key(const QString& name, int stream)
+	{
+		return QString("%1.stream%2").arg(name).arg(stream);
+	}
+}
@@ -0,0 +1,67 @@
+#include "stdafx.h"
+#include "QFrameSource.h"
+
+
+bool QFrameSource::depthToCameraSpaceTable(std::vector<float>& table)
+{
+	Q_UNUSED(table);
+	return false;
+}
+
+bool QFrameSource::depthToColorTable(std::vector<float>& table)
+{
+	Q_UNUSED(table);
+	return false;
+}
+
+bool QFrameSource::mapDepthFrameToColor(const unsigned short* depth, int count, float* points)
+{
+	Q_UNUSED(depth);
+	Q_UNUSED(count);
+	Q_UNUSED(points);
+	return false;
+}
+
+
+bool QFrameSource::prepareColorFrame(QKinectColorFrame& frame, QFramePool& pool, int width, int height, QKinectColorFrame::PixelFormat format)
+{
+	const int frameBytes = width * height * QKinectColorFrame::bytesPerPixel(format);
+
+	if (pool.bufferSize() != frameBytes)
+	{
+		pool.reset(pool.bufferCount(), frameBytes);
+	}
+
+	// a buffer still referenced by an emitted image is left to its consumers
+	if (frame.Buffer.isNull() || frame.Buffer.isShared() || frame.Buffer.size() != frameBytes)
+	{
+		frame.Buffer = pool.acquire();
+	}
+
+	frame.Format = format;
+	frame.Width = width;
+	frame.Height = height;
+
+	// every buffer is still in use downstream when this is null
+	return !frame.Buffer.isNull();
+}
+
+void QFrameSource::prepareDepthFrame(QKinectDepthFrame& frame, int width, int height)
+{
+	if (frame.Width != width || frame.Height != height || frame.Buffer.size() != static_cast<size_t>(width * height))
+	{
+		frame.Buffer.resize(width * height);
+		frame.Width = width;
+		frame.Height = height;
+	}
+}
+
+void QFrameSource::prepareInfraredFrame(QKinectInfraredFrame& frame, int width, int height)
+{
+	if (frame.Width != width || frame.Height != height || frame.Buffer.size() != static_cast<size_t>(width * height))
+	{
+		frame.Buffer.resize(width * height);
+		frame.Width = width;
+		frame.Height = height;
+	}
+}
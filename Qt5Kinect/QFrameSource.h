@@ -0,0 +1,88 @@
+#pragma once
+
+#include "QKinectFrames.h"
+
+
+/// <summary>
+/// Where the grabber gets its frames from: the sensor (QKinectFrameSource), a recording
+/// or a generator. The grabber thread opens the source, blocks in wait() until frames
+/// are ready and then reads them; only wake() is called from other threads.
+/// </summary>
+class QFrameSource
+{
+public:
+	enum Stream
+	{
+		NoStream = 0x0,
+		ColorStream = 0x1,
+		DepthStream = 0x2,
+		InfraredStream = 0x4,
+		BodyStream = 0x8,
+		AllStreams = ColorStream | DepthStream | InfraredStream | BodyStream
+	};
+
+	QFrameSource() : RawColor(false) {}
+	virtual ~QFrameSource() {}
+
+	/// <summary>
+	/// Deliver color in the sensor's raw YUY2 instead of BGRA, half the bytes and no
+	/// conversion while reading. Sources that only have BGRA keep delivering it, so check
+	/// QKinectColorFrame::Format. Applied on the next open().
+	/// </summary>
+	bool rawColor() const { return RawColor; }
+	void setRawColor(bool raw) { RawColor = raw; }
+
+	/// <summary>
+	/// Start delivering the given Stream flags. Returns false if the source is not available.
+	/// </summary>
+	virtual bool open(int streams) = 0;
+	virtual void close() = 0;
+
+	/// <summary>
+	/// Block until at least one stream has a new frame, wake() is called or
+	/// timeoutMs elapses. Returns the Stream flags of the streams with a frame ready.
+	/// </summary>
+	virtual int wait(unsigned long timeoutMs) = 0;
+
+	/// <summary>
+	/// Make a pending or the next wait() return immediately. May be called from any thread.
+	/// </summary>
+	virtual void wake() = 0;
+
+	/// <summary>
+	/// Copy the newest frame of a stream into frame, reusing its storage, and return false
+	/// if there is none. Color goes to a buffer of pool, see prepareColorFrame().
+	/// </summary>
+	virtual bool readColor(QKinectColorFrame& frame, QFramePool& pool) = 0;
+	virtual bool readDepth(QKinectDepthFrame& frame) = 0;
+	virtual bool readInfrared(QKinectInfraredFrame& frame) = 0;
+	virtual bool readBody(QKinectBodyFrame& frame) = 0;
+
+	/// <summary>
+	/// Calibration tables for the depth frame stages, see QKinectGrabber::pointCloud() and
+	/// QFrameRegistration. Sources that have no calibration keep the default, which fails.
+	/// </summary>
+	virtual bool depthToCameraSpaceTable(std::vector<float>& table);
+	virtual bool depthToColorTable(std::vector<float>& table);
+
+	/// <summary>
+	/// Color pixel of every pixel of a depth frame at its own depth, as interleaved x, y
+	/// floats (ColorSpacePoint), non-finite where there is none. What registration falls back
+	/// to when depthToColorTable() fails: called by the depth worker for every frame while
+	/// the grabber thread reads, so it must not touch the state reading uses. Sources without
+	/// a mapper keep the default, which fails, as do sources not calibrated yet.
+	/// </summary>
+	virtual bool mapDepthFrameToColor(const unsigned short* depth, int count, float* points);
+
+protected:
+	/// <summary>
+	/// Size frame for a new image and make sure its buffer is not still used downstream.
+	/// Color takes a fresh pool buffer when needed and returns false when the pool is exhausted.
+	/// </summary>
+	static bool prepareColorFrame(QKinectColorFrame& frame, QFramePool& pool, int width, int height,
+		QKinectColorFrame::PixelFormat format = QKinectColorFrame::Bgra);
+	static void prepareDepthFrame(QKinectDepthFrame& frame, int width, int height);
+	static void prepareInfraredFrame(QKinectInfraredFrame& frame, int width, int height);
+
+	bool		RawColor;
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <QtGlobal>
+
+
+/// <summary>
+/// Wire format between QFrameStreamServer and QFrameStreamSource over TCP.
+///
+/// The client opens the connection with one Request naming the streams it wants. From
+/// then on the server sends frames, each a FrameHeader followed by Size payload bytes,
+/// in QFrameRecording formats: depth and infrared Gray16Rvl, color downscaled Bgra32.
+/// Sequence counts the frames of a stream the server encoded, so a gap is the number
+/// of frames the connection dropped because the client or the link fell behind.
+/// Every field is little endian.
+/// </summary>
+namespace QFrameStream
+{
+	enum
+	{
+		Version = 1,
+		DefaultPort = 28500
+	};
+
+	static const quint32 RequestMagic = 0x5152534B;		// "KSRQ"
+	static const quint32 FrameMagic = 0x4D52464B;		// "KFRM"
+
+	struct Request
+	{
+		quint32		Magic;
+		quint32		Version;
+		quint32		Streams;		// QFrameSource::Stream flags
+		quint32		Reserved;
+	};
+
+	struct FrameHeader
+	{
+		quint32		Magic;
+		quint32		Stream;			// QFrameSource::Stream
+		quint32		Format;			// QFrameRecording::Format
+		quint32		Size;			// payload bytes
+		qint32		Width;
+		qint32		Height;
+		qint64		Time;			// RelativeTime, 100 ns ticks
+		quint32		Sequence;
+		quint32		Reserved;
+	};
+}
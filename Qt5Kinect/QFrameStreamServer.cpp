@@ -0,0 +1,518 @@
+#include "stdafx.h"
+#include "QFrameStreamServer.h"
+#include "QFrameSource.h"
+#include "QFrameRecording.h"
+#include <cstring>
+
+
+// Time the listener waits for a connection before it looks for finished ones, in ms
+#define AcceptPollInterval 100
+
+// Color frames go out at this fraction of the 1920 x 1080 sensor size unless set otherwise
+#define DefaultColorWidth 480
+#define DefaultColorHeight 270
+
+using namespace QFrameStream;
+
+
+
+/// <summary>
+/// One client: its socket, the frames waiting for it, one per stream, and the thread
+/// writing them
+/// </summary>
+class QFrameStreamConnection : public QThread
+{
+public:
+	explicit QFrameStreamConnection(QFrameStreamSocket* socket) :
+		Socket(socket),
+		Streams(QFrameSource::NoStream),
+		Stopping(false),
+		Done(false),
+		Sent(0),
+		Dropped(0)
+	{
+		for (int s = 0; s < QFrameStreamServer::StreamCount; ++s)
+			Waiting[s] = false;
+	}
+
+	~QFrameStreamConnection()
+	{
+		delete Socket;
+	}
+
+	/// <summary>
+	/// Queue a frame for the client, replacing the one of its stream not written yet
+	/// </summary>
+	void post(int s, int stream, const FrameHeader& header, const QFrameHandle& payload)
+	{
+		QMutexLocker lock(&Mutex);
+
+		if (!(Streams & stream) || Stopping)
+			return;
+
+		if (Waiting[s])
+			++Dropped;
+
+		Headers[s] = header;
+		Payloads[s] = payload;
+		Waiting[s] = true;
+		Wakeup.wakeAll();
+	}
+
+	void stop()
+	{
+		QMutexLocker lock(&Mutex);
+		Stopping = true;
+		Socket->shutdown();
+		Wakeup.wakeAll();
+	}
+
+	bool done() const
+	{
+		QMutexLocker lock(&Mutex);
+		return Done;
+	}
+
+	quint64 sentCount() const
+	{
+		QMutexLocker lock(&Mutex);
+		return Sent;
+	}
+
+	quint64 droppedCount() const
+	{
+		QMutexLocker lock(&Mutex);
+		return Dropped;
+	}
+
+protected:
+	void run() Q_DECL_OVERRIDE
+	{
+		Request request;
+		if (Socket->receive(&request, sizeof(request)) && request.Magic == RequestMagic && request.Version == Version)
+		{
+			{
+				QMutexLocker lock(&Mutex);
+				Streams = static_cast<int>(request.Streams);
+			}
+
+			while (sendWaiting())
+				;
+		}
+
+		QMutexLocker lock(&Mutex);
+		Done = true;
+		for (int s = 0; s < QFrameStreamServer::StreamCount; ++s)
+		{
+			Waiting[s] = false;
+			Payloads[s].reset();
+		}
+	}
+
+private:
+	/// <summary>
+	/// Wait for frames and write all of them with one call. Returns false once the
+	/// connection is stopped or lost.
+	/// </summary>
+	bool sendWaiting()
+	{
+		FrameHeader headers[QFrameStreamServer::StreamCount];
+		QFrameHandle payloads[QFrameStreamServer::StreamCount];
+		int count = 0;
+
+		{
+			QMutexLocker lock(&Mutex);
+
+			for (;;)
+			{
+				if (Stopping)
+					return false;
+
+				for (int s = 0; s < QFrameStreamServer::StreamCount; ++s)
+				{
+					if (!Waiting[s])
+						continue;
+
+					headers[count] = Headers[s];
+					payloads[count] = Payloads[s];
+					Payloads[s].reset();
+					Waiting[s] = false;
+					++count;
+				}
+
+				if (count > 0)
+					break;
+
+				Wakeup.wait(&Mutex);
+			}
+		}
+
+		// the payloads stay out of their pool until they are written
+		QFrameStreamSocket::Buffer parts[2 * QFrameStreamServer::StreamCount];
+		for (int i = 0; i < count; ++i)
+		{
+			parts[2 * i].Data = &headers[i];
+			parts[2 * i].Size = sizeof(FrameHeader);
+			parts[2 * i + 1].Data = payloads[i].data();
+			parts[2 * i + 1].Size = static_cast<int>(headers[i].Size);
+		}
+
+		if (!Socket->send(parts, 2 * count))
+		{
+			return false;
+		}
+
+		QMutexLocker lock(&Mutex);
+		Sent += count;
+		return true;
+	}
+
+	QFrameStreamSocket*		Socket;
+
+	mutable QMutex			Mutex;
+	QWaitCondition			Wakeup;
+	int						Streams;			// asked for by the client, none until its request arrived
+	bool					Stopping;
+	bool					Done;
+	bool					Waiting[QFrameStreamServer::StreamCount];
+	FrameHeader				Headers[QFrameStreamServer::StreamCount];
+	QFrameHandle			Payloads[QFrameStreamServer::StreamCount];
+	quint64					Sent;
+	quint64					Dropped;
+};
+
+
+/// <summary>
+/// Accepts clients and cleans up after the ones that went away
+/// </summary>
+class QFrameStreamListener : public QThread
+{
+public:
+	explicit QFrameStreamListener(QFrameStreamServer* server) :
+		Server(server)
+	{
+	}
+
+	void stop()
+	{
+		Stopping.storeRelease(1);
+	}
+
+protected:
+	void run() Q_DECL_OVERRIDE
+	{
+		QFrameStreamSocket* client = new QFrameStreamSocket();
+
+		while (!Stopping.loadAcquire())
+		{
+			if (Server->Socket.accept(*client, AcceptPollInterval))
+			{
+				Server->accepted(client);
+				client = new QFrameStreamSocket();
+			}
+
+			Server->reap();
+		}
+
+		delete client;
+	}
+
+private:
+	QFrameStreamServer*		Server;
+	QAtomicInt				Stopping;
+};
+
+
+
+QFrameStreamServer::QFrameStreamServer() :
+	Listener(NULL),
+	Sent(0),
+	Dropped(0),
+	ColorSize(DefaultColorWidth, DefaultColorHeight)
+{
+	for (int s = 0; s < StreamCount; ++s)
+		Sequences[s] = 0;
+}
+
+QFrameStreamServer::~QFrameStreamServer()
+{
+	close();
+}
+
+
+bool QFrameStreamServer::listen(quint16 port)
+{
+	close();
+
+	if (!Socket.listen(port))
+	{
+		return false;
+	}
+
+	Listener = new QFrameStreamListener(this);
+	Listener->start();
+	return true;
+}
+
+void QFrameStreamServer::close()
+{
+	if (Listener)
+	{
+		Listener->stop();
+		Listener->wait();
+		delete Listener;
+		Listener = NULL;
+	}
+
+	Socket.close();
+
+	QList<QFrameStreamConnection*> connections;
+	{
+		QMutexLocker lock(&Mutex);
+		connections.swap(Connections);
+	}
+
+	for (int i = 0; i < connections.size(); ++i)
+	{
+		connections[i]->stop();
+		connections[i]->wait();
+
+		QMutexLocker lock(&Mutex);
+		Sent += connections[i]->sentCount();
+		Dropped += connections[i]->droppedCount();
+		delete connections[i];
+	}
+}
+
+bool QFrameStreamServer::isListening() const
+{
+	return Socket.isOpen();
+}
+
+quint16 QFrameStreamServer::port() const
+{
+	return Socket.localPort();
+}
+
+
+QSize QFrameStreamServer::colorSize() const
+{
+	QMutexLocker lock(&Mutex);
+	return ColorSize;
+}
+
+void QFrameStreamServer::setColorSize(const QSize& size)
+{
+	QMutexLocker lock(&Mutex);
+	ColorSize = size;
+}
+
+
+bool QFrameStreamServer::hasClients() const
+{
+	QMutexLocker lock(&Mutex);
+	return !Connections.isEmpty();
+}
+
+int QFrameStreamServer::clientCount() const
+{
+	QMutexLocker lock(&Mutex);
+	return Connections.size();
+}
+
+quint64 QFrameStreamServer::sentCount() const
+{
+	QMutexLocker lock(&Mutex);
+
+	quint64 sent = Sent;
+	for (int i = 0; i < Connections.size(); ++i)
+		sent += Connections[i]->sentCount();
+
+	return sent;
+}
+
+quint64 QFrameStreamServer::droppedCount() const
+{
+	QMutexLocker lock(&Mutex);
+
+	quint64 dropped = Dropped;
+	for (int i = 0; i < Connections.size(); ++i)
+		dropped += Connections[i]->droppedCount();
+
+	return dropped;
+}
+
+
+/// <summary>
+/// Listener thread: start sending to a new client
+/// </summary>
+void QFrameStreamServer::accepted(QFrameStreamSocket* socket)
+{
+	QFrameStreamConnection* connection = new QFrameStreamConnection(socket);
+	connection->start();
+
+	QMutexLocker lock(&Mutex);
+	Connections.append(connection);
+}
+
+/// <summary>
+/// Listener thread: forget the clients whose connection ended
+/// </summary>
+void QFrameStreamServer::reap()
+{
+	QList<QFrameStreamConnection*> finished;
+	{
+		QMutexLocker lock(&Mutex);
+
+		for (int i = Connections.size() - 1; i >= 0; --i)
+		{
+			if (!Connections[i]->done())
+				continue;
+
+			Sent += Connections[i]->sentCount();
+			Dropped += Connections[i]->droppedCount();
+			finished.append(Connections[i]);
+			Connections.removeAt(i);
+		}
+	}
+
+	for (int i = 0; i < finished.size(); ++i)
+	{
+		finished[i]->wait();
+		delete finished[i];
+	}
+}
+
+
+/// <summary>
+/// A buffer for one encoded frame of a stream. Every connection holds at most two
+/// frames of a stream, the waiting one and the one being written, so the pool only
+/// grows when clients connect.
+/// </summary>
+QFrameHandle QFrameStreamServer::acquire(int s, int size)
+{
+	QFramePool& pool = Pools[s];
+	const int needed = 2 * clientCount() + 2;
+
+	if (pool.bufferSize() != size || pool.bufferCount() < needed)
+		pool.reset(qMax(needed, pool.bufferCount()), size);
+
+	return pool.acquire();
+}
+
+void QFrameStreamServer::post(int stream, const FrameHeader& header, const QFrameHandle& payload)
+{
+	const int s = slot(stream);
+
+	QMutexLocker lock(&Mutex);
+	for (int i = 0; i < Connections.size(); ++i)
+		Connections[i]->post(s, stream, header, payload);
+}
+
+
+void QFrameStreamServer::sendColor(const QKinectColorFrame& frame)
+{
+	if (!hasClients() || frame.Format != QKinectColorFrame::Bgra || frame.Buffer.isNull())
+	{
+		return;
+	}
+
+	const int s = slot(QFrameSource::ColorStream);
+	const QSize size = colorSize();
+	const int width = size.isEmpty() ? frame.Width : qMin(size.width(), static_cast<int>(frame.Width));
+	const int height = size.isEmpty() ? frame.Height : qMin(size.height(), static_cast<int>(frame.Height));
+
+	FrameHeader header;
+	header.Magic = FrameMagic;
+	header.Stream = QFrameSource::ColorStream;
+	header.Format = QFrameRecording::Bgra32;
+	header.Size = static_cast<quint32>(width * height * QKinectColorFrame::Channels);
+	header.Width = width;
+	header.Height = height;
+	header.Time = frame.Time;
+	header.Reserved = 0;
+
+	// never the grabber's own buffer, even at full size: a stalled client would hold it
+	// and starve the grabber's color pool
+	QFrameHandle payload = acquire(s, static_cast<int>(header.Size));
+	if (payload.isNull())
+	{
+		return;
+	}
+
+	// numbered once it is sure to be sent, a frame without a buffer is no gap to the clients
+	header.Sequence = Sequences[s]++;
+
+	const int rowSize = width * QKinectColorFrame::Channels;
+	if (width == frame.Width && height == frame.Height)
+	{
+		for (int y = 0; y < height; ++y)
+			std::memcpy(payload.data() + y * rowSize, frame.Buffer.data() + y * frame.bytesPerLine(), rowSize);
+	}
+	else
+	{
+		Downscaler.process(frame.Buffer.data(), frame.Width, frame.Height, frame.bytesPerLine(),
+			payload.data(), width, height, rowSize);
+	}
+
+	post(QFrameSource::ColorStream, header, payload);
+}
+
+void QFrameStreamServer::sendDepth(const QKinectDepthFrame& frame)
+{
+	encodeGray16(QFrameSource::DepthStream, frame.Buffer, frame.Width, frame.Height, frame.Time);
+}
+
+void QFrameStreamServer::sendInfrared(const QKinectInfraredFrame& frame)
+{
+	encodeGray16(QFrameSource::InfraredStream, frame.Buffer, frame.Width, frame.Height, frame.Time);
+}
+
+void QFrameStreamServer::encodeGray16(int stream, const std::vector<unsigned short>& buffer, int width, int height, qint64 time)
+{
+	const int count = width * height;
+
+	if (!hasClients() || count <= 0 || buffer.size() < static_cast<size_t>(count))
+	{
+		return;
+	}
+
+	const int s = slot(stream);
+
+	QFrameHandle payload = acquire(s, QDepthCodec::maxEncodedSize(count));
+	if (payload.isNull())
+	{
+		return;
+	}
+
+	const int size = Codec.encode(buffer.data(), count, payload.data(), payload.size());
+	if (size <= 0)
+	{
+		return;
+	}
+
+	FrameHeader header;
+	header.Magic = FrameMagic;
+	header.Stream = static_cast<quint32>(stream);
+	header.Format = QFrameRecording::Gray16Rvl;
+	header.Size = static_cast<quint32>(size);
+	header.Width = width;
+	header.Height = height;
+	header.Time = time;
+	header.Sequence = Sequences[s]++;
+	header.Reserved = 0;
+
+	post(stream, header, payload);
+}
+
+
+int QFrameStreamServer::slot(int stream)
+{
+	switch (stream)
+	{
+		case QFrameSource::ColorStream:		return 0;
+		case QFrameSource::DepthStream:		return 1;
+		case QFrameSource::InfraredStream:	return 2;
+		default:							return -1;
+	}
+}
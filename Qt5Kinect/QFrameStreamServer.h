@@ -0,0 +1,83 @@
+#pragma once
+
+#include "QFrameStream.h"
+#include "QFrameStreamSocket.h"
+#include "QKinectFrames.h"
+#include "QFramePool.h"
+#include "QDepthCodec.h"
+#include "QColorDownscaler.h"
+#include <QMutex>
+#include <QList>
+#include <QSize>
+
+class QFrameStreamConnection;
+class QFrameStreamListener;
+
+
+/// <summary>
+/// Sends frames to any number of TCP clients (QFrameStreamSource) for viewing and
+/// processing on other machines: depth and infrared coded losslessly with QDepthCodec,
+/// color downscaled to colorSize().
+///
+/// Each frame is encoded once, into a QFramePool buffer that every connection sending it
+/// shares. A connection has its own thread and a queue of one frame per stream: a newer
+/// frame replaces one still waiting, so every client gets the newest frames at the rate
+/// its link and its reader keep up with, and the senders never wait for a client. The
+/// waiting frames of a connection go out with one gathering write, headers and payloads
+/// straight from where they are.
+///
+/// The send calls come from the grabber's stream workers, one thread per stream; they
+/// return at once when no client is connected. A client that went away is noticed on
+/// the next write to it.
+/// </summary>
+class QFrameStreamServer
+{
+public:
+	enum { StreamCount = 3 };		// color, depth, infrared
+
+	QFrameStreamServer();
+	~QFrameStreamServer();
+
+	bool listen(quint16 port = QFrameStream::DefaultPort);	// 0 for any free port
+	void close();
+	bool isListening() const;
+	quint16 port() const;
+
+	QSize colorSize() const;
+	void setColorSize(const QSize& size);	// at most the source size, 1/4 of 1920 x 1080 by default
+
+	bool hasClients() const;
+	int clientCount() const;
+	quint64 sentCount() const;				// frames written to a client
+	quint64 droppedCount() const;			// frames replaced in a client's queue before they were written
+
+	void sendColor(const QKinectColorFrame& frame);		// BGRA
+	void sendDepth(const QKinectDepthFrame& frame);
+	void sendInfrared(const QKinectInfraredFrame& frame);
+
+private:
+	friend class QFrameStreamListener;
+
+	void accepted(QFrameStreamSocket* socket);
+	void reap();
+	QFrameHandle acquire(int s, int size);
+	void post(int stream, const QFrameStream::FrameHeader& header, const QFrameHandle& payload);
+	void encodeGray16(int stream, const std::vector<unsigned short>& buffer, int width, int height, qint64 time);
+	static int slot(int stream);
+
+	mutable QMutex					Mutex;
+	QFrameStreamSocket				Socket;
+	QFrameStreamListener*			Listener;
+	QList<QFrameStreamConnection*>	Connections;
+	quint64							Sent;			// of the connections already reaped
+	quint64							Dropped;
+	QSize							ColorSize;
+
+	// per stream, used by that stream's sending thread only
+	QFramePool						Pools[StreamCount];		// encoded frames
+	quint32							Sequences[StreamCount];
+	QColorDownscaler				Downscaler;
+	QDepthCodec						Codec;			// lossless, encode() is shared by the depth and infrared threads
+
+	Q_DISABLE_COPY(QFrameStreamServer);
+};
@@ -0,0 +1,290 @@
+#include "stdafx.h"
+#include "QFrameStreamSocket.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib,"ws2_32.lib")
+typedef int socklen_t;
+#define CloseSocket closesocket
+#define SocketShutdownBoth SD_BOTH
+#else
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#define CloseSocket ::close
+#define SocketShutdownBoth SHUT_RDWR
+#endif
+
+
+// Buffers gathered by one send call at most, the frame stream never needs more
+#define MaxSendBuffers 16
+
+// Kernel send buffer asked for, a few compressed depth frames
+#define SocketSendBufferSize (1 << 20)
+
+#define InvalidHandle qintptr(-1)
+
+
+
+QFrameStreamSocket::QFrameStreamSocket() :
+	Handle(InvalidHandle)
+{
+#ifdef _WIN32
+	// reference counted by Winsock, one per socket object
+	WSADATA data;
+	WSAStartup(MAKEWORD(2, 2), &data);
+#endif
+}
+
+QFrameStreamSocket::~QFrameStreamSocket()
+{
+	close();
+
+#ifdef _WIN32
+	WSACleanup();
+#endif
+}
+
+
+bool QFrameStreamSocket::listen(quint16 port)
+{
+	close();
+
+	Handle = static_cast<qintptr>(::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+	if (Handle == InvalidHandle)
+	{
+		std::cerr << "<Error> Could not create the frame stream socket" << std::endl;
+		return false;
+	}
+
+	// a restarted server takes its port back from connections still winding down
+	int reuse = 1;
+	setsockopt(Handle, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(port);
+
+	if (::bind(Handle, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || ::listen(Handle, SOMAXCONN) != 0)
+	{
+		std::cerr << "<Error> Could not listen for frame stream clients on port " << port << std::endl;
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+quint16 QFrameStreamSocket::localPort() const
+{
+	sockaddr_in address;
+	socklen_t length = sizeof(address);
+
+	if (Handle == InvalidHandle || getsockname(Handle, reinterpret_cast<sockaddr*>(&address), &length) != 0)
+		return 0;
+
+	return ntohs(address.sin_port);
+}
+
+bool QFrameStreamSocket::accept(QFrameStreamSocket& client, int timeoutMs)
+{
+	if (Handle == InvalidHandle)
+	{
+		return false;
+	}
+
+	fd_set ready;
+	FD_ZERO(&ready);
+	FD_SET(Handle, &ready);
+
+	timeval timeout;
+	timeout.tv_sec = timeoutMs / 1000;
+	timeout.tv_usec = (timeoutMs % 1000) * 1000;
+
+	if (select(static_cast<int>(Handle + 1), &ready, NULL, NULL, &timeout) <= 0)
+	{
+		return false;
+	}
+
+	const qintptr handle = static_cast<qintptr>(::accept(Handle, NULL, NULL));
+	if (handle == InvalidHandle)
+	{
+		return false;
+	}
+
+	client.close();
+	client.Handle = handle;
+	client.configure();
+	return true;
+}
+
+bool QFrameStreamSocket::connect(const QString& host, quint16 port)
+{
+	close();
+
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+
+	addrinfo* addresses = NULL;
+	if (getaddrinfo(host.toStdString().c_str(), QString::number(port).toStdString().c_str(), &hints, &addresses) != 0)
+	{
+		std::cerr << "<Error> Could not resolve frame stream server " << host.toStdString() << std::endl;
+		return false;
+	}
+
+	for (addrinfo* address = addresses; address; address = address->ai_next)
+	{
+		Handle = static_cast<qintptr>(::socket(address->ai_family, address->ai_socktype, address->ai_protocol));
+		if (Handle == InvalidHandle)
+			continue;
+
+		if (::connect(Handle, address->ai_addr, static_cast<socklen_t>(address->ai_addrlen)) == 0)
+			break;
+
+		close();
+	}
+
+	freeaddrinfo(addresses);
+
+	if (Handle == InvalidHandle)
+	{
+		std::cerr << "<Error> Could not connect to frame stream server " << host.toStdString() << ":" << port << std::endl;
+		return false;
+	}
+
+	configure();
+	return true;
+}
+
+/// <summary>
+/// Options of a connected socket: frames go out as soon as they are written, not when
+/// Nagle's algorithm sees fit, and the kernel holds a few of them
+/// </summary>
+void QFrameStreamSocket::configure()
+{
+	int noDelay = 1;
+	setsockopt(Handle, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+
+	int sendBuffer = SocketSendBufferSize;
+	setsockopt(Handle, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char*>(&sendBuffer), sizeof(sendBuffer));
+}
+
+
+bool QFrameStreamSocket::send(const Buffer* buffers, int count)
+{
+	if (Handle == InvalidHandle || count > MaxSendBuffers)
+	{
+		return false;
+	}
+
+#ifdef _WIN32
+	WSABUF parts[MaxSendBuffers];
+	for (int i = 0; i < count; ++i)
+	{
+		parts[i].buf = static_cast<char*>(const_cast<void*>(buffers[i].Data));
+		parts[i].len = static_cast<ULONG>(buffers[i].Size);
+	}
+#else
+	iovec parts[MaxSendBuffers];
+	for (int i = 0; i < count; ++i)
+	{
+		parts[i].iov_base = const_cast<void*>(buffers[i].Data);
+		parts[i].iov_len = static_cast<size_t>(buffers[i].Size);
+	}
+#endif
+
+	int first = 0;
+	while (first < count)
+	{
+#ifdef _WIN32
+		DWORD sent = 0;
+		if (WSASend(Handle, parts + first, static_cast<DWORD>(count - first), &sent, 0, NULL, NULL) != 0)
+			return false;
+#else
+		msghdr message;
+		memset(&message, 0, sizeof(message));
+		message.msg_iov = parts + first;
+		message.msg_iovlen = count - first;
+
+		// a client gone away is an error here, not a SIGPIPE
+		const ssize_t sent = sendmsg(Handle, &message, MSG_NOSIGNAL);
+		if (sent < 0)
+			return false;
+#endif
+
+		// skip what was written, a blocking socket may still stop short of the end
+		size_t left = static_cast<size_t>(sent);
+		while (first < count)
+		{
+#ifdef _WIN32
+			const size_t size = parts[first].len;
+#else
+			const size_t size = parts[first].iov_len;
+#endif
+			if (left < size)
+			{
+#ifdef _WIN32
+				parts[first].buf += left;
+				parts[first].len -= static_cast<ULONG>(left);
+#else
+				parts[first].iov_base = static_cast<char*>(parts[first].iov_base) + left;
+				parts[first].iov_len -= left;
+#endif
+				break;
+			}
+
+			left -= size;
+			++first;
+		}
+	}
+
+	return true;
+}
+
+bool QFrameStreamSocket::receive(void* data, int size)
+{
+	char* target = static_cast<char*>(data);
+
+	while (size > 0)
+	{
+		const int received = static_cast<int>(::recv(Handle, target, size, 0));
+		if (received <= 0)
+			return false;
+
+		target += received;
+		size -= received;
+	}
+
+	return true;
+}
+
+
+void QFrameStreamSocket::shutdown()
+{
+	if (Handle != InvalidHandle)
+		::shutdown(Handle, SocketShutdownBoth);
+}
+
+void QFrameStreamSocket::close()
+{
+	if (Handle != InvalidHandle)
+	{
+		CloseSocket(Handle);
+		Handle = InvalidHandle;
+	}
+}
+
+bool QFrameStreamSocket::isOpen() const
+{
+	return Handle != InvalidHandle;
+}
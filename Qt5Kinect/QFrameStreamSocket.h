@@ -0,0 +1,50 @@
+#pragma once
+
+#include <QString>
+
+
+/// <summary>
+/// Blocking TCP socket for the frame stream, a thin layer over Winsock and BSD sockets so
+/// the client side also builds on the non Windows machines that watch the stream.
+///
+/// send() writes a list of buffers with one gathering call (WSASend, sendmsg) instead of
+/// copying them together first, and only returns once all of them are written. Every
+/// call blocks; shutdown() from another thread makes a blocked call return false.
+/// </summary>
+class QFrameStreamSocket
+{
+public:
+	struct Buffer
+	{
+		const void*		Data;
+		int				Size;
+	};
+
+	QFrameStreamSocket();
+	~QFrameStreamSocket();
+
+	bool listen(quint16 port);					// on every interface, 0 for any free port
+	quint16 localPort() const;
+
+	/// <summary>
+	/// Wait up to timeoutMs for a connection on a listening socket and accept it into
+	/// client. Returns false on timeout.
+	/// </summary>
+	bool accept(QFrameStreamSocket& client, int timeoutMs);
+
+	bool connect(const QString& host, quint16 port);
+
+	bool send(const Buffer* buffers, int count);
+	bool receive(void* data, int size);
+
+	void shutdown();							// both directions, may be called from any thread
+	void close();
+	bool isOpen() const;
+
+private:
+	void configure();
+
+	qintptr		Handle;
+
+	Q_DISABLE_COPY(QFrameStreamSocket);
+};
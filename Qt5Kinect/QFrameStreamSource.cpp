@@ -0,0 +1,391 @@
+#include "stdafx.h"
+#include "QFrameStreamSource.h"
+#include "QFrameRecording.h"
+#include "QDepthCodec.h"
+#include <QElapsedTimer>
+#include <cstring>
+
+
+// Largest payload taken from the server, anything above is a broken stream
+#define MaxFramePayload (64 << 20)
+
+// Largest width or height taken from the server, the frames hold them in 16 bits
+#define MaxFrameSide 8192
+
+// Reliable depth range of the sensor, which is fixed and therefore not sent
+#define StreamMinReliableDistance 500
+#define StreamMaxReliableDistance 4500
+
+using namespace QFrameStream;
+
+
+/// <summary>
+/// Whether a received frame is of format, with positive dimensions its payload agrees
+/// with: exactly their pixels for Bgra32, a coded frame of exactly their pixels for Gray16Rvl
+/// </summary>
+static bool IsConsistent(const FrameHeader& header, const std::vector<unsigned char>& payload, quint32 format)
+{
+	if (header.Format != format || header.Size != payload.size() ||
+		header.Width <= 0 || header.Height <= 0 || header.Width > MaxFrameSide || header.Height > MaxFrameSide)
+		return false;
+
+	const int count = header.Width * header.Height;
+
+	if (format == QFrameRecording::Bgra32)
+		return header.Size == static_cast<quint32>(count * QKinectColorFrame::Channels);
+
+	return QDepthCodec::decodedCount(payload.data(), static_cast<int>(header.Size)) == count;
+}
+
+
+/// <summary>
+/// Thread reading the connection, see QFrameStreamSource::receive()
+/// </summary>
+class QFrameStreamReceiver : public QThread
+{
+public:
+	explicit QFrameStreamReceiver(QFrameStreamSource* source) : Source(source) {}
+
+protected:
+	void run() Q_DECL_OVERRIDE
+	{
+		Source->receive();
+	}
+
+private:
+	QFrameStreamSource*	Source;
+};
+
+
+
+QFrameStreamSource::QFrameStreamSource() :
+	Port(QFrameStream::DefaultPort),
+	Connected(false),
+	Woken(false),
+	Ready(NoStream),
+	ReceivedFrames(0),
+	Lost(0),
+	Replaced(0),
+	Receiver(NULL)
+{
+	for (int s = 0; s < StreamSlots; ++s)
+	{
+		NextSequence[s] = 0;
+		Started[s] = false;
+	}
+}
+
+QFrameStreamSource::~QFrameStreamSource()
+{
+	close();
+}
+
+QString QFrameStreamSource::host() const
+{
+	QMutexLocker lock(&Mutex);
+	return Host;
+}
+
+quint16 QFrameStreamSource::port() const
+{
+	QMutexLocker lock(&Mutex);
+	return Port;
+}
+
+void QFrameStreamSource::setServer(const QString& host, quint16 port)
+{
+	QMutexLocker lock(&Mutex);
+	Host = host;
+	Port = port;
+}
+
+bool QFrameStreamSource::isConnected() const
+{
+	QMutexLocker lock(&Mutex);
+	return Connected;
+}
+
+quint64 QFrameStreamSource::receivedCount() const
+{
+	QMutexLocker lock(&Mutex);
+	return ReceivedFrames;
+}
+
+quint64 QFrameStreamSource::lostCount() const
+{
+	QMutexLocker lock(&Mutex);
+	return Lost;
+}
+
+quint64 QFrameStreamSource::replacedCount() const
+{
+	QMutexLocker lock(&Mutex);
+	return Replaced;
+}
+
+
+bool QFrameStreamSource::open(int streams)
+{
+	close();
+
+	const QString host = this->host();
+	if (host.isEmpty())
+	{
+		std::cerr << "<Error> No frame stream server set" << std::endl;
+		return false;
+	}
+
+	if (!Socket.connect(host, port()))
+	{
+		return false;
+	}
+
+	Request request;
+	request.Magic = RequestMagic;
+	request.Version = Version;
+	request.Streams = static_cast<quint32>(streams & (ColorStream | DepthStream | InfraredStream));
+	request.Reserved = 0;
+
+	QFrameStreamSocket::Buffer part = { &request, sizeof(request) };
+	if (!Socket.send(&part, 1))
+	{
+		std::cerr << "<Error> Frame stream server " << host.toStdString() << " closed the connection" << std::endl;
+		Socket.close();
+		return false;
+	}
+
+	{
+		QMutexLocker lock(&Mutex);
+		Connected = true;
+		Woken = false;
+		Ready = NoStream;
+		ReceivedFrames = 0;
+		Lost = 0;
+		Replaced = 0;
+	}
+
+	for (int s = 0; s < StreamSlots; ++s)
+		Started[s] = false;
+
+	Receiver = new QFrameStreamReceiver(this);
+	Receiver->start();
+	return true;
+}
+
+void QFrameStreamSource::close()
+{
+	if (Receiver)
+	{
+		Socket.shutdown();
+		Receiver->wait();
+		delete Receiver;
+		Receiver = NULL;
+	}
+
+	Socket.close();
+
+	QMutexLocker lock(&Mutex);
+	Connected = false;
+	Ready = NoStream;
+}
+
+
+int QFrameStreamSource::wait(unsigned long timeoutMs)
+{
+	QElapsedTimer waited;
+	waited.start();
+
+	QMutexLocker lock(&Mutex);
+
+	for (;;)
+	{
+		if (Woken)
+		{
+			Woken = false;
+			return NoStream;
+		}
+
+		if (Ready != NoStream)
+			return Ready;
+
+		const qint64 remaining = static_cast<qint64>(timeoutMs) - waited.elapsed();
+		if (remaining <= 0 || !Connected)
+			return NoStream;
+
+		Wakeup.wait(&Mutex, static_cast<unsigned long>(remaining));
+	}
+}
+
+void QFrameStreamSource::wake()
+{
+	QMutexLocker lock(&Mutex);
+	Woken = true;
+	Wakeup.wakeAll();
+}
+
+
+int QFrameStreamSource::slot(int stream)
+{
+	switch (stream)
+	{
+		case ColorStream:		return 0;
+		case DepthStream:		return 1;
+		case InfraredStream:	return 2;
+		default:				return -1;
+	}
+}
+
+/// <summary>
+/// Receiving thread: read frames into the write slot of their stream until the
+/// connection ends. The payload vectors keep their capacity, so once every stream had
+/// its largest frame nothing is allocated anymore.
+/// </summary>
+void QFrameStreamSource::receive()
+{
+	FrameHeader header;
+
+	while (Socket.receive(&header, sizeof(header)))
+	{
+		const int s = slot(static_cast<int>(header.Stream));
+		if (header.Magic != FrameMagic || s < 0 || header.Size > MaxFramePayload)
+		{
+			std::cerr << "<Error> Broken frame stream, disconnecting" << std::endl;
+			break;
+		}
+
+		Received& target = Frames[s].writeBuffer();
+		target.Header = header;
+		target.Payload.resize(header.Size);
+
+		if (!Socket.receive(target.Payload.data(), static_cast<int>(header.Size)))
+			break;
+
+		Frames[s].publish();
+
+		// the server drops frames for a client that falls behind, which shows as a gap
+		const quint32 gap = Started[s] ? header.Sequence - NextSequence[s] : 0;
+		NextSequence[s] = header.Sequence + 1;
+		Started[s] = true;
+
+		QMutexLocker lock(&Mutex);
+		++ReceivedFrames;
+		Lost += gap;
+		if (Ready & header.Stream)
+			++Replaced;
+
+		Ready |= header.Stream;
+		Wakeup.wakeAll();
+	}
+
+	QMutexLocker lock(&Mutex);
+	Connected = false;
+	Wakeup.wakeAll();
+}
+
+/// <summary>
+/// Newest frame received for a stream, if it was not read yet
+/// </summary>
+const QFrameStreamSource::Received* QFrameStreamSource::take(int stream)
+{
+	{
+		QMutexLocker lock(&Mutex);
+
+		if (!(Ready & stream))
+			return NULL;
+
+		Ready &= ~stream;
+	}
+
+	QTripleBuffer<Received>& frames = Frames[slot(stream)];
+	return frames.fetch() ? &frames.readBuffer() : NULL;
+}
+
+
+bool QFrameStreamSource::readColor(QKinectColorFrame& frame, QFramePool& pool)
+{
+	const Received* received = take(ColorStream);
+	if (!received)
+	{
+		return false;
+	}
+
+	const FrameHeader& header = received->Header;
+
+	if (!IsConsistent(header, received->Payload, QFrameRecording::Bgra32))
+	{
+		std::cerr << "<Warning>	Unsupported color frame in frame stream" << std::endl;
+		return false;
+	}
+
+	if (!prepareColorFrame(frame, pool, header.Width, header.Height, QKinectColorFrame::Bgra))
+	{
+		// every buffer is still in use downstream, drop this frame
+		return false;
+	}
+
+	memcpy(frame.Buffer.data(), received->Payload.data(), frame.Buffer.size());
+	frame.Time = header.Time;
+	return true;
+}
+
+bool QFrameStreamSource::readDepth(QKinectDepthFrame& frame)
+{
+	const Received* received = take(DepthStream);
+	if (!received)
+	{
+		return false;
+	}
+
+	const FrameHeader& header = received->Header;
+
+	if (!IsConsistent(header, received->Payload, QFrameRecording::Gray16Rvl))
+	{
+		std::cerr << "<Warning>	Corrupt depth frame in frame stream" << std::endl;
+		return false;
+	}
+
+	prepareDepthFrame(frame, header.Width, header.Height);
+	if (!QDepthCodec::decode(received->Payload.data(), static_cast<int>(header.Size), frame.Buffer.data(), static_cast<int>(frame.Buffer.size())))
+	{
+		std::cerr << "<Warning>	Corrupt depth frame in frame stream" << std::endl;
+		return false;
+	}
+
+	frame.MinReliableDistance = StreamMinReliableDistance;
+	frame.MaxDistance = StreamMaxReliableDistance;
+	frame.Time = header.Time;
+	return true;
+}
+
+bool QFrameStreamSource::readInfrared(QKinectInfraredFrame& frame)
+{
+	const Received* received = take(InfraredStream);
+	if (!received)
+	{
+		return false;
+	}
+
+	const FrameHeader& header = received->Header;
+
+	if (!IsConsistent(header, received->Payload, QFrameRecording::Gray16Rvl))
+	{
+		std::cerr << "<Warning>	Corrupt infrared frame in frame stream" << std::endl;
+		return false;
+	}
+
+	prepareInfraredFrame(frame, header.Width, header.Height);
+	if (!QDepthCodec::decode(received->Payload.data(), static_cast<int>(header.Size), frame.Buffer.data(), static_cast<int>(frame.Buffer.size())))
+	{
+		std::cerr << "<Warning>	Corrupt infrared frame in frame stream" << std::endl;
+		return false;
+	}
+
+	frame.Time = header.Time;
+	return true;
+}
+
+bool QFrameStreamSource::readBody(QKinectBodyFrame& frame)
+{
+	Q_UNUSED(frame);
+	return false;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "QFrameSource.h"
+#include "QFrameStream.h"
+#include "QFrameStreamSocket.h"
+#include "QTripleBuffer.h"
+#include <QMutex>
+#include <QWaitCondition>
+#include <QString>
+
+class QFrameStreamReceiver;
+
+
+/// <summary>
+/// Client of a QFrameStreamServer: receives the frames a grabber on another machine
+/// sends, so a grabber here runs on them, see QKinectGrabber::setFrameSource().
+///
+/// A receiving thread reads the connection as fast as the server writes and keeps the
+/// newest frame of every stream; frames the grabber does not read in time are replaced,
+/// like the sensor does. Depth and infrared are decoded when they are read. Color comes
+/// at the size the server sends. Body frames and calibration tables are not sent, the
+/// point cloud and registration stages do not run on this source. A lost connection is
+/// not retried, wait() returns no frames until the next open().
+/// </summary>
+class QFrameStreamSource : public QFrameSource
+{
+public:
+	QFrameStreamSource();
+	~QFrameStreamSource();
+
+	// applied on the next open()
+	QString host() const;
+	quint16 port() const;
+	void setServer(const QString& host, quint16 port = QFrameStream::DefaultPort);
+
+	bool isConnected() const;
+	quint64 receivedCount() const;			// frames received since open()
+	quint64 lostCount() const;				// frames the server did not send us, from the gaps in their sequence
+	quint64 replacedCount() const;			// frames received but replaced by a newer one before they were read
+
+	bool open(int streams) Q_DECL_OVERRIDE;
+	void close() Q_DECL_OVERRIDE;
+
+	int wait(unsigned long timeoutMs) Q_DECL_OVERRIDE;
+	void wake() Q_DECL_OVERRIDE;
+
+	bool readColor(QKinectColorFrame& frame, QFramePool& pool) Q_DECL_OVERRIDE;
+	bool readDepth(QKinectDepthFrame& frame) Q_DECL_OVERRIDE;
+	bool readInfrared(QKinectInfraredFrame& frame) Q_DECL_OVERRIDE;
+	bool readBody(QKinectBodyFrame& frame) Q_DECL_OVERRIDE;
+
+private:
+	friend class QFrameStreamReceiver;
+
+	enum { StreamSlots = 3 };
+
+	struct Received
+	{
+		QFrameStream::FrameHeader	Header;
+		std::vector<unsigned char>	Payload;
+	};
+
+	static int slot(int stream);
+	void receive();
+	const Received* take(int stream);
+
+	mutable QMutex				Mutex;
+	QWaitCondition				Wakeup;
+
+	QString						Host;
+	quint16						Port;
+	bool						Connected;
+	bool						Woken;
+	int							Ready;				// streams with a frame received and not read yet
+	quint64						ReceivedFrames;
+	quint64						Lost;
+	quint64						Replaced;
+
+	QFrameStreamSocket			Socket;
+	QFrameStreamReceiver*		Receiver;
+	QTripleBuffer<Received>		Frames[StreamSlots];	// receiving thread -> grabber thread
+	quint32						NextSequence[StreamSlots];	// receiving thread only
+	bool						Started[StreamSlots];
+};
@@ -0,0 +1,112 @@
+#include "stdafx.h"
+#include "QFrameSynchronizer.h"
+
+
+QFrameSynchronizer::QFrameSynchronizer() :
+	Streams(QFrameSource::NoStream),
+	Tolerance(0),
+	Pending(QFrameSource::NoStream),
+	Earliest(0),
+	Latest(0),
+	Started(0),
+	Complete(0),
+	Incomplete(0)
+{
+}
+
+void QFrameSynchronizer::setStreams(int streams)
+{
+	Streams = streams & QFrameSource::AllStreams;
+	Pending = QFrameSource::NoStream;
+}
+
+int QFrameSynchronizer::streams() const
+{
+	return Streams;
+}
+
+void QFrameSynchronizer::setTolerance(qint64 ticks)
+{
+	Tolerance = qMax(ticks, Q_INT64_C(0));
+}
+
+qint64 QFrameSynchronizer::tolerance() const
+{
+	return Tolerance;
+}
+
+void QFrameSynchronizer::reset()
+{
+	Pending = QFrameSource::NoStream;
+	Earliest = 0;
+	Latest = 0;
+	Started = 0;
+	Complete = 0;
+	Incomplete = 0;
+}
+
+
+bool QFrameSynchronizer::add(QFrameSource::Stream stream, qint64 time)
+{
+	if (!(Streams & stream))
+	{
+		return false;
+	}
+
+	if (Pending != QFrameSource::NoStream)
+	{
+		qint64 earliest = qMin(Earliest, time);
+		qint64 latest = qMax(Latest, time);
+
+		// the stream already has a frame in this set, or the new one is out of range
+		if ((Pending & stream) || latest - earliest > Tolerance)
+		{
+			++Incomplete;
+			Pending = QFrameSource::NoStream;
+		}
+		else
+		{
+			Earliest = earliest;
+			Latest = latest;
+		}
+	}
+
+	if (Pending == QFrameSource::NoStream)
+	{
+		Earliest = time;
+		Latest = time;
+		++Started;
+	}
+
+	Pending |= stream;
+
+	if (Pending == Streams)
+	{
+		++Complete;
+		Pending = QFrameSource::NoStream;
+		return true;
+	}
+
+	return false;
+}
+
+
+qint64 QFrameSynchronizer::currentSet() const
+{
+	return qMax(Started - 1, Q_INT64_C(0));
+}
+
+int QFrameSynchronizer::pendingStreams() const
+{
+	return Pending;
+}
+
+quint64 QFrameSynchronizer::completeCount() const
+{
+	return Complete;
+}
+
+quint64 QFrameSynchronizer::incompleteCount() const
+{
+	return Incomplete;
+}
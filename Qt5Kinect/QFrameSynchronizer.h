@@ -0,0 +1,52 @@
+#pragma once
+
+#include "QFrameSource.h"
+
+
+/// <summary>
+/// Groups the timestamps of several streams into framesets.
+/// Timestamps are added as frames arrive; a set is complete once every enabled stream
+/// contributed one frame and all of them lie within the tolerance. A set that cannot be
+/// completed any more (a stream repeats, or a frame is too far apart) is counted as
+/// incomplete and a new set is started with the frame that broke it.
+/// Knows nothing about the sensor, times are plain RelativeTime ticks (100 ns).
+/// Every set is numbered, so frames can be tagged as they are read and put together later
+/// in whatever order their processing finishes.
+/// </summary>
+class QFrameSynchronizer
+{
+public:
+	QFrameSynchronizer();
+
+	void setStreams(int streams);		// QFrameSource::Stream flags
+	int streams() const;
+	void setTolerance(qint64 ticks);
+	qint64 tolerance() const;
+
+	void reset();
+
+	/// <summary>
+	/// Add the timestamp of a new frame. Returns true if it completed a set.
+	/// </summary>
+	bool add(QFrameSource::Stream stream, qint64 time);
+
+	/// <summary>
+	/// Number of the set the last added frame went into, counting from 0 after reset().
+	/// Frames with the same number belong to the same set.
+	/// </summary>
+	qint64 currentSet() const;
+
+	int pendingStreams() const;
+	quint64 completeCount() const;
+	quint64 incompleteCount() const;
+
+private:
+	int			Streams;
+	qint64		Tolerance;
+	int			Pending;
+	qint64		Earliest;
+	qint64		Latest;
+	qint64		Started;		// sets started since reset()
+	quint64		Complete;
+	quint64		Incomplete;
+};
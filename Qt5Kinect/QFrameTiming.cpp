@@ -0,0 +1,160 @@
+#include "stdafx.h"
+#include "QFrameTiming.h"
+#include "QFrameSource.h"
+#include <cmath>
+
+
+// Gaps after which the learnt frame period may grow again, a second at 30 fps
+#define PeriodWindow 30
+
+// How fast the host / sensor clock offset baseline may rise, as a fraction of the time
+// between frames: covers the drift between the two clocks, 200 ppm
+#define BaselineDrift 0.0002
+
+
+
+/// <summary>
+/// Running mean and sum of squared deviations (Welford)
+/// </summary>
+static void Accumulate(double value, quint64& count, double& mean, double& squares)
+{
+	++count;
+	const double delta = value - mean;
+	mean += delta / count;
+	squares += delta * (value - mean);
+}
+
+static double Deviation(quint64 count, double squares)
+{
+	return count > 1 ? std::sqrt(squares / (count - 1)) : 0.0;
+}
+
+
+
+QFrameTiming::QFrameTiming()
+{
+	reset();
+}
+
+void QFrameTiming::reset()
+{
+	QMutexLocker lock(&Mutex);
+
+	for (int s = 0; s < StreamCount; ++s)
+		resetStream(Streams[s]);
+}
+
+void QFrameTiming::add(int stream, qint64 time, qint64 arrived)
+{
+	QMutexLocker lock(&Mutex);
+
+	StreamTiming& timing = Streams[slot(stream)];
+	QKinectStreamStatistics& statistics = timing.Statistics;
+
+	const double offset = arrived - time * 100.0;
+	++statistics.Delivered;
+
+	if (!timing.Started)
+	{
+		timing.Started = true;
+		timing.LastTime = time;
+		timing.LastArrival = arrived;
+		timing.Baseline = offset;
+		return;
+	}
+
+	const qint64 gap = time - timing.LastTime;
+
+	if (gap == 0)
+	{
+		++statistics.Duplicate;
+		timing.LastArrival = arrived;
+		return;
+	}
+
+	if (gap < 0)
+	{
+		// older than a frame already delivered
+		++statistics.Late;
+		return;
+	}
+
+	// the period shrinks at once to a shorter gap, and grows only once a whole window had none
+	timing.ShortestGap = qMin(timing.ShortestGap, gap);
+	timing.Period = timing.Period > 0 ? qMin(timing.Period, gap) : gap;
+
+	if (++timing.Gaps == PeriodWindow)
+	{
+		timing.Period = timing.ShortestGap;
+		timing.ShortestGap = gap;
+		timing.Gaps = 0;
+	}
+
+	const qint64 periods = (gap + timing.Period / 2) / timing.Period;
+
+	if (periods > 1)
+		statistics.Dropped += periods - 1;
+	else
+		Accumulate(gap / 10000.0, timing.Intervals, timing.IntervalMean, timing.IntervalSquares);
+
+	Accumulate(((arrived - timing.LastArrival) - gap * 100.0) / 1e6, timing.Arrivals, timing.ArrivalMean, timing.ArrivalSquares);
+
+	timing.Baseline = qMin(timing.Baseline + gap * 100.0 * BaselineDrift, offset);
+	if (offset - timing.Baseline > timing.Period * 100.0)
+		++statistics.Late;
+
+	timing.LastTime = time;
+	timing.LastArrival = arrived;
+}
+
+QKinectFrameStatistics QFrameTiming::statistics() const
+{
+	QMutexLocker lock(&Mutex);
+
+	QKinectFrameStatistics statistics;
+	statistics.Color = snapshot(Streams[slot(QFrameSource::ColorStream)]);
+	statistics.Depth = snapshot(Streams[slot(QFrameSource::DepthStream)]);
+	statistics.Infrared = snapshot(Streams[slot(QFrameSource::InfraredStream)]);
+	statistics.Body = snapshot(Streams[slot(QFrameSource::BodyStream)]);
+	return statistics;
+}
+
+
+int QFrameTiming::slot(int stream)
+{
+	switch (stream)
+	{
+		case QFrameSource::ColorStream:		return 0;
+		case QFrameSource::DepthStream:		return 1;
+		case QFrameSource::InfraredStream:	return 2;
+		default:							return 3;
+	}
+}
+
+void QFrameTiming::resetStream(StreamTiming& timing)
+{
+	timing.Statistics = QKinectStreamStatistics();
+	timing.Started = false;
+	timing.LastTime = 0;
+	timing.LastArrival = 0;
+	timing.Period = 0;
+	timing.ShortestGap = Q_INT64_C(0x7FFFFFFFFFFFFFFF);
+	timing.Gaps = 0;
+	timing.Baseline = 0;
+	timing.Intervals = 0;
+	timing.IntervalMean = 0;
+	timing.IntervalSquares = 0;
+	timing.Arrivals = 0;
+	timing.ArrivalMean = 0;
+	timing.ArrivalSquares = 0;
+}
+
+QKinectStreamStatistics QFrameTiming::snapshot(const StreamTiming& timing)
+{
+	QKinectStreamStatistics statistics = timing.Statistics;
+	statistics.FramePeriod = timing.Period / 10000.0;
+	statistics.MeanInterval = timing.IntervalMean;
+	statistics.IntervalJitter = Deviation(timing.Intervals, timing.IntervalSquares);
+	statistics.ArrivalJitter = Deviation(timing.Arrivals, timing.ArrivalSquares);
+	return statistics;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "QKinectFrameStatistics.h"
+#include <QMutex>
+
+
+/// <summary>
+/// Infers dropped, duplicate and late frames and the jitter of every stream from the
+/// RelativeTime of the frames delivered and the time they reached the grabber.
+///
+/// A gap of n frame periods between two frames means n - 1 frames were dropped. The
+/// frame period is the shortest interval among the last few, so a stream that changes
+/// rate (color halves it in low light) is not mistaken for one that drops every other
+/// frame; the other way round, a stream that loses every other frame for a whole window
+/// of gaps is taken for one running at half rate, and the frames lost until then count as
+/// dropped. A frame is late when it reached the grabber more than a frame period behind
+/// the stream's earliest frames, the sensor and host clocks being compared through the
+/// smallest offset seen between them, which is allowed to drift slowly.
+///
+/// add() is called by the grabber thread; statistics() may be called from any thread.
+/// </summary>
+class QFrameTiming
+{
+public:
+	QFrameTiming();
+
+	void reset();
+
+	/// <summary>
+	/// A frame of stream (a QFrameSource::Stream flag) with RelativeTime time (100 ns ticks)
+	/// arrived at arrived (ns, QFrameLatency::now())
+	/// </summary>
+	void add(int stream, qint64 time, qint64 arrived);
+
+	QKinectFrameStatistics statistics() const;
+
+private:
+	enum { StreamCount = 4 };
+
+	struct StreamTiming
+	{
+		QKinectStreamStatistics	Statistics;
+		bool					Started;
+		qint64					LastTime;
+		qint64					LastArrival;
+		qint64					Period;				// ticks
+		qint64					ShortestGap;		// ticks, among the gaps since Period was last updated
+		int						Gaps;
+		double					Baseline;			// smallest arrival - time offset, ns
+		quint64					Intervals;			// Welford accumulators of the intervals without drops
+		double					IntervalMean;
+		double					IntervalSquares;
+		quint64					Arrivals;			// and of the arrival minus frame intervals
+		double					ArrivalMean;
+		double					ArrivalSquares;
+	};
+
+	static int slot(int stream);
+	static void resetStream(StreamTiming& timing);
+	static QKinectStreamStatistics snapshot(const StreamTiming& timing);
+
+	mutable QMutex		Mutex;
+	StreamTiming		Streams[StreamCount];
+};
@@ -1,18 +1,225 @@
 #include "stdafx.h"
 #include "QImageWidget.h"
+#include "QFrameLatency.h"
 
-QImageWidget::QImageWidget(QWidget* parent) : QLabel(parent)
+
+// Refresh rate assumed when the screen does not report one, in Hz
+#define DefaultRefreshRate 60.0
+
+
+QImageWidget::QImageWidget(QWidget* parent) :
+	QWidget(parent),
+	Dirty(false),
+	Received(0),
+	Painted(0),
+	Skipped(0),
+	Latency(nullptr),
+	LatencyStream(0)
+{
+	// paintEvent() covers every pixel, nothing needs erasing first
+	setAttribute(Qt::WA_OpaquePaintEvent);
+
+	// one tick per refresh of the screen
+	const QScreen* screen = QGuiApplication::primaryScreen();
+	const qreal rate = screen && screen->refreshRate() > 0 ? screen->refreshRate() : DefaultRefreshRate;
+
+	RefreshTimer.setTimerType(Qt::PreciseTimer);
+	RefreshTimer.setInterval(qMax(1, qRound(1000.0 / rate)));
+	connect(&RefreshTimer, SIGNAL(timeout()), this, SLOT(refresh()));
+}
+
+
+void QImageWidget::setLatency(QFrameLatency* latency, int stream)
+{
+	Latency = latency;
+	LatencyStream = stream;
+}
+
+
+QImage QImageWidget::image() const
+{
+	return Image;
+}
+
+quint64 QImageWidget::paintedCount() const
 {
+	return Painted;
+}
+
+quint64 QImageWidget::skippedCount() const
+{
+	return Skipped;
+}
+
+QSize QImageWidget::sizeHint() const
+{
+	return Image.isNull() ? QWidget::sizeHint() : Image.size();
 }
 
 
 void QImageWidget::setImage(const QImage& image)
 {
-	if (!image.isNull())
+	if (image.isNull())
+		return;
+
+	// the image not painted yet is dropped, with the buffer it holds
+	if (Dirty)
+		++Skipped;
+
+	Image = image;
+	Dirty = true;
+	Received = Latency ? QFrameLatency::now() : 0;
+
+	// the first image after a pause is painted right away, the following ones on the refresh ticks
+	if (!RefreshTimer.isActive())
 	{
-		//resize(image.size());
-		//setPixmap(QPixmap::fromImage(image));
-		setPixmap(QPixmap::fromImage(image).scaled(width(), height(), Qt::KeepAspectRatio));
+		update();
+		RefreshTimer.start();
+	}
+}
+
+
+/// <summary>
+/// Refresh tick: repaint if a new image arrived since the last one, else stop ticking
+/// until the next image
+/// </summary>
+void QImageWidget::refresh()
+{
+	if (Dirty && isVisible())
+		update();
+	else
+		RefreshTimer.stop();
+}
+
+
+void QImageWidget::resizeEvent(QResizeEvent* event)
+{
+	updateTargetRect();
+	QWidget::resizeEvent(event);
+}
+
+
+/// <summary>
+/// Largest rectangle with the image's aspect ratio, centered in the widget
+/// </summary>
+void QImageWidget::updateTargetRect()
+{
+	TargetImageSize = Image.size();
+
+	if (Image.isNull())
+	{
+		TargetRect = QRect();
+		return;
+	}
+
+	const QSize fitted = Image.size().scaled(size(), Qt::KeepAspectRatio);
+	TargetRect = QRect(QPoint((width() - fitted.width()) / 2, (height() - fitted.height()) / 2), fitted);
+}
+
+
+/// <summary>
+/// Image in a form the painter only has to copy: 32 bit without alpha, and shrunk to
+/// TargetRect when it is larger. Buffers are kept from one frame to the next.
+/// </summary>
+const QImage& QImageWidget::displayImage()
+{
+	const QImage* source = &Image;
+
+	switch (Image.format())
+	{
+		case QImage::Format_RGB32:
+			break;
+
+		case QImage::Format_ARGB32:
+		case QImage::Format_ARGB32_Premultiplied:
+			// the grabber's color images are opaque: the same pixels, read as RGB32 without a copy,
+			// are blitted instead of blended
+			Converted = QImage(Image.constBits(), Image.width(), Image.height(), Image.bytesPerLine(), QImage::Format_RGB32);
+			source = &Converted;
+			break;
+
+		case QImage::Format_Indexed8:
+		{
+			// depth and infrared, through their color table
+			QRgb table[256];
+			const QVector<QRgb> colors = Image.colorTable();
+			for (int i = 0; i < 256; ++i)
+				table[i] = i < colors.size() ? colors[i] : qRgb(0, 0, 0);
+
+			if (Converted.size() != Image.size() || Converted.format() != QImage::Format_RGB32)
+				Converted = QImage(Image.size(), QImage::Format_RGB32);
+
+			for (int y = 0; y < Image.height(); ++y)
+			{
+				const uchar* src = Image.constScanLine(y);
+				QRgb* dst = reinterpret_cast<QRgb*>(Converted.scanLine(y));
+
+				for (int x = 0; x < Image.width(); ++x)
+					dst[x] = table[src[x]];
+			}
+
+			source = &Converted;
+			break;
+		}
+
+		default:
+			Converted = Image.convertToFormat(QImage::Format_RGB32);
+			source = &Converted;
+			break;
+	}
+
+	if (source->width() <= TargetRect.width() && source->height() <= TargetRect.height())
+		return *source;
+
+	// shrinking averages the source pixels each target pixel covers, which a fast transform would skip
+	if (Scaled.size() != TargetRect.size())
+		Scaled = QImage(TargetRect.size(), QImage::Format_RGB32);
+
+	Downscaler.process(source->constBits(), source->width(), source->height(), source->bytesPerLine(),
+		Scaled.bits(), Scaled.width(), Scaled.height(), Scaled.bytesPerLine());
+
+	return Scaled;
+}
+
+
+void QImageWidget::paintEvent(QPaintEvent* event)
+{
+	Q_UNUSED(event);
+
+	QPainter painter(this);
+	const QBrush background = palette().window();
+
+	if (Image.isNull())
+	{
+		painter.fillRect(rect(), background);
+		return;
+	}
+
+	if (Image.size() != TargetImageSize)
+		updateTargetRect();
+
+	// the image covers the target rectangle, only the borders around it are cleared
+	painter.fillRect(0, 0, width(), TargetRect.top(), background);
+	painter.fillRect(0, TargetRect.bottom() + 1, width(), height() - TargetRect.bottom() - 1, background);
+	painter.fillRect(0, TargetRect.top(), TargetRect.left(), TargetRect.height(), background);
+	painter.fillRect(TargetRect.right() + 1, TargetRect.top(), width() - TargetRect.right() - 1, TargetRect.height(), background);
+
+	const QImage& image = displayImage();
+
+	// an image of the target's size is copied as is, a smaller one is enlarged with the fast transform
+	painter.setCompositionMode(QPainter::CompositionMode_Source);
+	if (image.size() == TargetRect.size())
+		painter.drawImage(TargetRect.topLeft(), image);
+	else
+		painter.drawImage(TargetRect, image);
+
+	if (Dirty)
+	{
+		Dirty = false;
+		++Painted;
+
+		if (Latency)
+			Latency->presented(LatencyStream, Image.cacheKey(), Received, QFrameLatency::now());
 	}
 }
 
@@ -25,14 +232,15 @@ bool QImageWidget::loadFile(const QString &fileName)
 		QMessageBox::information(this, QGuiApplication::applicationDisplayName(),
 			tr("Cannot load %1.").arg(QDir::toNativeSeparators(fileName)));
 		setWindowFilePath(QString());
-		setPixmap(QPixmap());
-		adjustSize();
+		Image = QImage();
+		Dirty = false;
+		update();
 		return false;
 	}
 
 	setImage(image);
+	updateGeometry();
 
 	setWindowFilePath(fileName);
 	return true;
 }
-
@@ -1,13 +1,65 @@
 #pragma once
 
-class QImageWidget : public QLabel
+#include "QColorDownscaler.h"
+
+class QFrameLatency;
+
+/// <summary>
+/// Shows the latest image it was given, fitted into the widget with its aspect ratio kept.
+///
+/// setImage() only keeps the image; the widget repaints at most once per display refresh,
+/// so images arriving faster than that are never drawn. Painting goes through a target
+/// rectangle computed when the widget or the image size changes, blits the image as is
+/// when it fits exactly, shrinks color images with QColorDownscaler into a buffer kept
+/// between frames, and draws everything else with a fast transform. A steady stream of
+/// frames therefore allocates no pixel buffers on the GUI thread.
+/// </summary>
+class QImageWidget : public QWidget
 {
 	Q_OBJECT
 
-public:
-	QImageWidget(QWidget* parent = nullptr);
-
-public slots:
-	bool loadFile(const QString &);
-	void setImage(const QImage& image);
+public:
+	QImageWidget(QWidget* parent = nullptr);
+
+	// report the queue and present stages of every image of stream, see QKinectGrabber::latency()
+	void setLatency(QFrameLatency* latency, int stream);
+
+	QImage image() const;
+	quint64 paintedCount() const;			// images painted
+	quint64 skippedCount() const;			// images replaced by a newer one before they were painted
+
+	QSize sizeHint() const Q_DECL_OVERRIDE;
+
+public slots:
+	bool loadFile(const QString &);
+	void setImage(const QImage& image);
+
+protected:
+	void paintEvent(QPaintEvent* event) Q_DECL_OVERRIDE;
+	void resizeEvent(QResizeEvent* event) Q_DECL_OVERRIDE;
+
+private slots:
+	void refresh();
+
+private:
+	void updateTargetRect();
+	const QImage& displayImage();
+
+	QImage				Image;				// latest image, drawn on the next refresh
+	bool				Dirty;				// Image was not painted yet
+	qint64				Received;			// when Image arrived, for the latency
+	QTimer				RefreshTimer;		// one tick per display refresh while images arrive
+
+	QRect				TargetRect;			// where Image goes, kept until the sizes change
+	QSize				TargetImageSize;	// image size TargetRect was computed for
+
+	QImage				Converted;			// Image as 32 bit, for the other formats
+	QImage				Scaled;				// Image shrunk to TargetRect
+	QColorDownscaler	Downscaler;
+
+	quint64				Painted;
+	quint64				Skipped;
+
+	QFrameLatency*		Latency;
+	int					LatencyStream;
 };
@@ -0,0 +1,212 @@
+#include "stdafx.h"
+#include "QInfraredToneMapper.h"
+#include <climits>
+
+
+// InfraredSourceValueMaximum is the highest value that can be returned in the InfraredFrame.
+// It is cast to a float for readability in the visualization code.
+#define InfraredSourceValueMaximum static_cast<float>(USHRT_MAX)
+
+// The InfraredOutputValueMinimum value is used to set the lower limit, post processing, of the
+// infrared data that we will render.
+// Increasing or decreasing this value sets a brightness "wall" either closer or further away.
+#define InfraredOutputValueMinimum 0.01f 
+
+// The InfraredOutputValueMaximum value is the upper limit, post processing, of the
+// infrared data that we will render.
+#define InfraredOutputValueMaximum 1.0f
+
+// The InfraredSceneValueAverage value specifies the average infrared value of the scene.
+// This value was selected by analyzing the average pixel intensity for a given scene.
+// Depending on the visualization requirements for a given application, this value can be
+// hard coded, as was done here, or calculated by averaging the intensity for each pixel prior
+// to rendering.
+#define InfraredSceneValueAverage 0.08f
+
+/// The InfraredSceneStandardDeviations value specifies the number of standard deviations
+/// to apply to InfraredSceneValueAverage. This value was selected by analyzing data
+/// from a given scene.
+/// Depending on the visualization requirements for a given application, this value can be
+/// hard coded, as was done here, or calculated at runtime.
+#define InfraredSceneStandardDeviations 3.0f
+
+// Lowest scene average adaptation may settle on, keeps a black scene from blowing up the gain
+#define InfraredSceneValueAverageMinimum 0.005f
+
+// The histogram is halved once it holds this many samples, so older frames fade out
+#define InfraredHistogramDecayLimit (1 << 20)
+
+
+QInfraredToneMapper::QInfraredToneMapper() :
+	TableAverage(0.f),
+	Rebuilds(0),
+	Adaptive(false),
+	SceneAverage(InfraredSceneValueAverage),
+	StandardDeviations(InfraredSceneStandardDeviations),
+	DriftThreshold(0.1f),
+	SampleStep(8),
+	SamplePhase(0),
+	HistogramTotal(0)
+{
+	Table.resize(USHRT_MAX + 1);
+	Histogram.resize(HistogramBins, 0);
+	rebuild(SceneAverage);
+}
+
+bool QInfraredToneMapper::adaptive() const
+{
+	return Adaptive;
+}
+
+void QInfraredToneMapper::setAdaptive(bool adaptive)
+{
+	if (Adaptive == adaptive)
+		return;
+
+	Adaptive = adaptive;
+	std::fill(Histogram.begin(), Histogram.end(), 0);
+	HistogramTotal = 0;
+
+	// switching adaptation off goes back to the fixed mapping
+	if (!Adaptive)
+		rebuild(SceneAverage);
+}
+
+float QInfraredToneMapper::sceneAverage() const
+{
+	return SceneAverage;
+}
+
+void QInfraredToneMapper::setSceneAverage(float average)
+{
+	SceneAverage = qMax(average, InfraredSceneValueAverageMinimum);
+	rebuild(SceneAverage);
+}
+
+float QInfraredToneMapper::standardDeviations() const
+{
+	return StandardDeviations;
+}
+
+void QInfraredToneMapper::setStandardDeviations(float deviations)
+{
+	StandardDeviations = qMax(deviations, 0.1f);
+	rebuild(TableAverage);
+}
+
+float QInfraredToneMapper::driftThreshold() const
+{
+	return DriftThreshold;
+}
+
+void QInfraredToneMapper::setDriftThreshold(float relativeChange)
+{
+	DriftThreshold = qMax(relativeChange, 0.f);
+}
+
+int QInfraredToneMapper::sampleStep() const
+{
+	return SampleStep;
+}
+
+void QInfraredToneMapper::setSampleStep(int step)
+{
+	SampleStep = qMax(step, 1);
+	SamplePhase = 0;
+}
+
+const unsigned char* QInfraredToneMapper::table() const
+{
+	return Table.data();
+}
+
+int QInfraredToneMapper::rebuildCount() const
+{
+	return Rebuilds;
+}
+
+
+void QInfraredToneMapper::rebuild(float average)
+{
+	// same operations, in the same order and precision, as the per pixel code this replaces
+	const float divisor = average * StandardDeviations;
+
+	for (int v = 0; v <= USHRT_MAX; ++v)
+	{
+		// normalize the incoming infrared data (ushort) to a float ranging from 
+		// [InfraredOutputValueMinimum, InfraredOutputValueMaximum] by
+		// 1. dividing the incoming value by the source maximum value
+		float intensityRatio = static_cast<float>(v) / InfraredSourceValueMaximum;
+
+		// 2. dividing by the (average scene value * standard deviations)
+		intensityRatio /= divisor;
+
+		// 3. limiting the value to InfraredOutputValueMaximum
+		intensityRatio = qMin(InfraredOutputValueMaximum, intensityRatio);
+
+		// 4. limiting the lower value InfraredOutputValueMinimym
+		intensityRatio = qMax(InfraredOutputValueMinimum, intensityRatio);
+
+		// 5. converting the normalized value to a byte
+		Table[v] = static_cast<unsigned char>(intensityRatio * 255.0f);
+	}
+
+	TableAverage = average;
+	++Rebuilds;
+}
+
+
+void QInfraredToneMapper::map(const unsigned short* src, int width, int height, unsigned char* dst, int dstStride)
+{
+	const unsigned char* table = Table.data();
+
+	for (int y = 0; y < height; ++y)
+	{
+		const unsigned short* in = src + y * width;
+		unsigned char* out = dst + y * dstStride;
+
+		for (int x = 0; x < width; ++x)
+			out[x] = table[in[x]];
+
+		// a few rows per frame feed the histogram, the phase moves so every row gets its turn
+		if (Adaptive && (y % SampleStep) == SamplePhase)
+		{
+			for (int x = SamplePhase; x < width; x += SampleStep)
+				++Histogram[in[x] >> HistogramShift];
+
+			HistogramTotal += (width - SamplePhase + SampleStep - 1) / SampleStep;
+		}
+	}
+
+	if (Adaptive)
+	{
+		SamplePhase = (SamplePhase + 1) % SampleStep;
+		adapt();
+	}
+}
+
+
+void QInfraredToneMapper::adapt()
+{
+	if (HistogramTotal == 0)
+		return;
+
+	double sum = 0.0;
+	for (int i = 0; i < HistogramBins; ++i)
+		sum += static_cast<double>(Histogram[i]) * ((i << HistogramShift) + (1 << (HistogramShift - 1)));
+
+	const float average = qMax(static_cast<float>(sum / HistogramTotal / InfraredSourceValueMaximum), InfraredSceneValueAverageMinimum);
+
+	if (qAbs(average - TableAverage) > DriftThreshold * TableAverage)
+		rebuild(average);
+
+	if (HistogramTotal > InfraredHistogramDecayLimit)
+	{
+		HistogramTotal = 0;
+		for (int i = 0; i < HistogramBins; ++i)
+		{
+			Histogram[i] >>= 1;
+			HistogramTotal += Histogram[i];
+		}
+	}
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+
+
+/// <summary>
+/// Maps 16 bit infrared to 8 bit through a 65536 entry lookup table.
+/// The table follows the SDK sample's normalization (value / max / (scene average *
+/// standard deviations), clamped). With adaptation off it uses the sample's fixed scene
+/// average and matches it exactly. With adaptation on, the scene average is estimated
+/// from a subsampled histogram that is updated while frames are mapped, and the table
+/// is rebuilt only when that estimate drifts past a threshold.
+/// </summary>
+class QInfraredToneMapper
+{
+public:
+	QInfraredToneMapper();
+
+	bool adaptive() const;
+	void setAdaptive(bool adaptive);
+
+	float sceneAverage() const;					// as a ratio of the source maximum
+	void setSceneAverage(float average);		// the fixed average, also the starting point of adaptation
+	float standardDeviations() const;
+	void setStandardDeviations(float deviations);
+	float driftThreshold() const;
+	void setDriftThreshold(float relativeChange);
+	int sampleStep() const;
+	void setSampleStep(int step);				// one pixel in step x step feeds the histogram
+
+	/// <summary>
+	/// Tone map a frame into dst, whose rows are dstStride bytes apart
+	/// </summary>
+	void map(const unsigned short* src, int width, int height, unsigned char* dst, int dstStride);
+
+	const unsigned char* table() const;
+	int rebuildCount() const;
+
+private:
+	void rebuild(float average);
+	void adapt();
+
+	std::vector<unsigned char>	Table;
+	float						TableAverage;		// scene average the table was built for
+	int							Rebuilds;
+
+	bool						Adaptive;
+	float						SceneAverage;
+	float						StandardDeviations;
+	float						DriftThreshold;
+	int							SampleStep;
+	int							SamplePhase;		// rotates the sampled rows from frame to frame
+
+	enum { HistogramBins = 256, HistogramShift = 8 };
+	std::vector<unsigned int>	Histogram;			// v >> HistogramShift
+	unsigned int				HistogramTotal;
+};
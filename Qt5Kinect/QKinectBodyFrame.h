@@ -0,0 +1,64 @@
+#pragma once
+
+#include <QMetaType>
+
+
+/// <summary>
+/// Every body slot of one body frame, laid out as structure of arrays.
+/// Joint j of body b lives at index(b, j); j follows the SDK's JointType order
+/// (JointType_SpineBase = 0 ... JointType_ThumbRight = 24). Entries of bodies that
+/// are not tracked are left as they were, check isTracked() first.
+/// Plain fixed size data: copying it never allocates.
+/// </summary>
+struct QKinectBodyFrame
+{
+	enum
+	{
+		BodyCount = 6,			// BODY_COUNT
+		JointCount = 25,		// JointType_Count
+		JointTotal = BodyCount * JointCount
+	};
+
+	// same values as the SDK's TrackingState
+	enum JointTrackingState
+	{
+		NotTracked = 0,
+		Inferred = 1,
+		Tracked = 2
+	};
+
+	static int index(int body, int joint)
+	{
+		return body * JointCount + joint;
+	}
+
+	bool isTracked(int body) const
+	{
+		return (TrackedBodies & (1 << body)) != 0;
+	}
+
+	qint64			Time;						// RelativeTime, 100 ns ticks
+	int				TrackedBodies;				// bit b set when body b is tracked
+	quint64			TrackingId[BodyCount];
+
+	// camera space, meters
+	float			PositionX[JointTotal];
+	float			PositionY[JointTotal];
+	float			PositionZ[JointTotal];
+
+	// joint orientation quaternion
+	float			OrientationX[JointTotal];
+	float			OrientationY[JointTotal];
+	float			OrientationZ[JointTotal];
+	float			OrientationW[JointTotal];
+
+	unsigned char	TrackingState[JointTotal];	// JointTrackingState
+
+	// joint positions projected into depth (512x424) and color (1920x1080) pixels
+	float			DepthX[JointTotal];
+	float			DepthY[JointTotal];
+	float			ColorX[JointTotal];
+	float			ColorY[JointTotal];
+};
+
+Q_DECLARE_METATYPE(QKinectBodyFrame)
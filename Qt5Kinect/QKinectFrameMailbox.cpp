@@ -0,0 +1,115 @@
+#include "stdafx.h"
+#include "QKinectFrameMailbox.h"
+#include "QKinectGrabber.h"
+#include "QFrameSource.h"
+
+
+
+QKinectFrameMailbox::QKinectFrameMailbox(QObject *parent) :
+	QObject(parent),
+	Scheduled(false),
+	Grabber(NULL)
+{
+	for (int s = 0; s < StreamCount; ++s)
+	{
+		Delivered[s] = 0;
+		Coalesced[s] = 0;
+	}
+}
+
+QKinectFrameMailbox::~QKinectFrameMailbox()
+{
+	// a deliver() still queued for this object is discarded with it
+	if (Grabber)
+		Grabber->removeMailbox(this);
+}
+
+
+void QKinectFrameMailbox::post(int stream, const QImage &image)
+{
+	const int s = slot(stream);
+	if (s < 0 || image.isNull())
+		return;
+
+	QMutexLocker lock(&Mutex);
+
+	if (!Pending[s].isNull())
+		++Coalesced[s];
+
+	// the replaced image is released here, its buffer goes back to the grabber's pool
+	Pending[s] = image;
+
+	if (!Scheduled)
+	{
+		Scheduled = true;
+		QMetaObject::invokeMethod(this, "deliver", Qt::QueuedConnection);
+	}
+}
+
+
+/// <summary>
+/// Runs in the mailbox's thread: emit every pending image
+/// </summary>
+void QKinectFrameMailbox::deliver()
+{
+	QImage images[StreamCount];
+	{
+		QMutexLocker lock(&Mutex);
+
+		for (int s = 0; s < StreamCount; ++s)
+		{
+			images[s] = Pending[s];
+			Pending[s] = QImage();
+
+			if (!images[s].isNull())
+				++Delivered[s];
+		}
+
+		Scheduled = false;
+	}
+
+	if (!images[0].isNull())
+		emit colorImage(images[0]);
+	if (!images[1].isNull())
+		emit depthImage(images[1]);
+	if (!images[2].isNull())
+		emit infraredImage(images[2]);
+}
+
+
+quint64 QKinectFrameMailbox::deliveredCount(int stream) const
+{
+	const int s = slot(stream);
+	QMutexLocker lock(&Mutex);
+	return s >= 0 ? Delivered[s] : 0;
+}
+
+quint64 QKinectFrameMailbox::coalescedCount(int stream) const
+{
+	const int s = slot(stream);
+	QMutexLocker lock(&Mutex);
+	return s >= 0 ? Coalesced[s] : 0;
+}
+
+void QKinectFrameMailbox::resetCounts()
+{
+	QMutexLocker lock(&Mutex);
+
+	for (int s = 0; s < StreamCount; ++s)
+	{
+		Delivered[s] = 0;
+		Coalesced[s] = 0;
+	}
+}
+
+
+int QKinectFrameMailbox::slot(int stream)
+{
+	switch (stream)
+	{
+		case QFrameSource::ColorStream:		return 0;
+		case QFrameSource::DepthStream:		return 1;
+		case QFrameSource::InfraredStream:	return 2;
+		default:							return -1;
+	}
+}
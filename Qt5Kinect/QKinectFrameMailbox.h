@@ -0,0 +1,64 @@
+#pragma once
+
+#include <QObject>
+#include <QImage>
+#include <QMutex>
+
+class QKinectGrabber;
+
+
+/// <summary>
+/// Latest-value delivery of the grabber's images to one consumer.
+///
+/// A queued connection to QKinectGrabber::colorImage() posts an event per frame, and
+/// while the receiving thread is busy those pile up, each holding its image. A mailbox
+/// keeps at most one pending image per stream instead: a newer frame replaces the
+/// pending one, which is counted as coalesced, and a single queued call hands over what
+/// is pending once the receiver's event loop gets to it. Under overload the receiver is
+/// then never more than one frame behind.
+///
+/// Create it in the consumer's thread, connect its signals as the grabber's would be and
+/// pass it to QKinectGrabber::addMailbox(). It removes itself when deleted.
+/// </summary>
+class QKinectFrameMailbox : public QObject
+{
+	Q_OBJECT
+
+public:
+	QKinectFrameMailbox(QObject *parent = 0);
+	~QKinectFrameMailbox();
+
+	/// <summary>
+	/// Grabber side, from any thread: make image the pending one of the stream, a
+	/// QFrameSource::Stream flag. Only color, depth and infrared are delivered.
+	/// </summary>
+	void post(int stream, const QImage &image);
+
+	quint64 deliveredCount(int stream) const;
+	quint64 coalescedCount(int stream) const;	// images replaced by a newer one before delivery
+	void resetCounts();
+
+signals:
+	void colorImage(const QImage &image);
+	void depthImage(const QImage &image);
+	void infraredImage(const QImage &image);
+
+private slots:
+	void deliver();
+
+private:
+	friend class QKinectGrabber;
+
+	enum { StreamCount = 3 };
+
+	static int slot(int stream);
+
+	mutable QMutex		Mutex;
+	QImage				Pending[StreamCount];
+	bool				Scheduled;				// a deliver() call is queued
+	quint64				Delivered[StreamCount];
+	quint64				Coalesced[StreamCount];
+	QKinectGrabber*		Grabber;				// set while added to a grabber
+
+	Q_DISABLE_COPY(QKinectFrameMailbox);
+};
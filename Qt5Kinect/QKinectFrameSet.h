@@ -0,0 +1,38 @@
+#pragma once
+
+#include <QImage>
+#include <QMetaType>
+#include "QKinectBodyFrame.h"
+
+
+/// <summary>
+/// Frames of every enabled stream that belong to the same sensor tick,
+/// emitted by QKinectGrabber::frameSet() in synchronized mode.
+/// Body is only meaningful when the body stream is part of the set.
+/// Times are the frames' RelativeTime (100 ns ticks).
+/// </summary>
+struct QKinectFrameSet
+{
+	QKinectFrameSet() :
+		Streams(0),
+		ColorTime(0),
+		DepthTime(0),
+		InfraredTime(0),
+		BodyTime(0)
+	{
+	}
+
+	int			Streams;		// QFrameSource::Stream flags of the frames in the set
+
+	QImage		Color;
+	QImage		Depth;
+	QImage		Infrared;
+	QKinectBodyFrame Body;
+
+	qint64		ColorTime;
+	qint64		DepthTime;
+	qint64		InfraredTime;
+	qint64		BodyTime;
+};
+
+Q_DECLARE_METATYPE(QKinectFrameSet)
@@ -0,0 +1,912 @@
+#include "stdafx.h"
+#include "QKinectFrameSource.h"
+#include "QFrameRegistration.h"
+#include <algorithm>
+
+
+// Interval the readers are polled at when frame events are not used
+#define PollInterval 3
+
+// Depths (mm) the registration table is sampled at
+#define RegistrationNearDepth 1000.f
+#define RegistrationMidDepth 2000.f
+#define RegistrationFarDepth 4000.f
+
+// Largest distance, in color pixels, the table may put a depth pixel from where the mapper
+// does: about a quarter of the color pixels one depth pixel covers. Checked for all but
+// the worst percent of the pixels, a few at the frame corners are off with lens distortion.
+#define RegistrationMaxError 1.f
+#define RegistrationErrorPercentile 0.99f
+
+// Depths (mm) the table is checked at, away from the two it is fitted to
+static const float RegistrationCheckDepths[] = { 500.f, 2500.f, 4500.f, 8000.f };
+
+
+
+QKinectFrameSource::QKinectFrameSource() :
+	KinectSensor(NULL),
+	CoordinateMapper(NULL),
+	ColorFrameReader(NULL),
+	DepthFrameReader(NULL),
+	InfraredFrameReader(NULL),
+	BodyFrameReader(NULL),
+	OpenStreams(NoStream),
+	RegistrationRejected(false),
+	UseFrameEvents(true),
+	Subscribed(false),
+	ColorEvent(0),
+	DepthEvent(0),
+	InfraredEvent(0),
+	BodyEvent(0),
+	HandleCount(0)
+{
+	for (int b = 0; b < BODY_COUNT; ++b)
+		Bodies[b] = NULL;
+
+	// auto reset, so a wake() is consumed by exactly one wait()
+	WakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+}
+
+QKinectFrameSource::~QKinectFrameSource()
+{
+	close();
+
+	if (WakeEvent)
+	{
+		CloseHandle(WakeEvent);
+		WakeEvent = NULL;
+	}
+}
+
+bool QKinectFrameSource::useFrameEvents() const
+{
+	return UseFrameEvents;
+}
+
+void QKinectFrameSource::setUseFrameEvents(bool use)
+{
+	UseFrameEvents = use;
+}
+
+
+bool QKinectFrameSource::open(int streams)
+{
+	close();
+
+	HRESULT hr;
+
+	hr = GetDefaultKinectSensor(&KinectSensor);
+	if (FAILED(hr))
+	{
+		return false;
+	}
+
+	if (KinectSensor)
+	{
+		hr = KinectSensor->Open();
+
+		// the mapper serves body joints as well as the depth frame stages
+		if (SUCCEEDED(hr))
+		{
+			hr = KinectSensor->get_CoordinateMapper(&CoordinateMapper);
+		}
+
+		if (streams & ColorStream){
+			IColorFrameSource* pColorFrameSource = NULL;
+			if (SUCCEEDED(hr))
+			{
+				hr = KinectSensor->get_ColorFrameSource(&pColorFrameSource);
+			}
+
+			if (SUCCEEDED(hr))
+			{
+				hr = pColorFrameSource->OpenReader(&ColorFrameReader);
+			}
+
+			SafeRelease(pColorFrameSource);
+		}
+
+		// DepthFrame
+		if (streams & DepthStream){
+			IDepthFrameSource* pDepthFrameSource = NULL;
+			if (SUCCEEDED(hr))
+			{
+				hr = KinectSensor->get_DepthFrameSource(&pDepthFrameSource);
+			}
+
+			if (SUCCEEDED(hr))
+			{
+				hr = pDepthFrameSource->OpenReader(&DepthFrameReader);
+			}
+
+			SafeRelease(pDepthFrameSource);
+		}
+
+		// InfraredFrame
+		if (streams & InfraredStream){
+			IInfraredFrameSource* pInfraredFrameSource = NULL;
+			if (SUCCEEDED(hr))
+			{
+				hr = KinectSensor->get_InfraredFrameSource(&pInfraredFrameSource);
+			}
+
+			if (SUCCEEDED(hr))
+			{
+				hr = pInfraredFrameSource->OpenReader(&InfraredFrameReader);
+			}
+
+			SafeRelease(pInfraredFrameSource);
+		}
+
+		// Body Frame
+		if (streams & BodyStream){
+			IBodyFrameSource* pBodyFrameSource = NULL;
+
+			if (SUCCEEDED(hr))
+			{
+				hr = KinectSensor->get_BodyFrameSource(&pBodyFrameSource);
+			}
+
+			if (SUCCEEDED(hr))
+			{
+				hr = pBodyFrameSource->OpenReader(&BodyFrameReader);
+			}
+
+			SafeRelease(pBodyFrameSource);
+		}
+	}
+
+	if (!KinectSensor || FAILED(hr))
+	{
+		std::cerr << "No ready Kinect found!" << std::endl;
+		close();
+		return false;
+	}
+
+	OpenStreams = streams;
+
+	// block on the readers' events instead of polling them, fall back to polling if that fails
+	Subscribed = UseFrameEvents && subscribe();
+
+	return true;
+}
+
+
+void QKinectFrameSource::close()
+{
+	unsubscribe();
+
+	SafeRelease(ColorFrameReader);
+	SafeRelease(DepthFrameReader);
+	SafeRelease(InfraredFrameReader);
+	SafeRelease(BodyFrameReader);
+	SafeRelease(CoordinateMapper);
+
+	for (int b = 0; b < BODY_COUNT; ++b)
+		SafeRelease(Bodies[b]);
+
+	// close the Kinect Sensor
+	if (KinectSensor)
+	{
+		KinectSensor->Close();
+	}
+
+	SafeRelease(KinectSensor);
+	OpenStreams = NoStream;
+}
+
+
+/// <summary>
+/// Subscribe to the frame arrived events of the open readers
+/// </summary>
+bool QKinectFrameSource::subscribe()
+{
+	if (!WakeEvent)
+	{
+		return false;
+	}
+
+	HRESULT hr = S_OK;
+
+	Handles[0] = WakeEvent;
+	Streams[0] = NoStream;
+	HandleCount = 1;
+
+	if (ColorFrameReader && SUCCEEDED(hr))
+	{
+		hr = ColorFrameReader->SubscribeFrameArrived(&ColorEvent);
+		if (SUCCEEDED(hr))
+		{
+			Handles[HandleCount] = reinterpret_cast<HANDLE>(ColorEvent);
+			Streams[HandleCount++] = ColorStream;
+		}
+	}
+
+	if (DepthFrameReader && SUCCEEDED(hr))
+	{
+		hr = DepthFrameReader->SubscribeFrameArrived(&DepthEvent);
+		if (SUCCEEDED(hr))
+		{
+			Handles[HandleCount] = reinterpret_cast<HANDLE>(DepthEvent);
+			Streams[HandleCount++] = DepthStream;
+		}
+	}
+
+	if (InfraredFrameReader && SUCCEEDED(hr))
+	{
+		hr = InfraredFrameReader->SubscribeFrameArrived(&InfraredEvent);
+		if (SUCCEEDED(hr))
+		{
+			Handles[HandleCount] = reinterpret_cast<HANDLE>(InfraredEvent);
+			Streams[HandleCount++] = InfraredStream;
+		}
+	}
+
+	if (BodyFrameReader && SUCCEEDED(hr))
+	{
+		hr = BodyFrameReader->SubscribeFrameArrived(&BodyEvent);
+		if (SUCCEEDED(hr))
+		{
+			Handles[HandleCount] = reinterpret_cast<HANDLE>(BodyEvent);
+			Streams[HandleCount++] = BodyStream;
+		}
+	}
+
+	if (FAILED(hr))
+	{
+		std::cerr << "<Error>	Could not subscribe to frame arrived events" << std::endl;
+		unsubscribe();
+		return false;
+	}
+
+	return true;
+}
+
+
+void QKinectFrameSource::unsubscribe()
+{
+	if (ColorEvent)
+	{
+		ColorFrameReader->UnsubscribeFrameArrived(ColorEvent);
+		ColorEvent = 0;
+	}
+
+	if (DepthEvent)
+	{
+		DepthFrameReader->UnsubscribeFrameArrived(DepthEvent);
+		DepthEvent = 0;
+	}
+
+	if (InfraredEvent)
+	{
+		InfraredFrameReader->UnsubscribeFrameArrived(InfraredEvent);
+		InfraredEvent = 0;
+	}
+
+	if (BodyEvent)
+	{
+		BodyFrameReader->UnsubscribeFrameArrived(BodyEvent);
+		BodyEvent = 0;
+	}
+
+	HandleCount = 0;
+	Subscribed = false;
+}
+
+
+int QKinectFrameSource::wait(unsigned long timeoutMs)
+{
+	if (!Subscribed)
+	{
+		// polling: try every open reader after a short sleep, wake() cuts the sleep short
+		if (WakeEvent && WaitForSingleObject(WakeEvent, min(timeoutMs, static_cast<unsigned long>(PollInterval))) == WAIT_OBJECT_0)
+		{
+			return NoStream;
+		}
+
+		return OpenStreams;
+	}
+
+	DWORD result = WaitForMultipleObjects(HandleCount, Handles, FALSE, timeoutMs);
+
+	if (result < WAIT_OBJECT_0 + 1 || result >= WAIT_OBJECT_0 + HandleCount)
+	{
+		// woken up, timed out or failed
+		return NoStream;
+	}
+
+	// WaitForMultipleObjects only reports the first signaled handle, collect the others too
+	int streams = Streams[result - WAIT_OBJECT_0];
+	for (DWORD i = 1; i < HandleCount; ++i)
+	{
+		if (!(streams & Streams[i]) && WaitForSingleObject(Handles[i], 0) == WAIT_OBJECT_0)
+		{
+			streams |= Streams[i];
+		}
+	}
+
+	for (DWORD i = 1; i < HandleCount; ++i)
+	{
+		if (streams & Streams[i])
+		{
+			acknowledge(Streams[i]);
+		}
+	}
+
+	return streams;
+}
+
+
+void QKinectFrameSource::wake()
+{
+	if (WakeEvent)
+	{
+		SetEvent(WakeEvent);
+	}
+}
+
+
+/// <summary>
+/// Consume the event data of a signaled reader so its event is rearmed
+/// </summary>
+void QKinectFrameSource::acknowledge(int stream)
+{
+	switch (stream)
+	{
+		case ColorStream:
+		{
+			IColorFrameArrivedEventArgs* pArgs = NULL;
+			if (SUCCEEDED(ColorFrameReader->GetFrameArrivedEventData(ColorEvent, &pArgs)))
+			{
+				SafeRelease(pArgs);
+			}
+			break;
+		}
+
+		case DepthStream:
+		{
+			IDepthFrameArrivedEventArgs* pArgs = NULL;
+			if (SUCCEEDED(DepthFrameReader->GetFrameArrivedEventData(DepthEvent, &pArgs)))
+			{
+				SafeRelease(pArgs);
+			}
+			break;
+		}
+
+		case InfraredStream:
+		{
+			IInfraredFrameArrivedEventArgs* pArgs = NULL;
+			if (SUCCEEDED(InfraredFrameReader->GetFrameArrivedEventData(InfraredEvent, &pArgs)))
+			{
+				SafeRelease(pArgs);
+			}
+			break;
+		}
+
+		case BodyStream:
+		{
+			IBodyFrameArrivedEventArgs* pArgs = NULL;
+			if (SUCCEEDED(BodyFrameReader->GetFrameArrivedEventData(BodyEvent, &pArgs)))
+			{
+				SafeRelease(pArgs);
+			}
+			break;
+		}
+
+		default:
+			break;
+	}
+}
+
+
+
+/// <summary>
+/// Get color frame from kinect
+/// </summary>
+bool QKinectFrameSource::readColor(QKinectColorFrame& frame, QFramePool& pool)
+{
+	if (!ColorFrameReader)
+	{
+		return false;
+	}
+
+	IColorFrame* pColorFrame = NULL;
+
+	HRESULT hr = ColorFrameReader->AcquireLatestFrame(&pColorFrame);
+
+	if (SUCCEEDED(hr))
+	{
+		INT64 nTime = 0;
+		IFrameDescription* pFrameDescription = NULL;
+		int frameWidth = 0;
+		int frameHeight = 0;
+		ColorImageFormat imageFormat = ColorImageFormat_None;
+		BYTE *pBuffer = NULL;
+
+		hr = pColorFrame->get_RelativeTime(&nTime);
+
+		if (SUCCEEDED(hr))
+		{
+			hr = pColorFrame->get_FrameDescription(&pFrameDescription);
+		}
+
+		if (SUCCEEDED(hr))
+		{
+			hr = pFrameDescription->get_Width(&frameWidth);
+		}
+
+		if (SUCCEEDED(hr))
+		{
+			hr = pFrameDescription->get_Height(&frameHeight);
+		}
+
+		if (SUCCEEDED(hr))
+		{
+			hr = pColorFrame->get_RawColorImageFormat(&imageFormat);
+		}
+
+		if (SUCCEEDED(hr))
+		{
+			// the raw frame is kept as it is when asked for, without the conversion to BGRA
+			const bool raw = RawColor && imageFormat == ColorImageFormat_Yuy2;
+
+			if (!prepareColorFrame(frame, pool, frameWidth, frameHeight, raw ? QKinectColorFrame::Yuy2 : QKinectColorFrame::Bgra))
+			{
+				// every buffer is still in use downstream, drop this frame
+				hr = E_PENDING;
+			}
+
+			else if (raw || imageFormat == ColorImageFormat_Bgra)
+			{
+				UINT bufferSize;
+				hr = pColorFrame->AccessRawUnderlyingBuffer(&bufferSize, &pBuffer);
+
+				// copy data to color buffer
+				if (SUCCEEDED(hr))
+				{
+					std::copy(pBuffer, pBuffer + min(bufferSize, static_cast<UINT>(frame.Buffer.size())), frame.Buffer.data());
+				}
+			}
+			else
+			{
+				hr = pColorFrame->CopyConvertedFrameDataToArray(static_cast<UINT>(frame.Buffer.size()), frame.Buffer.data(), ColorImageFormat_Bgra);
+				if (FAILED(hr))
+				{
+					std::cerr << "<Error>	Could not convert data from color frame to color buffer" << std::endl;
+				}
+			}
+
+			if (SUCCEEDED(hr))
+			{
+				frame.Time = nTime;
+			}
+		}
+
+		SafeRelease(pFrameDescription);
+	}
+
+	SafeRelease(pColorFrame);
+
+	if (!SUCCEEDED(hr))
+		return false;
+
+	return true;
+}
+
+
+bool QKinectFrameSource::readDepth(QKinectDepthFrame& frame)
+{
+	if (!DepthFrameReader)
+	{
+		return false;
+	}
+
+	IDepthFrame* pDepthFrame = NULL;
+
+	HRESULT hr = DepthFrameReader->AcquireLatestFrame(&pDepthFrame);
+
+	if (SUCCEEDED(hr))
+	{
+		INT64 nTime = 0;
+		IFrameDescription* pFrameDescription = NULL;
+		int frameWidth = 0;
+		int frameHeight = 0;
+		USHORT nDepthMinReliableDistance = 0;
+		USHORT nDepthMaxDistance = 0;
+		UINT nBufferSize = 0;
+		UINT16 *pBuffer = NULL;
+
+		hr = pDepthFrame->get_RelativeTime(&nTime);
+
+		if (SUCCEEDED(hr))
+		{
+			hr = pDepthFrame->get_FrameDescription(&pFrameDescription);
+		}
+
+		if (SUCCEEDED(hr))
+		{
+			hr = pFrameDescription->get_Width(&frameWidth);
+		}
+
+		if (SUCCEEDED(hr))
+		{
+			hr = pFrameDescription->get_Height(&frameHeight);
+		}
+
+		if (SUCCEEDED(hr))
+		{
+			hr = pDepthFrame->get_DepthMinReliableDistance(&nDepthMinReliableDistance);
+		}
+
+		if (SUCCEEDED(hr))
+		{
+			// In order to see the full range of depth (including the less reliable far field depth)
+			// we are setting nDepthMaxDistance to the extreme potential depth threshold
+			//nDepthMaxDistance = USHRT_MAX;
+
+			// Note:  If you wish to filter by reliable depth distance, uncomment the following line.
+			hr = pDepthFrame->get_DepthMaxReliableDistance(&nDepthMaxDistance);
+		}
+
+		if (SUCCEEDED(hr))
+		{
+			hr = pDepthFrame->AccessUnderlyingBuffer(&nBufferSize, &pBuffer);
+		}
+
+
+		if (SUCCEEDED(hr))
+		{
+			prepareDepthFrame(frame, frameWidth, frameHeight);
+
+			// copy data to depth buffer
+			std::copy(pBuffer, pBuffer + min(nBufferSize, static_cast<UINT>(frame.Buffer.size())), frame.Buffer.begin());
+			frame.MinReliableDistance = nDepthMinReliableDistance;
+			frame.MaxDistance = nDepthMaxDistance;
+			frame.Time = nTime;
+		}
+
+		SafeRelease(pFrameDescription);
+	}
+
+	SafeRelease(pDepthFrame);
+
+	if (!SUCCEEDED(hr))
+		return false;
+
+	return true;
+}
+
+
+
+bool QKinectFrameSource::readInfrared(QKinectInfraredFrame& frame)
+{
+	if (!InfraredFrameReader)
+	{
+		return false;
+	}
+
+	IInfraredFrame* pInfraredFrame = NULL;
+
+	HRESULT hr = InfraredFrameReader->AcquireLatestFrame(&pInfraredFrame);
+
+	if (SUCCEEDED(hr))
+	{
+		INT64 nTime = 0;
+		IFrameDescription* pFrameDescription = NULL;
+		int frameWidth = 0;
+		int frameHeight = 0;
+		UINT nBufferSize = 0;
+		UINT16 *pBuffer = NULL;
+
+		hr = pInfraredFrame->get_RelativeTime(&nTime);
+
+		if (SUCCEEDED(hr))
+		{
+			hr = pInfraredFrame->get_FrameDescription(&pFrameDescription);
+		}
+
+		if (SUCCEEDED(hr))
+		{
+			hr = pFrameDescription->get_Width(&frameWidth);
+		}
+
+		if (SUCCEEDED(hr))
+		{
+			hr = pFrameDescription->get_Height(&frameHeight);
+		}
+
+		if (SUCCEEDED(hr))
+		{
+			hr = pInfraredFrame->AccessUnderlyingBuffer(&nBufferSize, &pBuffer);
+		}
+
+		if (SUCCEEDED(hr))
+		{
+			prepareInfraredFrame(frame, frameWidth, frameHeight);
+
+			std::copy(pBuffer, pBuffer + min(nBufferSize, static_cast<UINT>(frame.Buffer.size())), frame.Buffer.begin());
+			frame.Time = nTime;
+		}
+
+		SafeRelease(pFrameDescription);
+	}
+
+	SafeRelease(pInfraredFrame);
+
+	if (!SUCCEEDED(hr))
+		return false;
+
+	return true;
+}
+
+
+/// <summary>
+/// Get body frame from kinect.
+/// Joints of all tracked bodies go into the structure of arrays of the frame and are
+/// projected into depth and color space with one mapper call per space.
+/// </summary>
+bool QKinectFrameSource::readBody(QKinectBodyFrame& frame)
+{
+	if (!BodyFrameReader)
+	{
+		return false;
+	}
+
+	IBodyFrame* pBodyFrame = NULL;
+
+	HRESULT hr = BodyFrameReader->AcquireLatestFrame(&pBodyFrame);
+
+	if (SUCCEEDED(hr))
+	{
+		INT64 nTime = 0;
+
+		hr = pBodyFrame->get_RelativeTime(&nTime);
+
+		if (SUCCEEDED(hr))
+		{
+			// refreshes the IBody objects kept from the previous frame instead of creating new ones
+			hr = pBodyFrame->GetAndRefreshBodyData(BODY_COUNT, Bodies);
+		}
+
+		if (SUCCEEDED(hr))
+		{
+			frame.Time = nTime;
+			frame.TrackedBodies = 0;
+
+			Joint joints[JointType_Count];
+			JointOrientation orientations[JointType_Count];
+			UINT mappedCount = 0;
+
+			for (int b = 0; b < BODY_COUNT; ++b)
+			{
+				IBody* pBody = Bodies[b];
+				BOOLEAN tracked = false;
+
+				if (!pBody || FAILED(pBody->get_IsTracked(&tracked)) || !tracked ||
+					FAILED(pBody->GetJoints(JointType_Count, joints)) ||
+					FAILED(pBody->GetJointOrientations(JointType_Count, orientations)))
+				{
+					frame.TrackingId[b] = 0;
+					memset(frame.TrackingState + QKinectBodyFrame::index(b, 0), QKinectBodyFrame::NotTracked, JointType_Count);
+					continue;
+				}
+
+				frame.TrackedBodies |= 1 << b;
+				pBody->get_TrackingId(&frame.TrackingId[b]);
+
+				for (int j = 0; j < JointType_Count; ++j)
+				{
+					const int i = QKinectBodyFrame::index(b, j);
+
+					frame.PositionX[i] = joints[j].Position.X;
+					frame.PositionY[i] = joints[j].Position.Y;
+					frame.PositionZ[i] = joints[j].Position.Z;
+					frame.OrientationX[i] = orientations[j].Orientation.x;
+					frame.OrientationY[i] = orientations[j].Orientation.y;
+					frame.OrientationZ[i] = orientations[j].Orientation.z;
+					frame.OrientationW[i] = orientations[j].Orientation.w;
+					frame.TrackingState[i] = static_cast<unsigned char>(joints[j].TrackingState);
+
+					// tracked joints are packed for the batched mapping below
+					MappedJoints[mappedCount++] = joints[j].Position;
+				}
+			}
+
+			if (CoordinateMapper && mappedCount > 0)
+			{
+				HRESULT hrDepth = CoordinateMapper->MapCameraPointsToDepthSpace(mappedCount, MappedJoints, mappedCount, MappedDepthPoints);
+				HRESULT hrColor = CoordinateMapper->MapCameraPointsToColorSpace(mappedCount, MappedJoints, mappedCount, MappedColorPoints);
+
+				// scatter the packed results back to the body slots, in the same order they were packed
+				UINT m = 0;
+				for (int b = 0; b < BODY_COUNT; ++b)
+				{
+					if (!frame.isTracked(b))
+						continue;
+
+					for (int j = 0; j < JointType_Count; ++j, ++m)
+					{
+						const int i = QKinectBodyFrame::index(b, j);
+
+						frame.DepthX[i] = SUCCEEDED(hrDepth) ? MappedDepthPoints[m].X : 0.f;
+						frame.DepthY[i] = SUCCEEDED(hrDepth) ? MappedDepthPoints[m].Y : 0.f;
+						frame.ColorX[i] = SUCCEEDED(hrColor) ? MappedColorPoints[m].X : 0.f;
+						frame.ColorY[i] = SUCCEEDED(hrColor) ? MappedColorPoints[m].Y : 0.f;
+					}
+				}
+			}
+		}
+	}
+
+	SafeRelease(pBodyFrame);
+
+	if (!SUCCEEDED(hr))
+		return false;
+
+	return true;
+}
+
+
+
+/// <summary>
+/// Fetch the depth-to-camera-space table from the mapper. Fails until the mapper
+/// has a calibration.
+/// </summary>
+bool QKinectFrameSource::depthToCameraSpaceTable(std::vector<float>& table)
+{
+	if (!CoordinateMapper)
+	{
+		return false;
+	}
+
+	UINT32 entryCount = 0;
+	PointF* pEntries = NULL;
+
+	HRESULT hr = CoordinateMapper->GetDepthFrameToCameraSpaceTable(&entryCount, &pEntries);
+
+	if (SUCCEEDED(hr) && entryCount > 0)
+	{
+		const float* entries = reinterpret_cast<const float*>(pEntries);
+		table.assign(entries, entries + 2 * entryCount);
+	}
+
+	CoTaskMemFree(pEntries);
+
+	return SUCCEEDED(hr) && entryCount > 0;
+}
+
+
+/// <summary>
+/// Sample the mapper at two depths for every depth pixel and fit the registration table
+/// </summary>
+bool QKinectFrameSource::depthToColorTable(std::vector<float>& table)
+{
+	if (!CoordinateMapper || RegistrationRejected)
+	{
+		return false;
+	}
+
+	IDepthFrameSource* pDepthFrameSource = NULL;
+	IFrameDescription* pFrameDescription = NULL;
+	int depthWidth = 0;
+	int depthHeight = 0;
+
+	HRESULT hr = KinectSensor->get_DepthFrameSource(&pDepthFrameSource);
+
+	if (SUCCEEDED(hr))
+	{
+		hr = pDepthFrameSource->get_FrameDescription(&pFrameDescription);
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		hr = pFrameDescription->get_Width(&depthWidth);
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		hr = pFrameDescription->get_Height(&depthHeight);
+	}
+
+	SafeRelease(pFrameDescription);
+	SafeRelease(pDepthFrameSource);
+
+	if (FAILED(hr))
+	{
+		return false;
+	}
+
+	const UINT count = depthWidth * depthHeight;
+	std::vector<DepthSpacePoint> depthPoints(count);
+	std::vector<ColorSpacePoint> nearPoints(count);
+	std::vector<ColorSpacePoint> midPoints(count);
+	std::vector<ColorSpacePoint> farPoints(count);
+	std::vector<UINT16> nearDepths(count, static_cast<UINT16>(RegistrationNearDepth));
+	std::vector<UINT16> midDepths(count, static_cast<UINT16>(RegistrationMidDepth));
+	std::vector<UINT16> farDepths(count, static_cast<UINT16>(RegistrationFarDepth));
+
+	for (UINT i = 0; i < count; ++i)
+	{
+		depthPoints[i].X = static_cast<float>(i % depthWidth);
+		depthPoints[i].Y = static_cast<float>(i / depthWidth);
+	}
+
+	hr = CoordinateMapper->MapDepthPointsToColorSpace(count, depthPoints.data(), count, nearDepths.data(), count, nearPoints.data());
+
+	if (SUCCEEDED(hr))
+	{
+		hr = CoordinateMapper->MapDepthPointsToColorSpace(count, depthPoints.data(), count, midDepths.data(), count, midPoints.data());
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		hr = CoordinateMapper->MapDepthPointsToColorSpace(count, depthPoints.data(), count, farDepths.data(), count, farPoints.data());
+	}
+
+	// an uncalibrated mapper answers -infinity everywhere
+	if (FAILED(hr) || !(nearPoints[count / 2].X > -1e6f))
+	{
+		return false;
+	}
+
+	table.resize(QFrameRegistration::TableStride * count);
+	QFrameRegistration::fitTable(reinterpret_cast<const float*>(nearPoints.data()), reinterpret_cast<const float*>(midPoints.data()),
+		reinterpret_cast<const float*>(farPoints.data()), count, RegistrationNearDepth, RegistrationMidDepth, RegistrationFarDepth, table.data());
+
+	// the fit is exact at its three depths, compare it with the mapper's own frame mapping at others
+	std::vector<UINT16> checkFrame(count);
+
+	for (size_t c = 0; c < sizeof(RegistrationCheckDepths) / sizeof(RegistrationCheckDepths[0]); ++c)
+	{
+		const float depth = RegistrationCheckDepths[c];
+		std::fill(checkFrame.begin(), checkFrame.end(), static_cast<UINT16>(depth));
+
+		hr = CoordinateMapper->MapDepthFrameToColorSpace(count, checkFrame.data(), count, nearPoints.data());
+		if (FAILED(hr))
+		{
+			table.clear();
+			return false;
+		}
+
+		const float error = QFrameRegistration::tableError(table.data(), reinterpret_cast<const float*>(nearPoints.data()), count, depth,
+			RegistrationErrorPercentile);
+		if (error > RegistrationMaxError)
+		{
+			// the calibration does not change, neither would the next fit
+			std::cerr << "<Warning>	Registration table is " << error << " color pixels off the coordinate mapper at "
+				<< depth << " mm, mapping every frame with the coordinate mapper instead" << std::endl;
+			RegistrationRejected = true;
+			table.clear();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/// <summary>
+/// Only the coordinate mapper, which may be used from any thread: the depth worker calls
+/// this while the grabber thread reads frames
+/// </summary>
+bool QKinectFrameSource::mapDepthFrameToColor(const unsigned short* depth, int count, float* points)
+{
+	if (!CoordinateMapper)
+	{
+		return false;
+	}
+
+	ColorSpacePoint* colorPoints = reinterpret_cast<ColorSpacePoint*>(points);
+	if (FAILED(CoordinateMapper->MapDepthFrameToColorSpace(static_cast<UINT>(count), depth, static_cast<UINT>(count), colorPoints)))
+	{
+		return false;
+	}
+
+	// an uncalibrated mapper answers -infinity everywhere, a calibrated one maps the first valid pixel
+	for (int i = 0; i < count; ++i)
+	{
+		if (depth[i] && colorPoints[i].X > -1e6f)
+			return true;
+	}
+
+	return false;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "QFrameSource.h"
+#include "QKinectSdk.h"
+
+
+/// <summary>
+/// Frames of the default Kinect sensor.
+/// Either waits on the frame arrived events of the open readers, plus a private
+/// event used by wake(), with one WaitForMultipleObjects call, or polls the readers
+/// every few milliseconds when frame events are off or could not be subscribed.
+/// </summary>
+class QKinectFrameSource : public QFrameSource
+{
+public:
+	QKinectFrameSource();
+	~QKinectFrameSource();
+
+	bool useFrameEvents() const;
+	void setUseFrameEvents(bool use);		// applied on the next open()
+
+	bool open(int streams) Q_DECL_OVERRIDE;
+	void close() Q_DECL_OVERRIDE;
+
+	int wait(unsigned long timeoutMs) Q_DECL_OVERRIDE;
+	void wake() Q_DECL_OVERRIDE;
+
+	bool readColor(QKinectColorFrame& frame, QFramePool& pool) Q_DECL_OVERRIDE;
+	bool readDepth(QKinectDepthFrame& frame) Q_DECL_OVERRIDE;
+	bool readInfrared(QKinectInfraredFrame& frame) Q_DECL_OVERRIDE;
+	bool readBody(QKinectBodyFrame& frame) Q_DECL_OVERRIDE;
+
+	bool depthToCameraSpaceTable(std::vector<float>& table) Q_DECL_OVERRIDE;
+	bool depthToColorTable(std::vector<float>& table) Q_DECL_OVERRIDE;
+	bool mapDepthFrameToColor(const unsigned short* depth, int count, float* points) Q_DECL_OVERRIDE;
+
+private:
+	bool subscribe();
+	void unsubscribe();
+	void acknowledge(int stream);
+
+	enum { MaxHandles = 5 };
+
+	IKinectSensor*			KinectSensor;
+	ICoordinateMapper*		CoordinateMapper;
+	IColorFrameReader*		ColorFrameReader;
+	IDepthFrameReader*		DepthFrameReader;
+	IInfraredFrameReader*	InfraredFrameReader;
+	IBodyFrameReader*		BodyFrameReader;
+	int						OpenStreams;
+	bool					RegistrationRejected;	// the fitted table was off the mapper, depthToColorTable() fails and registration maps every frame
+
+	IBody*					Bodies[BODY_COUNT];		// refreshed in place every frame
+	CameraSpacePoint		MappedJoints[QKinectBodyFrame::JointTotal];
+	DepthSpacePoint			MappedDepthPoints[QKinectBodyFrame::JointTotal];
+	ColorSpacePoint			MappedColorPoints[QKinectBodyFrame::JointTotal];
+
+	bool					UseFrameEvents;
+	bool					Subscribed;				// wait() blocks on the events instead of polling
+	WAITABLE_HANDLE			ColorEvent;
+	WAITABLE_HANDLE			DepthEvent;
+	WAITABLE_HANDLE			InfraredEvent;
+	WAITABLE_HANDLE			BodyEvent;
+	HANDLE					WakeEvent;
+
+	HANDLE					Handles[MaxHandles];	// WakeEvent first, then one per subscribed reader
+	int						Streams[MaxHandles];
+	DWORD					HandleCount;
+
+	Q_DISABLE_COPY(QKinectFrameSource);
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <QMetaType>
+
+
+/// <summary>
+/// Delivery statistics of one stream, counted from the frames' RelativeTime.
+/// Intervals are in milliseconds; the jitters are standard deviations.
+/// </summary>
+struct QKinectStreamStatistics
+{
+	QKinectStreamStatistics() :
+		Delivered(0),
+		Dropped(0),
+		Duplicate(0),
+		Late(0),
+		FramePeriod(0),
+		MeanInterval(0),
+		IntervalJitter(0),
+		ArrivalJitter(0),
+		QueueDepth(0),
+		QueueDropped(0)
+	{
+	}
+
+	quint64		Delivered;			// frames read from the source
+	quint64		Dropped;			// sensor frames never seen: gaps of more than one frame period
+	quint64		Duplicate;			// delivered with the same RelativeTime as the frame before
+	quint64		Late;				// reached the grabber over a frame period behind the earliest frames, or out of order
+
+	double		FramePeriod;		// learnt from the shortest recent intervals, 33.3 ms or 66.7 ms for color in low light
+	double		MeanInterval;		// between consecutive frames with none dropped in between
+	double		IntervalJitter;		// of those intervals, on the sensor's clock
+	double		ArrivalJitter;		// of the time between arrivals minus the time between the frames
+
+	int			QueueDepth;			// frames read and waiting for the stream's worker
+	quint64		QueueDropped;		// frames read but dropped from the full queue of a worker that fell behind
+};
+
+
+/// <summary>
+/// Snapshot of the statistics of every stream, see QKinectGrabber::statistics()
+/// </summary>
+struct QKinectFrameStatistics
+{
+	QKinectStreamStatistics		Color;
+	QKinectStreamStatistics		Depth;
+	QKinectStreamStatistics		Infrared;
+	QKinectStreamStatistics		Body;
+};
+
+Q_DECLARE_METATYPE(QKinectFrameStatistics)
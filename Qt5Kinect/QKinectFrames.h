@@ -0,0 +1,58 @@
+#pragma once
+
+#include "QFramePool.h"
+#include "QKinectBodyFrame.h"
+#include <QMetaType>
+#include <vector>
+
+
+/// <summary>
+/// Raw frames as a QFrameSource delivers them to the grabber, before any conversion.
+/// Buffers are reused from frame to frame; Time is the RelativeTime in 100 ns ticks.
+/// </summary>
+struct QKinectColorFrame
+{
+	enum { Channels = 4 };
+
+	enum PixelFormat
+	{
+		Bgra,			// Channels bytes per pixel
+		Yuy2			// the sensor's raw format, 2 bytes per pixel, see QFrameSource::setRawColor()
+	};
+
+	QFrameHandle				Buffer;			// pool buffer, shared with the emitted QImage
+	PixelFormat					Format;
+	unsigned short				Width;
+	unsigned short				Height;
+	qint64						Time;			// timestamp
+
+	static int bytesPerPixel(PixelFormat format)
+	{
+		return format == Yuy2 ? 2 : Channels;
+	}
+
+	int bytesPerLine() const
+	{
+		return Width * bytesPerPixel(Format);
+	}
+};
+
+Q_DECLARE_METATYPE(QKinectColorFrame)
+
+struct QKinectDepthFrame
+{
+	std::vector<unsigned short>	Buffer;
+	unsigned short				Width;
+	unsigned short				Height;
+	qint64						Time;			// timestamp
+	unsigned short				MinReliableDistance;
+	unsigned short				MaxDistance;
+};
+
+struct QKinectInfraredFrame
+{
+	std::vector<unsigned short>	Buffer;
+	unsigned short				Width;
+	unsigned short				Height;
+	qint64						Time;			// timestamp
+};
@@ -1,129 +1,350 @@
 #include "stdafx.h"
 #include "QKinectGrabber.h"
+#include "QFrameQueue.h"
+#include "QFramePool.h"
+#ifdef QT5KINECT_SDK
+#include "QKinectFrameSource.h"
+#endif
+#include "QFrameSynchronizer.h"
+#include "QFrameKernels.h"
+#include "QColorDownscaler.h"
+#include "QInfraredToneMapper.h"
+#include "QDepthFilter.h"
+#include "QFrameRegistration.h"
+#include "QVoxelGrid.h"
+#include "QFrameRecorder.h"
+#include "QDepthCodec.h"
+#include "QFramePublisher.h"
+#include "QFrameStreamServer.h"
+#include "QFrameLatency.h"
+#include "QFrameTiming.h"
+#include "QKinectFrameMailbox.h"
+#include <functional>
+
+
+// Upper bound for a single wait on the frame arrived events, so stop() is noticed
+// even if no frame ever arrives.
+#define FrameWaitTimeout 100
+
+// Default spread allowed between the RelativeTime of frames in one synchronized set,
+// in 100 ns ticks: half a frame period at 30 fps.
+#define DefaultFrameSetTolerance 166666
+
+// Framesets staged at once: how many sets apart the stream workers may be before the
+// frames of the oldest set are dropped
+#define FrameSetSlots 8
+
+// Default time between two statisticsUpdated() signals, in ms
+#define DefaultStatisticsInterval 1000
+
+
+
+// A frame waiting in its stream's queue, with the times its latency is followed from
+template <typename Frame>
+struct QueuedFrame
+{
+	Frame						Data;
+	qint64						Arrived;
+	qint64						Read;
+	qint64						FrameSet;		// number of the set the synchronizer put it in, -1 when not synchronizing
+};
+
+typedef QueuedFrame<QKinectColorFrame>		QueuedColorFrame;
+typedef QueuedFrame<QKinectDepthFrame>		QueuedDepthFrame;
+typedef QueuedFrame<QKinectInfraredFrame>	QueuedInfraredFrame;
+typedef QueuedFrame<QKinectBodyFrame>		QueuedBodyFrame;
+
+
+/// <summary>
+/// Thread running the post-processing loop of one stream, see QKinectGrabberPrivate::StartWorkers()
+/// </summary>
+class QKinectStreamWorker : public QThread
+{
+public:
+	explicit QKinectStreamWorker(const std::function<void()>& loop) : Loop(loop) {}
 
+protected:
+	void run() Q_DECL_OVERRIDE
+	{
+		Loop();
+	}
 
-// InfraredSourceValueMaximum is the highest value that can be returned in the InfraredFrame.
-// It is cast to a float for readability in the visualization code.
-#define InfraredSourceValueMaximum static_cast<float>(USHRT_MAX)
+private:
+	std::function<void()>		Loop;
+};
 
-// The InfraredOutputValueMinimum value is used to set the lower limit, post processing, of the
-// infrared data that we will render.
-// Increasing or decreasing this value sets a brightness "wall" either closer or further away.
-#define InfraredOutputValueMinimum 0.01f 
 
-// The InfraredOutputValueMaximum value is the upper limit, post processing, of the
-// infrared data that we will render.
-#define InfraredOutputValueMaximum 1.0f
 
-// The InfraredSceneValueAverage value specifies the average infrared value of the scene.
-// This value was selected by analyzing the average pixel intensity for a given scene.
-// Depending on the visualization requirements for a given application, this value can be
-// hard coded, as was done here, or calculated by averaging the intensity for each pixel prior
-// to rendering.
-#define InfraredSceneValueAverage 0.08f
+/// <summary>
+/// Properties that may be changed from any thread while the grabber runs, guarded by
+/// QKinectGrabberPrivate::Mutex. The grabber thread and the workers copy them once per
+/// frame with CurrentSettings(), so every frame is processed with one consistent set.
+/// </summary>
+struct QKinectGrabberSettings
+{
+	QKinectGrabberSettings() :
+		SynchronizeFrames(false),
+		ColorScale(1),
+		FilterDepth(false),
+		AdaptiveInfrared(false),
+		PointCloudLayout(QKinectPointCloud::Planar),
+		PointCloudMask(false),
+		PointCloudColor(false),
+		PointCloudLeafSize(0),
+		PointCloudVoxelMode(QVoxelGrid::Centroid),
+		UseRegistration(false),
+		RegisterDepthInColor(false)
+	{
+	}
 
-/// The InfraredSceneStandardDeviations value specifies the number of standard deviations
-/// to apply to InfraredSceneValueAverage. This value was selected by analyzing data
-/// from a given scene.
-/// Depending on the visualization requirements for a given application, this value can be
-/// hard coded, as was done here, or calculated at runtime.
-#define InfraredSceneStandardDeviations 3.0f
+	bool						SynchronizeFrames;
+	int							ColorScale;				// divisor of the emitted size, 1 for full size
+	QSize						ColorOutputSize;		// emitted size when valid
+	bool						FilterDepth;
+	bool						AdaptiveInfrared;
+	QKinectPointCloud::Layout	PointCloudLayout;
+	bool						PointCloudMask;
+	bool						PointCloudColor;
+	float						PointCloudLeafSize;		// 0 for a point per pixel
+	QVoxelGrid::Mode			PointCloudVoxelMode;
+	bool						UseRegistration;
+	bool						RegisterDepthInColor;
+};
 
 
 
 class QKinectGrabberPrivate
 {
+	Q_DECLARE_PUBLIC(QKinectGrabber)
+
 public:
-	QKinectGrabberPrivate();
-	bool InitializeSensor();
-	void UninitializeSensor();
-	bool UpdateColor();
-	bool UpdateDepth();
-	bool UpdateInfrared();
+	QKinectGrabberPrivate(QKinectGrabber* q);
+	QFrameSource* SelectedSource();
+	bool OpenSource();
+	void CloseSource();
+	void ResetQueues();
+	void StartWorkers();
+	void StopWorkers();
+	bool ReadColor(qint64 arrived);
+	bool ReadDepth(qint64 arrived);
+	bool ReadInfrared(qint64 arrived);
+	bool ReadBody(qint64 arrived);
+	void ProcessColor(const QueuedColorFrame& queued);
+	void ProcessDepth(const QueuedDepthFrame& queued);
+	void ProcessInfrared(const QueuedInfraredFrame& queued);
+	void ProcessBody(const QueuedBodyFrame& queued);
+	QKinectGrabberSettings CurrentSettings();
+	qint64 JoinFrameSet(QFrameSource::Stream stream, qint64 time);
+	QKinectFrameSet* StagedFrameSet(qint64 number);
+	void AddToFrameSet(QKinectFrameSet* set, QFrameSource::Stream stream, QMutexLocker& lock);
+	void RecordGray16(int stream, const std::vector<unsigned short>& buffer, int width, int height, qint64 time);
+	bool HasMailboxes();
+	void PostToMailboxes(int stream, const QImage& image);
+	bool UpdateCameraSpaceTable();
+	void BuildPointCloud(const QKinectGrabberSettings& settings, const QKinectDepthFrame& frame, const QRgb* color);
+	int UpdateRegistration(const QKinectDepthFrame& frame);
+	bool BuildRGBDFrame(const QKinectGrabberSettings& settings, const QKinectDepthFrame& depthFrame, const QKinectColorFrame& colorFrame);
+	QSize ColorOutputSizeFor(const QKinectGrabberSettings& settings, int width, int height);
+	QImage ScaleColor(const QKinectColorFrame& frame, const QSize& size);
+	const QKinectColorFrame* ColorBgra(const QKinectColorFrame& frame);
+
+	/// <summary>
+	/// Body of a stream's worker: process the queued frames, oldest first, until stop()
+	/// </summary>
+	template <typename Frame, typename Process>
+	void WorkerLoop(QFrameQueue<Frame>& queue, Process process)
+	{
+		while (Running.loadAcquire())
+		{
+			Frame* frame = queue.pop(FrameWaitTimeout);
+			if (frame)
+			{
+				process(*frame);
+				queue.release(frame);
+			}
+		}
+	}
 
 
-	IKinectSensor*				KinectSensor;		// Current Kinect	
+	QKinectGrabber*				q_ptr;
+	QFrameSource*				Source;			// open source, read by the grabber thread; the depth worker only maps with it
+	QFrameSource*				ExternalSource;		// set with setFrameSource(), not owned
+#ifdef QT5KINECT_SDK
+	QKinectFrameSource			KinectSource;
+#endif
 
 	QVector<QRgb>				ColorTable;
 	QMutex						Mutex;
-	bool						Running;
+	QKinectGrabberSettings		Settings;		// guarded by Mutex
+	QAtomicInt					Running;		// set by run(), cleared by stop() from any thread
+
+	// Per-stream workers, fed by the grabber thread through their bounded queues
+	int							FrameQueueCapacity;
+	QKinectStreamWorker			ColorWorker;
+	QKinectStreamWorker			DepthWorker;
+	QKinectStreamWorker			InfraredWorker;
+	QKinectStreamWorker			BodyWorker;
+
+	// signals whose payload is only built when somebody is connected
+	QMetaMethod					ColorImageSignal;
+	QMetaMethod					ColorGrayImageSignal;
+	QMetaMethod					ColorFrameSignal;
+
+	// Latest-value delivery, see addMailbox()
+	QVector<QKinectFrameMailbox*> Mailboxes;
+	QMutex						MailboxMutex;
+
+	// Synchronized framesets: the grabber thread numbers the set of every frame as it reads
+	// it, in the sensor's order, the workers stage their images under that number
+	QFrameSynchronizer			Synchronizer;		// guarded by FrameSetMutex while running
+	QKinectFrameSet				FrameSets[FrameSetSlots];	// sets being built, by number modulo FrameSetSlots, guarded by FrameSetMutex
+	qint64						FrameSetNumbers[FrameSetSlots];
+	QMutex						FrameSetMutex;
 
 	//Color Frame
 	bool						UseColorFrame;
-	IColorFrameReader*			ColorFrameReader;	// Color reader	
-	std::vector<unsigned char>	ColorBuffer;
+	QFrameQueue<QueuedColorFrame> ColorQueue;
+	QFramePool					ColorPool;
+	int							ColorPoolSize;
 	unsigned short				ColorFrameWidth;		// = 1920;
 	unsigned short				ColorFrameHeight;		// = 1080;
-	const unsigned short		ColorFrameChannels;		// = 4;
-	signed __int64				ColorFrameTime;			// timestamp
+	QColorDownscaler			ColorDownscaler;		// used by the color worker only
+	QFramePool					ScaledColorPool;		// emitted images when scaled, sized on the first scaled frame
+	bool						RawColor;
+	QKinectColorFrame			ConvertedColor;			// BGRA of the last raw frame, see ColorBgra()
+	QFramePool					ConvertedColorPool;
+	QKinectColorFrame			RegistrationColor;		// newest BGRA frame, handed to the depth worker
+	QMutex						RegistrationColorMutex;
 
 
 	//Depth Frame
 	bool						UseDepthFrame;
-	IDepthFrameReader*			DepthFrameReader;	// Depth reader	
-	std::vector<unsigned short>	DepthBuffer;
-	unsigned short				DepthFrameWidth;		// = 512;
-	unsigned short				DepthFrameHeight;		// = 424;
-	signed __int64				DepthFrameTime;			// timestamp
-	unsigned short				DepthMinReliableDistance;
-	unsigned short				DepthMaxDistance;
+	QFrameQueue<QueuedDepthFrame> DepthQueue;
+	unsigned short				DepthFrameWidth;		// = 512;
+	unsigned short				DepthFrameHeight;		// = 424;
+	bool						DepthFiltering;			// FilterDepth as last seen by the depth worker
+	QDepthFilter				DepthFilter;			// used by the depth worker only
+	QKinectDepthFrame			FilteredDepth;
 
 
 	//Infrared Frame
 	bool						UseInfraredFrame;
-	IInfraredFrameReader*		InfraredFrameReader;	// Infrared reader
-	unsigned short				InfraredFrameWidth;		// = 512;
-	unsigned short				InfraredFrameHeight;	// = 424;
-	signed __int64				InfraredFrameTime;		// timestamp
-	std::vector<unsigned short> InfraredBuffer;
+	QFrameQueue<QueuedInfraredFrame> InfraredQueue;
+	QInfraredToneMapper			InfraredMapper;		// used by the infrared worker only
+	unsigned short				InfraredFrameWidth;		// = 512;
+	unsigned short				InfraredFrameHeight;	// = 424;
 
 	//Body Frame
 	bool						UseBodyFrame;
-	IBodyFrameReader*			BodyFrameReader;
-	ICoordinateMapper*			CoordinateMapper;
+	QFrameQueue<QueuedBodyFrame> BodyQueue;
+
+	//Point Cloud
+	bool						UsePointCloud;
+	QVoxelGrid					VoxelGrid;				// only used by the depth worker
+	std::vector<float>			CameraSpaceTable;		// x, y per depth pixel, fetched once per session
+	QAtomicInt					CameraSpaceReady;		// set by the grabber thread once the table is filled
+	QKinectPointCloud			PointCloud;
+
+	//Registration
+	enum { NoRegistration, TableRegistration, MapperRegistration };
+	std::vector<float>			RegistrationTable;		// QFrameRegistration table, built once per session
+	std::vector<float>			RegistrationProbe;		// color points the grabber thread tries the mapper with
+	std::vector<float>			RegistrationPoints;		// color points of the current depth frame, depth worker only
+	std::vector<float>			RegistrationFrameTable;	// table of the current depth frame, depth worker only
+	QAtomicInt					RegistrationReady;		// set by the grabber thread: table, mapper or none yet
+	QFrameRegistration			Registration;
+	QKinectRGBDFrame			RGBDFrame;
+
+	//Recording
+	QFrameRecorder				Recorder;
+	bool						CompressRecording;
+	QDepthCodec					RecordingCodec;
+	std::vector<unsigned char>	RecordingBuffer;		// coded depth or infrared, used by the grabber thread only
+
+	//Publishing
+	QFramePublisher				Publisher;
+	QFrameStreamServer			StreamServer;
+
+	//Latency
+	QFrameLatency				Latency;
+	int							LatencyReportInterval;	// ms, 0 for no report
+
+	//Statistics
+	QFrameTiming				Timing;
+	int							StatisticsInterval;		// ms, 0 for no signal
 
 };
 
-QKinectGrabberPrivate::QKinectGrabberPrivate():
-	Running(false),
-	KinectSensor(NULL),
+QKinectGrabberPrivate::QKinectGrabberPrivate(QKinectGrabber* q):
+	q_ptr(q),
+	Source(NULL),
+	ExternalSource(NULL),
+	Running(0),
+	FrameQueueCapacity(QFrameQueue<QueuedColorFrame>::DefaultCapacity),
+	ColorWorker([this]() { WorkerLoop(ColorQueue, [this](const QueuedColorFrame& frame) { ProcessColor(frame); }); }),
+	DepthWorker([this]() { WorkerLoop(DepthQueue, [this](const QueuedDepthFrame& frame) { ProcessDepth(frame); }); }),
+	InfraredWorker([this]() { WorkerLoop(InfraredQueue, [this](const QueuedInfraredFrame& frame) { ProcessInfrared(frame); }); }),
+	BodyWorker([this]() { WorkerLoop(BodyQueue, [this](const QueuedBodyFrame& frame) { ProcessBody(frame); }); }),
+	ColorImageSignal(QMetaMethod::fromSignal(&QKinectGrabber::colorImage)),
+	ColorGrayImageSignal(QMetaMethod::fromSignal(&QKinectGrabber::colorGrayImage)),
+	ColorFrameSignal(QMetaMethod::fromSignal(&QKinectGrabber::colorFrame)),
 	UseColorFrame(false),
-	ColorFrameReader(NULL),
 	ColorFrameWidth(1920),
 	ColorFrameHeight(1080),
-	ColorFrameChannels(4),
+	ColorPoolSize(8),
+	RawColor(false),
 	UseDepthFrame(false),
-	DepthFrameReader(NULL),
-	DepthFrameWidth(512),
+	DepthFrameWidth(512),
 	DepthFrameHeight(424),
+	DepthFiltering(false),
 	UseInfraredFrame(false),
-	InfraredFrameReader(NULL),
-	InfraredFrameWidth(512),
+	InfraredFrameWidth(512),
 	InfraredFrameHeight(424),
 	UseBodyFrame(false),
-	BodyFrameReader(NULL),
-	CoordinateMapper(NULL)	
+	UsePointCloud(false),
+	CompressRecording(false),
+	LatencyReportInterval(0),
+	StatisticsInterval(DefaultStatisticsInterval)
 {
-	ColorBuffer.resize(ColorFrameWidth * ColorFrameHeight * ColorFrameChannels, 0);
-	DepthBuffer.resize(DepthFrameWidth * DepthFrameHeight, 0);
-	InfraredBuffer.resize(DepthFrameWidth * DepthFrameHeight, 0);
+	// every buffer is allocated up front, the frame loop never reallocates
+	ColorPool.reset(ColorPoolSize, ColorFrameWidth * ColorFrameHeight * QKinectColorFrame::Channels);
+	ResetQueues();
+
+	ConvertedColor.Format = QKinectColorFrame::Bgra;
+	ConvertedColor.Width = 0;
+	ConvertedColor.Height = 0;
+	ConvertedColor.Time = 0;
+	RegistrationColor = ConvertedColor;
 
 	for (int i = 0; i < 256; ++i)
 		ColorTable.push_back(qRgb(i, i, i));
+
+	Synchronizer.setTolerance(DefaultFrameSetTolerance);
 }
 
 
 
 
 QKinectGrabber::QKinectGrabber(QObject *parent)
-	: QThread(parent), d_ptr(new QKinectGrabberPrivate)
+	: QThread(parent), d_ptr(new QKinectGrabberPrivate(this))
 {
-
+	qRegisterMetaType<QKinectColorFrame>("QKinectColorFrame");
+	qRegisterMetaType<QKinectFrameSet>("QKinectFrameSet");
+	qRegisterMetaType<QKinectBodyFrame>("QKinectBodyFrame");
+	qRegisterMetaType<QKinectPointCloud>("QKinectPointCloud");
+	qRegisterMetaType<QKinectRGBDFrame>("QKinectRGBDFrame");
+	qRegisterMetaType<QKinectFrameStatistics>("QKinectFrameStatistics");
 }
 
 QKinectGrabber::~QKinectGrabber()
 {
 	stop();
+
+	// mailboxes outliving the grabber must not try to remove themselves
+	QMutexLocker lock(&d_ptr->MailboxMutex);
+	for (int i = 0; i < d_ptr->Mailboxes.size(); ++i)
+		d_ptr->Mailboxes[i]->Grabber = NULL;
+	d_ptr->Mailboxes.clear();
 }
 
 bool QKinectGrabber::useColorFrame() const
@@ -136,6 +357,129 @@ void QKinectGrabber::setUseColorFrame(bool use)
 	d_ptr->UseColorFrame = use;
 }
 
+int QKinectGrabber::colorPoolSize() const
+{
+	return d_ptr->ColorPoolSize;
+}
+
+void QKinectGrabber::setColorPoolSize(int size)
+{
+	d_ptr->ColorPoolSize = qMax(size, 4);
+}
+
+quint64 QKinectGrabber::colorPoolExhaustedCount() const
+{
+	return d_ptr->ColorPool.exhaustedCount() + d_ptr->ScaledColorPool.exhaustedCount() + d_ptr->ConvertedColorPool.exhaustedCount();
+}
+
+bool QKinectGrabber::rawColor() const
+{
+	return d_ptr->RawColor;
+}
+
+void QKinectGrabber::setRawColor(bool raw)
+{
+	d_ptr->RawColor = raw;
+}
+
+int QKinectGrabber::colorScale() const
+{
+	QMutexLocker lock(&d_ptr->Mutex);
+	return d_ptr->Settings.ColorScale;
+}
+
+void QKinectGrabber::setColorScale(int divisor)
+{
+	QMutexLocker lock(&d_ptr->Mutex);
+	d_ptr->Settings.ColorScale = qMax(divisor, 1);
+}
+
+QSize QKinectGrabber::colorOutputSize() const
+{
+	QMutexLocker lock(&d_ptr->Mutex);
+	return d_ptr->Settings.ColorOutputSize;
+}
+
+void QKinectGrabber::setColorOutputSize(const QSize& size)
+{
+	QMutexLocker lock(&d_ptr->Mutex);
+	d_ptr->Settings.ColorOutputSize = size;
+}
+
+int QKinectGrabber::frameQueueCapacity() const
+{
+	return d_ptr->FrameQueueCapacity;
+}
+
+void QKinectGrabber::setFrameQueueCapacity(int frames)
+{
+	d_ptr->FrameQueueCapacity = qMax(frames, 1);
+}
+
+QFrameSource* QKinectGrabber::frameSource() const
+{
+	return d_ptr->ExternalSource;
+}
+
+void QKinectGrabber::setFrameSource(QFrameSource* source)
+{
+	d_ptr->ExternalSource = source;
+}
+
+bool QKinectGrabber::useFrameEvents() const
+{
+#ifdef QT5KINECT_SDK
+	return d_ptr->KinectSource.useFrameEvents();
+#else
+	return false;
+#endif
+}
+
+void QKinectGrabber::setUseFrameEvents(bool use)
+{
+#ifdef QT5KINECT_SDK
+	d_ptr->KinectSource.setUseFrameEvents(use);
+#else
+	Q_UNUSED(use);
+#endif
+}
+
+bool QKinectGrabber::synchronizeFrames() const
+{
+	QMutexLocker lock(&d_ptr->Mutex);
+	return d_ptr->Settings.SynchronizeFrames;
+}
+
+void QKinectGrabber::setSynchronizeFrames(bool sync)
+{
+	QMutexLocker lock(&d_ptr->Mutex);
+	d_ptr->Settings.SynchronizeFrames = sync;
+}
+
+qint64 QKinectGrabber::frameSetTolerance() const
+{
+	QMutexLocker lock(&d_ptr->FrameSetMutex);
+	return d_ptr->Synchronizer.tolerance();
+}
+
+void QKinectGrabber::setFrameSetTolerance(qint64 ticks)
+{
+	QMutexLocker lock(&d_ptr->FrameSetMutex);
+	d_ptr->Synchronizer.setTolerance(ticks);
+}
+
+quint64 QKinectGrabber::frameSetCount() const
+{
+	QMutexLocker lock(&d_ptr->FrameSetMutex);
+	return d_ptr->Synchronizer.completeCount();
+}
+
+quint64 QKinectGrabber::incompleteFrameSetCount() const
+{
+	QMutexLocker lock(&d_ptr->FrameSetMutex);
+	return d_ptr->Synchronizer.incompleteCount();
+}
+
 bool QKinectGrabber::useDepthFrame() const
 {
 	return d_ptr->UseDepthFrame;
@@ -146,6 +490,23 @@ void QKinectGrabber::setUseDepthFrame(bool use)
 	d_ptr->UseDepthFrame = use;
 }
 
+bool QKinectGrabber::filterDepth() const
+{
+	QMutexLocker lock(&d_ptr->Mutex);
+	return d_ptr->Settings.FilterDepth;
+}
+
+void QKinectGrabber::setFilterDepth(bool filter)
+{
+	QMutexLocker lock(&d_ptr->Mutex);
+	d_ptr->Settings.FilterDepth = filter;
+}
+
+QDepthFilter* QKinectGrabber::depthFilter() const
+{
+	return &d_ptr->DepthFilter;
+}
+
 bool QKinectGrabber::useInfraredFrame() const
 {
 	return d_ptr->UseInfraredFrame;
@@ -157,523 +518,1233 @@ void QKinectGrabber::setUseInfraredFrame(bool use)
 }
 
 
-bool QKinectGrabber::useBodyFrame() const
+bool QKinectGrabber::adaptiveInfrared() const
 {
-	return d_ptr->UseBodyFrame;
+	QMutexLocker lock(&d_ptr->Mutex);
+	return d_ptr->Settings.AdaptiveInfrared;
 }
 
-void QKinectGrabber::setUseBodyFrame(bool use)
+void QKinectGrabber::setAdaptiveInfrared(bool adaptive)
 {
-	d_ptr->UseBodyFrame = use;
+	QMutexLocker lock(&d_ptr->Mutex);
+	d_ptr->Settings.AdaptiveInfrared = adaptive;
 }
 
+bool QKinectGrabber::usePointCloud() const
+{
+	return d_ptr->UsePointCloud;
+}
 
+void QKinectGrabber::setUsePointCloud(bool use)
+{
+	d_ptr->UsePointCloud = use;
+}
 
-bool QKinectGrabberPrivate::InitializeSensor()
+int QKinectGrabber::pointCloudLayout() const
 {
-	HRESULT hr;
+	QMutexLocker lock(&d_ptr->Mutex);
+	return d_ptr->Settings.PointCloudLayout;
+}
 
-	hr = GetDefaultKinectSensor(&KinectSensor);
-	if (FAILED(hr))
-	{
-		return false;
-	}
+void QKinectGrabber::setPointCloudLayout(int layout)
+{
+	QMutexLocker lock(&d_ptr->Mutex);
+	d_ptr->Settings.PointCloudLayout = layout == QKinectPointCloud::Interleaved ? QKinectPointCloud::Interleaved : QKinectPointCloud::Planar;
+}
 
-	if (KinectSensor)
-	{
-		hr = KinectSensor->Open();
+bool QKinectGrabber::pointCloudMask() const
+{
+	QMutexLocker lock(&d_ptr->Mutex);
+	return d_ptr->Settings.PointCloudMask;
+}
 
-		if (UseColorFrame){
-			IColorFrameSource* pColorFrameSource = NULL;
-			if (SUCCEEDED(hr))
-			{
-				hr = KinectSensor->get_ColorFrameSource(&pColorFrameSource);
-			}
+void QKinectGrabber::setPointCloudMask(bool mask)
+{
+	QMutexLocker lock(&d_ptr->Mutex);
+	d_ptr->Settings.PointCloudMask = mask;
+}
 
-			if (SUCCEEDED(hr))
-			{
-				hr = pColorFrameSource->OpenReader(&ColorFrameReader);
-			}
+bool QKinectGrabber::pointCloudColor() const
+{
+	QMutexLocker lock(&d_ptr->Mutex);
+	return d_ptr->Settings.PointCloudColor;
+}
 
-			SafeRelease(pColorFrameSource);
-		}
-		
-		// DepthFrame
-		if (UseDepthFrame){
-			IDepthFrameSource* pDepthFrameSource = NULL;
-			if (SUCCEEDED(hr))
-			{
-				hr = KinectSensor->get_DepthFrameSource(&pDepthFrameSource);
-			}
-
-			if (SUCCEEDED(hr))
-			{
-				hr = pDepthFrameSource->OpenReader(&DepthFrameReader);
-			}
+void QKinectGrabber::setPointCloudColor(bool color)
+{
+	QMutexLocker lock(&d_ptr->Mutex);
+	d_ptr->Settings.PointCloudColor = color;
+}
 
-			SafeRelease(pDepthFrameSource);
-		}
-
-		// InfraredFrame
-		if (UseInfraredFrame){
-			IInfraredFrameSource* pInfraredFrameSource = NULL;
-			if (SUCCEEDED(hr))
-			{
-				hr = KinectSensor->get_InfraredFrameSource(&pInfraredFrameSource);
-			}
-
-			if (SUCCEEDED(hr))
-			{
-				hr = pInfraredFrameSource->OpenReader(&InfraredFrameReader);
-			}
+float QKinectGrabber::pointCloudLeafSize() const
+{
+	QMutexLocker lock(&d_ptr->Mutex);
+	return d_ptr->Settings.PointCloudLeafSize;
+}
 
-			SafeRelease(pInfraredFrameSource);
-		}
+void QKinectGrabber::setPointCloudLeafSize(float meters)
+{
+	QMutexLocker lock(&d_ptr->Mutex);
+	d_ptr->Settings.PointCloudLeafSize = qMax(meters, 0.0f);
+}
 
-		// Body Frame
-		if (UseBodyFrame){			
-			IBodyFrameSource* pBodyFrameSource = NULL;
+int QKinectGrabber::pointCloudVoxelMode() const
+{
+	QMutexLocker lock(&d_ptr->Mutex);
+	return d_ptr->Settings.PointCloudVoxelMode;
+}
 
-			if (SUCCEEDED(hr))
-			{
-				hr = KinectSensor->get_CoordinateMapper(&CoordinateMapper);
-			}
+void QKinectGrabber::setPointCloudVoxelMode(int mode)
+{
+	QMutexLocker lock(&d_ptr->Mutex);
+	d_ptr->Settings.PointCloudVoxelMode = mode == QVoxelGrid::FirstPoint ? QVoxelGrid::FirstPoint : QVoxelGrid::Centroid;
+}
 
-			if (SUCCEEDED(hr))
-			{
-				hr = KinectSensor->get_BodyFrameSource(&pBodyFrameSource);
-			}
+bool QKinectGrabber::useRegistration() const
+{
+	QMutexLocker lock(&d_ptr->Mutex);
+	return d_ptr->Settings.UseRegistration;
+}
 
-			if (SUCCEEDED(hr))
-			{
-				hr = pBodyFrameSource->OpenReader(&BodyFrameReader);
-			}
+void QKinectGrabber::setUseRegistration(bool use)
+{
+	QMutexLocker lock(&d_ptr->Mutex);
+	d_ptr->Settings.UseRegistration = use;
+}
 
-			SafeRelease(pBodyFrameSource);
-		}
+bool QKinectGrabber::registerDepthInColor() const
+{
+	QMutexLocker lock(&d_ptr->Mutex);
+	return d_ptr->Settings.RegisterDepthInColor;
+}
+
+void QKinectGrabber::setRegisterDepthInColor(bool enable)
+{
+	QMutexLocker lock(&d_ptr->Mutex);
+	d_ptr->Settings.RegisterDepthInColor = enable;
+}
+
+bool QKinectGrabber::useBodyFrame() const
+{
+	return d_ptr->UseBodyFrame;
+}
+
+void QKinectGrabber::setUseBodyFrame(bool use)
+{
+	d_ptr->UseBodyFrame = use;
+}
+
+
+
+/// <summary>
+/// Source the next OpenSource() opens, NULL if there is none
+/// </summary>
+QFrameSource* QKinectGrabberPrivate::SelectedSource()
+{
+#ifdef QT5KINECT_SDK
+	return ExternalSource ? ExternalSource : &KinectSource;
+#else
+	return ExternalSource;
+#endif
+}
+
+bool QKinectGrabberPrivate::OpenSource()
+{
+	if (UseColorFrame && ColorPool.bufferCount() != ColorPoolSize)
+	{
+		ColorPool.reset(ColorPoolSize, ColorFrameWidth * ColorFrameHeight * QKinectColorFrame::Channels);
 	}
 
-	if (!KinectSensor || FAILED(hr))
+	if (ColorQueue.capacity() != FrameQueueCapacity)
+	{
+		ResetQueues();
+	}
+
+	int streams = QFrameSource::NoStream;
+	if (UseColorFrame)
+		streams |= QFrameSource::ColorStream;
+	if (UseDepthFrame)
+		streams |= QFrameSource::DepthStream;
+	if (UseInfraredFrame)
+		streams |= QFrameSource::InfraredStream;
+	if (UseBodyFrame)
+		streams |= QFrameSource::BodyStream;
+
+	QFrameSource* source = SelectedSource();
+	if (!source)
+	{
+		std::cerr << "<Error> Built without the Kinect SDK, set a frame source with setFrameSource()" << std::endl;
+		return false;
+	}
+
+	source->setRawColor(RawColor);
+
+	if (!source->open(streams))
 	{
-		std::cerr << "No ready Kinect found!" << std::endl;
 		return false;
 	}
 
+	Source = source;
 	return true;
 }
 
 
-void QKinectGrabberPrivate::UninitializeSensor()
+void QKinectGrabberPrivate::CloseSource()
 {
-	// done with color frame reader
-	SafeRelease(ColorFrameReader);
-	SafeRelease(DepthFrameReader);
-	SafeRelease(InfraredFrameReader);
-	SafeRelease(BodyFrameReader);
-
-	// close the Kinect Sensor
-	if (KinectSensor)
+	if (Source)
 	{
-		KinectSensor->Close();
+		Source->close();
+		Source = NULL;
 	}
 
-	SafeRelease(KinectSensor);
+	CameraSpaceReady.store(0);
+	RegistrationReady.store(NoRegistration);
+	CameraSpaceTable.clear();
+	RegistrationTable.clear();
+}
+
+
+/// <summary>
+/// Size every stream's queue to FrameQueueCapacity, with the slots allocated up front.
+/// Only while the workers are stopped.
+/// </summary>
+void QKinectGrabberPrivate::ResetQueues()
+{
+	ColorQueue.reset(FrameQueueCapacity);
+	ColorQueue.initialize([this](QueuedColorFrame& frame)
+	{
+		frame.Data.Format = QKinectColorFrame::Bgra;
+		frame.Data.Width = ColorFrameWidth;
+		frame.Data.Height = ColorFrameHeight;
+		frame.Data.Time = 0;
+	});
+
+	DepthQueue.reset(FrameQueueCapacity);
+	DepthQueue.initialize([this](QueuedDepthFrame& frame)
+	{
+		frame.Data.Buffer.resize(DepthFrameWidth * DepthFrameHeight, 0);
+		frame.Data.Width = DepthFrameWidth;
+		frame.Data.Height = DepthFrameHeight;
+		frame.Data.Time = 0;
+		frame.Data.MinReliableDistance = 0;
+		frame.Data.MaxDistance = 0;
+	});
+
+	InfraredQueue.reset(FrameQueueCapacity);
+	InfraredQueue.initialize([this](QueuedInfraredFrame& frame)
+	{
+		frame.Data.Buffer.resize(InfraredFrameWidth * InfraredFrameHeight, 0);
+		frame.Data.Width = InfraredFrameWidth;
+		frame.Data.Height = InfraredFrameHeight;
+		frame.Data.Time = 0;
+	});
+
+	BodyQueue.reset(FrameQueueCapacity);
+	BodyQueue.initialize([](QueuedBodyFrame& frame)
+	{
+		memset(&frame.Data, 0, sizeof(frame.Data));
+	});
+}
+
+
+/// <summary>
+/// Start a worker for every enabled stream, once Running is set
+/// </summary>
+void QKinectGrabberPrivate::StartWorkers()
+{
+	ColorQueue.resetCounts();
+	DepthQueue.resetCounts();
+	InfraredQueue.resetCounts();
+	BodyQueue.resetCounts();
+
+	// a new session starts without the last one's depth history
+	DepthFilter.reset();
+
+	if (UseColorFrame)
+		ColorWorker.start();
+	if (UseDepthFrame)
+		DepthWorker.start();
+	if (UseInfraredFrame)
+		InfraredWorker.start();
+	if (UseBodyFrame)
+		BodyWorker.start();
+}
+
+
+/// <summary>
+/// Join the workers once Running is cleared, dropping the frames they did not get to
+/// </summary>
+void QKinectGrabberPrivate::StopWorkers()
+{
+	// release the workers blocked on an empty queue
+	ColorQueue.wake();
+	DepthQueue.wake();
+	InfraredQueue.wake();
+	BodyQueue.wake();
+
+	ColorWorker.wait();
+	DepthWorker.wait();
+	InfraredWorker.wait();
+	BodyWorker.wait();
+
+	ColorQueue.clear();
+	DepthQueue.clear();
+	InfraredQueue.clear();
+	BodyQueue.clear();
+
+	// give the held buffers back to their pools
+	RegistrationColor.Buffer = QFrameHandle();
+	for (int i = 0; i < FrameSetSlots; ++i)
+		FrameSets[i] = QKinectFrameSet();
 }
 
 
 
 
 /// <summary>
-/// Get color frame from kinect
+/// Read the color frame straight into a free slot of the color queue and hand it to the
+/// color worker. When the worker fell behind, the oldest frame it had queued is dropped.
 /// </summary>
-bool QKinectGrabberPrivate::UpdateColor()
+bool QKinectGrabberPrivate::ReadColor(qint64 arrived)
 {
-	if (!ColorFrameReader || !UseColorFrame)
+	if (!UseColorFrame)
 	{
 		return false;
 	}
 
-	IColorFrame* pColorFrame = NULL;
-
-	HRESULT hr = ColorFrameReader->AcquireLatestFrame(&pColorFrame);
+	// the slot belongs to this thread until it is pushed, no lock is needed while filling it
+	QueuedColorFrame* slot = ColorQueue.acquire();
 
-	if (SUCCEEDED(hr))
+	if (!Source->readColor(slot->Data, ColorPool))
 	{
-		INT64 nTime = 0;
-		IFrameDescription* pFrameDescription = NULL;
-		int frameWidth = 0;
-		int frameHeight = 0;
-		ColorImageFormat imageFormat = ColorImageFormat_None;
-		BYTE *pBuffer = NULL;
-
-		hr = pColorFrame->get_RelativeTime(&nTime);
+		ColorQueue.release(slot);
+		return false;
+	}
 
-		if (SUCCEEDED(hr))
-		{
-			hr = pColorFrame->get_FrameDescription(&pFrameDescription);
-		}
+	const QKinectColorFrame& frame = slot->Data;
+	slot->Arrived = arrived;
+	slot->Read = QFrameLatency::now();
 
-		if (SUCCEEDED(hr))
-		{
-			hr = pFrameDescription->get_Width(&frameWidth);
-		}
+	// gaps in RelativeTime are the frames the source skipped while this thread was busy
+	Timing.add(QFrameSource::ColorStream, frame.Time, arrived);
+	slot->FrameSet = JoinFrameSet(QFrameSource::ColorStream, frame.Time);
 
-		if (SUCCEEDED(hr))
-		{
-			hr = pFrameDescription->get_Height(&frameHeight);
-		}
+	// raw frames go to the recorder before anything is converted
+	if (Recorder.isOpen())
+		Recorder.write(QFrameSource::ColorStream, frame.Format == QKinectColorFrame::Yuy2 ? QFrameRecording::Yuy2 : QFrameRecording::Bgra32,
+			frame.Width, frame.Height, frame.Time, frame.Buffer.data(), frame.bytesPerLine() * frame.Height);
+	if (Publisher.isOpen())
+		Publisher.publish(QFrameSource::ColorStream, frame.Format == QKinectColorFrame::Yuy2 ? QFrameRecording::Yuy2 : QFrameRecording::Bgra32,
+			frame.Width, frame.Height, frame.Time, frame.Buffer.data(), frame.bytesPerLine() * frame.Height);
 
-		if (SUCCEEDED(hr))
-		{
-			hr = pColorFrame->get_RawColorImageFormat(&imageFormat);
-		}
+	ColorQueue.push(slot);
+	return true;
+}
 
-		if (SUCCEEDED(hr))
-		{
-			if (imageFormat == ColorImageFormat_Bgra)
-			{
-				UINT bufferSize;
-				hr = pColorFrame->AccessRawUnderlyingBuffer(&bufferSize, reinterpret_cast<BYTE**>(pBuffer));
-
-				// copy data to color buffer
-				if (SUCCEEDED(hr))
-				{
-					Mutex.lock();
-					{
-						std::copy(reinterpret_cast<unsigned char*>(pBuffer), pBuffer + bufferSize, ColorBuffer.begin());
-						ColorFrameTime = nTime;
-
-						if (ColorFrameWidth != frameWidth || ColorFrameHeight != frameHeight)
-						{
-							std::cerr << "<Warning>	Unexpected size for depth buffer" << std::endl;
-							ColorFrameWidth = frameWidth;
-							ColorFrameHeight = frameHeight;
-						}
-					}
-					Mutex.unlock();
-				}
-			}
-			else
-			{
-				Mutex.lock();
-				{
-					hr = pColorFrame->CopyConvertedFrameDataToArray(ColorBuffer.size(), reinterpret_cast<BYTE*>(ColorBuffer.data()), ColorImageFormat_Bgra);
-					if (SUCCEEDED(hr))
-					{
-						ColorFrameTime = nTime;
-						if (ColorFrameWidth != frameWidth || ColorFrameHeight != frameHeight)
-						{
-							std::cerr << "<Warning>	Unexpected size for depth buffer" << std::endl;
-							ColorFrameWidth = frameWidth;
-							ColorFrameHeight = frameHeight;
-						}
-					}
-					else
-					{
-						std::cerr << "<Error>	Could not convert data from color frame to color buffer" << std::endl;
-					}
-				}
-				Mutex.unlock();
-			}
-		}
 
-		SafeRelease(pFrameDescription);
+bool QKinectGrabberPrivate::ReadDepth(qint64 arrived)
+{
+	if (!UseDepthFrame)
+	{
+		return false;
 	}
 
-	SafeRelease(pColorFrame);
+	QueuedDepthFrame* slot = DepthQueue.acquire();
 
-	if (!SUCCEEDED(hr))
+	if (!Source->readDepth(slot->Data))
+	{
+		DepthQueue.release(slot);
 		return false;
+	}
 
-	return true;
-}
-
+	const QKinectDepthFrame& frame = slot->Data;
+	slot->Arrived = arrived;
+	slot->Read = QFrameLatency::now();
 
-bool QKinectGrabberPrivate::UpdateDepth()
-{
-	if (!DepthFrameReader || !UseDepthFrame)
-	{
-		return false;
-	}
-
-	IDepthFrame* pDepthFrame = NULL;
-
-	HRESULT hr = DepthFrameReader->AcquireLatestFrame(&pDepthFrame);
-
-	if (SUCCEEDED(hr))
-	{
-		INT64 nTime = 0;
-		IFrameDescription* pFrameDescription = NULL;
-		int frameWidth = 0;
-		int frameHeight = 0;
-		USHORT nDepthMinReliableDistance = 0;
-		USHORT nDepthMaxDistance = 0;
-		UINT nBufferSize = 0;
-		UINT16 *pBuffer = NULL;
-
-		hr = pDepthFrame->get_RelativeTime(&nTime);
-
-		if (SUCCEEDED(hr))
-		{
-			hr = pDepthFrame->get_FrameDescription(&pFrameDescription);
-		}
-
-		if (SUCCEEDED(hr))
-		{
-			hr = pFrameDescription->get_Width(&frameWidth);
-		}
-
-		if (SUCCEEDED(hr))
-		{
-			hr = pFrameDescription->get_Height(&frameHeight);
-		}
-
-		if (SUCCEEDED(hr))
-		{
-			hr = pDepthFrame->get_DepthMinReliableDistance(&nDepthMinReliableDistance);
-		}
-
-		if (SUCCEEDED(hr))
-		{
-			// In order to see the full range of depth (including the less reliable far field depth)
-			// we are setting nDepthMaxDistance to the extreme potential depth threshold
-			//nDepthMaxDistance = USHRT_MAX;
-
-			// Note:  If you wish to filter by reliable depth distance, uncomment the following line.
-			hr = pDepthFrame->get_DepthMaxReliableDistance(&nDepthMaxDistance);
-		}
-
-		if (SUCCEEDED(hr))
-		{
-			hr = pDepthFrame->AccessUnderlyingBuffer(&nBufferSize, &pBuffer);
-		}
-
-
-		if (SUCCEEDED(hr))
-		{
-			Mutex.lock();
-			{
-				// copy data to depth buffer
-				std::copy(reinterpret_cast<unsigned short*>(pBuffer), pBuffer + nBufferSize, DepthBuffer.begin());
-				DepthMinReliableDistance = nDepthMinReliableDistance;
-				DepthMaxDistance = nDepthMaxDistance;
-				DepthFrameTime = nTime;
-
-				if (DepthFrameWidth != frameWidth || DepthFrameHeight != frameHeight)
-				{
-					std::cerr << "<Warning>	Unexpected size for depth buffer" << std::endl;
-					DepthFrameWidth = frameWidth;
-					DepthFrameHeight = frameHeight;
-				}
-			}
-			Mutex.unlock();
-		}
-
-		SafeRelease(pFrameDescription);
-	}
-
-	SafeRelease(pDepthFrame);
-
-	if (!SUCCEEDED(hr))
-		return false;
-
-	return true;
-}
+	Timing.add(QFrameSource::DepthStream, frame.Time, arrived);
+	slot->FrameSet = JoinFrameSet(QFrameSource::DepthStream, frame.Time);
 
+	if (Recorder.isOpen())
+		RecordGray16(QFrameSource::DepthStream, frame.Buffer, frame.Width, frame.Height, frame.Time);
+	if (Publisher.isOpen())
+		Publisher.publish(QFrameSource::DepthStream, QFrameRecording::Gray16, frame.Width, frame.Height, frame.Time,
+			frame.Buffer.data(), static_cast<int>(frame.Buffer.size() * sizeof(unsigned short)));
 
+	// the tables come from the source, which only this thread touches; the depth worker
+	// reads them once they are published
+	if (UsePointCloud && CameraSpaceReady.load() == 0 && UpdateCameraSpaceTable())
+		CameraSpaceReady.storeRelease(1);
+	if (UseColorFrame && RegistrationReady.load() == NoRegistration && CurrentSettings().UseRegistration)
+		RegistrationReady.storeRelease(UpdateRegistration(frame));
 
-bool QKinectGrabberPrivate::UpdateInfrared()
-{
-	if (!InfraredFrameReader || !UseInfraredFrame)
-	{
-		return false;
-	}
-
-	IInfraredFrame* pInfraredFrame = NULL;
-
-	HRESULT hr = InfraredFrameReader->AcquireLatestFrame(&pInfraredFrame);
-
-	if (SUCCEEDED(hr))
-	{
-		INT64 nTime = 0;
-		IFrameDescription* pFrameDescription = NULL;
-		int frameWidth = 0;
-		int frameHeight = 0;
-		UINT nBufferSize = 0;
-		UINT16 *pBuffer = NULL;
-
-		hr = pInfraredFrame->get_RelativeTime(&nTime);
-
-		if (SUCCEEDED(hr))
-		{
-			hr = pInfraredFrame->get_FrameDescription(&pFrameDescription);
-		}
-
-		if (SUCCEEDED(hr))
-		{
-			hr = pFrameDescription->get_Width(&frameWidth);
-		}
-
-		if (SUCCEEDED(hr))
-		{
-			hr = pFrameDescription->get_Height(&frameHeight);
-		}
-
-		if (SUCCEEDED(hr))
-		{
-			hr = pInfraredFrame->AccessUnderlyingBuffer(&nBufferSize, &pBuffer);
-		}
-
-		if (SUCCEEDED(hr))
-		{
-			std::copy(reinterpret_cast<unsigned short*>(pBuffer), pBuffer + nBufferSize, InfraredBuffer.begin());
-			InfraredFrameTime = nTime;
-
-			if (InfraredFrameWidth != frameWidth || InfraredFrameHeight != frameHeight)
-			{
-				std::cerr << "<Warning>	Unexpected size for depth buffer" << std::endl;
-				InfraredFrameWidth = frameWidth;
-				InfraredFrameHeight = frameHeight;
-			}
-		}
-
-		SafeRelease(pFrameDescription);
-	}
-
-	SafeRelease(pInfraredFrame);
-
-	if (!SUCCEEDED(hr))
-		return false;
-
+	DepthQueue.push(slot);
 	return true;
 }
 
 
-void QKinectGrabber::stop()
+bool QKinectGrabberPrivate::ReadInfrared(qint64 arrived)
 {
-	Q_D(QKinectGrabber);
-	d->Mutex.lock();
+	if (!UseInfraredFrame)
+	{
+		return false;
+	}
+
+	QueuedInfraredFrame* slot = InfraredQueue.acquire();
+
+	if (!Source->readInfrared(slot->Data))
 	{
-		d->Running = false;
+		InfraredQueue.release(slot);
+		return false;
 	}
-	d->Mutex.unlock();
 
-	wait();
+	const QKinectInfraredFrame& frame = slot->Data;
+	slot->Arrived = arrived;
+	slot->Read = QFrameLatency::now();
 
-	d->UninitializeSensor();
-}
+	Timing.add(QFrameSource::InfraredStream, frame.Time, arrived);
+	slot->FrameSet = JoinFrameSet(QFrameSource::InfraredStream, frame.Time);
+
+	if (Recorder.isOpen())
+		RecordGray16(QFrameSource::InfraredStream, frame.Buffer, frame.Width, frame.Height, frame.Time);
+	if (Publisher.isOpen())
+		Publisher.publish(QFrameSource::InfraredStream, QFrameRecording::Gray16, frame.Width, frame.Height, frame.Time,
+			frame.Buffer.data(), static_cast<int>(frame.Buffer.size() * sizeof(unsigned short)));
 
+	InfraredQueue.push(slot);
+	return true;
+}
 
 
-void QKinectGrabber::run()
+bool QKinectGrabberPrivate::ReadBody(qint64 arrived)
 {
-	Q_D(QKinectGrabber);
-
-	if (!d->InitializeSensor())
+	if (!UseBodyFrame)
 	{
-		std::cerr << "<Error> Kinect not started" << std::endl;
-		return;
+		return false;
 	}
 
-	d->Running = true;
+	QueuedBodyFrame* slot = BodyQueue.acquire();
 
-	while (d->Running)
+	if (!Source->readBody(slot->Data))
 	{
-		bool colorUpdated = d->UpdateColor();
-		bool depthUpdated = d->UpdateDepth();
-		bool infraredUpdated = d->UpdateInfrared();
-
-		if (colorUpdated || depthUpdated || infraredUpdated)
-			emit frameUpdated();
+		BodyQueue.release(slot);
+		return false;
+	}
+
+	const QKinectBodyFrame& frame = slot->Data;
+	slot->Arrived = arrived;
+	slot->Read = QFrameLatency::now();
+
+	Timing.add(QFrameSource::BodyStream, frame.Time, arrived);
+	slot->FrameSet = JoinFrameSet(QFrameSource::BodyStream, frame.Time);
+
+	if (Recorder.isOpen())
+		Recorder.write(QFrameSource::BodyStream, QFrameRecording::BodyFrame, QKinectBodyFrame::BodyCount, QKinectBodyFrame::JointCount, frame.Time,
+			&frame, sizeof(frame));
+	if (Publisher.isOpen())
+		Publisher.publish(QFrameSource::BodyStream, QFrameRecording::BodyFrame, QKinectBodyFrame::BodyCount, QKinectBodyFrame::JointCount, frame.Time,
+			&frame, sizeof(frame));
+
+	BodyQueue.push(slot);
+	return true;
+}
+
+
+
 
-		// If send image is enabled, emit signal with the color image
-		if (d->UseColorFrame && colorUpdated)
+/// <summary>
+/// Color worker: emit the frame as read, its luma and its image, and hand its BGRA
+/// version to the depth worker for registration
+/// </summary>
+void QKinectGrabberPrivate::ProcessColor(const QueuedColorFrame& queued)
+{
+	Q_Q(QKinectGrabber);
+
+	// the image holds a reference on the pool buffer, which is recycled once every receiver dropped it
+	const QKinectColorFrame& frame = queued.Data;
+
+	if (q->isSignalConnected(ColorFrameSignal))
+		emit q->colorFrame(frame);
+
+	if (frame.Format == QKinectColorFrame::Yuy2 && q->isSignalConnected(ColorGrayImageSignal))
+	{
+		QImage grayImg = QImage(frame.Width, frame.Height, QImage::Format::Format_Indexed8);
+		grayImg.setColorTable(ColorTable);
+		QFrameKernels::yuy2ToGray8(frame.Buffer.data(), frame.Width, frame.Height, frame.bytesPerLine(), grayImg.bits(), grayImg.bytesPerLine());
+		emit q->colorGrayImage(grayImg);
+	}
+
+	// raw frames are converted only when an image is wanted
+	const bool wantImage = q->isSignalConnected(ColorImageSignal) || queued.FrameSet >= 0 || HasMailboxes();
+	const QKinectGrabberSettings settings = CurrentSettings();
+	const bool wantRegistration = settings.UseRegistration && UseDepthFrame;
+	const bool wantStream = StreamServer.hasClients();
+	const QKinectColorFrame* bgra = wantImage || wantRegistration || wantStream ? ColorBgra(frame) : NULL;
+
+	if (!bgra)
+	{
+		return;
+	}
+
+	if (wantRegistration)
+	{
+		QMutexLocker lock(&RegistrationColorMutex);
+		RegistrationColor = *bgra;
+	}
+
+	if (wantStream)
+		StreamServer.sendColor(*bgra);
+
+	if (!wantImage)
+	{
+		return;
+	}
+
+	const QSize outputSize = ColorOutputSizeFor(settings, bgra->Width, bgra->Height);
+
+	// a scaled image is all that leaves the grabber, the full size one is never built
+	QImage colorImg;
+	if (outputSize.width() == bgra->Width && outputSize.height() == bgra->Height)
+		colorImg = bgra->Buffer.toImage(bgra->Width, bgra->Height, bgra->bytesPerLine(), QImage::Format_ARGB32);
+	else
+		colorImg = ScaleColor(*bgra, outputSize);
+
+	if (colorImg.isNull())
+	{
+		return;
+	}
+
+	// noted before the emit: a receiver may call presented() before emit returns
+	Latency.emitted(QFrameSource::ColorStream, colorImg.cacheKey(), queued.Arrived, queued.Read, QFrameLatency::now());
+	emit q->colorImage(colorImg);
+	PostToMailboxes(QFrameSource::ColorStream, colorImg);
+
+	if (queued.FrameSet >= 0)
+	{
+		QMutexLocker lock(&FrameSetMutex);
+		QKinectFrameSet* set = StagedFrameSet(queued.FrameSet);
+		if (set)
 		{
-			d->Mutex.lock();
-			{
-				//emit colorBuffer(d->ColorBuffer.data());
-				emit colorImage(QImage(d->ColorBuffer.data(), d->ColorFrameWidth, d->ColorFrameHeight, QImage::Format_ARGB32));
-			}
-			d->Mutex.unlock();
+			set->Color = colorImg;
+			set->ColorTime = frame.Time;
+			AddToFrameSet(set, QFrameSource::ColorStream, lock);
+		}
+	}
+}
+
+
+/// <summary>
+/// Depth worker: emit the depth image, and the point cloud and registered frame when enabled
+/// </summary>
+void QKinectGrabberPrivate::ProcessDepth(const QueuedDepthFrame& queued)
+{
+	Q_Q(QKinectGrabber);
+
+	const QKinectGrabberSettings settings = CurrentSettings();
+
+	// the filter is only touched here, pick up a change of the property made from another thread;
+	// history left from before it was off would hold pixels back
+	if (DepthFiltering != settings.FilterDepth)
+	{
+		DepthFiltering = settings.FilterDepth;
+		DepthFilter.reset();
+	}
+
+	if (DepthFiltering)
+	{
+		FilteredDepth.Width = queued.Data.Width;
+		FilteredDepth.Height = queued.Data.Height;
+		FilteredDepth.Time = queued.Data.Time;
+		FilteredDepth.MinReliableDistance = queued.Data.MinReliableDistance;
+		FilteredDepth.MaxDistance = queued.Data.MaxDistance;
+		FilteredDepth.Buffer.resize(queued.Data.Buffer.size());
+		DepthFilter.process(queued.Data.Buffer.data(), queued.Data.Width, queued.Data.Height, FilteredDepth.Buffer.data());
+	}
+
+	const QKinectDepthFrame& frame = DepthFiltering ? FilteredDepth : queued.Data;
+
+	// create depth image
+	QImage depthImg = QImage(frame.Width, frame.Height, QImage::Format::Format_Indexed8);
+	depthImg.setColorTable(ColorTable);
+
+	// casting from unsigned short (2 bytes precision) to unsigned char (1 byte precision),
+	// straight into the image scanlines
+	QFrameKernels::depthToGray8(frame.Buffer.data(), frame.Width, frame.Height, frame.MaxDistance, depthImg.bits(), depthImg.bytesPerLine());
+
+	// noted before the emit: a receiver may call presented() before emit returns
+	Latency.emitted(QFrameSource::DepthStream, depthImg.cacheKey(), queued.Arrived, queued.Read, QFrameLatency::now());
+	emit q->depthImage(depthImg);
+	PostToMailboxes(QFrameSource::DepthStream, depthImg);
+
+	// returns at once without clients
+	StreamServer.sendDepth(frame);
+
+	// pair the depth frame with the newest color frame the color worker made BGRA
+	bool registered = false;
+	if (settings.UseRegistration && UseColorFrame && RegistrationReady.loadAcquire() != NoRegistration)
+	{
+		QKinectColorFrame colorFrame;
+		{
+			QMutexLocker lock(&RegistrationColorMutex);
+			colorFrame = RegistrationColor;
+		}
+
+		if (!colorFrame.Buffer.isNull() && BuildRGBDFrame(settings, frame, colorFrame))
+		{
+			emit q->rgbdFrame(RGBDFrame);
+			registered = true;
+		}
+	}
+
+	// after the registration, which gives the points their color
+	if (UsePointCloud && CameraSpaceReady.loadAcquire() && CameraSpaceTable.size() == 2 * frame.Buffer.size())
+	{
+		BuildPointCloud(settings, frame, registered && settings.PointCloudColor ? reinterpret_cast<const QRgb*>(RGBDFrame.Color.constBits()) : NULL);
+		emit q->pointCloud(PointCloud);
+	}
+
+	if (queued.FrameSet >= 0)
+	{
+		QMutexLocker lock(&FrameSetMutex);
+		QKinectFrameSet* set = StagedFrameSet(queued.FrameSet);
+		if (set)
+		{
+			set->Depth = depthImg;
+			set->DepthTime = frame.Time;
+			AddToFrameSet(set, QFrameSource::DepthStream, lock);
+		}
+	}
+}
+
+
+void QKinectGrabberPrivate::ProcessInfrared(const QueuedInfraredFrame& queued)
+{
+	Q_Q(QKinectGrabber);
+
+	const QKinectInfraredFrame& frame = queued.Data;
+
+	QImage infraredImg = QImage(frame.Width, frame.Height, QImage::Format::Format_Indexed8);
+	infraredImg.setColorTable(ColorTable);
+
+	// the mapper is only touched here, pick up a change of the property made from another thread
+	const bool adaptive = CurrentSettings().AdaptiveInfrared;
+	if (InfraredMapper.adaptive() != adaptive)
+		InfraredMapper.setAdaptive(adaptive);
+
+	// casting from unsigned short (2 bytes precision) to unsigned char (1 byte precision)
+	// through the tone mapping table, straight into the image scanlines
+	InfraredMapper.map(frame.Buffer.data(), frame.Width, frame.Height, infraredImg.bits(), infraredImg.bytesPerLine());
+
+	// noted before the emit: a receiver may call presented() before emit returns
+	Latency.emitted(QFrameSource::InfraredStream, infraredImg.cacheKey(), queued.Arrived, queued.Read, QFrameLatency::now());
+	emit q->infraredImage(infraredImg);
+	PostToMailboxes(QFrameSource::InfraredStream, infraredImg);
+
+	StreamServer.sendInfrared(frame);
+
+	if (queued.FrameSet >= 0)
+	{
+		QMutexLocker lock(&FrameSetMutex);
+		QKinectFrameSet* set = StagedFrameSet(queued.FrameSet);
+		if (set)
+		{
+			set->Infrared = infraredImg;
+			set->InfraredTime = frame.Time;
+			AddToFrameSet(set, QFrameSource::InfraredStream, lock);
+		}
+	}
+}
+
+
+void QKinectGrabberPrivate::ProcessBody(const QueuedBodyFrame& queued)
+{
+	Q_Q(QKinectGrabber);
+
+	const QKinectBodyFrame& frame = queued.Data;
+
+	Latency.emitted(QFrameSource::BodyStream, 0, queued.Arrived, queued.Read, QFrameLatency::now());
+	emit q->bodyFrame(frame);
+
+	if (queued.FrameSet >= 0)
+	{
+		QMutexLocker lock(&FrameSetMutex);
+		QKinectFrameSet* set = StagedFrameSet(queued.FrameSet);
+		if (set)
+		{
+			set->Body = frame;
+			set->BodyTime = frame.Time;
+			AddToFrameSet(set, QFrameSource::BodyStream, lock);
+		}
+	}
+}
+
+
+/// <summary>
+/// Copy of the properties another thread may change, for the frame being read or processed
+/// </summary>
+QKinectGrabberSettings QKinectGrabberPrivate::CurrentSettings()
+{
+	QMutexLocker lock(&Mutex);
+	return Settings;
+}
+
+
+bool QKinectGrabberPrivate::HasMailboxes()
+{
+	QMutexLocker lock(&MailboxMutex);
+	return !Mailboxes.isEmpty();
+}
+
+
+/// <summary>
+/// Make image the pending one of its stream in every mailbox; a mailbox never holds more
+/// than one image per stream, whatever its receiver's backlog
+/// </summary>
+void QKinectGrabberPrivate::PostToMailboxes(int stream, const QImage& image)
+{
+	QMutexLocker lock(&MailboxMutex);
+	for (int i = 0; i < Mailboxes.size(); ++i)
+		Mailboxes[i]->post(stream, image);
+}
+
+
+/// <summary>
+/// Number of the set a frame just read belongs to, -1 when not synchronizing. Called by
+/// the grabber thread, which reads the streams in the order the sensor delivers them: the
+/// workers finish in any order, lagging behind each other by a frame or more.
+/// </summary>
+qint64 QKinectGrabberPrivate::JoinFrameSet(QFrameSource::Stream stream, qint64 time)
+{
+	if (!CurrentSettings().SynchronizeFrames)
+	{
+		return -1;
+	}
+
+	QMutexLocker lock(&FrameSetMutex);
+	Synchronizer.add(stream, time);
+	return Synchronizer.currentSet();
+}
+
+/// <summary>
+/// Set a worker stages its frame of set number in, under the locked FrameSetMutex. NULL if
+/// the other workers moved FrameSetSlots sets further since, the frame is dropped then.
+/// </summary>
+QKinectFrameSet* QKinectGrabberPrivate::StagedFrameSet(qint64 number)
+{
+	const int slot = static_cast<int>(number % FrameSetSlots);
+
+	if (FrameSetNumbers[slot] > number)
+	{
+		return NULL;
+	}
+
+	// the set left in the slot never got all its frames, it was incomplete or lost a frame in a queue
+	if (FrameSetNumbers[slot] < number)
+	{
+		FrameSets[slot] = QKinectFrameSet();
+		FrameSetNumbers[slot] = number;
+	}
+
+	return &FrameSets[slot];
+}
+
+/// <summary>
+/// A stream's frame was staged in set, under the locked FrameSetMutex: emit the set if it
+/// was the last one missing. The lock is released before emitting.
+/// </summary>
+void QKinectGrabberPrivate::AddToFrameSet(QKinectFrameSet* set, QFrameSource::Stream stream, QMutexLocker& lock)
+{
+	Q_Q(QKinectGrabber);
+
+	set->Streams |= stream;
+	if (set->Streams != Synchronizer.streams())
+	{
+		return;
+	}
+
+	QKinectFrameSet frames = *set;
+
+	// drop the staged images so their buffers can go back to the pool
+	*set = QKinectFrameSet();
+
+	lock.unlock();
+	emit q->frameSet(frames);
+}
+
+
+/// <summary>
+/// Record a depth or infrared frame, coded first when compressRecording is on. Runs on
+/// the grabber thread, the coding takes a fraction of a millisecond.
+/// </summary>
+void QKinectGrabberPrivate::RecordGray16(int stream, const std::vector<unsigned short>& buffer, int width, int height, qint64 time)
+{
+	const int count = static_cast<int>(buffer.size());
+
+	if (CompressRecording && RecordingCodec.encode(buffer.data(), count, RecordingBuffer) > 0)
+	{
+		Recorder.write(stream, QFrameRecording::Gray16Rvl, width, height, time, RecordingBuffer.data(), static_cast<int>(RecordingBuffer.size()));
+		return;
+	}
+
+	Recorder.write(stream, QFrameRecording::Gray16, width, height, time, buffer.data(), count * static_cast<int>(sizeof(unsigned short)));
+}
+
+
+/// <summary>
+/// Fetch the depth-to-camera-space table from the source. It only changes with the
+/// calibration, so it is fetched once per session; until the source has one this fails
+/// and is retried on the next depth frame.
+/// </summary>
+bool QKinectGrabberPrivate::UpdateCameraSpaceTable()
+{
+	if (CameraSpaceTable.empty() && !Source->depthToCameraSpaceTable(CameraSpaceTable))
+	{
+		CameraSpaceTable.clear();
+	}
+
+	return !CameraSpaceTable.empty();
+}
+
+
+/// <summary>
+/// Fill PointCloud from the depth frame, one point per pixel or, with a leaf size, one per
+/// voxel. color is the registered color of every depth pixel, NULL for a cloud without.
+/// </summary>
+void QKinectGrabberPrivate::BuildPointCloud(const QKinectGrabberSettings& settings, const QKinectDepthFrame& frame, const QRgb* color)
+{
+	const float leafSize = settings.PointCloudLeafSize;
+
+	int count = frame.Width * frame.Height;
+	if (leafSize > 0)
+	{
+		VoxelGrid.setLeafSize(leafSize);
+		VoxelGrid.setMode(settings.PointCloudVoxelMode);
+		count = VoxelGrid.process(frame.Buffer.data(), frame.Width, frame.Height, CameraSpaceTable.data(), color);
+	}
+
+	// resizing a vector nobody else holds keeps its storage, only a shared one is reallocated
+	PointCloud.PointLayout = settings.PointCloudLayout;
+	PointCloud.Width = leafSize > 0 ? count : frame.Width;
+	PointCloud.Height = leafSize > 0 ? 1 : frame.Height;
+	PointCloud.Time = frame.Time;
+	PointCloud.Points.resize(3 * count);
+	PointCloud.Mask.resize(settings.PointCloudMask && leafSize <= 0 ? count : 0);
+	PointCloud.Colors.resize(color ? count : 0);
+
+	float* points = PointCloud.Points.data();
+
+	if (leafSize > 0)
+	{
+		if (settings.PointCloudLayout == QKinectPointCloud::Interleaved)
+			VoxelGrid.points(points);
+		else
+			VoxelGrid.points(points, points + count, points + 2 * count);
+
+		if (color)
+			VoxelGrid.colors(PointCloud.Colors.data());
+		return;
+	}
+
+	unsigned char* mask = settings.PointCloudMask ? PointCloud.Mask.data() : NULL;
+
+	if (settings.PointCloudLayout == QKinectPointCloud::Interleaved)
+		QFrameKernels::depthToPointsInterleaved(frame.Buffer.data(), CameraSpaceTable.data(), count, points, mask);
+	else
+		QFrameKernels::depthToPoints(frame.Buffer.data(), CameraSpaceTable.data(), count, points, points + count, points + 2 * count, mask);
+
+	if (color)
+		std::copy(color, color + count, PointCloud.Colors.begin());
+}
+
+
+/// <summary>
+/// Fetch the registration table from the source. Like the camera space table it is built
+/// once per session. A source without a table that maps this frame is mapped every frame
+/// instead. Both are tried again on the next frame while the source has no calibration yet.
+/// </summary>
+int QKinectGrabberPrivate::UpdateRegistration(const QKinectDepthFrame& frame)
+{
+	if (RegistrationTable.empty() && !Source->depthToColorTable(RegistrationTable))
+	{
+		RegistrationTable.clear();
+	}
+
+	if (!RegistrationTable.empty())
+		return TableRegistration;
+
+	const int count = frame.Width * frame.Height;
+	RegistrationProbe.resize(2 * count);
+	if (Source->mapDepthFrameToColor(frame.Buffer.data(), count, RegistrationProbe.data()))
+		return MapperRegistration;
+
+	return NoRegistration;
+}
+
+
+/// <summary>
+/// Register depthFrame in colorFrame with the session's table, or with a table of this
+/// frame's own mapping when the source has none. False if the source could not map it.
+/// </summary>
+bool QKinectGrabberPrivate::BuildRGBDFrame(const QKinectGrabberSettings& settings, const QKinectDepthFrame& depthFrame, const QKinectColorFrame& colorFrame)
+{
+	const float* table = RegistrationTable.data();
+
+	if (RegistrationReady.loadAcquire() == MapperRegistration)
+	{
+		const int count = depthFrame.Width * depthFrame.Height;
+		RegistrationPoints.resize(2 * count);
+		RegistrationFrameTable.resize(QFrameRegistration::TableStride * count);
+
+		if (!Source->mapDepthFrameToColor(depthFrame.Buffer.data(), count, RegistrationPoints.data()))
+			return false;
+
+		QFrameRegistration::pointTable(RegistrationPoints.data(), count, RegistrationFrameTable.data());
+		table = RegistrationFrameTable.data();
+	}
+
+	// reuse the previous frame's storage unless a consumer still holds it
+	if (RGBDFrame.Color.width() != depthFrame.Width || RGBDFrame.Color.height() != depthFrame.Height || !RGBDFrame.Color.isDetached())
+		RGBDFrame.Color = QImage(depthFrame.Width, depthFrame.Height, QImage::Format_ARGB32);
+
+	RGBDFrame.Width = depthFrame.Width;
+	RGBDFrame.Height = depthFrame.Height;
+	RGBDFrame.ColorWidth = colorFrame.Width;
+	RGBDFrame.ColorHeight = colorFrame.Height;
+	RGBDFrame.DepthTime = depthFrame.Time;
+	RGBDFrame.ColorTime = colorFrame.Time;
+	RGBDFrame.Depth.resize(depthFrame.Width * depthFrame.Height);
+	RGBDFrame.DepthInColor.resize(settings.RegisterDepthInColor ? colorFrame.Width * colorFrame.Height : 0);
+
+	std::copy(depthFrame.Buffer.begin(), depthFrame.Buffer.end(), RGBDFrame.Depth.begin());
+
+	Registration.process(depthFrame.Buffer.data(), depthFrame.Width, depthFrame.Height, table,
+		colorFrame.Buffer.data(), colorFrame.Width, colorFrame.Height, colorFrame.bytesPerLine(),
+		reinterpret_cast<QRgb*>(RGBDFrame.Color.bits()), settings.RegisterDepthInColor ? RGBDFrame.DepthInColor.data() : NULL);
+	return true;
+}
+
+
+/// <summary>
+/// Size colorImage() is emitted at for a color frame of the given size: colorOutputSize if
+/// set, else 1 / colorScale of the frame, never larger than the frame
+/// </summary>
+QSize QKinectGrabberPrivate::ColorOutputSizeFor(const QKinectGrabberSettings& settings, int width, int height)
+{
+	QSize size = settings.ColorOutputSize;
+
+	if (size.isEmpty())
+		size = QSize(width / settings.ColorScale, height / settings.ColorScale);
+
+	return QSize(qBound(1, size.width(), width), qBound(1, size.height(), height));
+}
+
+
+/// <summary>
+/// Shrink the color frame straight from its pool buffer into a buffer of the scaled pool.
+/// A null image when every scaled buffer is still held by a receiver.
+/// </summary>
+QImage QKinectGrabberPrivate::ScaleColor(const QKinectColorFrame& frame, const QSize& size)
+{
+	const int bytesPerLine = size.width() * QKinectColorFrame::Channels;
+
+	// images of the previous size keep their buffers until released
+	if (ScaledColorPool.bufferSize() != bytesPerLine * size.height() || ScaledColorPool.bufferCount() != ColorPoolSize)
+		ScaledColorPool.reset(ColorPoolSize, bytesPerLine * size.height());
+
+	QFrameHandle buffer = ScaledColorPool.acquire();
+	if (buffer.isNull())
+		return QImage();
+
+	ColorDownscaler.process(frame.Buffer.data(), frame.Width, frame.Height, frame.bytesPerLine(),
+		buffer.data(), size.width(), size.height(), bytesPerLine);
+
+	return buffer.toImage(size.width(), size.height(), bytesPerLine, QImage::Format_ARGB32);
+}
+
+
+/// <summary>
+/// The color frame in BGRA: the frame itself, or for a raw frame its conversion. NULL when
+/// there is no frame or every converted buffer is still held by a receiver.
+/// </summary>
+const QKinectColorFrame* QKinectGrabberPrivate::ColorBgra(const QKinectColorFrame& frame)
+{
+	if (frame.Buffer.isNull())
+		return NULL;
+
+	if (frame.Format == QKinectColorFrame::Bgra)
+		return &frame;
+
+	const int frameBytes = frame.Width * frame.Height * QKinectColorFrame::Channels;
+
+	if (ConvertedColorPool.bufferSize() != frameBytes || ConvertedColorPool.bufferCount() != ColorPoolSize)
+		ConvertedColorPool.reset(ColorPoolSize, frameBytes);
+
+	// a conversion still referenced by an emitted image or the depth worker is left to them
+	if (ConvertedColor.Buffer.isNull() || ConvertedColor.Buffer.isShared() || ConvertedColor.Buffer.size() != frameBytes)
+		ConvertedColor.Buffer = ConvertedColorPool.acquire();
+
+	if (ConvertedColor.Buffer.isNull())
+		return NULL;
+
+	ConvertedColor.Width = frame.Width;
+	ConvertedColor.Height = frame.Height;
+	ConvertedColor.Time = frame.Time;
+
+	QFrameKernels::yuy2ToBgra(frame.Buffer.data(), frame.Width, frame.Height, frame.bytesPerLine(),
+		ConvertedColor.Buffer.data(), ConvertedColor.bytesPerLine());
+
+	return &ConvertedColor;
+}
+
+
+void QKinectGrabber::addMailbox(QKinectFrameMailbox* mailbox)
+{
+	QMutexLocker lock(&d_ptr->MailboxMutex);
+
+	if (mailbox->Grabber)
+	{
+		std::cerr << "<Warning> Mailbox already added to a grabber" << std::endl;
+		return;
+	}
+
+	d_ptr->Mailboxes.append(mailbox);
+	mailbox->Grabber = this;
+}
+
+void QKinectGrabber::removeMailbox(QKinectFrameMailbox* mailbox)
+{
+	QMutexLocker lock(&d_ptr->MailboxMutex);
+
+	if (d_ptr->Mailboxes.removeOne(mailbox))
+		mailbox->Grabber = NULL;
+}
+
+
+bool QKinectGrabber::startRecording(const QString& fileName)
+{
+	return d_ptr->Recorder.open(fileName);
+}
+
+void QKinectGrabber::stopRecording()
+{
+	d_ptr->Recorder.close();
+}
+
+bool QKinectGrabber::isRecording() const
+{
+	return d_ptr->Recorder.isOpen();
+}
+
+bool QKinectGrabber::compressRecording() const
+{
+	return d_ptr->CompressRecording;
+}
+
+void QKinectGrabber::setCompressRecording(bool compress)
+{
+	d_ptr->CompressRecording = compress;
+}
+
+quint64 QKinectGrabber::recordedFrameCount() const
+{
+	return d_ptr->Recorder.frameCount();
+}
+
+quint64 QKinectGrabber::recordingDroppedCount() const
+{
+	return d_ptr->Recorder.droppedCount();
+}
+
+
+bool QKinectGrabber::startPublishing(const QString& name, int slotCount)
+{
+	return d_ptr->Publisher.open(name, slotCount);
+}
+
+void QKinectGrabber::stopPublishing()
+{
+	d_ptr->Publisher.close();
+}
+
+bool QKinectGrabber::isPublishing() const
+{
+	return d_ptr->Publisher.isOpen();
+}
+
+quint64 QKinectGrabber::publishedFrameCount() const
+{
+	return d_ptr->Publisher.publishedCount();
+}
+
+
+bool QKinectGrabber::startStreaming(quint16 port)
+{
+	return d_ptr->StreamServer.listen(port);
+}
+
+void QKinectGrabber::stopStreaming()
+{
+	d_ptr->StreamServer.close();
+}
+
+bool QKinectGrabber::isStreaming() const
+{
+	return d_ptr->StreamServer.isListening();
+}
+
+QFrameStreamServer* QKinectGrabber::streamServer() const
+{
+	return &d_ptr->StreamServer;
+}
+
+
+QFrameLatency* QKinectGrabber::latency() const
+{
+	return &d_ptr->Latency;
+}
+
+int QKinectGrabber::latencyReportInterval() const
+{
+	return d_ptr->LatencyReportInterval;
+}
+
+void QKinectGrabber::setLatencyReportInterval(int ms)
+{
+	d_ptr->LatencyReportInterval = qMax(ms, 0);
+}
+
+QKinectFrameStatistics QKinectGrabber::statistics() const
+{
+	QKinectFrameStatistics statistics = d_ptr->Timing.statistics();
+
+	statistics.Color.QueueDepth = d_ptr->ColorQueue.depth();
+	statistics.Color.QueueDropped = d_ptr->ColorQueue.droppedCount();
+	statistics.Depth.QueueDepth = d_ptr->DepthQueue.depth();
+	statistics.Depth.QueueDropped = d_ptr->DepthQueue.droppedCount();
+	statistics.Infrared.QueueDepth = d_ptr->InfraredQueue.depth();
+	statistics.Infrared.QueueDropped = d_ptr->InfraredQueue.droppedCount();
+	statistics.Body.QueueDepth = d_ptr->BodyQueue.depth();
+	statistics.Body.QueueDropped = d_ptr->BodyQueue.droppedCount();
+	return statistics;
+}
+
+void QKinectGrabber::resetStatistics()
+{
+	d_ptr->Timing.reset();
+	d_ptr->ColorQueue.resetCounts();
+	d_ptr->DepthQueue.resetCounts();
+	d_ptr->InfraredQueue.resetCounts();
+	d_ptr->BodyQueue.resetCounts();
+}
+
+int QKinectGrabber::statisticsInterval() const
+{
+	return d_ptr->StatisticsInterval;
+}
+
+void QKinectGrabber::setStatisticsInterval(int ms)
+{
+	d_ptr->StatisticsInterval = qMax(ms, 0);
+}
+
+
+void QKinectGrabber::stop()
+{
+	Q_D(QKinectGrabber);
+	d->Running.storeRelease(0);
+
+	// release a run() blocked on frame events. Source is written by the grabber thread,
+	// the source it opens is woken instead, also when run() has not opened it yet
+	QFrameSource* source = d->SelectedSource();
+	if (source)
+		source->wake();
+
+	wait();
+
+	d->CloseSource();
+}
+
+
+
+void QKinectGrabber::run()
+{
+	Q_D(QKinectGrabber);
+
+	if (!d->OpenSource())
+	{
+		std::cerr << "<Error> Frame source not started" << std::endl;
+		return;
+	}
+
+	int enabledStreams = QFrameSource::NoStream;
+	if (d->UseColorFrame)
+		enabledStreams |= QFrameSource::ColorStream;
+	if (d->UseDepthFrame)
+		enabledStreams |= QFrameSource::DepthStream;
+	if (d->UseInfraredFrame)
+		enabledStreams |= QFrameSource::InfraredStream;
+	if (d->UseBodyFrame)
+		enabledStreams |= QFrameSource::BodyStream;
+
+	{
+		QMutexLocker lock(&d->FrameSetMutex);
+		d->Synchronizer.setStreams(enabledStreams);
+		d->Synchronizer.reset();
+
+		for (int i = 0; i < FrameSetSlots; ++i)
+		{
+			d->FrameSets[i] = QKinectFrameSet();
+			d->FrameSetNumbers[i] = 0;
 		}
+	}
+	d->Timing.reset();
+
+	d->Running.storeRelease(1);
+
+	// this thread only acquires, every stream is processed and emitted by its own worker
+	d->StartWorkers();
 
-		// If send image is enabled, emit signal with the depth image
-		if (d->UseDepthFrame && depthUpdated)
-		{
-			d->Mutex.lock();
-			{
-				// create depth image
-				QImage depthImg = QImage(d->DepthFrameWidth, d->DepthFrameHeight, QImage::Format::Format_Indexed8);
-				depthImg.setColorTable(d->ColorTable);
-
-				std::vector<unsigned char> depthImgBuffer(d->DepthBuffer.size());
-
-				// casting from unsigned short (2 bytes precision) to unsigned char (1 byte precision)
-				std::transform(
-					d->DepthBuffer.begin(),
-					d->DepthBuffer.end(),
-					depthImgBuffer.begin(),
-					[=](const unsigned short depth) { return static_cast<unsigned char>((float)depth / (float)d->DepthMaxDistance * 255.f); });
-
-				// set pixels to depth image
-				for (int y = 0; y < depthImg.height(); y++)
-					memcpy(depthImg.scanLine(y), depthImgBuffer.data() + y * depthImg.width(), depthImg.width());
-
-				emit depthImage(depthImg);
-			}
-			d->Mutex.unlock();
+	qint64 lastLatencyReport = QFrameLatency::now();
+	qint64 lastStatistics = lastLatencyReport;
+
+	while (d->Running.loadAcquire())
+	{
+		// sleep until a stream has something new and only touch that stream
+		int streams = d->Source->wait(FrameWaitTimeout);
+
+		// also while no frame comes: a stalled sensor is what the statistics have to show
+		const qint64 now = QFrameLatency::now();
+
+		if (d->LatencyReportInterval > 0 && now - lastLatencyReport >= d->LatencyReportInterval * Q_INT64_C(1000000))
+		{
+			std::cout << d->Latency.report().toStdString() << std::flush;
+			lastLatencyReport = now;
 		}
 
-		// If send image is enabled, emit signal with the depth image
-		if (d->UseInfraredFrame && infraredUpdated)
-		{
-			d->Mutex.lock();
-			{
-				// create depth image
-				QImage infraredImg = QImage(d->InfraredFrameWidth, d->InfraredFrameHeight, QImage::Format::Format_Indexed8);
-				infraredImg.setColorTable(d->ColorTable);
-
-				std::vector<unsigned char> infraredImgBuffer(d->InfraredBuffer.size());
-
-				// casting from unsigned short (2 bytes precision) to unsigned char (1 byte precision)
-				std::transform(
-					d->InfraredBuffer.begin(),
-					d->InfraredBuffer.end(),
-					infraredImgBuffer.begin(),
-					[=](const unsigned short infra) 
-					{ 
-						// normalize the incoming infrared data (ushort) to a float ranging from 
-						// [InfraredOutputValueMinimum, InfraredOutputValueMaximum] by
-						// 1. dividing the incoming value by the source maximum value
-						float intensityRatio = static_cast<float>(infra) / InfraredSourceValueMaximum;
-
-						// 2. dividing by the (average scene value * standard deviations)
-						intensityRatio /= InfraredSceneValueAverage * InfraredSceneStandardDeviations;
-
-						// 3. limiting the value to InfraredOutputValueMaximum
-						intensityRatio = min(InfraredOutputValueMaximum, intensityRatio);
-
-						// 4. limiting the lower value InfraredOutputValueMinimym
-						intensityRatio = max(InfraredOutputValueMinimum, intensityRatio);
-
-						// 5. converting the normalized value to a byte and using the result
-						// as the RGB components required by the image
-						byte intensity = static_cast<byte>(intensityRatio * 255.0f);
-
-						return static_cast<unsigned char>(intensity); 
-				
-					}
-				);
-
-				// set pixels to depth image
-				for (int y = 0; y < infraredImg.height(); y++)
-					memcpy(infraredImg.scanLine(y), infraredImgBuffer.data() + y * infraredImg.width(), infraredImg.width());
-
-				emit infraredImage(infraredImg);
-			}
-			d->Mutex.unlock();
+		if (d->StatisticsInterval > 0 && now - lastStatistics >= d->StatisticsInterval * Q_INT64_C(1000000))
+		{
+			emit statisticsUpdated(statistics());
+			lastStatistics = now;
 		}
-		msleep(3);
+
+		if (streams == QFrameSource::NoStream)
+			continue;
+
+		// every frame read below is followed from here until its worker emits it
+		const qint64 arrived = QFrameLatency::now();
+		bool updated = false;
+
+		if (streams & QFrameSource::ColorStream)
+			updated |= d->ReadColor(arrived);
+		if (streams & QFrameSource::DepthStream)
+			updated |= d->ReadDepth(arrived);
+		if (streams & QFrameSource::InfraredStream)
+			updated |= d->ReadInfrared(arrived);
+		if (streams & QFrameSource::BodyStream)
+			updated |= d->ReadBody(arrived);
+
+		if (updated)
+			emit frameUpdated();
 	}
 
+	d->StopWorkers();
 }
\ No newline at end of file
@@ -1,6 +1,18 @@
 #pragma once
 
+#include "QKinectFrames.h"
+#include "QKinectFrameSet.h"
+#include "QKinectBodyFrame.h"
+#include "QKinectPointCloud.h"
+#include "QKinectRGBDFrame.h"
+#include "QKinectFrameStatistics.h"
+#include "QFrameStream.h"
 
+class QFrameSource;
+class QFrameLatency;
+class QDepthFilter;
+class QFrameStreamServer;
+class QKinectFrameMailbox;
 class QKinectGrabberPrivate;
 class QKinectGrabber : public QThread
 {
@@ -13,27 +25,129 @@ public:
 private:
 	Q_PROPERTY(bool useColorFrame READ useColorFrame WRITE setUseColorFrame)
 	Q_PROPERTY(bool useDepthFrame READ useDepthFrame WRITE setUseDepthFrame)
+	Q_PROPERTY(bool filterDepth READ filterDepth WRITE setFilterDepth)
 	Q_PROPERTY(bool useInfraredFrame READ useInfraredFrame WRITE setUseInfraredFrame)
 	Q_PROPERTY(bool useBodyFrame READ useBodyFrame WRITE setUseBodyFrame)
+	Q_PROPERTY(bool adaptiveInfrared READ adaptiveInfrared WRITE setAdaptiveInfrared)
+	Q_PROPERTY(bool usePointCloud READ usePointCloud WRITE setUsePointCloud)
+	Q_PROPERTY(int pointCloudLayout READ pointCloudLayout WRITE setPointCloudLayout)
+	Q_PROPERTY(bool pointCloudMask READ pointCloudMask WRITE setPointCloudMask)
+	Q_PROPERTY(bool pointCloudColor READ pointCloudColor WRITE setPointCloudColor)
+	Q_PROPERTY(float pointCloudLeafSize READ pointCloudLeafSize WRITE setPointCloudLeafSize)
+	Q_PROPERTY(int pointCloudVoxelMode READ pointCloudVoxelMode WRITE setPointCloudVoxelMode)
+	Q_PROPERTY(bool useRegistration READ useRegistration WRITE setUseRegistration)
+	Q_PROPERTY(bool registerDepthInColor READ registerDepthInColor WRITE setRegisterDepthInColor)
+	Q_PROPERTY(int colorPoolSize READ colorPoolSize WRITE setColorPoolSize)
+	Q_PROPERTY(int frameQueueCapacity READ frameQueueCapacity WRITE setFrameQueueCapacity)
+	Q_PROPERTY(bool rawColor READ rawColor WRITE setRawColor)
+	Q_PROPERTY(int colorScale READ colorScale WRITE setColorScale)
+	Q_PROPERTY(QSize colorOutputSize READ colorOutputSize WRITE setColorOutputSize)
+	Q_PROPERTY(bool useFrameEvents READ useFrameEvents WRITE setUseFrameEvents)
+	Q_PROPERTY(bool synchronizeFrames READ synchronizeFrames WRITE setSynchronizeFrames)
+	Q_PROPERTY(qint64 frameSetTolerance READ frameSetTolerance WRITE setFrameSetTolerance)
+	Q_PROPERTY(int statisticsInterval READ statisticsInterval WRITE setStatisticsInterval)
+	Q_PROPERTY(bool compressRecording READ compressRecording WRITE setCompressRecording)
 
 public:
 	bool useColorFrame() const;
 	void setUseColorFrame(bool);
+	int colorPoolSize() const;
+	void setColorPoolSize(int);				// applied on the next start()
+	quint64 colorPoolExhaustedCount() const;	// color frames dropped because every buffer was still in use
+	int colorScale() const;
+	void setColorScale(int divisor);		// emit colorImage() at 1 / divisor of the sensor size, 1 for full size
+	QSize colorOutputSize() const;
+	void setColorOutputSize(const QSize&);	// emit colorImage() at this size instead, an empty size for colorScale()
+	bool rawColor() const;
+	void setRawColor(bool);					// read color as YUY2, converted to BGRA only for colorImage(), frameSet() and rgbdFrame(); applied on the next start()
 	bool useDepthFrame() const;
 	void setUseDepthFrame(bool);
+	bool filterDepth() const;
+	void setFilterDepth(bool);				// denoise depth before depthImage(), pointCloud() and rgbdFrame(); recordings stay raw
+	QDepthFilter* depthFilter() const;		// the filter's settings, change them before start()
 	bool useInfraredFrame() const;
 	void setUseInfraredFrame(bool);
+	bool adaptiveInfrared() const;
+	void setAdaptiveInfrared(bool);			// follow the scene brightness instead of the fixed scene average
+	bool usePointCloud() const;
+	void setUsePointCloud(bool);			// emit pointCloud() for every depth frame, needs useDepthFrame
+	int pointCloudLayout() const;
+	void setPointCloudLayout(int);			// QKinectPointCloud::Layout
+	bool pointCloudMask() const;
+	void setPointCloudMask(bool);			// also fill QKinectPointCloud::Mask
+	bool pointCloudColor() const;
+	void setPointCloudColor(bool);			// also fill QKinectPointCloud::Colors, needs useRegistration
+	float pointCloudLeafSize() const;
+	void setPointCloudLeafSize(float);		// downsample to voxels of this many meters, 0 for a point per pixel
+	int pointCloudVoxelMode() const;
+	void setPointCloudVoxelMode(int);		// QVoxelGrid::Mode
+	bool useRegistration() const;
+	void setUseRegistration(bool);			// emit rgbdFrame() for every depth frame, needs color and depth
+	bool registerDepthInColor() const;
+	void setRegisterDepthInColor(bool);		// also fill QKinectRGBDFrame::DepthInColor
 	bool useBodyFrame() const;
 	void setUseBodyFrame(bool);
+	int frameQueueCapacity() const;
+	void setFrameQueueCapacity(int frames);	// frames a stream's worker may fall behind before its oldest is dropped; applied on the next start()
+											// every color frame waiting holds a colorPoolSize buffer
+	QFrameSource* frameSource() const;
+	void setFrameSource(QFrameSource *source);	// replaces the sensor, not owned; NULL for the sensor, applied on the next start()
+											// required when built without the Kinect SDK (QT5KINECT_SDK undefined)
+	bool useFrameEvents() const;
+	void setUseFrameEvents(bool);			// block on frame arrived events instead of polling, applied on the next start()
+	bool synchronizeFrames() const;
+	void setSynchronizeFrames(bool);		// also emit frameSet() with the frames of every enabled stream
+	qint64 frameSetTolerance() const;
+	void setFrameSetTolerance(qint64);		// max RelativeTime spread inside a set, in 100 ns ticks
+	quint64 frameSetCount() const;
+	quint64 incompleteFrameSetCount() const;	// sets abandoned because a stream was missing or out of tolerance
+
+	void addMailbox(QKinectFrameMailbox *mailbox);		// also post every image to it, a newer one replacing the one not delivered yet
+	void removeMailbox(QKinectFrameMailbox *mailbox);
+
+	bool startRecording(const QString &fileName);	// append every raw frame to a QFrameRecording file
+	void stopRecording();
+	bool isRecording() const;
+	bool compressRecording() const;
+	void setCompressRecording(bool);		// record depth and infrared losslessly coded with QDepthCodec, about half the size
+	quint64 recordedFrameCount() const;
+	quint64 recordingDroppedCount() const;	// frames lost because the disk could not keep up
+
+	bool startPublishing(const QString &name, int slotCount = 4);	// share every raw frame with other processes, see QFramePublisher
+	void stopPublishing();
+	bool isPublishing() const;
+	quint64 publishedFrameCount() const;
+
+	bool startStreaming(quint16 port = QFrameStream::DefaultPort);	// send depth, infrared and downscaled color to TCP clients, see QFrameStreamServer
+	void stopStreaming();
+	bool isStreaming() const;
+	QFrameStreamServer* streamServer() const;	// clients and color size of the stream
+
+	QFrameLatency* latency() const;			// per stage latency of every emitted frame, always on
+	int latencyReportInterval() const;
+	void setLatencyReportInterval(int ms);	// print latency()->report() this often, 0 for never
+
+	QKinectFrameStatistics statistics() const;	// delivered, dropped, duplicate and late frames, jitter and queue depths since start()
+	void resetStatistics();
+	int statisticsInterval() const;
+	void setStatisticsInterval(int ms);		// emit statisticsUpdated() this often, 0 for never; default 1000
 
 public slots:
 	void stop();
-
-signals:
-	void colorImage(const QImage &image);
-	void depthImage(const QImage &image);
-	void infraredImage(const QImage &image);
+
+signals:
+	// frames are read by this thread and emitted by their stream's worker thread
+	void colorImage(const QImage &image);
+	void colorGrayImage(const QImage &image);			// luma of raw color frames, without converting them
+	void colorFrame(const QKinectColorFrame &frame);	// every color frame as read, BGRA or YUY2
+	void depthImage(const QImage &image);
+	void infraredImage(const QImage &image);
+	void bodyFrame(const QKinectBodyFrame &bodies);
+	void pointCloud(const QKinectPointCloud &cloud);
+	void rgbdFrame(const QKinectRGBDFrame &frame);
 	void frameUpdated();
+	void frameSet(const QKinectFrameSet &frames);
+	void statisticsUpdated(const QKinectFrameStatistics &statistics);
 	void colorBuffer(const BYTE* pBuf);
 
 protected:
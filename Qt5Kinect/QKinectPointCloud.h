@@ -0,0 +1,43 @@
+#pragma once
+
+#include <QVector>
+#include <QRgb>
+#include <QMetaType>
+
+
+/// <summary>
+/// Camera space point cloud of one depth frame, emitted by QKinectGrabber::pointCloud().
+/// One point per depth pixel, in meters; pixels without depth are (0, 0, 0).
+/// The vectors are implicitly shared with the grabber, which refills them in place
+/// when no consumer holds on to the previous cloud.
+///
+/// With a pointCloudLeafSize the cloud is downsampled by a QVoxelGrid: one point per
+/// occupied voxel, no longer organized by pixel, so Width is the point count, Height is 1
+/// and Mask stays empty.
+/// </summary>
+struct QKinectPointCloud
+{
+	enum Layout
+	{
+		Planar,			// Width * Height x values, then all y, then all z
+		Interleaved		// x, y, z of each pixel in turn
+	};
+
+	QKinectPointCloud() :
+		PointLayout(Planar),
+		Width(0),
+		Height(0),
+		Time(0)
+	{
+	}
+
+	Layout					PointLayout;
+	int						Width;
+	int						Height;
+	qint64					Time;			// RelativeTime of the depth frame, 100 ns ticks
+	QVector<float>			Points;
+	QVector<unsigned char>	Mask;			// 0xFF where depth is valid, empty unless requested
+	QVector<QRgb>			Colors;			// registered color per point, 0 where unseen, empty unless requested
+};
+
+Q_DECLARE_METATYPE(QKinectPointCloud)
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <QImage>
+#include <QVector>
+#include <QMetaType>
+
+
+/// <summary>
+/// Depth frame registered with the newest color frame, emitted by QKinectGrabber::rgbdFrame().
+/// Color holds the color seen by every depth pixel (Format_ARGB32 at depth resolution),
+/// transparent black where the pixel has no depth, falls outside the color frame or is
+/// hidden from the color camera. DepthInColor is only filled when requested.
+/// Times are the frames' RelativeTime (100 ns ticks).
+/// </summary>
+struct QKinectRGBDFrame
+{
+	QKinectRGBDFrame() :
+		Width(0),
+		Height(0),
+		ColorWidth(0),
+		ColorHeight(0),
+		DepthTime(0),
+		ColorTime(0)
+	{
+	}
+
+	int						Width;			// depth resolution
+	int						Height;
+	QImage					Color;
+	QVector<unsigned short>	Depth;			// mm, Width * Height
+
+	int						ColorWidth;		// color resolution
+	int						ColorHeight;
+	QVector<unsigned short>	DepthInColor;	// mm, ColorWidth * ColorHeight, 0 where no depth lands
+
+	qint64					DepthTime;
+	qint64					ColorTime;
+};
+
+Q_DECLARE_METATYPE(QKinectRGBDFrame)
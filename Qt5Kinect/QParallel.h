@@ -0,0 +1,106 @@
+#pragma once
+
+#include <QThreadPool>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QAtomicInt>
+
+
+/// <summary>
+/// Minimal fork/join helper on top of QThreadPool for the per-frame stages.
+/// </summary>
+namespace QParallel
+{
+	template <typename Func>
+	class TileJob
+	{
+	public:
+		TileJob(int count, int grain, const Func& f) :
+			Count(count),
+			Grain(grain),
+			Tiles((count + grain - 1) / grain),
+			Next(0),
+			F(f)
+		{
+		}
+
+		int tiles() const
+		{
+			return Tiles;
+		}
+
+		// tiles are claimed one at a time, so a slow thread does not hold up the others
+		void run()
+		{
+			for (int tile = Next.fetchAndAddRelaxed(1); tile < Tiles; tile = Next.fetchAndAddRelaxed(1))
+			{
+				const int begin = tile * Grain;
+				F(begin, qMin(Count, begin + Grain));
+			}
+		}
+
+	private:
+		const int		Count;
+		const int		Grain;
+		const int		Tiles;
+		QAtomicInt		Next;
+		const Func&		F;
+
+		Q_DISABLE_COPY(TileJob);
+	};
+
+	template <typename Func>
+	class TileRunner : public QRunnable
+	{
+	public:
+		TileRunner(TileJob<Func>* job, QSemaphore* done) :
+			Job(job),
+			Done(done)
+		{
+		}
+
+		void run() Q_DECL_OVERRIDE
+		{
+			Job->run();
+			Done->release();
+		}
+
+	private:
+		TileJob<Func>*	Job;
+		QSemaphore*		Done;
+	};
+
+
+	/// <summary>
+	/// Call f(begin, end) for every tile of grain items in [0, count) and return when all
+	/// of them are done. The calling thread works on tiles too; pool threads only join if
+	/// they are idle right now, so a busy pool degrades to a plain loop instead of a wait.
+	/// f is called concurrently and must only write to data owned by its tile (or use atomics).
+	/// </summary>
+	template <typename Func>
+	void forTiles(int count, int grain, const Func& f, QThreadPool* pool = QThreadPool::globalInstance())
+	{
+		if (count <= 0)
+			return;
+
+		TileJob<Func> job(count, qMax(grain, 1), f);
+		QSemaphore done;
+
+		int helpers = 0;
+		const int wanted = qMin(job.tiles(), pool->maxThreadCount()) - 1;
+
+		for (int i = 0; i < wanted; ++i)
+		{
+			TileRunner<Func>* runner = new TileRunner<Func>(&job, &done);
+			if (!pool->tryStart(runner))
+			{
+				delete runner;
+				break;
+			}
+			++helpers;
+		}
+
+		job.run();
+		done.acquire(helpers);
+	}
+}
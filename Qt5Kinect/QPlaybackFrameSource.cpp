@@ -0,0 +1,458 @@
+#include "stdafx.h"
+#include "QPlaybackFrameSource.h"
+#include "QFrameKernels.h"
+#include "QDepthCodec.h"
+#include <cstring>
+
+
+// Reliable depth range of the sensor, which is fixed and therefore not recorded
+#define RecordedMinReliableDistance 500
+#define RecordedMaxReliableDistance 4500
+
+
+
+/// <summary>
+/// Copy a depth or infrared chunk into buffer, decoding it if it was recorded compressed
+/// </summary>
+static bool ReadGray16(const QFrameRecording::ChunkHeader& header, const unsigned char* payload, std::vector<unsigned short>& buffer)
+{
+	if (header.Format == QFrameRecording::Gray16Rvl)
+	{
+		if (!QDepthCodec::decode(payload, static_cast<int>(header.Size), buffer.data(), static_cast<int>(buffer.size())))
+		{
+			std::cerr << "<Warning>	Corrupt compressed frame in recording" << std::endl;
+			return false;
+		}
+
+		return true;
+	}
+
+	if (header.Size < buffer.size() * sizeof(unsigned short))
+	{
+		std::cerr << "<Warning>	Truncated frame in recording" << std::endl;
+		return false;
+	}
+
+	memcpy(buffer.data(), payload, buffer.size() * sizeof(unsigned short));
+	return true;
+}
+
+
+QPlaybackFrameSource::QPlaybackFrameSource() :
+	PlaybackPacing(RealTime),
+	Speed(1.0),
+	Loop(false),
+	Requested(NoStream),
+	Opened(false),
+	Woken(false),
+	Steps(0),
+	Cursor(0),
+	ClockOrigin(0),
+	Delivered(0),
+	Skipped(0)
+{
+	for (int s = 0; s < StreamSlots; ++s)
+		Pending[s] = -1;
+}
+
+QPlaybackFrameSource::~QPlaybackFrameSource()
+{
+	close();
+}
+
+bool QPlaybackFrameSource::load(const QString& fileName)
+{
+	QMutexLocker lock(&Mutex);
+
+	Cursor = 0;
+	for (int s = 0; s < StreamSlots; ++s)
+		Pending[s] = -1;
+
+	return Reader.open(fileName);
+}
+
+const QFrameRecordingReader& QPlaybackFrameSource::recording() const
+{
+	return Reader;
+}
+
+QPlaybackFrameSource::Pacing QPlaybackFrameSource::pacing() const
+{
+	QMutexLocker lock(&Mutex);
+	return PlaybackPacing;
+}
+
+void QPlaybackFrameSource::setPacing(Pacing pacing)
+{
+	QMutexLocker lock(&Mutex);
+	PlaybackPacing = pacing;
+	restartClock();
+	Wakeup.wakeAll();
+}
+
+double QPlaybackFrameSource::speed() const
+{
+	QMutexLocker lock(&Mutex);
+	return Speed;
+}
+
+void QPlaybackFrameSource::setSpeed(double speed)
+{
+	QMutexLocker lock(&Mutex);
+	Speed = speed > 0.0 ? speed : 1.0;
+	restartClock();
+	Wakeup.wakeAll();
+}
+
+bool QPlaybackFrameSource::loop() const
+{
+	QMutexLocker lock(&Mutex);
+	return Loop;
+}
+
+void QPlaybackFrameSource::setLoop(bool loop)
+{
+	QMutexLocker lock(&Mutex);
+	Loop = loop;
+	Wakeup.wakeAll();
+}
+
+void QPlaybackFrameSource::seek(qint64 time)
+{
+	QMutexLocker lock(&Mutex);
+
+	Cursor = Reader.find(time);
+	for (int s = 0; s < StreamSlots; ++s)
+		Pending[s] = -1;
+
+	restartClock();
+	Wakeup.wakeAll();
+}
+
+void QPlaybackFrameSource::step(int ticks)
+{
+	QMutexLocker lock(&Mutex);
+	Steps += ticks;
+	Wakeup.wakeAll();
+}
+
+qint64 QPlaybackFrameSource::position() const
+{
+	QMutexLocker lock(&Mutex);
+	return Cursor < Reader.count() ? Reader.entry(Cursor).Time : Reader.endTime();
+}
+
+bool QPlaybackFrameSource::atEnd() const
+{
+	QMutexLocker lock(&Mutex);
+	return Cursor >= Reader.count();
+}
+
+quint64 QPlaybackFrameSource::deliveredCount() const
+{
+	QMutexLocker lock(&Mutex);
+	return Delivered;
+}
+
+quint64 QPlaybackFrameSource::skippedCount() const
+{
+	QMutexLocker lock(&Mutex);
+	return Skipped;
+}
+
+
+bool QPlaybackFrameSource::open(int streams)
+{
+	QMutexLocker lock(&Mutex);
+
+	if (!Reader.isOpen())
+	{
+		std::cerr << "<Error> No recording loaded for playback" << std::endl;
+		return false;
+	}
+
+	Requested = streams;
+	Opened = true;
+	Woken = false;
+	Steps = 0;
+	Delivered = 0;
+	Skipped = 0;
+	restartClock();
+	return true;
+}
+
+void QPlaybackFrameSource::close()
+{
+	QMutexLocker lock(&Mutex);
+
+	Opened = false;
+	for (int s = 0; s < StreamSlots; ++s)
+		Pending[s] = -1;
+}
+
+
+int QPlaybackFrameSource::wait(unsigned long timeoutMs)
+{
+	QElapsedTimer waited;
+	waited.start();
+
+	QMutexLocker lock(&Mutex);
+
+	for (;;)
+	{
+		const qint64 remaining = static_cast<qint64>(timeoutMs) - waited.elapsed();
+
+		if (Woken || remaining <= 0 || !Opened)
+		{
+			Woken = false;
+			return NoStream;
+		}
+
+		if (Cursor >= Reader.count())
+		{
+			if (!Loop || Reader.count() == 0)
+			{
+				// idle at the end until seek(), setLoop() or wake()
+				Wakeup.wait(&Mutex, static_cast<unsigned long>(remaining));
+				continue;
+			}
+
+			Cursor = 0;
+			restartClock();
+		}
+
+		int streams = NoStream;
+		qint64 sleep = remaining;
+
+		switch (PlaybackPacing)
+		{
+			case AsFastAsPossible:
+				streams = collectTick();
+				break;
+
+			case Stepped:
+				if (Steps > 0)
+				{
+					--Steps;
+					streams = collectTick();
+				}
+				break;
+
+			case RealTime:
+			{
+				streams = collectDue();
+
+				// sleep until the next chunk is due
+				if (Cursor < Reader.count())
+				{
+					const qint64 due = static_cast<qint64>((Reader.entry(Cursor).Time - ClockOrigin) / (Speed * 10000.0));
+					sleep = qMin(remaining, qMax(due - Clock.elapsed(), Q_INT64_C(1)));
+				}
+				break;
+			}
+		}
+
+		if (streams != NoStream)
+			return streams;
+
+		Wakeup.wait(&Mutex, static_cast<unsigned long>(sleep));
+	}
+}
+
+void QPlaybackFrameSource::wake()
+{
+	QMutexLocker lock(&Mutex);
+	Woken = true;
+	Wakeup.wakeAll();
+}
+
+
+int QPlaybackFrameSource::slot(int stream)
+{
+	switch (stream)
+	{
+		case ColorStream:		return 0;
+		case DepthStream:		return 1;
+		case InfraredStream:	return 2;
+		case BodyStream:		return 3;
+		default:				return -1;
+	}
+}
+
+/// <summary>
+/// Hand out chunks until a stream would get a second frame
+/// </summary>
+int QPlaybackFrameSource::collectTick()
+{
+	int streams = NoStream;
+
+	for (; Cursor < Reader.count(); ++Cursor)
+	{
+		const int stream = Reader.entry(Cursor).Stream;
+		const int s = slot(stream);
+
+		if (s < 0 || !(Requested & stream))
+			continue;
+		if (streams & stream)
+			break;
+
+		Pending[s] = Cursor;
+		streams |= stream;
+	}
+
+	return streams;
+}
+
+/// <summary>
+/// Hand out every chunk that is due on the playback clock, the newest one per stream
+/// </summary>
+int QPlaybackFrameSource::collectDue()
+{
+	int streams = NoStream;
+	const double elapsed = Clock.elapsed() * Speed * 10000.0;
+
+	for (; Cursor < Reader.count(); ++Cursor)
+	{
+		const QFrameRecording::IndexEntry& entry = Reader.entry(Cursor);
+		const int s = slot(entry.Stream);
+
+		if (entry.Time - ClockOrigin > elapsed)
+			break;
+		if (s < 0 || !(Requested & entry.Stream))
+			continue;
+
+		if (Pending[s] >= 0)
+			++Skipped;
+
+		Pending[s] = Cursor;
+		streams |= entry.Stream;
+	}
+
+	return streams;
+}
+
+void QPlaybackFrameSource::restartClock()
+{
+	ClockOrigin = Cursor < Reader.count() ? Reader.entry(Cursor).Time : 0;
+	Clock.start();
+}
+
+/// <summary>
+/// Chunk pending for a stream, -1 if there is none
+/// </summary>
+int QPlaybackFrameSource::take(int stream)
+{
+	QMutexLocker lock(&Mutex);
+
+	const int s = slot(stream);
+	const int chunk = Pending[s];
+
+	if (chunk >= 0)
+	{
+		Pending[s] = -1;
+		++Delivered;
+	}
+
+	return chunk;
+}
+
+
+bool QPlaybackFrameSource::readColor(QKinectColorFrame& frame, QFramePool& pool)
+{
+	const int i = take(ColorStream);
+	if (i < 0)
+	{
+		return false;
+	}
+
+	const QFrameRecording::ChunkHeader& header = Reader.chunk(i);
+
+	if (header.Format != QFrameRecording::Bgra32 && header.Format != QFrameRecording::Yuy2)
+	{
+		std::cerr << "<Warning>	Unsupported color format in recording" << std::endl;
+		return false;
+	}
+
+	// recorded YUY2 is handed out as it is when raw color is asked for, converted otherwise
+	const bool yuy2 = header.Format == QFrameRecording::Yuy2;
+	const bool raw = yuy2 && RawColor;
+
+	if (static_cast<int>(header.Size) < header.Width * header.Height * (yuy2 ? 2 : 4))
+	{
+		std::cerr << "<Warning>	Truncated color frame in recording" << std::endl;
+		return false;
+	}
+
+	if (!prepareColorFrame(frame, pool, header.Width, header.Height, raw ? QKinectColorFrame::Yuy2 : QKinectColorFrame::Bgra))
+	{
+		// every buffer is still in use downstream, drop this frame
+		return false;
+	}
+
+	if (yuy2 && !raw)
+	{
+		QFrameKernels::yuy2ToBgra(Reader.payload(i), header.Width, header.Height, header.Width * 2,
+			frame.Buffer.data(), frame.bytesPerLine());
+	}
+	else
+	{
+		memcpy(frame.Buffer.data(), Reader.payload(i), frame.bytesPerLine() * frame.Height);
+	}
+
+	frame.Time = header.Time;
+	return true;
+}
+
+bool QPlaybackFrameSource::readDepth(QKinectDepthFrame& frame)
+{
+	const int i = take(DepthStream);
+	if (i < 0)
+	{
+		return false;
+	}
+
+	const QFrameRecording::ChunkHeader& header = Reader.chunk(i);
+
+	prepareDepthFrame(frame, header.Width, header.Height);
+	if (!ReadGray16(header, Reader.payload(i), frame.Buffer))
+	{
+		return false;
+	}
+
+	frame.MinReliableDistance = RecordedMinReliableDistance;
+	frame.MaxDistance = RecordedMaxReliableDistance;
+	frame.Time = header.Time;
+	return true;
+}
+
+bool QPlaybackFrameSource::readInfrared(QKinectInfraredFrame& frame)
+{
+	const int i = take(InfraredStream);
+	if (i < 0)
+	{
+		return false;
+	}
+
+	const QFrameRecording::ChunkHeader& header = Reader.chunk(i);
+
+	prepareInfraredFrame(frame, header.Width, header.Height);
+	if (!ReadGray16(header, Reader.payload(i), frame.Buffer))
+	{
+		return false;
+	}
+
+	frame.Time = header.Time;
+	return true;
+}
+
+bool QPlaybackFrameSource::readBody(QKinectBodyFrame& frame)
+{
+	const int i = take(BodyStream);
+	if (i < 0 || Reader.chunk(i).Size != sizeof(frame))
+	{
+		return false;
+	}
+
+	memcpy(&frame, Reader.payload(i), sizeof(frame));
+	return true;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "QFrameSource.h"
+#include "QFrameRecordingReader.h"
+#include <QMutex>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+
+
+/// <summary>
+/// Replays a QFrameRecording file through the grabber, see QKinectGrabber::setFrameSource().
+///
+/// RealTime keeps the recorded spacing between frames (scaled by speed()) and, like the
+/// sensor, skips to the newest frame of a stream when the grabber falls behind.
+/// AsFastAsPossible hands out every frame, one tick (at most one frame per stream) per
+/// wait(). Stepped does the same, but only after each step().
+/// </summary>
+class QPlaybackFrameSource : public QFrameSource
+{
+public:
+	enum Pacing
+	{
+		RealTime,
+		AsFastAsPossible,
+		Stepped
+	};
+
+	QPlaybackFrameSource();
+	~QPlaybackFrameSource();
+
+	/// <summary>
+	/// Open a recording. Must not be called while the grabber runs on this source.
+	/// </summary>
+	bool load(const QString& fileName);
+	const QFrameRecordingReader& recording() const;
+
+	Pacing pacing() const;
+	void setPacing(Pacing pacing);
+	double speed() const;
+	void setSpeed(double speed);			// RealTime only, 2 plays twice as fast
+	bool loop() const;
+	void setLoop(bool loop);				// start over at the end instead of going idle
+
+	// the calls below may come from any thread
+	void seek(qint64 time);					// recorded RelativeTime, 100 ns ticks
+	void step(int ticks = 1);				// Stepped only
+	qint64 position() const;				// time of the next chunk
+	bool atEnd() const;
+	quint64 deliveredCount() const;
+	quint64 skippedCount() const;			// RealTime frames replaced by a newer one before they were read
+
+	bool open(int streams) Q_DECL_OVERRIDE;
+	void close() Q_DECL_OVERRIDE;
+
+	int wait(unsigned long timeoutMs) Q_DECL_OVERRIDE;
+	void wake() Q_DECL_OVERRIDE;
+
+	bool readColor(QKinectColorFrame& frame, QFramePool& pool) Q_DECL_OVERRIDE;
+	bool readDepth(QKinectDepthFrame& frame) Q_DECL_OVERRIDE;
+	bool readInfrared(QKinectInfraredFrame& frame) Q_DECL_OVERRIDE;
+	bool readBody(QKinectBodyFrame& frame) Q_DECL_OVERRIDE;
+
+private:
+	enum { StreamSlots = 4 };
+
+	static int slot(int stream);
+	int collectTick();
+	int collectDue();
+	void restartClock();
+	int take(int stream);
+
+	mutable QMutex				Mutex;
+	QWaitCondition				Wakeup;
+	QFrameRecordingReader		Reader;
+
+	Pacing						PlaybackPacing;
+	double						Speed;
+	bool						Loop;
+	int							Requested;			// streams the grabber opened us with
+	bool						Opened;
+	bool						Woken;
+	int							Steps;
+
+	int							Cursor;				// next chunk
+	int							Pending[StreamSlots];	// chunk ready to be read per stream, -1 if none
+	QElapsedTimer				Clock;				// RealTime: started when the chunk at ClockOrigin was due
+	qint64						ClockOrigin;
+	quint64						Delivered;
+	quint64						Skipped;
+};
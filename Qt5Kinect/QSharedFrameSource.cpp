@@ -0,0 +1,310 @@
+#include "stdafx.h"
+#include "QSharedFrameSource.h"
+#include "QFrameKernels.h"
+#include "QFrameRecording.h"
+#include <cstring>
+
+
+// Time between two wait() looks at the rings, in ms
+#define SharedPollInterval 1
+
+// Time between two attempts to attach a stream whose ring does not exist yet, in ms
+#define SharedAttachInterval 100
+
+// Reliable depth range of the sensor, which is fixed and therefore not published
+#define SharedMinReliableDistance 500
+#define SharedMaxReliableDistance 4500
+
+
+
+QSharedFrameSource::QSharedFrameSource() :
+	Requested(NoStream),
+	Opened(false),
+	Woken(false),
+	Read(0),
+	Overruns(0)
+{
+}
+
+QSharedFrameSource::~QSharedFrameSource()
+{
+	close();
+}
+
+QString QSharedFrameSource::name() const
+{
+	QMutexLocker lock(&Mutex);
+	return Name;
+}
+
+void QSharedFrameSource::setName(const QString& name)
+{
+	QMutexLocker lock(&Mutex);
+	Name = name;
+}
+
+quint64 QSharedFrameSource::readCount() const
+{
+	QMutexLocker lock(&Mutex);
+	return Read;
+}
+
+quint64 QSharedFrameSource::overrunCount() const
+{
+	QMutexLocker lock(&Mutex);
+	return Overruns;
+}
+
+
+bool QSharedFrameSource::open(int streams)
+{
+	QMutexLocker lock(&Mutex);
+
+	if (Name.isEmpty())
+	{
+		std::cerr << "<Error> No shared frame ring name set" << std::endl;
+		return false;
+	}
+
+	for (int s = 0; s < StreamSlots; ++s)
+		Readers[s].detach();
+
+	Requested = streams;
+	Opened = true;
+	Woken = false;
+	Read = 0;
+	Overruns = 0;
+	AttachClock.invalidate();
+	return true;
+}
+
+void QSharedFrameSource::close()
+{
+	QMutexLocker lock(&Mutex);
+
+	Opened = false;
+	for (int s = 0; s < StreamSlots; ++s)
+		Readers[s].detach();
+}
+
+
+int QSharedFrameSource::wait(unsigned long timeoutMs)
+{
+	QElapsedTimer waited;
+	waited.start();
+
+	QMutexLocker lock(&Mutex);
+
+	for (;;)
+	{
+		const qint64 remaining = static_cast<qint64>(timeoutMs) - waited.elapsed();
+
+		if (Woken || remaining <= 0 || !Opened)
+		{
+			Woken = false;
+			return NoStream;
+		}
+
+		const bool retryAttach = !AttachClock.isValid() || AttachClock.elapsed() >= SharedAttachInterval;
+		if (retryAttach)
+			AttachClock.start();
+
+		int streams = NoStream;
+
+		for (int s = 0; s < StreamSlots; ++s)
+		{
+			const int stream = 1 << s;
+			if (!(Requested & stream))
+				continue;
+
+			if (!Readers[s].isAttached() && (!retryAttach || !Readers[s].attach(Name, stream)))
+				continue;
+
+			if (Readers[s].pending() > 0)
+				streams |= stream;
+		}
+
+		if (streams != NoStream)
+			return streams;
+
+		Wakeup.wait(&Mutex, static_cast<unsigned long>(qMin(remaining, static_cast<qint64>(SharedPollInterval))));
+	}
+}
+
+void QSharedFrameSource::wake()
+{
+	QMutexLocker lock(&Mutex);
+	Woken = true;
+	Wakeup.wakeAll();
+}
+
+
+int QSharedFrameSource::slot(int stream)
+{
+	switch (stream)
+	{
+		case ColorStream:		return 0;
+		case DepthStream:		return 1;
+		case InfraredStream:	return 2;
+		case BodyStream:		return 3;
+		default:				return -1;
+	}
+}
+
+/// <summary>
+/// Publish the counters of the readers, which only the grabber thread touches
+/// </summary>
+void QSharedFrameSource::updateCounts()
+{
+	QMutexLocker lock(&Mutex);
+
+	Read = 0;
+	Overruns = 0;
+	for (int s = 0; s < StreamSlots; ++s)
+	{
+		Read += Readers[s].readCount();
+		Overruns += Readers[s].overrunCount();
+	}
+}
+
+/// <summary>
+/// Copy the newest depth or infrared frame into buffer
+/// </summary>
+bool QSharedFrameSource::readGray16(int stream, std::vector<unsigned short>& buffer, int& width, int& height, qint64& time)
+{
+	QFrameSharedReader& reader = Readers[slot(stream)];
+	QSharedFrameView view;
+
+	if (!reader.latest(view))
+	{
+		return false;
+	}
+
+	if (view.Format != QFrameRecording::Gray16 || view.Size != view.Width * view.Height * static_cast<int>(sizeof(unsigned short)))
+	{
+		std::cerr << "<Warning>	Unsupported frame format in shared frame ring" << std::endl;
+		return false;
+	}
+
+	if (buffer.size() != static_cast<size_t>(view.Width * view.Height))
+		buffer.resize(view.Width * view.Height);
+
+	const bool complete = reader.copy(view, buffer.data());
+	updateCounts();
+
+	width = view.Width;
+	height = view.Height;
+	time = view.Time;
+	return complete;
+}
+
+
+bool QSharedFrameSource::readColor(QKinectColorFrame& frame, QFramePool& pool)
+{
+	QFrameSharedReader& reader = Readers[slot(ColorStream)];
+	QSharedFrameView view;
+
+	if (!reader.latest(view))
+	{
+		return false;
+	}
+
+	if (view.Format != QFrameRecording::Bgra32 && view.Format != QFrameRecording::Yuy2)
+	{
+		std::cerr << "<Warning>	Unsupported color format in shared frame ring" << std::endl;
+		return false;
+	}
+
+	// published YUY2 is handed out as it is when raw color is asked for, converted otherwise
+	const bool yuy2 = view.Format == QFrameRecording::Yuy2;
+	const bool raw = yuy2 && RawColor;
+
+	if (view.Size < view.Width * view.Height * (yuy2 ? 2 : 4))
+	{
+		std::cerr << "<Warning>	Truncated color frame in shared frame ring" << std::endl;
+		return false;
+	}
+
+	if (!prepareColorFrame(frame, pool, view.Width, view.Height, raw ? QKinectColorFrame::Yuy2 : QKinectColorFrame::Bgra))
+	{
+		// every buffer is still in use downstream, drop this frame
+		return false;
+	}
+
+	bool complete;
+	if (yuy2 && !raw)
+	{
+		// converted straight out of the ring, then checked like a copy
+		QFrameKernels::yuy2ToBgra(view.Data, view.Width, view.Height, view.Width * 2, frame.Buffer.data(), frame.bytesPerLine());
+		complete = reader.isValid(view);
+	}
+	else
+	{
+		QSharedFrameView part = view;
+		part.Size = qMin(view.Size, frame.Buffer.size());
+		complete = reader.copy(part, frame.Buffer.data());
+	}
+
+	updateCounts();
+
+	frame.Time = view.Time;
+	return complete;
+}
+
+bool QSharedFrameSource::readDepth(QKinectDepthFrame& frame)
+{
+	int width, height;
+	qint64 time;
+
+	if (!readGray16(DepthStream, frame.Buffer, width, height, time))
+	{
+		return false;
+	}
+
+	frame.Width = width;
+	frame.Height = height;
+	frame.MinReliableDistance = SharedMinReliableDistance;
+	frame.MaxDistance = SharedMaxReliableDistance;
+	frame.Time = time;
+	return true;
+}
+
+bool QSharedFrameSource::readInfrared(QKinectInfraredFrame& frame)
+{
+	int width, height;
+	qint64 time;
+
+	if (!readGray16(InfraredStream, frame.Buffer, width, height, time))
+	{
+		return false;
+	}
+
+	frame.Width = width;
+	frame.Height = height;
+	frame.Time = time;
+	return true;
+}
+
+bool QSharedFrameSource::readBody(QKinectBodyFrame& frame)
+{
+	QFrameSharedReader& reader = Readers[slot(BodyStream)];
+	QSharedFrameView view;
+
+	if (!reader.latest(view) || view.Format != QFrameRecording::BodyFrame || view.Size != sizeof(frame))
+	{
+		return false;
+	}
+
+	// a torn copy is not handed out, the caller's frame is only written when the copy is complete
+	QKinectBodyFrame copy;
+	const bool complete = reader.copy(view, &copy);
+	updateCounts();
+
+	if (!complete)
+	{
+		return false;
+	}
+
+	frame = copy;
+	return true;
+}
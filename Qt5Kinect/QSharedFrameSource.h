@@ -0,0 +1,63 @@
+#pragma once
+
+#include "QFrameSource.h"
+#include "QFrameSharedReader.h"
+#include <QMutex>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+
+
+/// <summary>
+/// Reads the frames another process publishes with QKinectGrabber::startPublishing(),
+/// so a grabber in this process runs on the sensor without opening it, see
+/// QKinectGrabber::setFrameSource().
+///
+/// Like the sensor, every read hands out the newest frame of a stream and skips the
+/// older ones. A stream is attached on its first wait() after the publisher created
+/// its ring, so the publisher may start after this source. wait() polls the rings every
+/// millisecond, the publisher never signals its readers. No calibration tables are
+/// shared, the point cloud and registration stages do not run on this source.
+/// </summary>
+class QSharedFrameSource : public QFrameSource
+{
+public:
+	QSharedFrameSource();
+	~QSharedFrameSource();
+
+	QString name() const;
+	void setName(const QString& name);		// applied on the next open()
+
+	quint64 readCount() const;				// frames read since open()
+	quint64 overrunCount() const;			// frames lost to the publisher overwriting them
+
+	bool open(int streams) Q_DECL_OVERRIDE;
+	void close() Q_DECL_OVERRIDE;
+
+	int wait(unsigned long timeoutMs) Q_DECL_OVERRIDE;
+	void wake() Q_DECL_OVERRIDE;
+
+	bool readColor(QKinectColorFrame& frame, QFramePool& pool) Q_DECL_OVERRIDE;
+	bool readDepth(QKinectDepthFrame& frame) Q_DECL_OVERRIDE;
+	bool readInfrared(QKinectInfraredFrame& frame) Q_DECL_OVERRIDE;
+	bool readBody(QKinectBodyFrame& frame) Q_DECL_OVERRIDE;
+
+private:
+	enum { StreamSlots = 4 };
+
+	static int slot(int stream);
+	bool readGray16(int stream, std::vector<unsigned short>& buffer, int& width, int& height, qint64& time);
+	void updateCounts();
+
+	mutable QMutex				Mutex;
+	QWaitCondition				Wakeup;
+
+	QString						Name;
+	int							Requested;			// streams the grabber opened us with
+	bool						Opened;
+	bool						Woken;
+
+	QFrameSharedReader			Readers[StreamSlots];	// used by the grabber thread only
+	QElapsedTimer				AttachClock;		// since the last attempt to attach the missing streams
+	quint64						Read;
+	quint64						Overruns;
+};
@@ -0,0 +1,426 @@
+#include "stdafx.h"
+#include "QSyntheticFrameSource.h"
+#include "QFrameRegistration.h"
+
+
+// Sensor-like defaults: 30 fps, depth range and optics of the Kinect v2
+#define DefaultFrameRate 30.0
+#define DepthFocalLength 365.5f			// at 512 pixels wide
+#define ColorFocalLength 1081.4f		// at 1920 pixels wide
+#define ColorBaseline 52.f				// mm between the depth and the color camera
+
+
+
+/// <summary>
+/// Integer hash used as the noise source, the same on every platform
+/// </summary>
+static inline quint32 Hash(quint32 x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352d;
+	x ^= x >> 15;
+	x *= 0x846ca68b;
+	x ^= x >> 16;
+	return x;
+}
+
+static qint64 FrameTime(qint64 index, double fps)
+{
+	return static_cast<qint64>(index * (10000000.0 / fps));
+}
+
+
+
+QSyntheticFrameSource::QSyntheticFrameSource() :
+	ColorWidth(1920),
+	ColorHeight(1080),
+	DepthWidth(512),
+	DepthHeight(424),
+	Paced(true),
+	Seed(0),
+	Streams(NoStream),
+	Woken(false),
+	Frames(0)
+{
+	for (int s = 0; s < StreamSlots; ++s)
+	{
+		Rates[s] = DefaultFrameRate;
+		Next[s] = 0;
+		Ready[s] = -1;
+	}
+}
+
+void QSyntheticFrameSource::setColorSize(int width, int height)
+{
+	QMutexLocker lock(&Mutex);
+	ColorWidth = qMax(width, 1);
+	ColorHeight = qMax(height, 1);
+}
+
+void QSyntheticFrameSource::setDepthSize(int width, int height)
+{
+	QMutexLocker lock(&Mutex);
+	DepthWidth = qMax(width, 2);
+	DepthHeight = qMax(height, 2);
+}
+
+void QSyntheticFrameSource::setFrameRate(Stream stream, double fps)
+{
+	QMutexLocker lock(&Mutex);
+	const int s = slot(stream);
+	if (s >= 0 && fps > 0.0)
+		Rates[s] = fps;
+}
+
+double QSyntheticFrameSource::frameRate(Stream stream) const
+{
+	QMutexLocker lock(&Mutex);
+	const int s = slot(stream);
+	return s >= 0 ? Rates[s] : 0.0;
+}
+
+void QSyntheticFrameSource::setPaced(bool paced)
+{
+	QMutexLocker lock(&Mutex);
+	Paced = paced;
+}
+
+bool QSyntheticFrameSource::paced() const
+{
+	QMutexLocker lock(&Mutex);
+	return Paced;
+}
+
+void QSyntheticFrameSource::setSeed(quint32 seed)
+{
+	QMutexLocker lock(&Mutex);
+	Seed = seed;
+}
+
+quint64 QSyntheticFrameSource::frameCount() const
+{
+	QMutexLocker lock(&Mutex);
+	return Frames;
+}
+
+
+bool QSyntheticFrameSource::open(int streams)
+{
+	QMutexLocker lock(&Mutex);
+
+	Streams = streams & (ColorStream | DepthStream | InfraredStream);
+	Woken = false;
+	Frames = 0;
+
+	for (int s = 0; s < StreamSlots; ++s)
+	{
+		Next[s] = 0;
+		Ready[s] = -1;
+	}
+
+	Clock.start();
+	return true;
+}
+
+void QSyntheticFrameSource::close()
+{
+	QMutexLocker lock(&Mutex);
+	Streams = NoStream;
+}
+
+
+int QSyntheticFrameSource::wait(unsigned long timeoutMs)
+{
+	static const Stream streamOf[StreamSlots] = { ColorStream, DepthStream, InfraredStream };
+
+	QElapsedTimer waited;
+	waited.start();
+
+	QMutexLocker lock(&Mutex);
+
+	for (;;)
+	{
+		if (Woken)
+		{
+			Woken = false;
+			return NoStream;
+		}
+
+		int streams = NoStream;
+		double sleepMs = static_cast<double>(timeoutMs);
+
+		if (Streams != NoStream && !Paced)
+		{
+			for (int s = 0; s < StreamSlots; ++s)
+			{
+				if (Streams & streamOf[s])
+				{
+					Ready[s] = Next[s]++;
+					streams |= streamOf[s];
+				}
+			}
+		}
+		else if (Streams != NoStream)
+		{
+			// frame n of a stream is due n periods after open(); frames the grabber was too
+			// slow for are skipped, like the sensor does
+			const double now = Clock.nsecsElapsed() / 1e9;
+
+			for (int s = 0; s < StreamSlots; ++s)
+			{
+				if (!(Streams & streamOf[s]))
+					continue;
+
+				const double due = Next[s] / Rates[s];
+
+				if (due <= now)
+				{
+					Ready[s] = static_cast<qint64>(now * Rates[s]);
+					Next[s] = Ready[s] + 1;
+					streams |= streamOf[s];
+				}
+				else
+				{
+					sleepMs = qMin(sleepMs, (due - now) * 1000.0);
+				}
+			}
+		}
+
+		if (streams != NoStream)
+			return streams;
+
+		const qint64 remaining = static_cast<qint64>(timeoutMs) - waited.elapsed();
+		if (remaining <= 0)
+			return NoStream;
+
+		Wakeup.wait(&Mutex, static_cast<unsigned long>(qBound(1.0, sleepMs, static_cast<double>(remaining))));
+	}
+}
+
+void QSyntheticFrameSource::wake()
+{
+	QMutexLocker lock(&Mutex);
+	Woken = true;
+	Wakeup.wakeAll();
+}
+
+
+int QSyntheticFrameSource::slot(Stream stream)
+{
+	switch (stream)
+	{
+		case ColorStream:		return 0;
+		case DepthStream:		return 1;
+		case InfraredStream:	return 2;
+		default:				return -1;
+	}
+}
+
+/// <summary>
+/// Frame index handed out for a stream by the last wait(), if it was not read yet
+/// </summary>
+bool QSyntheticFrameSource::take(Stream stream, qint64& index)
+{
+	QMutexLocker lock(&Mutex);
+
+	const int s = slot(stream);
+	if (Ready[s] < 0)
+		return false;
+
+	index = Ready[s];
+	Ready[s] = -1;
+	++Frames;
+	return true;
+}
+
+
+/// <summary>
+/// Moving gradient: blue follows x, green y and red the diagonal, all scrolling with n
+/// </summary>
+bool QSyntheticFrameSource::readColor(QKinectColorFrame& frame, QFramePool& pool)
+{
+	qint64 n;
+	if (!take(ColorStream, n))
+	{
+		return false;
+	}
+
+	if (!prepareColorFrame(frame, pool, ColorWidth, ColorHeight, RawColor ? QKinectColorFrame::Yuy2 : QKinectColorFrame::Bgra))
+	{
+		// every buffer is still in use downstream, drop this frame
+		return false;
+	}
+
+	const quint32 shift = static_cast<quint32>(n);
+
+	if (frame.Format == QKinectColorFrame::Yuy2)
+	{
+		// the same gradient in luma and chroma: Y0 U Y1 V per pixel pair
+		for (int y = 0; y < ColorHeight; ++y)
+		{
+			unsigned char* row = frame.Buffer.data() + y * frame.bytesPerLine();
+			const unsigned char v = static_cast<unsigned char>(y + 2 * shift);
+
+			for (int x = 0; x + 1 < ColorWidth; x += 2)
+			{
+				row[2 * x] = static_cast<unsigned char>((x + y) / 4 + shift);
+				row[2 * x + 1] = static_cast<unsigned char>(x + 4 * shift);
+				row[2 * x + 2] = static_cast<unsigned char>((x + 1 + y) / 4 + shift);
+				row[2 * x + 3] = v;
+			}
+		}
+	}
+	else
+	{
+		for (int y = 0; y < ColorHeight; ++y)
+		{
+			quint32* row = reinterpret_cast<quint32*>(frame.Buffer.data()) + y * ColorWidth;
+			const quint32 green = ((y + 2 * shift) & 0xFF) << 8;
+
+			for (int x = 0; x < ColorWidth; ++x)
+			{
+				const quint32 red = (((x + y) / 4 + shift) & 0xFF) << 16;
+				const quint32 blue = (x + 4 * shift) & 0xFF;
+				row[x] = 0xFF000000 | red | green | blue;
+			}
+		}
+	}
+
+	frame.Time = FrameTime(n, Rates[0]);
+	return true;
+}
+
+/// <summary>
+/// Background plane from 1.5 m (top left) to 3.7 m (bottom right), a box at 1 m sliding
+/// across it with an unmeasured shadow on its left edge, and about 3% of scattered holes
+/// </summary>
+bool QSyntheticFrameSource::readDepth(QKinectDepthFrame& frame)
+{
+	qint64 n;
+	if (!take(DepthStream, n))
+	{
+		return false;
+	}
+
+	prepareDepthFrame(frame, DepthWidth, DepthHeight);
+
+	const int boxWidth = DepthWidth / 4;
+	const int boxX = static_cast<int>((n * 4) % (DepthWidth + boxWidth)) - boxWidth;
+	const int boxY = DepthHeight / 3;
+	const int boxHeight = DepthHeight / 3;
+	const int shadow = DepthWidth / 64;
+	const quint32 frameSeed = Seed ^ Hash(static_cast<quint32>(n));
+
+	for (int y = 0; y < DepthHeight; ++y)
+	{
+		unsigned short* row = frame.Buffer.data() + y * DepthWidth;
+		const bool boxRow = y >= boxY && y < boxY + boxHeight;
+
+		for (int x = 0; x < DepthWidth; ++x)
+		{
+			unsigned short depth = static_cast<unsigned short>(1500 + y * 1700 / DepthHeight + x * 500 / DepthWidth);
+
+			if (boxRow && x >= boxX && x < boxX + boxWidth)
+				depth = 1000;
+			else if (boxRow && x >= boxX - shadow && x < boxX)
+				depth = 0;
+
+			if (Hash(static_cast<quint32>(y * DepthWidth + x) ^ frameSeed) % 32 == 0)
+				depth = 0;
+
+			row[x] = depth;
+		}
+	}
+
+	frame.MinReliableDistance = 500;
+	frame.MaxDistance = 4500;
+	frame.Time = FrameTime(n, Rates[1]);
+	return true;
+}
+
+/// <summary>
+/// Vertical ramp with 11 bits of per-pixel noise
+/// </summary>
+bool QSyntheticFrameSource::readInfrared(QKinectInfraredFrame& frame)
+{
+	qint64 n;
+	if (!take(InfraredStream, n))
+	{
+		return false;
+	}
+
+	prepareInfraredFrame(frame, DepthWidth, DepthHeight);
+
+	const quint32 frameSeed = ~Seed ^ Hash(static_cast<quint32>(n));
+
+	for (int y = 0; y < DepthHeight; ++y)
+	{
+		unsigned short* row = frame.Buffer.data() + y * DepthWidth;
+		const int level = 2000 + y * 8000 / DepthHeight;
+
+		for (int x = 0; x < DepthWidth; ++x)
+			row[x] = static_cast<unsigned short>(level + (Hash(static_cast<quint32>(y * DepthWidth + x) ^ frameSeed) & 0x7FF));
+	}
+
+	frame.Time = FrameTime(n, Rates[2]);
+	return true;
+}
+
+bool QSyntheticFrameSource::readBody(QKinectBodyFrame& frame)
+{
+	Q_UNUSED(frame);
+	return false;
+}
+
+
+/// <summary>
+/// Pinhole depth camera centered on the frame, with the sensor's field of view
+/// </summary>
+bool QSyntheticFrameSource::depthToCameraSpaceTable(std::vector<float>& table)
+{
+	const float focal = DepthFocalLength * DepthWidth / 512.f;
+	const float cx = DepthWidth / 2.f;
+	const float cy = DepthHeight / 2.f;
+
+	table.resize(2 * DepthWidth * DepthHeight);
+
+	for (int y = 0; y < DepthHeight; ++y)
+	{
+		for (int x = 0; x < DepthWidth; ++x)
+		{
+			const int i = y * DepthWidth + x;
+			table[2 * i] = (x - cx) / focal;
+			table[2 * i + 1] = (cy - y) / focal;
+		}
+	}
+
+	return true;
+}
+
+/// <summary>
+/// Pinhole color camera sharing the depth camera's orientation, offset along x
+/// </summary>
+bool QSyntheticFrameSource::depthToColorTable(std::vector<float>& table)
+{
+	const float depthFocal = DepthFocalLength * DepthWidth / 512.f;
+	const float colorFocal = ColorFocalLength * ColorWidth / 1920.f;
+	const float cx = DepthWidth / 2.f;
+	const float cy = DepthHeight / 2.f;
+
+	table.resize(QFrameRegistration::TableStride * DepthWidth * DepthHeight);
+
+	for (int y = 0; y < DepthHeight; ++y)
+	{
+		for (int x = 0; x < DepthWidth; ++x)
+		{
+			float* t = &table[QFrameRegistration::TableStride * (y * DepthWidth + x)];
+			t[0] = ColorWidth / 2.f + colorFocal * (x - cx) / depthFocal;
+			t[1] = colorFocal * ColorBaseline;
+			t[2] = ColorHeight / 2.f + colorFocal * (y - cy) / depthFocal;
+			t[3] = 0.f;
+			t[4] = 0.f;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "QFrameSource.h"
+#include <QMutex>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+
+
+/// <summary>
+/// Generates deterministic frames without a sensor, see QKinectGrabber::setFrameSource().
+/// Color is a moving gradient, in YUY2 with raw color, depth a tilted background plane with a box sliding in front
+/// of it and scattered holes, infrared a vertical ramp with noise. Frame n of a stream is the
+/// same for a given seed on every run and machine, and times advance by exactly one
+/// period per frame. Paced, each stream ticks at its own rate; unpaced, every wait()
+/// returns a frame of every stream at once. Body frames are not generated.
+/// Pinhole calibration tables matching the configured sizes are provided, so the point
+/// cloud and registration stages run on the generated frames too.
+/// </summary>
+class QSyntheticFrameSource : public QFrameSource
+{
+public:
+	QSyntheticFrameSource();
+
+	// applied on the next open()
+	void setColorSize(int width, int height);
+	void setDepthSize(int width, int height);		// infrared has the depth size
+	void setFrameRate(Stream stream, double fps);
+	double frameRate(Stream stream) const;
+	void setPaced(bool paced);
+	bool paced() const;
+	void setSeed(quint32 seed);
+
+	quint64 frameCount() const;						// frames generated since open()
+
+	bool open(int streams) Q_DECL_OVERRIDE;
+	void close() Q_DECL_OVERRIDE;
+
+	int wait(unsigned long timeoutMs) Q_DECL_OVERRIDE;
+	void wake() Q_DECL_OVERRIDE;
+
+	bool readColor(QKinectColorFrame& frame, QFramePool& pool) Q_DECL_OVERRIDE;
+	bool readDepth(QKinectDepthFrame& frame) Q_DECL_OVERRIDE;
+	bool readInfrared(QKinectInfraredFrame& frame) Q_DECL_OVERRIDE;
+	bool readBody(QKinectBodyFrame& frame) Q_DECL_OVERRIDE;
+
+	bool depthToCameraSpaceTable(std::vector<float>& table) Q_DECL_OVERRIDE;
+	bool depthToColorTable(std::vector<float>& table) Q_DECL_OVERRIDE;
+
+private:
+	enum { StreamSlots = 3 };
+
+	static int slot(Stream stream);
+	bool take(Stream stream, qint64& index);
+
+	mutable QMutex			Mutex;
+	QWaitCondition			Wakeup;
+	QElapsedTimer			Clock;
+
+	int						ColorWidth;
+	int						ColorHeight;
+	int						DepthWidth;
+	int						DepthHeight;
+	double					Rates[StreamSlots];		// color, depth, infrared
+	bool					Paced;
+	quint32					Seed;
+
+	int						Streams;				// open streams that are generated
+	bool					Woken;
+	qint64					Next[StreamSlots];		// index of the next frame per stream
+	qint64					Ready[StreamSlots];		// frame index handed out by wait(), -1 if none
+	quint64					Frames;
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <QAtomicInt>
+
+
+/// <summary>
+/// Lock-free single producer / single consumer frame exchange.
+///
+/// Three slots rotate between the writer, the reader and a shared "ready" slot.
+/// The writer fills writeBuffer() and calls publish(), which swaps its slot with
+/// the ready slot. The reader calls fetch(), which swaps the ready slot with its
+/// own slot if a newer frame was published, and then reads readBuffer().
+/// Neither side ever blocks and the reader always sees the newest complete frame.
+/// </summary>
+template <typename T>
+class QTripleBuffer
+{
+public:
+	QTripleBuffer() :
+		WriteIndex(0),
+		ReadIndex(1),
+		Ready(2)
+	{
+	}
+
+	/// <summary>
+	/// Calls f on every slot. Only safe before producer and consumer are started.
+	/// </summary>
+	template <typename Func>
+	void initialize(Func f)
+	{
+		for (int i = 0; i < 3; ++i)
+			f(Slots[i]);
+	}
+
+	/// <summary>
+	/// Slot owned by the producer
+	/// </summary>
+	T& writeBuffer()
+	{
+		return Slots[WriteIndex];
+	}
+
+	/// <summary>
+	/// Hand the write slot over to the consumer and take the previous ready slot back
+	/// </summary>
+	void publish()
+	{
+		int previous = Ready.fetchAndStoreAcquireRelease(WriteIndex | FreshBit);
+		WriteIndex = previous & IndexMask;
+	}
+
+	/// <summary>
+	/// Take the latest published slot, if any. Returns false when nothing new was published
+	/// since the last call, in which case readBuffer() still holds the previous frame.
+	/// </summary>
+	bool fetch()
+	{
+		if (!(Ready.loadAcquire() & FreshBit))
+			return false;
+
+		int previous = Ready.fetchAndStoreAcquireRelease(ReadIndex);
+		ReadIndex = previous & IndexMask;
+		return true;
+	}
+
+	/// <summary>
+	/// Slot owned by the consumer
+	/// </summary>
+	const T& readBuffer() const
+	{
+		return Slots[ReadIndex];
+	}
+
+	T& readBuffer()
+	{
+		return Slots[ReadIndex];
+	}
+
+private:
+	enum
+	{
+		IndexMask = 0x3,
+		FreshBit = 0x4
+	};
+
+	T			Slots[3];
+	int			WriteIndex;		// touched by the producer only
+	int			ReadIndex;		// touched by the consumer only
+	QAtomicInt	Ready;			// ready slot index | FreshBit
+
+	Q_DISABLE_COPY(QTripleBuffer);
+};
@@ -0,0 +1,350 @@
+#include "stdafx.h"
+#include "QVoxelGrid.h"
+#include "QParallel.h"
+
+
+// Rows per band, 14 bands for a 424 row frame
+#define VoxelGridBandRows 32
+
+#define DefaultLeafSize 0.01f
+
+// Smaller leaves than this would overflow the packed voxel coordinates far from the camera
+#define MinLeafSize 0.001f
+
+// Depth is in mm, points in m
+#define DepthToMeters 0.001f
+
+// Bits per packed voxel coordinate, biased to be positive
+#define KeyBits 21
+#define KeyBias (1 << (KeyBits - 1))
+#define KeyMask ((Q_UINT64_C(1) << KeyBits) - 1)
+
+
+
+struct Voxel
+{
+	quint64		Key;
+	qint32		Slot;			// of the table holding it, to clear the table through its voxels
+	qint32		Count;
+	double		X;				// sums of the points, or the first point
+	double		Y;
+	double		Z;
+	quint32		Blue;			// sums of the colored points, or the first point's color
+	quint32		Green;
+	quint32		Red;
+	quint32		Colored;		// points with color
+};
+
+
+/// <summary>
+/// Open addressing hash table of voxels with linear probing. The slots index a dense
+/// vector of voxels in insertion order, both reserved for the most voxels the table can
+/// get, so inserting never allocates.
+/// </summary>
+class QVoxelGrid::Table
+{
+public:
+	Table() : Mask(0) {}
+
+	void reserve(int voxels)
+	{
+		clear();
+
+		// at most half full, probes stay short
+		int size = 64;
+		while (size < 2 * voxels)
+			size <<= 1;
+
+		if (static_cast<int>(Slots.size()) < size)
+		{
+			Slots.assign(size, -1);
+			Mask = static_cast<quint32>(size - 1);
+		}
+
+		Voxels.reserve(voxels);
+	}
+
+	void clear()
+	{
+		for (size_t i = 0; i < Voxels.size(); ++i)
+			Slots[Voxels[i].Slot] = -1;
+
+		Voxels.clear();
+	}
+
+	/// <summary>
+	/// The voxel of key, a new one with only Key and Slot set if created is set
+	/// </summary>
+	Voxel& find(quint64 key, bool& created)
+	{
+		quint32 slot = static_cast<quint32>((key * Q_UINT64_C(0x9E3779B97F4A7C15)) >> 32) & Mask;
+
+		for (;;)
+		{
+			const qint32 index = Slots[slot];
+
+			if (index < 0)
+			{
+				Slots[slot] = static_cast<qint32>(Voxels.size());
+				Voxels.push_back(Voxel());
+				Voxels.back().Key = key;
+				Voxels.back().Slot = static_cast<qint32>(slot);
+				created = true;
+				return Voxels.back();
+			}
+
+			if (Voxels[index].Key == key)
+			{
+				created = false;
+				return Voxels[index];
+			}
+
+			slot = (slot + 1) & Mask;
+		}
+	}
+
+	std::vector<qint32>		Slots;			// index in Voxels, -1 for free
+	quint32					Mask;
+	std::vector<Voxel>		Voxels;
+};
+
+
+static inline int Floor(float value)
+{
+	const int truncated = static_cast<int>(value);
+	return truncated - (value < static_cast<float>(truncated) ? 1 : 0);
+}
+
+static inline quint64 VoxelKey(int x, int y, int z)
+{
+	return ((static_cast<quint64>(x + KeyBias) & KeyMask) << (2 * KeyBits)) |
+		((static_cast<quint64>(y + KeyBias) & KeyMask) << KeyBits) |
+		(static_cast<quint64>(z + KeyBias) & KeyMask);
+}
+
+/// <summary>
+/// Bin the points of rows [begin, end) into table
+/// </summary>
+void QVoxelGrid::binRows(const unsigned short* depth, int width, int begin, int end, const float* table, const QRgb* color,
+	float inverseLeaf, Mode mode, Table& bins)
+{
+	for (int i = begin * width; i < end * width; ++i)
+	{
+		if (!depth[i])
+			continue;
+
+		const float z = static_cast<float>(depth[i]) * DepthToMeters;
+		const float x = table[2 * i] * z;
+		const float y = table[2 * i + 1] * z;
+
+		// pixels the calibration has no ray for
+		if (x != x || y != y)
+			continue;
+
+		bool created;
+		Voxel& voxel = bins.find(VoxelKey(Floor(x * inverseLeaf), Floor(y * inverseLeaf), Floor(z * inverseLeaf)), created);
+
+		if (created)
+		{
+			voxel.Count = 0;
+			voxel.X = voxel.Y = voxel.Z = 0.0;
+			voxel.Blue = voxel.Green = voxel.Red = voxel.Colored = 0;
+		}
+		else if (mode == FirstPoint)
+		{
+			++voxel.Count;
+			continue;
+		}
+
+		++voxel.Count;
+		voxel.X += x;
+		voxel.Y += y;
+		voxel.Z += z;
+
+		if (color && qAlpha(color[i]))
+		{
+			voxel.Blue += qBlue(color[i]);
+			voxel.Green += qGreen(color[i]);
+			voxel.Red += qRed(color[i]);
+			++voxel.Colored;
+		}
+	}
+}
+
+/// <summary>
+/// Add the voxels of a band to the merged table, in their order
+/// </summary>
+void QVoxelGrid::mergeBand(const Table& band, Mode mode, Table& merged)
+{
+	for (size_t i = 0; i < band.Voxels.size(); ++i)
+	{
+		const Voxel& from = band.Voxels[i];
+
+		bool created;
+		Voxel& voxel = merged.find(from.Key, created);
+
+		if (created)
+		{
+			const qint32 slot = voxel.Slot;
+			voxel = from;
+			voxel.Slot = slot;
+			continue;
+		}
+
+		voxel.Count += from.Count;
+
+		// an earlier band saw this voxel first
+		if (mode == FirstPoint)
+			continue;
+
+		voxel.X += from.X;
+		voxel.Y += from.Y;
+		voxel.Z += from.Z;
+		voxel.Blue += from.Blue;
+		voxel.Green += from.Green;
+		voxel.Red += from.Red;
+		voxel.Colored += from.Colored;
+	}
+}
+
+
+
+QVoxelGrid::QVoxelGrid() :
+	LeafSize(DefaultLeafSize),
+	GridMode(Centroid),
+	Merged(new Table())
+{
+}
+
+QVoxelGrid::~QVoxelGrid()
+{
+	for (size_t b = 0; b < Bands.size(); ++b)
+		delete Bands[b];
+
+	delete Merged;
+}
+
+float QVoxelGrid::leafSize() const
+{
+	return LeafSize;
+}
+
+void QVoxelGrid::setLeafSize(float meters)
+{
+	LeafSize = qMax(meters, MinLeafSize);
+}
+
+QVoxelGrid::Mode QVoxelGrid::mode() const
+{
+	return GridMode;
+}
+
+void QVoxelGrid::setMode(Mode mode)
+{
+	GridMode = mode;
+}
+
+
+/// <summary>
+/// Tables for bands of bandPixels and a frame of pixels
+/// </summary>
+void QVoxelGrid::resize(int bands, int pixels, int bandPixels)
+{
+	while (static_cast<int>(Bands.size()) < bands)
+		Bands.push_back(new Table());
+
+	for (int b = 0; b < bands; ++b)
+		Bands[b]->reserve(bandPixels);
+
+	Merged->reserve(pixels);
+}
+
+
+int QVoxelGrid::process(const unsigned short* depth, int width, int height, const float* table, const QRgb* color)
+{
+	return process(depth, width, height, table, color, VoxelGridBandRows);
+}
+
+int QVoxelGrid::process(const unsigned short* depth, int width, int height, const float* table, const QRgb* color, int bandRows)
+{
+	const int rows = bandRows > 0 ? qMin(bandRows, height) : height;
+	const int bands = rows > 0 ? (height + rows - 1) / rows : 0;
+
+	resize(bands, width * height, width * rows);
+
+	if (bands == 0)
+	{
+		return 0;
+	}
+
+	const float inverseLeaf = 1.0f / LeafSize;
+	const Mode mode = GridMode;
+	std::vector<Table*>& tables = Bands;
+
+	QParallel::forTiles(bands, 1, [&](int begin, int end)
+	{
+		for (int b = begin; b < end; ++b)
+			binRows(depth, width, b * rows, qMin(height, (b + 1) * rows), table, color, inverseLeaf, mode, *tables[b]);
+	});
+
+	for (int b = 0; b < bands; ++b)
+		mergeBand(*Bands[b], mode, *Merged);
+
+	return count();
+}
+
+
+int QVoxelGrid::count() const
+{
+	return static_cast<int>(Merged->Voxels.size());
+}
+
+void QVoxelGrid::points(float* xyz) const
+{
+	const std::vector<Voxel>& voxels = Merged->Voxels;
+
+	for (size_t i = 0; i < voxels.size(); ++i)
+	{
+		const Voxel& voxel = voxels[i];
+		const double scale = GridMode == Centroid ? 1.0 / voxel.Count : 1.0;
+
+		xyz[3 * i] = static_cast<float>(voxel.X * scale);
+		xyz[3 * i + 1] = static_cast<float>(voxel.Y * scale);
+		xyz[3 * i + 2] = static_cast<float>(voxel.Z * scale);
+	}
+}
+
+void QVoxelGrid::points(float* x, float* y, float* z) const
+{
+	const std::vector<Voxel>& voxels = Merged->Voxels;
+
+	for (size_t i = 0; i < voxels.size(); ++i)
+	{
+		const Voxel& voxel = voxels[i];
+		const double scale = GridMode == Centroid ? 1.0 / voxel.Count : 1.0;
+
+		x[i] = static_cast<float>(voxel.X * scale);
+		y[i] = static_cast<float>(voxel.Y * scale);
+		z[i] = static_cast<float>(voxel.Z * scale);
+	}
+}
+
+void QVoxelGrid::colors(QRgb* colors) const
+{
+	const std::vector<Voxel>& voxels = Merged->Voxels;
+
+	for (size_t i = 0; i < voxels.size(); ++i)
+	{
+		const Voxel& voxel = voxels[i];
+
+		if (!voxel.Colored)
+		{
+			colors[i] = 0;
+			continue;
+		}
+
+		// rounded mean; a first point's color is its own mean
+		const quint32 half = voxel.Colored / 2;
+		colors[i] = qRgb((voxel.Red + half) / voxel.Colored, (voxel.Green + half) / voxel.Colored, (voxel.Blue + half) / voxel.Colored);
+	}
+}
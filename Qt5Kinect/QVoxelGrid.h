@@ -0,0 +1,72 @@
+#pragma once
+
+#include <QRgb>
+#include <vector>
+
+
+/// <summary>
+/// Voxel grid downsampling of the point cloud of a depth frame: space is cut into cubes
+/// of leafSize() meters and every cube holding points becomes one point, the centroid of
+/// its points or the first of them in row order, with the mean or first color when the
+/// frame comes with registered color.
+///
+/// Points are computed from the depth and the camera space table as they are binned, the
+/// full cloud is never built. Every band of rows bins into its own open addressing hash
+/// table over the global QThreadPool, and the band tables are then reduced into one, in
+/// band order, so the result does not depend on the number of threads. The tables and
+/// their voxels are kept between frames and cleared through the voxels they hold, so
+/// binning a stream of frames allocates nothing once the largest frame was seen.
+///
+/// Voxels come out in the order their first point was seen, row by row.
+/// </summary>
+class QVoxelGrid
+{
+public:
+	enum Mode
+	{
+		Centroid,
+		FirstPoint
+	};
+
+	QVoxelGrid();
+	~QVoxelGrid();
+
+	float leafSize() const;
+	void setLeafSize(float meters);
+	Mode mode() const;
+	void setMode(Mode mode);
+
+	/// <summary>
+	/// Bin the frame's points and return the number of voxels. table is the camera space
+	/// table of QFrameKernels::depthToPoints(). color is optional (may be NULL): one pixel
+	/// per depth pixel, as QKinectRGBDFrame::Color, where 0 alpha means no color.
+	/// bandRows 0 bins on the calling thread only.
+	/// </summary>
+	int process(const unsigned short* depth, int width, int height, const float* table, const QRgb* color = NULL);
+	int process(const unsigned short* depth, int width, int height, const float* table, const QRgb* color, int bandRows);
+
+	/// <summary>
+	/// The voxels of the last process(), count() of them, interleaved x, y, z or planar.
+	/// Colors are 0 for voxels without any colored point, or when there was no color.
+	/// </summary>
+	int count() const;
+	void points(float* xyz) const;
+	void points(float* x, float* y, float* z) const;
+	void colors(QRgb* colors) const;
+
+private:
+	class Table;
+
+	void resize(int bands, int pixels, int bandPixels);
+	static void binRows(const unsigned short* depth, int width, int begin, int end, const float* table, const QRgb* color,
+		float inverseLeaf, Mode mode, Table& bins);
+	static void mergeBand(const Table& band, Mode mode, Table& merged);
+
+	float						LeafSize;
+	Mode						GridMode;
+
+	std::vector<Table*>			Bands;			// one per band of the last frame, kept for the next
+	Table*						Merged;
+
+	Q_DISABLE_COPY(QVoxelGrid);
+};
@@ -1,74 +1,25 @@
 #pragma once
 
-#ifndef WIN32_LEAN_AND_MEAN
-#define WIN32_LEAN_AND_MEAN             // Exclude rarely-used stuff from Windows headers
-#endif
-
-// Windows Header Files
-#include <windows.h>
-#include <d2d1.h>
-#include <d2d1helper.h>
-#include <dwrite.h>
-#include <wincodec.h>
-
-// Kinect Header files
-#include <Kinect.h>
-#include <Shlobj.h>
-
-//Qt Headers
-
-#include <QMutex>
-#include <QSize>
-#include <QThread>
-#include <QWaitCondition>
-#include <QImage>
-#include <QWidget>
-#include <QtWidgets>
+// Shared by every file of the library and kept free of platform SDK headers, so the
+// library builds without Windows or the Kinect SDK. Files that talk to the sensor
+// include QKinectSdk.h on top of it.
+
+//Qt Headers
+
+#include <QMutex>
+#include <QSize>
+#include <QThread>
+#include <QWaitCondition>
+#include <QImage>
+#include <QWidget>
+#include <QtWidgets>
 #include <QThread>
 #include <QObject>
 #include <QResizeEvent>
 
 //std lib
-#include <strsafe.h>
-#include <iostream>
-
-#ifdef _UNICODE
-#if defined _M_IX86
-#pragma comment(linker,"/manifestdependency:\"type='win32' name='Microsoft.Windows.Common-Controls' version='6.0.0.0' processorArchitecture='x86' publicKeyToken='6595b64144ccf1df' language='*'\"")
-#elif defined _M_X64
-#pragma comment(linker,"/manifestdependency:\"type='win32' name='Microsoft.Windows.Common-Controls' version='6.0.0.0' processorArchitecture='amd64' publicKeyToken='6595b64144ccf1df' language='*'\"")
-#else
-#pragma comment(linker,"/manifestdependency:\"type='win32' name='Microsoft.Windows.Common-Controls' version='6.0.0.0' processorArchitecture='*' publicKeyToken='6595b64144ccf1df' language='*'\"")
-#endif
-#endif
-
-#pragma comment(lib,"d2d1.lib")
-#pragma comment(lib,"dwrite.lib")
-#pragma comment(lib,"windowscodecs.lib")
-#pragma comment(lib,"dxgi.lib")
-
-// Safe release for interfaces
-template<class Interface>
-inline void SafeRelease(Interface *& pInterfaceToRelease)
-{
-	if (pInterfaceToRelease != NULL)
-	{
-		pInterfaceToRelease->Release();
-		pInterfaceToRelease = NULL;
-	}
-}
-
-// a diffrent style release, we will unify them in the future
-#ifndef V_RETURN
-#define V_RETURN(x)    { hr = (x); if( FAILED(hr) ) { return hr; } }
-#endif
+#include <iostream>
+#include <cstring>
 
-#ifndef SAFE_DELETE
-#define SAFE_DELETE(p)       { if (p) { delete (p);     (p)=NULL; } }
-#endif    
-#ifndef SAFE_DELETE_ARRAY
-#define SAFE_DELETE_ARRAY(p) { if (p) { delete[] (p);   (p)=NULL; } }
-#endif    
-#ifndef SAFE_RELEASE
-#define SAFE_RELEASE(p)      { if (p) { (p)->Release(); (p)=NULL; } }
-#endif
\ No newline at end of file
+// named by QKinectGrabber.h, the same type as the one windows.h declares
+typedef unsigned char BYTE;
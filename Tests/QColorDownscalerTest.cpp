@@ -0,0 +1,184 @@
+#include "stdafx.h"
+#include "QColorDownscaler.h"
+#include "TestCheck.h"
+#include <vector>
+#include <random>
+#include <cmath>
+
+using QFrameKernels::InstructionSet;
+
+
+// Bytes after every row, source and destination; the destination's must stay untouched
+#define GuardBytes 37
+#define Guard 0xA5
+
+
+static const char* Name(int isa)
+{
+	switch (isa)
+	{
+		case QFrameKernels::Sse2:	return "Sse2";
+		case QFrameKernels::Avx2:	return "Avx2";
+		default:					return "Scalar";
+	}
+}
+
+
+/// <summary>
+/// A source frame of random bytes with rows GuardBytes longer than the pixels, every
+/// fifth row saturated so the largest sums are reached
+/// </summary>
+static std::vector<unsigned char> Frame(int width, int height, std::mt19937& random)
+{
+	const int stride = width * QColorDownscaler::Channels + GuardBytes;
+	std::uniform_int_distribution<int> value(0, 255);
+	std::vector<unsigned char> frame(height * stride);
+
+	for (int y = 0; y < height; ++y)
+		for (int i = 0; i < stride; ++i)
+			frame[y * stride + i] = static_cast<unsigned char>(y % 5 == 4 ? 255 : value(random));
+
+	return frame;
+}
+
+/// <summary>
+/// Mean of the source area destination pixel (x, y) covers in channel c, in double: every
+/// source pixel weighs the part of it inside the area, measured exactly in 1 / (dstWidth *
+/// dstHeight) source pixels
+/// </summary>
+static double AreaMean(const unsigned char* src, int srcWidth, int srcHeight, int srcStride, int dstWidth, int dstHeight, int x, int y, int c)
+{
+	double sum = 0.0;
+
+	for (int sy = y * srcHeight / dstHeight; sy * dstHeight < (y + 1) * srcHeight; ++sy)
+	{
+		const int overlapY = qMin((sy + 1) * dstHeight, (y + 1) * srcHeight) - qMax(sy * dstHeight, y * srcHeight);
+
+		for (int sx = x * srcWidth / dstWidth; sx * dstWidth < (x + 1) * srcWidth; ++sx)
+		{
+			const int overlapX = qMin((sx + 1) * dstWidth, (x + 1) * srcWidth) - qMax(sx * dstWidth, x * srcWidth);
+			sum += static_cast<double>(overlapX) * overlapY * src[sy * srcStride + sx * QColorDownscaler::Channels + c];
+		}
+	}
+
+	return sum / (static_cast<double>(srcWidth) * srcHeight);
+}
+
+/// <summary>
+/// Shrink a random frame with every instruction set: each gives the scalar output byte
+/// for byte and leaves the bytes after the rows alone, and the scalar output is the area
+/// mean, exactly rounded for the box sizes and within rounding of the float weights for
+/// the others
+/// </summary>
+static bool Matches(int srcWidth, int srcHeight, int dstWidth, int dstHeight)
+{
+	std::mt19937 random(srcWidth * 7 + dstWidth);
+	const std::vector<unsigned char> src = Frame(srcWidth, srcHeight, random);
+	const int srcStride = srcWidth * QColorDownscaler::Channels + GuardBytes;
+	const int dstStride = dstWidth * QColorDownscaler::Channels + GuardBytes;
+	const bool box = QColorDownscaler::boxFactor(srcWidth, srcHeight, dstWidth, dstHeight) != 0;
+
+	std::vector<unsigned char> expected(dstHeight * dstStride, Guard);
+	QColorDownscaler scalar;
+	scalar.process(src.data(), srcWidth, srcHeight, srcStride, expected.data(), dstWidth, dstHeight, dstStride, QFrameKernels::Scalar);
+
+	for (int y = 0; y < dstHeight; ++y)
+	{
+		for (int i = 0; i < dstStride; ++i)
+		{
+			const int value = expected[y * dstStride + i];
+			if (i >= dstWidth * QColorDownscaler::Channels)
+			{
+				if (!CHECK_EQUAL(value, Guard))
+					return false;
+				continue;
+			}
+
+			const int x = i / QColorDownscaler::Channels;
+			const double mean = AreaMean(src.data(), srcWidth, srcHeight, srcStride, dstWidth, dstHeight, x, y, i % QColorDownscaler::Channels);
+
+			// a box mean is a multiple of 1 / k^2 and ties round up; the float weights may round a tie either way
+			const bool close = box ? value == static_cast<int>(std::floor(mean + 0.5)) : std::fabs(value - mean) <= 0.5 + 1e-3;
+			if (!close)
+			{
+				std::cerr << "  " << srcWidth << "x" << srcHeight << " to " << dstWidth << "x" << dstHeight << ": pixel " << x << ", " << y
+					<< " channel " << i % QColorDownscaler::Channels << " is " << value << " instead of " << mean << std::endl;
+				CHECK(close);
+				return false;
+			}
+		}
+	}
+
+	for (int isa = QFrameKernels::Sse2; isa <= QFrameKernels::instructionSet(); ++isa)
+	{
+		// the same downscaler twice, the second frame reuses the taps and scratch rows
+		QColorDownscaler downscaler;
+		for (int frame = 0; frame < 2; ++frame)
+		{
+			std::vector<unsigned char> actual(dstHeight * dstStride, Guard);
+			downscaler.process(src.data(), srcWidth, srcHeight, srcStride, actual.data(), dstWidth, dstHeight, dstStride, static_cast<InstructionSet>(isa));
+
+			for (size_t i = 0; i < actual.size(); ++i)
+			{
+				if (actual[i] != expected[i])
+				{
+					std::cerr << "  " << Name(isa) << ", " << srcWidth << "x" << srcHeight << " to " << dstWidth << "x" << dstHeight
+						<< ": byte " << i % dstStride << " of row " << i / dstStride << " is " << int(actual[i]) << " instead of " << int(expected[i]) << std::endl;
+					CHECK(actual[i] == expected[i]);
+					return false;
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+
+/// <summary>
+/// The color frame shrunk by 2, 3 and 4, and small frames whose destination widths leave
+/// every tail after the vector loops
+/// </summary>
+static void BoxSizes()
+{
+	for (int k = 2; k <= QColorDownscaler::MaxBoxFactor; ++k)
+	{
+		CHECK_EQUAL(QColorDownscaler::boxFactor(1920, 1080, 1920 / k, 1080 / k), k);
+		if (!CHECK(Matches(1920, 1080, 1920 / k, 1080 / k)))
+			return;
+
+		for (int dstWidth = 1; dstWidth <= 17; ++dstWidth)
+			if (!CHECK(Matches(dstWidth * k, 3 * k, dstWidth, 3)))
+				return;
+	}
+}
+
+
+/// <summary>
+/// Sizes the box filter does not take: 1920x1080 to 1280x720, factor 1.5, sizes with no
+/// common factor, a factor past MaxBoxFactor and different factors across and down
+/// </summary>
+static void AreaSizes()
+{
+	CHECK_EQUAL(QColorDownscaler::boxFactor(1920, 1080, 1280, 720), 0);
+	CHECK_EQUAL(QColorDownscaler::boxFactor(50, 10, 10, 2), 0);
+	CHECK_EQUAL(QColorDownscaler::boxFactor(40, 30, 20, 10), 0);
+
+	CHECK(Matches(1920, 1080, 1280, 720));
+	CHECK(Matches(101, 67, 40, 30));
+	CHECK(Matches(50, 10, 10, 2));
+	CHECK(Matches(40, 30, 20, 10));
+
+	for (int dstWidth = 1; dstWidth <= 9; ++dstWidth)
+		if (!CHECK(Matches(2 * dstWidth + 1, 7, dstWidth, 4)))
+			return;
+}
+
+
+int main()
+{
+	BoxSizes();
+	AreaSizes();
+
+	return TestCheck::result();
+}
@@ -0,0 +1,219 @@
+#include "stdafx.h"
+#include "QDepthCodec.h"
+#include "TestCheck.h"
+#include <vector>
+#include <random>
+
+
+typedef std::vector<unsigned short> Pixels;
+
+
+/// <summary>
+/// What decode() gives back for v coded with shift: rounded to the nearest step,
+/// saturating at 0xFFFF like the coder
+/// </summary>
+static unsigned short Expected(unsigned short v, int shift)
+{
+	const int half = (1 << shift) >> 1;
+	return static_cast<unsigned short>((qMin(v + half, 0xFFFF) >> shift) << shift);
+}
+
+/// <summary>
+/// Instruction sets this CPU runs, the scalar coder first
+/// </summary>
+static std::vector<QFrameKernels::InstructionSet> InstructionSets()
+{
+	std::vector<QFrameKernels::InstructionSet> sets;
+	for (int isa = QFrameKernels::Scalar; isa <= QFrameKernels::instructionSet(); ++isa)
+		sets.push_back(static_cast<QFrameKernels::InstructionSet>(isa));
+
+	return sets;
+}
+
+/// <summary>
+/// A depth frame: smooth surfaces with noise, scattered holes and a large empty area
+/// </summary>
+static Pixels DepthLike(int count, std::mt19937& random)
+{
+	Pixels pixels(count);
+	std::uniform_int_distribution<int> noise(-3, 3);
+	std::uniform_int_distribution<int> hole(0, 50);
+
+	for (int i = 0; i < count; ++i)
+	{
+		if (i % 512 < 100 || hole(random) == 0)
+			pixels[i] = 0;
+		else
+			pixels[i] = static_cast<unsigned short>(800 + (i % 512) * 4 + noise(random));
+	}
+
+	return pixels;
+}
+
+static Pixels Random(int count, std::mt19937& random)
+{
+	Pixels pixels(count);
+	std::uniform_int_distribution<int> value(0, 0xFFFF);
+
+	for (int i = 0; i < count; ++i)
+		pixels[i] = static_cast<unsigned short>(value(random));
+
+	return pixels;
+}
+
+
+/// <summary>
+/// Every input round trips through every quantization: the coded bytes are the same for
+/// every instruction set, and every instruction set decodes them to the rounded pixels
+/// </summary>
+static void RoundTrip(const char* name, const Pixels& src)
+{
+	const int count = static_cast<int>(src.size());
+	const std::vector<QFrameKernels::InstructionSet> sets = InstructionSets();
+
+	for (int shift = 0; shift <= QDepthCodec::MaxQuantization; ++shift)
+	{
+		QDepthCodec codec;
+		codec.setQuantization(shift);
+
+		std::vector<unsigned char> reference;
+		for (size_t s = 0; s < sets.size(); ++s)
+		{
+			std::vector<unsigned char> coded(QDepthCodec::maxEncodedSize(count));
+			const int size = codec.encode(src.data(), count, coded.data(), static_cast<int>(coded.size()), sets[s]);
+			if (!CHECK(size > 0))
+			{
+				std::cerr << "  " << name << ", quantization " << shift << ", instruction set " << sets[s] << std::endl;
+				continue;
+			}
+
+			coded.resize(size);
+			if (s == 0)
+				reference = coded;
+			else if (!CHECK(coded == reference))
+				std::cerr << "  " << name << ", quantization " << shift << ", instruction set " << sets[s] << std::endl;
+
+			CHECK_EQUAL(QDepthCodec::decodedCount(coded.data(), size), count);
+		}
+
+		for (size_t s = 0; s < sets.size(); ++s)
+		{
+			// exactly count pixels, so a write past the end shows under a sanitizer
+			Pixels decoded(count, 0xABCD);
+			const bool decodedOk = QDepthCodec::decode(reference.data(), static_cast<int>(reference.size()), decoded.data(), count, sets[s]);
+
+			int wrong = 0;
+			for (int i = 0; i < count; ++i)
+				wrong += decoded[i] != Expected(src[i], shift);
+
+			if (!CHECK(decodedOk) || !CHECK_EQUAL(wrong, 0))
+				std::cerr << "  " << name << ", quantization " << shift << ", instruction set " << sets[s] << std::endl;
+		}
+	}
+}
+
+static void RoundTrips()
+{
+	std::mt19937 random(1);
+
+	RoundTrip("random", Random(512 * 424, random));
+	RoundTrip("depth", DepthLike(512 * 424, random));
+	RoundTrip("all zero", Pixels(512 * 424, 0));
+	RoundTrip("all max", Pixels(512 * 424, 0xFFFF));
+	RoundTrip("empty", Pixels());
+
+	// short groups and runs ending anywhere in a group
+	const int lengths[] = { 1, 2, 7, 9, 15, 17, 63, 1001, 512 * 424 - 1 };
+	for (int length : lengths)
+	{
+		RoundTrip("odd random", Random(length, random));
+		RoundTrip("odd depth", DepthLike(length, random));
+		RoundTrip("odd max", Pixels(length, 0xFFFF));
+	}
+}
+
+
+/// <summary>
+/// A truncated frame, a damaged header or the wrong count is refused; random damage to
+/// the body either decodes or is refused, but never writes past the count pixels
+/// </summary>
+static void CorruptInput()
+{
+	std::mt19937 random(2);
+	const Pixels src = DepthLike(4099, random);
+	const int count = static_cast<int>(src.size());
+	const std::vector<QFrameKernels::InstructionSet> sets = InstructionSets();
+
+	std::vector<unsigned char> coded;
+	QDepthCodec codec;
+	const int size = codec.encode(src.data(), count, coded);
+	CHECK(size > static_cast<int>(sizeof(QDepthCodec::Header)));
+
+	Pixels decoded(count);
+	for (QFrameKernels::InstructionSet isa : sets)
+	{
+		int accepted = 0;
+		for (int length = 0; length < size; ++length)
+		{
+			// a copy of the exact length, so a read past it shows under a sanitizer
+			std::vector<unsigned char> truncated(coded.begin(), coded.begin() + length);
+			accepted += QDepthCodec::decode(truncated.data(), length, decoded.data(), count, isa);
+		}
+		CHECK_EQUAL(accepted, 0);
+
+		CHECK(!QDepthCodec::decode(NULL, size, decoded.data(), count, isa));
+		CHECK(!QDepthCodec::decode(coded.data(), size, decoded.data(), count - 1, isa));
+		CHECK(!QDepthCodec::decode(coded.data(), size, decoded.data(), -1, isa));
+
+		// trailing bytes
+		std::vector<unsigned char> longer(coded);
+		longer.push_back(0);
+		CHECK(!QDepthCodec::decode(longer.data(), static_cast<int>(longer.size()), decoded.data(), count, isa));
+
+		std::vector<unsigned char> header(coded);
+		header[0] ^= 1;
+		CHECK(!QDepthCodec::decode(header.data(), size, decoded.data(), count, isa));
+
+		header = coded;
+		reinterpret_cast<QDepthCodec::Header*>(header.data())->Quantization = QDepthCodec::MaxQuantization + 1;
+		CHECK(!QDepthCodec::decode(header.data(), size, decoded.data(), count, isa));
+
+		// the header claims more pixels than the body holds
+		header = coded;
+		reinterpret_cast<QDepthCodec::Header*>(header.data())->Count = count + 8;
+		Pixels more(count + 8);
+		CHECK(!QDepthCodec::decode(header.data(), size, more.data(), count + 8, isa));
+	}
+
+	std::uniform_int_distribution<int> position(static_cast<int>(sizeof(QDepthCodec::Header)), size - 1);
+	std::uniform_int_distribution<int> bit(0, 7);
+
+	for (int trial = 0; trial < 2000; ++trial)
+	{
+		std::vector<unsigned char> damaged(coded);
+		for (int flips = 1 + trial % 4; flips > 0; --flips)
+			damaged[position(random)] ^= static_cast<unsigned char>(1 << bit(random));
+
+		for (QFrameKernels::InstructionSet isa : sets)
+		{
+			// guard pixels past the count must stay untouched
+			Pixels guarded(count + 64, 0xABCD);
+			QDepthCodec::decode(damaged.data(), size, guarded.data(), count, isa);
+
+			int touched = 0;
+			for (int i = count; i < count + 64; ++i)
+				touched += guarded[i] != 0xABCD;
+
+			CHECK_EQUAL(touched, 0);
+		}
+	}
+}
+
+
+int main()
+{
+	RoundTrips();
+	CorruptInput();
+
+	return TestCheck::result();
+}
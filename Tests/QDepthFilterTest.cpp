@@ -0,0 +1,321 @@
+#include "stdafx.h"
+#include "QDepthFilter.h"
+#include "TestCheck.h"
+#include <vector>
+#include <random>
+#include <algorithm>
+
+using QFrameKernels::InstructionSet;
+
+
+// Frames of the synthetic sequence
+#define SequenceFrames 40
+
+// Values after the frame that process() must leave alone
+#define GuardValues 37
+#define Guard 0xA5A5
+
+
+static const char* Name(int isa)
+{
+	switch (isa)
+	{
+		case QFrameKernels::Sse2:	return "Sse2";
+		case QFrameKernels::Avx2:	return "Avx2";
+		default:					return "Scalar";
+	}
+}
+
+static const char* Name(QDepthFilter::Mode mode)
+{
+	return mode == QDepthFilter::Median ? "Median" : "Exponential";
+}
+
+
+/// <summary>
+/// A depth stream with everything the filter tells apart: a noisy background, a foreground
+/// block that moves across it, holes that come and go in runs, pixels that stay holes, and
+/// samples past MaxDepth
+/// </summary>
+static std::vector<std::vector<unsigned short>> Sequence(int width, int height, std::mt19937& random)
+{
+	std::uniform_int_distribution<int> noise(-40, 40);
+	std::uniform_int_distribution<int> chance(0, 99);
+	std::uniform_int_distribution<int> far(QDepthFilter::MaxDepth - 100, 65535);
+
+	std::vector<std::vector<unsigned short>> frames(SequenceFrames, std::vector<unsigned short>(width * height));
+
+	for (int t = 0; t < SequenceFrames; ++t)
+	{
+		const int blockX = (t * 3) % width;
+
+		for (int y = 0; y < height; ++y)
+		{
+			for (int x = 0; x < width; ++x)
+			{
+				int d = 1500 + 40 * y + noise(random);
+				if (x >= blockX && x < blockX + width / 4 && y > height / 3)
+					d = 700 + noise(random);
+
+				const int roll = chance(random);
+				if (roll < 8 || (x + 2 * y) % 29 == 0 || (t / 5 % 2 && x % 11 == 3))
+					d = 0;
+				else if (roll < 10)
+					d = far(random);
+
+				frames[t][y * width + x] = static_cast<unsigned short>(d);
+			}
+		}
+	}
+
+	return frames;
+}
+
+/// <summary>
+/// Feed the sequence to a filter with the scalar kernels in one band and to one with
+/// every other instruction set and band height, comparing the output frame by frame and
+/// the values after it with the guard
+/// </summary>
+static bool SequenceMatches(int width, int height, QDepthFilter::Mode mode, int smoothing, bool holeFilling)
+{
+	std::mt19937 random(width * 31 + height);
+	const std::vector<std::vector<unsigned short>> frames = Sequence(width, height, random);
+	const int count = width * height;
+	const int bandRows[] = { 0, 1, 7, 32 };
+
+	for (int isa = QFrameKernels::Scalar; isa <= QFrameKernels::instructionSet(); ++isa)
+	{
+		for (int bands : bandRows)
+		{
+			QDepthFilter reference, filter;
+			for (QDepthFilter* f : { &reference, &filter })
+			{
+				f->setMode(mode);
+				f->setSmoothing(smoothing);
+				f->setHoleFilling(holeFilling);
+			}
+
+			std::vector<unsigned short> expected(count), actual(count + GuardValues, Guard);
+
+			for (int t = 0; t < SequenceFrames; ++t)
+			{
+				reference.process(frames[t].data(), width, height, expected.data(), QFrameKernels::Scalar, 0);
+				filter.process(frames[t].data(), width, height, actual.data(), static_cast<InstructionSet>(isa), bands);
+
+				for (int i = 0; i < count + GuardValues; ++i)
+				{
+					const unsigned short value = i < count ? expected[i] : Guard;
+					if (actual[i] != value)
+					{
+						std::cerr << "  " << Name(isa) << ", " << Name(mode) << ", smoothing " << smoothing << (holeFilling ? ", filled" : "")
+							<< ", " << width << "x" << height << " in bands of " << bands << " rows: frame " << t << " pixel " << i
+							<< " is " << actual[i] << " instead of " << value << std::endl;
+						return false;
+					}
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+
+/// <summary>
+/// Every instruction set and band height gives the scalar single band output bit for bit,
+/// in both modes, with and without the hole fill, on a full depth frame and on widths
+/// that leave vector tails or end right after a vector
+/// </summary>
+static void SimdAndBands()
+{
+	const QDepthFilter::Mode modes[] = { QDepthFilter::Exponential, QDepthFilter::Median };
+
+	for (QDepthFilter::Mode mode : modes)
+	{
+		if (!CHECK(SequenceMatches(512, 424, mode, 2, true)) ||
+			!CHECK(SequenceMatches(512, 424, mode, 2, false)) ||
+			!CHECK(SequenceMatches(37, 19, mode, 0, true)) ||
+			!CHECK(SequenceMatches(37, 19, mode, 6, true)) ||
+			!CHECK(SequenceMatches(33, 9, mode, 2, true)) ||
+			!CHECK(SequenceMatches(3, 2, mode, 2, true)) ||
+			!CHECK(SequenceMatches(1, 5, mode, 2, true)))
+			return;
+	}
+}
+
+
+/// <summary>
+/// A filter without history and the given settings, for one instruction set
+/// </summary>
+struct Filter
+{
+	Filter(InstructionSet isa, QDepthFilter::Mode mode, bool holeFilling, int width, int height) :
+		Isa(isa),
+		Width(width),
+		Height(height),
+		Output(width * height)
+	{
+		Depth.setMode(mode);
+		Depth.setHoleFilling(holeFilling);
+	}
+
+	const std::vector<unsigned short>& process(const std::vector<unsigned short>& frame)
+	{
+		Depth.process(frame.data(), Width, Height, Output.data(), Isa, 0);
+		return Output;
+	}
+
+	// a frame of depth everywhere
+	const std::vector<unsigned short>& process(unsigned short depth)
+	{
+		return process(std::vector<unsigned short>(Width * Height, depth));
+	}
+
+	QDepthFilter				Depth;
+	InstructionSet				Isa;
+	int							Width;
+	int							Height;
+	std::vector<unsigned short>	Output;
+};
+
+
+/// <summary>
+/// A single frame: holes of one and two pixels close, the shadow beside a foreground edge
+/// takes the background, a hole at the corner is filled from inside the frame and the
+/// middle of a 3x3 hole stays one. Without the fill the holes stay.
+/// </summary>
+static void HoleFill()
+{
+	const int width = 24;
+	const int height = 8;
+
+	// foreground at 800 left of column 10, a one pixel shadow, background at 2000
+	std::vector<unsigned short> frame(width * height);
+	for (int y = 0; y < height; ++y)
+		for (int x = 0; x < width; ++x)
+			frame[y * width + x] = x < 10 ? 800 : x == 10 ? 0 : 2000;
+
+	frame[0] = 0;										// corner
+	frame[2 * width + 3] = 0;							// one pixel
+	frame[5 * width + 4] = frame[5 * width + 5] = 0;	// two pixels
+	for (int y = 2; y <= 4; ++y)						// 3x3 hole
+		for (int x = 15; x <= 17; ++x)
+			frame[y * width + x] = 0;
+
+	for (int isa = QFrameKernels::Scalar; isa <= QFrameKernels::instructionSet(); ++isa)
+	{
+		Filter filled(static_cast<InstructionSet>(isa), QDepthFilter::Exponential, true, width, height);
+		const std::vector<unsigned short>& out = filled.process(frame);
+
+		const bool fills =
+			CHECK_EQUAL(out[0], 800) &&
+			CHECK_EQUAL(out[2 * width + 3], 800) &&
+			CHECK_EQUAL(out[5 * width + 4], 800) &&
+			CHECK_EQUAL(out[5 * width + 5], 800) &&
+			CHECK_EQUAL(out[3 * width + 10], 2000) &&
+			CHECK_EQUAL(out[3 * width + 16], 0) &&
+			CHECK_EQUAL(out[2 * width + 15], 2000) &&
+			CHECK_EQUAL(out[4 * width + 17], 2000) &&
+			CHECK_EQUAL(out[7 * width + 9], 800) &&
+			CHECK_EQUAL(out[7 * width + 11], 2000);
+
+		Filter unfilled(static_cast<InstructionSet>(isa), QDepthFilter::Exponential, false, width, height);
+		const bool keeps = CHECK(unfilled.process(frame) == frame);
+
+		if (!fills || !keeps)
+		{
+			std::cerr << "  " << Name(isa) << std::endl;
+			return;
+		}
+	}
+}
+
+
+/// <summary>
+/// One pixel over time, without the hole fill. Exponential mode: a step within the motion
+/// threshold is approached over frames, a step past it is taken at once, a hole holds the
+/// value for two frames and drops to 0 on the third. Median mode: a one frame spike is
+/// removed, a step past the threshold is taken at once. reset() and a new frame size both
+/// pass the next frame unfiltered.
+/// </summary>
+static void MotionAndHoles()
+{
+	for (int isa = QFrameKernels::Scalar; isa <= QFrameKernels::instructionSet(); ++isa)
+	{
+		const int failures = TestCheck::failures();
+
+		Filter exponential(static_cast<InstructionSet>(isa), QDepthFilter::Exponential, false, 17, 3);
+
+		// the first frame passes
+		CHECK_EQUAL(exponential.process(1000)[0], 1000);
+		CHECK_EQUAL(exponential.process(1000)[0], 1000);
+
+		// within the threshold of 30 + 1000 / 32: a quarter of the way, then closer every frame
+		int previous = exponential.process(1040)[0];
+		CHECK(previous > 1000 && previous < 1040);
+		for (int t = 0; t < 30; ++t)
+		{
+			const int next = exponential.process(1040)[0];
+			if (!CHECK(next >= previous && next <= 1040))
+				break;
+			previous = next;
+		}
+		CHECK_EQUAL(previous, 1040);
+
+		// past the threshold: motion, no trail
+		CHECK_EQUAL(exponential.process(1200)[16], 1200);
+		CHECK_EQUAL(exponential.process(700)[50], 700);
+
+		// a hole holds while one of the two samples before it was valid
+		CHECK_EQUAL(exponential.process(0)[0], 700);
+		CHECK_EQUAL(exponential.process(0)[0], 700);
+		CHECK_EQUAL(exponential.process(0)[0], 0);
+		CHECK_EQUAL(exponential.process(900)[0], 900);
+
+		// reset forgets the history: a step within the threshold passes
+		exponential.Depth.reset();
+		CHECK_EQUAL(exponential.process(920)[0], 920);
+
+		// so does a frame of another size
+		exponential.Width = 40;
+		exponential.Output.resize(40 * 3);
+		CHECK_EQUAL(exponential.process(950)[39], 950);
+
+		Filter median(static_cast<InstructionSet>(isa), QDepthFilter::Median, false, 17, 3);
+
+		CHECK_EQUAL(median.process(1000)[0], 1000);
+		CHECK_EQUAL(median.process(1000)[0], 1000);
+		CHECK_EQUAL(median.process(1000)[0], 1000);
+
+		// a spike within the threshold is outvoted
+		CHECK_EQUAL(median.process(1050)[0], 1000);
+		CHECK_EQUAL(median.process(1000)[0], 1000);
+
+		// two samples at the new depth move the median
+		CHECK_EQUAL(median.process(1000)[0], 1000);
+		CHECK_EQUAL(median.process(1050)[0], 1000);
+		CHECK_EQUAL(median.process(1050)[0], 1050);
+
+		// motion restarts the whole ring, the older samples do not win it back
+		CHECK_EQUAL(median.process(2000)[0], 2000);
+		CHECK_EQUAL(median.process(2010)[0], 2000);
+
+		// holes hold, then drop
+		CHECK_EQUAL(median.process(0)[0], 2000);
+		CHECK_EQUAL(median.process(0)[0], 2000);
+		CHECK_EQUAL(median.process(0)[0], 0);
+
+		if (TestCheck::failures() != failures)
+			std::cerr << "  " << Name(isa) << std::endl;
+	}
+}
+
+
+int main()
+{
+	SimdAndBands();
+	HoleFill();
+	MotionAndHoles();
+
+	return TestCheck::result();
+}
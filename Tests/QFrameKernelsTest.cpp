@@ -0,0 +1,484 @@
+#include "stdafx.h"
+#include "QFrameKernels.h"
+#include "TestCheck.h"
+#include <vector>
+#include <random>
+#include <limits>
+#include <cstring>
+
+using namespace QFrameKernels;
+
+
+// Bytes after every row and frame that a kernel must leave alone
+#define GuardBytes 37
+#define Guard 0xA5
+
+
+static const char* Name(InstructionSet isa)
+{
+	switch (isa)
+	{
+		case Sse2:	return "Sse2";
+		case Avx2:	return "Avx2";
+		default:	return "Scalar";
+	}
+}
+
+
+//
+// Depth to 8 bit
+//
+
+/// <summary>
+/// The formula depthToGray8() documents: the float truncated to int, then its low byte
+/// </summary>
+static unsigned char DepthToGrayReference(unsigned short depth, unsigned short maxDistance)
+{
+	if (maxDistance == 0)
+		return 0;
+
+	return static_cast<unsigned char>(static_cast<int>(static_cast<float>(depth) / static_cast<float>(maxDistance) * 255.f));
+}
+
+/// <summary>
+/// Convert depth of width x height into rows dstStride apart with isa and compare with
+/// the reference, the bytes between and after the rows included
+/// </summary>
+static bool DepthToGrayMatches(const std::vector<unsigned short>& depth, int width, int height, unsigned short maxDistance, int dstStride, InstructionSet isa)
+{
+	std::vector<unsigned char> dst(height * dstStride + GuardBytes, Guard);
+	depthToGray8(depth.data(), width, height, maxDistance, dst.data(), dstStride, isa);
+
+	for (int y = 0; y < height; ++y)
+	{
+		for (int x = 0; x < dstStride; ++x)
+		{
+			const unsigned char expected = x < width ? DepthToGrayReference(depth[y * width + x], maxDistance) : Guard;
+			if (dst[y * dstStride + x] != expected)
+			{
+				std::cerr << "  " << Name(isa) << ", max distance " << maxDistance << ", " << width << " x " << height << " stride " << dstStride
+					<< ": pixel " << x << ", " << y << " is " << int(dst[y * dstStride + x]) << " instead of " << int(expected) << std::endl;
+				return false;
+			}
+		}
+	}
+
+	for (int i = height * dstStride; i < static_cast<int>(dst.size()); ++i)
+	{
+		if (dst[i] != Guard)
+		{
+			std::cerr << "  " << Name(isa) << ", " << width << " x " << height << " stride " << dstStride << ": wrote past the frame" << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/// <summary>
+/// Every depth value, including those beyond maxDistance that wrap around, gives the
+/// reference's byte with every instruction set this CPU has
+/// </summary>
+static void DepthToGrayAllValues()
+{
+	std::vector<unsigned short> depth(256 * 256);
+	for (int i = 0; i < 256 * 256; ++i)
+		depth[i] = static_cast<unsigned short>(i);
+
+	const unsigned short maxDistances[] = { 0, 1, 3, 255, 256, 1000, 4500, 8000, 12345, 65535 };
+
+	for (int isa = Scalar; isa <= instructionSet(); ++isa)
+	{
+		for (unsigned short maxDistance : maxDistances)
+			CHECK(DepthToGrayMatches(depth, 256, 256, maxDistance, 256, static_cast<InstructionSet>(isa)));
+	}
+}
+
+
+/// <summary>
+/// Every width up to a few vectors, contiguous and with padded rows: the tails after the
+/// last full vector and the row ends are converted like the rest, the padding is untouched
+/// </summary>
+static void DepthToGrayShapes()
+{
+	std::mt19937 random(5);
+	std::uniform_int_distribution<int> value(0, 0xFFFF);
+
+	for (int isa = Scalar; isa <= instructionSet(); ++isa)
+	{
+		for (int width = 1; width <= 70; ++width)
+		{
+			const int height = 1 + width % 5;
+
+			std::vector<unsigned short> depth(width * height);
+			for (size_t i = 0; i < depth.size(); ++i)
+				depth[i] = static_cast<unsigned short>(value(random));
+
+			const int strides[] = { width, width + 1, width + 16, (width + 3) & ~3 };
+			for (int stride : strides)
+			{
+				if (!CHECK(DepthToGrayMatches(depth, width, height, 4500, stride, static_cast<InstructionSet>(isa))))
+					break;
+			}
+		}
+	}
+
+	// the overload without an instruction set takes this CPU's
+	std::vector<unsigned short> depth(512 * 424);
+	for (size_t i = 0; i < depth.size(); ++i)
+		depth[i] = static_cast<unsigned short>(value(random));
+
+	std::vector<unsigned char> best(depth.size()), chosen(depth.size());
+	depthToGray8(depth.data(), 512, 424, 4500, best.data(), 512, instructionSet());
+	depthToGray8(depth.data(), 512, 424, 4500, chosen.data(), 512);
+	CHECK(best == chosen);
+}
+
+
+//
+// YUY2 to BGRA and gray
+//
+
+static unsigned char Clamp(int value)
+{
+	return static_cast<unsigned char>(value < 0 ? 0 : value > 255 ? 255 : value);
+}
+
+/// <summary>
+/// The formula yuy2ToBgra() documents for pixel i of a row, as B, G, R, A; negative sums
+/// shift arithmetically, rounding down
+/// </summary>
+static void Yuy2ToBgraReference(const unsigned char* row, int i, unsigned char* bgra)
+{
+	const int y = row[2 * i];
+	const int u = row[4 * (i / 2) + 1] - 128;
+	const int v = row[4 * (i / 2) + 3] - 128;
+
+	bgra[0] = Clamp(y + ((29032 * u + 8192) >> 14));
+	bgra[1] = Clamp(y + ((-5638 * u - 11700 * v + 8192) >> 14));
+	bgra[2] = Clamp(y + ((22970 * v + 8192) >> 14));
+	bgra[3] = 0xFF;
+}
+
+/// <summary>
+/// Convert src of width x height, rows srcStride apart, into rows dstStride apart with isa in
+/// bands of bandRows, as BGRA or as gray, and compare with the reference, the bytes between
+/// and after the rows included
+/// </summary>
+static bool Yuy2Matches(const std::vector<unsigned char>& src, int width, int height, int srcStride, int dstStride,
+	bool gray, InstructionSet isa, int bandRows)
+{
+	const int channels = gray ? 1 : 4;
+
+	std::vector<unsigned char> dst(height * dstStride + GuardBytes, Guard);
+	if (gray)
+		yuy2ToGray8(src.data(), width, height, srcStride, dst.data(), dstStride, isa, bandRows);
+	else
+		yuy2ToBgra(src.data(), width, height, srcStride, dst.data(), dstStride, isa, bandRows);
+
+	for (int y = 0; y < height; ++y)
+	{
+		const unsigned char* row = src.data() + y * srcStride;
+
+		for (int x = 0; x * channels < dstStride; ++x)
+		{
+			unsigned char expected[4] = { Guard, Guard, Guard, Guard };
+			if (x < width && gray)
+				expected[0] = row[2 * x];
+			else if (x < width)
+				Yuy2ToBgraReference(row, x, expected);
+
+			for (int c = 0; c < channels && x * channels + c < dstStride; ++c)
+			{
+				if (dst[y * dstStride + x * channels + c] != expected[c])
+				{
+					std::cerr << "  " << Name(isa) << (gray ? " gray" : " bgra") << ", " << width << " x " << height
+						<< " strides " << srcStride << ", " << dstStride << ", bands of " << bandRows << ": pixel " << x << ", " << y
+						<< " channel " << c << " is " << int(dst[y * dstStride + x * channels + c]) << " instead of " << int(expected[c]) << std::endl;
+					return false;
+				}
+			}
+		}
+	}
+
+	for (int i = height * dstStride; i < static_cast<int>(dst.size()); ++i)
+	{
+		if (dst[i] != Guard)
+		{
+			std::cerr << "  " << Name(isa) << ", " << width << " x " << height << " strides " << srcStride << ", " << dstStride << ": wrote past the frame" << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/// <summary>
+/// Every Y, U and V combination converts to the reference's BGRA with every instruction
+/// set: one frame per U, V down the rows and Y across, the second Y of a pair mirrored
+/// </summary>
+static void Yuy2AllValues()
+{
+	const int width = 512;
+	const int height = 256;
+	std::vector<unsigned char> src(2 * width * height);
+
+	for (int u = 0; u < 256; ++u)
+	{
+		for (int v = 0; v < height; ++v)
+		{
+			for (int pair = 0; pair < width / 2; ++pair)
+			{
+				unsigned char* p = &src[2 * width * v + 4 * pair];
+				p[0] = static_cast<unsigned char>(pair);
+				p[1] = static_cast<unsigned char>(u);
+				p[2] = static_cast<unsigned char>(255 - pair);
+				p[3] = static_cast<unsigned char>(v);
+			}
+		}
+
+		for (int isa = Scalar; isa <= instructionSet(); ++isa)
+		{
+			if (!CHECK(Yuy2Matches(src, width, height, 2 * width, 4 * width, false, static_cast<InstructionSet>(isa), 0)))
+				return;
+		}
+	}
+}
+
+
+/// <summary>
+/// Every even width up to a few vectors, contiguous and padded rows and bands of any
+/// height give the reference, for BGRA and gray alike
+/// </summary>
+static void Yuy2Shapes()
+{
+	std::mt19937 random(17);
+	std::uniform_int_distribution<int> byte(0, 255);
+
+	for (int isa = Scalar; isa <= instructionSet(); ++isa)
+	{
+		for (int width = 2; width <= 80; width += 2)
+		{
+			const int height = 1 + width % 7;
+			const int srcStride = 2 * width + (width % 3) * 6;
+
+			std::vector<unsigned char> src(height * srcStride);
+			for (size_t i = 0; i < src.size(); ++i)
+				src[i] = static_cast<unsigned char>(byte(random));
+
+			const int bands[] = { 0, 1, 3, height };
+			for (int bandRows : bands)
+			{
+				const bool matches =
+					Yuy2Matches(src, width, height, srcStride, 4 * width, false, static_cast<InstructionSet>(isa), bandRows) &&
+					Yuy2Matches(src, width, height, srcStride, 4 * width + 12, false, static_cast<InstructionSet>(isa), bandRows) &&
+					Yuy2Matches(src, width, height, srcStride, width, true, static_cast<InstructionSet>(isa), bandRows) &&
+					Yuy2Matches(src, width, height, srcStride, width + 5, true, static_cast<InstructionSet>(isa), bandRows);
+
+				if (!CHECK(matches))
+					return;
+			}
+		}
+	}
+
+	// the overloads without an instruction set take this CPU's
+	std::vector<unsigned char> src(2 * 1920 * 64);
+	for (size_t i = 0; i < src.size(); ++i)
+		src[i] = static_cast<unsigned char>(byte(random));
+
+	std::vector<unsigned char> best(4 * 1920 * 64), chosen(best.size());
+	yuy2ToBgra(src.data(), 1920, 64, 2 * 1920, best.data(), 4 * 1920, instructionSet(), 0);
+	yuy2ToBgra(src.data(), 1920, 64, 2 * 1920, chosen.data(), 4 * 1920);
+	CHECK(best == chosen);
+
+	std::vector<unsigned char> bestGray(1920 * 64), chosenGray(bestGray.size());
+	yuy2ToGray8(src.data(), 1920, 64, 2 * 1920, bestGray.data(), 1920, instructionSet(), 0);
+	yuy2ToGray8(src.data(), 1920, 64, 2 * 1920, chosenGray.data(), 1920);
+	CHECK(bestGray == chosenGray);
+}
+
+
+//
+// Depth to camera space
+//
+
+// What the point arrays are filled with before a kernel runs, also after them
+static const float GuardPoint = -12345.f;
+
+/// <summary>
+/// The formula depthToPoints() documents for pixel i: the ray of the table scaled by the
+/// depth in meters, as x, y, z
+/// </summary>
+static void DepthToPointReference(const unsigned short* depth, const float* table, int i, float* point)
+{
+	const float meters = static_cast<float>(depth[i]) * 0.001f;
+	point[0] = table[2 * i] * meters;
+	point[1] = table[2 * i + 1] * meters;
+	point[2] = meters;
+}
+
+/// <summary>
+/// Bit for bit, any NaN being the same as any other
+/// </summary>
+static bool SameFloat(float a, float b)
+{
+	return (a != a && b != b) || memcmp(&a, &b, sizeof(float)) == 0;
+}
+
+/// <summary>
+/// Convert count pixels with isa, planar and interleaved, with and without a mask, and
+/// compare every coordinate and mask byte with the reference and the values after them
+/// with the guards
+/// </summary>
+static bool PointsMatch(const std::vector<unsigned short>& depth, const std::vector<float>& table, int count, InstructionSet isa)
+{
+	std::vector<float> x(count + GuardBytes, GuardPoint), y(x), z(x);
+	std::vector<float> xyz(3 * count + GuardBytes, GuardPoint);
+	std::vector<unsigned char> planarMask(count + GuardBytes, Guard), interleavedMask(planarMask);
+
+	depthToPoints(depth.data(), table.data(), count, x.data(), y.data(), z.data(), planarMask.data(), isa);
+	depthToPointsInterleaved(depth.data(), table.data(), count, xyz.data(), interleavedMask.data(), isa);
+
+	// without a mask the points are the same
+	std::vector<float> xNoMask(count + GuardBytes, GuardPoint), yNoMask(xNoMask), zNoMask(xNoMask);
+	std::vector<float> xyzNoMask(3 * count + GuardBytes, GuardPoint);
+	depthToPoints(depth.data(), table.data(), count, xNoMask.data(), yNoMask.data(), zNoMask.data(), NULL, isa);
+	depthToPointsInterleaved(depth.data(), table.data(), count, xyzNoMask.data(), NULL, isa);
+
+	for (int i = 0; i < count + GuardBytes; ++i)
+	{
+		float expected[3] = { GuardPoint, GuardPoint, GuardPoint };
+		if (i < count)
+			DepthToPointReference(depth.data(), table.data(), i, expected);
+
+		const float planar[3] = { x[i], y[i], z[i] };
+		const float planarNoMask[3] = { xNoMask[i], yNoMask[i], zNoMask[i] };
+		const unsigned char expectedMask = i < count ? (depth[i] ? 0xFF : 0) : Guard;
+
+		for (int c = 0; c < 3; ++c)
+		{
+			const bool interleavedInside = 3 * i + c < 3 * count + GuardBytes;
+			const float interleavedExpected = 3 * i + c < 3 * count ? expected[c] : GuardPoint;
+
+			if (!SameFloat(planar[c], expected[c]) || !SameFloat(planarNoMask[c], expected[c]) ||
+				(interleavedInside && (!SameFloat(xyz[3 * i + c], interleavedExpected) || !SameFloat(xyzNoMask[3 * i + c], interleavedExpected))))
+			{
+				std::cerr << "  " << Name(isa) << ", " << count << " points: point " << i << " coordinate " << c << " is "
+					<< planar[c] << " planar, " << (interleavedInside ? xyz[3 * i + c] : 0.f) << " interleaved instead of " << expected[c] << std::endl;
+				return false;
+			}
+		}
+
+		if (planarMask[i] != expectedMask || interleavedMask[i] != expectedMask)
+		{
+			std::cerr << "  " << Name(isa) << ", " << count << " points: mask " << i << " is " << int(planarMask[i]) << " planar, "
+				<< int(interleavedMask[i]) << " interleaved instead of " << int(expectedMask) << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/// <summary>
+/// Rays over the sensor's field of view, a few of them missing (NaN) as they are at the
+/// corners of a real table
+/// </summary>
+static std::vector<float> RayTable(int count, std::mt19937& random)
+{
+	std::uniform_real_distribution<float> rayX(-0.72f, 0.72f);
+	std::uniform_real_distribution<float> rayY(-0.6f, 0.6f);
+	std::vector<float> table(2 * count);
+
+	for (int i = 0; i < count; ++i)
+	{
+		table[2 * i] = rayX(random);
+		table[2 * i + 1] = rayY(random);
+	}
+
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+	for (int i = 0; i < count; i += 37)
+	{
+		table[2 * i] = nan;
+		table[2 * i + 1] = nan;
+	}
+
+	return table;
+}
+
+
+/// <summary>
+/// A full depth frame with every depth value once, zero depth over finite and NaN rays
+/// among them, gives the reference's points and mask with every instruction set, planar
+/// and interleaved alike
+/// </summary>
+static void DepthToPointsValues()
+{
+	std::mt19937 random(29);
+	const int count = 512 * 424;
+
+	std::vector<unsigned short> depth(count);
+	for (int i = 0; i < count; ++i)
+		depth[i] = static_cast<unsigned short>(i);
+
+	// holes in runs, as the sensor leaves them
+	for (int i = 0x10000; i < count; i += 61)
+		std::fill(depth.begin() + i, depth.begin() + qMin(i + 1 + i % 13, count), 0);
+
+	const std::vector<float> table = RayTable(count, random);
+
+	for (int isa = Scalar; isa <= instructionSet(); ++isa)
+		CHECK(PointsMatch(depth, table, count, static_cast<InstructionSet>(isa)));
+
+	// the overloads without an instruction set take this CPU's
+	std::vector<float> best(3 * count), chosen(3 * count);
+	std::vector<unsigned char> bestMask(count), chosenMask(count);
+	depthToPoints(depth.data(), table.data(), count, best.data(), best.data() + count, best.data() + 2 * count, bestMask.data(), instructionSet());
+	depthToPoints(depth.data(), table.data(), count, chosen.data(), chosen.data() + count, chosen.data() + 2 * count, chosenMask.data());
+	CHECK(memcmp(best.data(), chosen.data(), best.size() * sizeof(float)) == 0 && bestMask == chosenMask);
+
+	depthToPointsInterleaved(depth.data(), table.data(), count, best.data(), bestMask.data(), instructionSet());
+	depthToPointsInterleaved(depth.data(), table.data(), count, chosen.data(), chosenMask.data());
+	CHECK(memcmp(best.data(), chosen.data(), best.size() * sizeof(float)) == 0 && bestMask == chosenMask);
+}
+
+
+/// <summary>
+/// Every count up to a few vectors: the tails after the last full vector are converted
+/// like the rest and nothing after the last point is written
+/// </summary>
+static void DepthToPointsShapes()
+{
+	std::mt19937 random(31);
+	std::uniform_int_distribution<int> value(0, 8000);
+
+	for (int isa = Scalar; isa <= instructionSet(); ++isa)
+	{
+		for (int count = 0; count <= 70; ++count)
+		{
+			std::vector<unsigned short> depth(count);
+			for (int i = 0; i < count; ++i)
+				depth[i] = static_cast<unsigned short>(i % 3 ? value(random) : 0);
+
+			if (!CHECK(PointsMatch(depth, RayTable(count, random), count, static_cast<InstructionSet>(isa))))
+				return;
+		}
+	}
+}
+
+
+int main()
+{
+	std::cout << "Instruction set: " << Name(instructionSet()) << std::endl;
+
+	DepthToGrayAllValues();
+	DepthToGrayShapes();
+	Yuy2AllValues();
+	Yuy2Shapes();
+	DepthToPointsValues();
+	DepthToPointsShapes();
+
+	return TestCheck::result();
+}
@@ -0,0 +1,271 @@
+#include "stdafx.h"
+#include "QFrameRecorder.h"
+#include "QFrameRecordingReader.h"
+#include "QFrameSource.h"
+#include "TestCheck.h"
+#include <QDir>
+#include <QFile>
+#include <vector>
+#include <cstring>
+
+
+// Sensor tick at 30 Hz, in RelativeTime ticks of 100 ns
+#define FramePeriod 333333
+
+// Frame sets of the recorded session
+#define SessionFrames 90
+
+
+/// <summary>
+/// One frame of the session. The sizes are small, and the infrared payload is not a
+/// multiple of the chunk alignment, so the padding between chunks is exercised.
+/// </summary>
+struct SessionFrame
+{
+	int							Stream;
+	QFrameRecording::Format		Format;
+	int							Width;
+	int							Height;
+	int							Size;
+};
+
+static const SessionFrame Streams[] =
+{
+	{ QFrameSource::ColorStream,	QFrameRecording::Yuy2,		64,	48,	2 * 64 * 48 },
+	{ QFrameSource::DepthStream,	QFrameRecording::Gray16,	32,	24,	2 * 32 * 24 },
+	{ QFrameSource::InfraredStream,	QFrameRecording::Gray16,	31,	7,	2 * 31 * 7 },
+	{ QFrameSource::BodyStream,		QFrameRecording::BodyFrame,	6,	25,	1000 }
+};
+
+static const int StreamCount = sizeof(Streams) / sizeof(Streams[0]);
+
+
+/// <summary>
+/// Time of the frame of stream s in set t: the streams of a set a little apart and not in
+/// the order they are written in, as the sensor delivers them
+/// </summary>
+static qint64 FrameTime(int t, int s)
+{
+	static const qint64 offsets[] = { 2000, -1500, 0, 500 };
+	return Q_INT64_C(10000000) + t * FramePeriod + offsets[s];
+}
+
+/// <summary>
+/// Payload of the frame of stream s in set t, different for every frame
+/// </summary>
+static std::vector<unsigned char> FramePayload(int t, int s)
+{
+	std::vector<unsigned char> payload(Streams[s].Size);
+	for (size_t i = 0; i < payload.size(); ++i)
+		payload[i] = static_cast<unsigned char>(s * 31 + t * 7 + i);
+	return payload;
+}
+
+/// <summary>
+/// Write SessionFrames sets of every stream to fileName and close it
+/// </summary>
+static bool RecordSession(const QString& fileName)
+{
+	QFrameRecorder recorder;
+	if (!CHECK(recorder.open(fileName, 1024 * 1024, 64 * 1024)))
+		return false;
+
+	for (int t = 0; t < SessionFrames; ++t)
+	{
+		for (int s = 0; s < StreamCount; ++s)
+		{
+			const std::vector<unsigned char> payload = FramePayload(t, s);
+			if (!CHECK(recorder.write(Streams[s].Stream, Streams[s].Format, Streams[s].Width, Streams[s].Height, FrameTime(t, s), payload.data(), Streams[s].Size)))
+				return false;
+		}
+	}
+
+	recorder.close();
+
+	CHECK(!recorder.isOpen());
+	CHECK_EQUAL(recorder.frameCount(), static_cast<quint64>(SessionFrames * StreamCount));
+	CHECK_EQUAL(recorder.droppedCount(), Q_UINT64_C(0));
+	return true;
+}
+
+/// <summary>
+/// The first count chunks of the reader are the session's first chunks, headers and payloads
+/// </summary>
+static bool ChunksMatch(const QFrameRecordingReader& reader, int count)
+{
+	for (int i = 0; i < count; ++i)
+	{
+		const int t = i / StreamCount;
+		const int s = i % StreamCount;
+		const QFrameRecording::IndexEntry& entry = reader.entry(i);
+		const QFrameRecording::ChunkHeader& chunk = reader.chunk(i);
+
+		const bool matches =
+			CHECK_EQUAL(entry.Stream, static_cast<quint32>(Streams[s].Stream)) &&
+			CHECK_EQUAL(entry.Time, FrameTime(t, s)) &&
+			CHECK_EQUAL(entry.Size, static_cast<quint32>(Streams[s].Size)) &&
+			CHECK_EQUAL(chunk.Magic, QFrameRecording::ChunkMagic) &&
+			CHECK_EQUAL(chunk.Stream, static_cast<quint32>(Streams[s].Stream)) &&
+			CHECK_EQUAL(chunk.Format, static_cast<quint32>(Streams[s].Format)) &&
+			CHECK_EQUAL(chunk.Width, Streams[s].Width) &&
+			CHECK_EQUAL(chunk.Height, Streams[s].Height) &&
+			CHECK_EQUAL(chunk.Time, FrameTime(t, s)) &&
+			CHECK(memcmp(reader.payload(i), FramePayload(t, s).data(), Streams[s].Size) == 0);
+
+		if (!matches)
+		{
+			std::cerr << "  chunk " << i << " of " << count << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/// <summary>
+/// find() against its definition: the first chunk with every chunk before it before time
+/// </summary>
+static bool FindMatches(const QFrameRecordingReader& reader, qint64 time)
+{
+	int expected = 0;
+	while (expected < reader.count() && reader.entry(expected).Time < time)
+		++expected;
+
+	if (!CHECK_EQUAL(reader.find(time), expected))
+	{
+		std::cerr << "  time " << time << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+/// <summary>
+/// A session of every stream reads back chunk for chunk through the index the recorder
+/// appended, with the streams, the time range and find() of every frame and between frames
+/// </summary>
+static void RoundTrip(const QString& fileName)
+{
+	if (!RecordSession(fileName))
+		return;
+
+	QFrameRecordingReader reader;
+	if (!CHECK(reader.open(fileName)))
+		return;
+
+	CHECK_EQUAL(reader.count(), SessionFrames * StreamCount);
+	CHECK(ChunksMatch(reader, reader.count()));
+	CHECK_EQUAL(reader.streams(), static_cast<int>(QFrameSource::ColorStream | QFrameSource::DepthStream | QFrameSource::InfraredStream | QFrameSource::BodyStream));
+
+	// the first chunk starts the recording, the latest frame, color of the last set, ends it
+	CHECK_EQUAL(reader.startTime(), FrameTime(0, 0));
+	CHECK_EQUAL(reader.endTime(), FrameTime(SessionFrames - 1, 0));
+
+	CHECK_EQUAL(reader.find(0), 0);
+	CHECK_EQUAL(reader.find(reader.endTime() + 1), reader.count());
+
+	for (int t = 0; t < SessionFrames; ++t)
+	{
+		for (int s = 0; s < StreamCount; ++s)
+		{
+			const qint64 time = FrameTime(t, s);
+			if (!FindMatches(reader, time) || !FindMatches(reader, time + 1) || !FindMatches(reader, time + FramePeriod / 2))
+				return;
+		}
+	}
+
+	reader.close();
+	CHECK(!reader.isOpen());
+	CHECK_EQUAL(reader.count(), 0);
+}
+
+
+/// <summary>
+/// A file cut short while recording, without its index and footer and in the middle of a
+/// chunk, is indexed by walking its chunks: every complete chunk is found, the partial
+/// one is not. A file cut right after a chunk keeps that chunk, one with only its header
+/// opens empty.
+/// </summary>
+static void Truncated(const QString& fileName)
+{
+	if (!RecordSession(fileName))
+		return;
+
+	QFrameRecordingReader reader;
+	if (!CHECK(reader.open(fileName)))
+		return;
+
+	const int total = reader.count();
+	std::vector<QFrameRecording::IndexEntry> entries;
+	for (int i = 0; i < total; ++i)
+		entries.push_back(reader.entry(i));
+	reader.close();
+
+	const QString cutName = fileName + ".cut";
+
+	// cut into the payload of a chunk, into its header, and right at its end
+	const int cutChunks[] = { 1, 2, StreamCount * 10 + 2, total - 1 };
+
+	for (int kept : cutChunks)
+	{
+		const quint64 start = entries[kept].Offset;
+		const quint64 end = start + sizeof(QFrameRecording::ChunkHeader) + QFrameRecording::paddedSize(entries[kept].Size);
+
+		const quint64 cuts[] = { start + sizeof(QFrameRecording::ChunkHeader) + entries[kept].Size / 2, start + 5, start, end - 1 };
+
+		for (quint64 cut : cuts)
+		{
+			QFile::remove(cutName);
+			if (!CHECK(QFile::copy(fileName, cutName)) || !CHECK(QFile::resize(cutName, static_cast<qint64>(cut))))
+				return;
+
+			if (!CHECK(reader.open(cutName)))
+				return;
+
+			const bool matches = CHECK_EQUAL(reader.count(), kept) && CHECK(ChunksMatch(reader, kept)) &&
+				CHECK_EQUAL(reader.startTime(), kept ? FrameTime(0, 0) : 0) && FindMatches(reader, FrameTime(1, 1));
+			reader.close();
+
+			if (!matches)
+			{
+				std::cerr << "  cut at " << cut << ", in chunk " << kept << std::endl;
+				return;
+			}
+		}
+
+		// the whole chunk is there, so is it
+		QFile::remove(cutName);
+		if (!CHECK(QFile::copy(fileName, cutName)) || !CHECK(QFile::resize(cutName, static_cast<qint64>(end))) || !CHECK(reader.open(cutName)))
+			return;
+
+		CHECK_EQUAL(reader.count(), kept + 1);
+		CHECK(ChunksMatch(reader, kept + 1));
+		reader.close();
+	}
+
+	// the header alone
+	QFile::remove(cutName);
+	if (CHECK(QFile::copy(fileName, cutName)) && CHECK(QFile::resize(cutName, sizeof(QFrameRecording::Header))) && CHECK(reader.open(cutName)))
+	{
+		CHECK_EQUAL(reader.count(), 0);
+		CHECK_EQUAL(reader.streams(), 0);
+		CHECK_EQUAL(reader.find(FrameTime(0, 0)), 0);
+		reader.close();
+	}
+
+	QFile::remove(cutName);
+}
+
+
+int main()
+{
+	const QString fileName = QDir::temp().filePath("QFrameRecordingTest.qkrec");
+
+	RoundTrip(fileName);
+	Truncated(fileName);
+
+	QFile::remove(fileName);
+
+	return TestCheck::result();
+}
@@ -0,0 +1,236 @@
+#include "stdafx.h"
+#include "QFrameRegistration.h"
+#include "TestCheck.h"
+#include <vector>
+#include <random>
+#include <cmath>
+#include <limits>
+
+
+#define DepthWidth 512
+#define DepthHeight 424
+#define DepthPixels (DepthWidth * DepthHeight)
+#define ColorWidth 1920
+#define ColorHeight 1080
+
+// Depths (mm) the table is fitted at, as QKinectFrameSource does
+#define NearDepth 1000.f
+#define MidDepth 2000.f
+#define FarDepth 4000.f
+
+
+/// <summary>
+/// Stand-in for the coordinate mapper: pinhole depth and color cameras, the color camera
+/// baseline mm to the side and forward mm ahead. The color pixel of a depth pixel is
+/// exactly a + b / (z + c), what the table models, c being forward.
+/// </summary>
+struct Cameras
+{
+	float	Baseline;
+	float	Forward;
+
+	void map(float depth, std::vector<float>& points) const
+	{
+		points.resize(2 * DepthPixels);
+
+		for (int i = 0; i < DepthPixels; ++i)
+		{
+			const float x = (i % DepthWidth - 256.f) / 365.f * depth;
+			const float y = (i / DepthWidth - 212.f) / 365.f * depth;
+
+			points[2 * i] = 1081.f * (x + Baseline) / (depth + Forward) + 960.f;
+			points[2 * i + 1] = 1081.f * y / (depth + Forward) + 540.f;
+		}
+
+		// the corner the mapper cannot map
+		points[0] = points[1] = -std::numeric_limits<float>::infinity();
+	}
+
+	std::vector<float> table() const
+	{
+		std::vector<float> nearPoints, midPoints, farPoints, table(QFrameRegistration::TableStride * DepthPixels);
+		map(NearDepth, nearPoints);
+		map(MidDepth, midPoints);
+		map(FarDepth, farPoints);
+		QFrameRegistration::fitTable(nearPoints.data(), midPoints.data(), farPoints.data(), DepthPixels, NearDepth, MidDepth, FarDepth, table.data());
+		return table;
+	}
+
+	float error(const std::vector<float>& table, float depth, float percentile = 1.f) const
+	{
+		std::vector<float> points;
+		map(depth, points);
+		return QFrameRegistration::tableError(table.data(), points.data(), DepthPixels, depth, percentile);
+	}
+};
+
+
+/// <summary>
+/// The fit is exact at every depth, for a color camera on the baseline and for one ahead of
+/// it; a table without the offset, as a two depth fit would give, is off away from its depths
+/// </summary>
+static void TableError()
+{
+	const float depths[] = { 500.f, NearDepth, 2500.f, FarDepth, 8000.f };
+
+	const Cameras baseline = { 52.f, 0.f };
+	const std::vector<float> exact = baseline.table();
+
+	for (float depth : depths)
+		CHECK(baseline.error(exact, depth) < 0.01f);
+
+	const Cameras ahead = { 52.f, 20.f };
+	const std::vector<float> fitted = ahead.table();
+
+	for (float depth : depths)
+		CHECK(ahead.error(fitted, depth) < 0.01f);
+	CHECK(std::fabs(fitted[QFrameRegistration::TableStride * (DepthPixels / 2) + 4] - 20.f) < 0.1f);
+
+	// the mid depth repeating the near one leaves no parallax to fit the offset with
+	std::vector<float> nearPoints, farPoints, twoDepths(QFrameRegistration::TableStride * DepthPixels);
+	ahead.map(NearDepth, nearPoints);
+	ahead.map(FarDepth, farPoints);
+	QFrameRegistration::fitTable(nearPoints.data(), nearPoints.data(), farPoints.data(), DepthPixels, NearDepth, NearDepth, FarDepth, twoDepths.data());
+	CHECK_EQUAL(twoDepths[QFrameRegistration::TableStride * (DepthPixels / 2) + 4], 0.f);
+	CHECK(ahead.error(twoDepths, NearDepth) < 0.01f);
+	CHECK(ahead.error(twoDepths, 500.f) > 1.f);
+	CHECK(std::isfinite(ahead.error(twoDepths, 500.f)));
+}
+
+
+/// <summary>
+/// The percentile leaves out the worst pixels: one pixel off does not reject a table at
+/// the 99th, a few percent of them do, and the maximum catches either
+/// </summary>
+static void TableErrorPercentile()
+{
+	const Cameras baseline = { 52.f, 0.f };
+	const std::vector<float> exact = baseline.table();
+
+	std::vector<float> shifted(exact);
+	shifted[QFrameRegistration::TableStride * (DepthPixels / 2)] += 1.5f;
+	CHECK(baseline.error(shifted, 2500.f) > 1.4f);
+	CHECK(baseline.error(shifted, 2500.f, 0.99f) < 0.01f);
+
+	// the first 2 % of the rows, lens distortion at a frame edge
+	for (int i = 0; i < DepthPixels / 50; ++i)
+		shifted[QFrameRegistration::TableStride * i] += 1.5f;
+	CHECK(baseline.error(shifted, 2500.f, 0.99f) > 1.4f);
+
+	// the corner the mapper cannot map is no error, a frame without any valid pixel has none
+	std::vector<float> invalid(2 * DepthPixels, -std::numeric_limits<float>::infinity());
+	CHECK_EQUAL(QFrameRegistration::tableError(exact.data(), invalid.data(), DepthPixels, 2500.f, 0.99f), 0.f);
+}
+
+
+/// <summary>
+/// A table of one frame's mapped points, what registration falls back to without a fitted
+/// table, puts every pixel where the mapper does at that frame's depth
+/// </summary>
+static void PointTable()
+{
+	const Cameras ahead = { 52.f, 20.f };
+
+	std::vector<float> points, table(QFrameRegistration::TableStride * DepthPixels);
+	ahead.map(2500.f, points);
+	QFrameRegistration::pointTable(points.data(), DepthPixels, table.data());
+
+	CHECK_EQUAL(ahead.error(table, 2500.f), 0.f);
+	CHECK(!std::isfinite(table[0]));
+}
+
+
+/// <summary>
+/// Parallel matches Reference exactly for both outputs, with and without occlusion and
+/// for any tile height, and Parallel is what process() runs by default
+/// </summary>
+static void ParallelMatchesReference()
+{
+	const Cameras cameras = { 52.f, 0.f };
+	const std::vector<float> table = cameras.table();
+
+	// a near box in front of a far wall, with holes, so occlusion has something to hide
+	std::mt19937 random(1);
+	std::uniform_int_distribution<int> noise(0, 29);
+	std::uniform_int_distribution<int> hole(0, 19);
+	std::uniform_int_distribution<int> byte(0, 255);
+
+	std::vector<unsigned short> depth(DepthPixels);
+	for (int i = 0; i < DepthPixels; ++i)
+	{
+		const int x = i % DepthWidth;
+		depth[i] = hole(random) == 0 ? 0 : static_cast<unsigned short>((x > 200 && x < 260 ? 900 : 2500) + noise(random));
+	}
+
+	// a wall right in front of the camera, nearer than anything in depth
+	const std::vector<unsigned short> nearWall(DepthPixels, 600);
+
+	std::vector<unsigned char> color(ColorWidth * ColorHeight * 4);
+	for (size_t i = 0; i < color.size(); ++i)
+		color[i] = static_cast<unsigned char>(byte(random));
+
+	std::vector<QRgb> reference(DepthPixels), parallel(DepthPixels);
+	std::vector<unsigned short> referenceDepth(ColorWidth * ColorHeight), parallelDepth(ColorWidth * ColorHeight);
+
+	int visibleWithout = 0;
+
+	for (int occlusion = 0; occlusion < 2; ++occlusion)
+	{
+		QFrameRegistration registration;
+		registration.setOcclusion(occlusion != 0);
+
+		registration.process(depth.data(), DepthWidth, DepthHeight, table.data(), color.data(), ColorWidth, ColorHeight, ColorWidth * 4,
+			reference.data(), referenceDepth.data(), QFrameRegistration::Reference);
+
+		int visible = 0;
+		for (int i = 0; i < DepthPixels; ++i)
+			visible += reference[i] != 0;
+
+		// the rows beyond the color frame never get color, the box hides part of the wall only with occlusion on
+		if (occlusion)
+			CHECK(visible < visibleWithout - 1000);
+		else
+			visibleWithout = visible;
+
+		const int tileRows[] = { 1, 7, 16, DepthHeight };
+		for (int rows : tileRows)
+		{
+			registration.setTileRows(rows);
+
+			// after a nearer frame: the z-buffer left by a frame must not leak into the next one
+			for (int pass = 0; pass < 2; ++pass)
+			{
+				if (pass)
+				{
+					registration.process(nearWall.data(), DepthWidth, DepthHeight, table.data(), color.data(), ColorWidth, ColorHeight, ColorWidth * 4,
+						parallel.data(), parallelDepth.data(), QFrameRegistration::Parallel);
+				}
+
+				registration.process(depth.data(), DepthWidth, DepthHeight, table.data(), color.data(), ColorWidth, ColorHeight, ColorWidth * 4,
+					parallel.data(), parallelDepth.data(), QFrameRegistration::Parallel);
+
+				if (!CHECK(parallel == reference) || !CHECK(parallelDepth == referenceDepth))
+					std::cerr << "  occlusion " << occlusion << ", tile rows " << rows << ", pass " << pass << std::endl;
+			}
+
+			registration.process(depth.data(), DepthWidth, DepthHeight, table.data(), color.data(), ColorWidth, ColorHeight, ColorWidth * 4,
+				parallel.data(), NULL, QFrameRegistration::Parallel);
+			CHECK(parallel == reference);
+		}
+
+		registration.process(depth.data(), DepthWidth, DepthHeight, table.data(), color.data(), ColorWidth, ColorHeight, ColorWidth * 4,
+			parallel.data(), parallelDepth.data());
+		CHECK(parallel == reference && parallelDepth == referenceDepth);
+	}
+}
+
+
+int main()
+{
+	TableError();
+	TableErrorPercentile();
+	PointTable();
+	ParallelMatchesReference();
+
+	return TestCheck::result();
+}
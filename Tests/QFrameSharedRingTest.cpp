@@ -0,0 +1,200 @@
+#include "stdafx.h"
+#include "QFramePublisher.h"
+#include "QFrameSharedReader.h"
+#include "QFrameSource.h"
+#include "TestCheck.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QProcess>
+#include <QThread>
+#include <vector>
+#include <cstring>
+
+
+// A depth frame of this size, large enough for the publisher to overwrite a slot
+// while a reader is still in it
+#define FrameWidth 512
+#define FrameHeight 256
+#define FramePixels (FrameWidth * FrameHeight)
+
+// Frames published after the first one, the last one tells the readers to stop
+#define FrameCount 2000
+
+// Milliseconds the slow reader spends on every frame
+#define SlowReaderDelay 2
+
+// Milliseconds a process waits for the others before it fails
+#define Timeout 30000
+
+
+/// <summary>
+/// Frame n holds n in every pixel, and n as its time
+/// </summary>
+static bool IsWhole(const unsigned short* pixels, qint64 time)
+{
+	for (int i = 0; i < FramePixels; ++i)
+	{
+		if (pixels[i] != static_cast<unsigned short>(time))
+			return false;
+	}
+
+	return true;
+}
+
+
+/// <summary>
+/// One reader process. "next" walks every frame and checks it in place, "slow" walks
+/// every frame copying it but takes longer per frame than the publisher, "latest" only
+/// copies the newest. Every frame handed out must be whole and newer than the one before,
+/// the frames next() passes over must all be counted as overruns, and the slow reader
+/// must have been lapped. Returns the exit code.
+/// </summary>
+static int Reader(const QString& name, const char* mode)
+{
+	const bool slow = strcmp(mode, "slow") == 0;
+	const bool latest = strcmp(mode, "latest") == 0;
+	const bool inPlace = strcmp(mode, "next") == 0;
+
+	QFrameSharedReader reader;
+	if (!CHECK(reader.attach(name, QFrameSource::DepthStream)))
+		return TestCheck::result();
+
+	// the publisher waits for this line before it goes on
+	std::cout << "attached" << std::endl;
+
+	std::vector<unsigned short> copy(FramePixels);
+	qint64 last = 0;
+	quint64 torn = 0;
+	quint64 backwards = 0;
+	quint64 uncounted = 0;
+	quint64 whole = 0;
+
+	QElapsedTimer timer;
+	timer.start();
+
+	while (last < FrameCount && !timer.hasExpired(Timeout))
+	{
+		const quint64 overruns = reader.overrunCount();
+
+		QSharedFrameView view;
+		if (!(latest ? reader.latest(view) : reader.next(view)))
+		{
+			QThread::yieldCurrentThread();
+			continue;
+		}
+
+		const qint64 n = view.Time;
+		if (n <= last)
+			++backwards;
+
+		// next() hands out every frame or counts it, latest() passes over the older ones on purpose
+		if (!latest && n > last + 1 && last > 0 && reader.overrunCount() - overruns != static_cast<quint64>(n - last - 1))
+			++uncounted;
+
+		last = n;
+
+		if (inPlace)
+		{
+			// in place the frame may change under the check, only a check the reader still vouches for counts
+			const bool same = IsWhole(reinterpret_cast<const unsigned short*>(view.Data), n);
+			if (reader.isValid(view))
+			{
+				torn += !same;
+				whole += same;
+			}
+		}
+		else if (reader.copy(view, copy.data()))
+		{
+			torn += !IsWhole(copy.data(), n);
+			whole += IsWhole(copy.data(), n);
+		}
+
+		if (slow)
+			QThread::msleep(SlowReaderDelay);
+	}
+
+	std::cerr << mode << " reader: " << reader.readCount() << " read, " << whole << " whole, "
+		<< reader.overrunCount() << " overruns, " << reader.skippedCount() << " skipped" << std::endl;
+
+	CHECK_EQUAL(last, FrameCount);
+	CHECK_EQUAL(torn, Q_UINT64_C(0));
+	CHECK_EQUAL(backwards, Q_UINT64_C(0));
+	CHECK_EQUAL(uncounted, Q_UINT64_C(0));
+	CHECK(whole > 0);
+
+	if (slow)
+		CHECK(reader.overrunCount() > 0);
+
+	return TestCheck::result();
+}
+
+
+/// <summary>
+/// The publisher process: starts one reader process per mode, publishes the frames as
+/// fast as it can, and collects the readers' exit codes
+/// </summary>
+static int Publisher()
+{
+	const QString name = QString("QFrameSharedRingTest%1").arg(static_cast<qint64>(QCoreApplication::applicationPid()));
+	std::vector<unsigned short> frame(FramePixels, 0);
+
+	QFramePublisher publisher;
+	if (!CHECK(publisher.open(name)))
+		return TestCheck::result();
+
+	// the first frame creates the ring the readers attach to
+	CHECK(publisher.publish(QFrameSource::DepthStream, QFrameRecording::Gray16, FrameWidth, FrameHeight, 0, frame.data(), FramePixels * 2));
+
+	const char* modes[] = { "next", "slow", "latest" };
+	std::vector<QProcess*> readers;
+
+	for (const char* mode : modes)
+	{
+		QProcess* process = new QProcess;
+		process->setProcessChannelMode(QProcess::ForwardedErrorChannel);
+		process->start(QCoreApplication::applicationFilePath(), QStringList() << "reader" << name << mode);
+
+		const bool attached = process->waitForReadyRead(Timeout) && process->readAllStandardOutput().startsWith("attached");
+		if (!CHECK(attached))
+			std::cerr << "  " << mode << " reader" << std::endl;
+
+		readers.push_back(process);
+	}
+
+	// never paced: on a single core the readers only run when the scheduler preempts the
+	// publisher, anywhere in publish(), and a lapped reader lands on the slot being written
+	for (int n = 1; n <= FrameCount; ++n)
+	{
+		std::fill(frame.begin(), frame.end(), static_cast<unsigned short>(n));
+		CHECK(publisher.publish(QFrameSource::DepthStream, QFrameRecording::Gray16, FrameWidth, FrameHeight, n, frame.data(), FramePixels * 2));
+	}
+
+	CHECK_EQUAL(publisher.publishedCount(), static_cast<quint64>(FrameCount + 1));
+	CHECK_EQUAL(publisher.droppedCount(), Q_UINT64_C(0));
+
+	for (size_t r = 0; r < readers.size(); ++r)
+	{
+		const bool passed = readers[r]->waitForFinished(Timeout) && readers[r]->exitStatus() == QProcess::NormalExit && readers[r]->exitCode() == 0;
+		if (!CHECK(passed))
+			std::cerr << "  " << modes[r] << " reader" << std::endl;
+
+		delete readers[r];
+	}
+
+	return TestCheck::result();
+}
+
+
+/// <summary>
+/// One publisher and several reader processes on a ring: run without arguments, the
+/// test starts itself again as each reader
+/// </summary>
+int main(int argc, char* argv[])
+{
+	QCoreApplication application(argc, argv);
+
+	if (argc == 4 && strcmp(argv[1], "reader") == 0)
+		return Reader(QString::fromLocal8Bit(argv[2]), argv[3]);
+
+	return Publisher();
+}
@@ -0,0 +1,586 @@
+#include "stdafx.h"
+#include "QFrameStreamServer.h"
+#include "QFrameStreamSource.h"
+#include "QFrameRecording.h"
+#include "TestCheck.h"
+#include <QElapsedTimer>
+#include <QThread>
+#include <vector>
+#include <cstring>
+
+
+#define DepthWidth 512
+#define DepthHeight 424
+#define DepthPixels (DepthWidth * DepthHeight)
+
+// Frames sent one at a time, each read before the next one goes
+#define LockstepCount 200
+
+// Frames sent as fast as the server encodes them
+#define FloodCount 500
+
+// Milliseconds to wait for the other side before a check fails
+#define Timeout 5000
+
+// Clients of one server: all but the last read as fast as they can, the last one waits
+// SlowClientDelay ms after every frame
+#define ClientCount 4
+#define SlowClientDelay 40
+
+// Frames sent to them, one every FramePace ms
+#define PacedCount 100
+#define FramePace 10
+
+using namespace QFrameStream;
+
+
+/// <summary>
+/// Depth frame n: a slanted surface moving with n and holes, so every frame codes differently
+/// </summary>
+static void MakeDepth(QKinectDepthFrame& frame, int n)
+{
+	frame.Width = DepthWidth;
+	frame.Height = DepthHeight;
+	frame.Time = n;
+	frame.Buffer.resize(DepthPixels);
+
+	for (int i = 0; i < DepthPixels; ++i)
+		frame.Buffer[i] = (i * 7 + n) % 97 == 0 ? 0 : static_cast<unsigned short>(500 + (i % DepthWidth) * 8 + n);
+}
+
+static bool WaitForClients(const QFrameStreamServer& server, int count)
+{
+	QElapsedTimer timer;
+	timer.start();
+
+	while (server.clientCount() != count && !timer.hasExpired(Timeout))
+		QThread::msleep(1);
+
+	return server.clientCount() == count;
+}
+
+/// <summary>
+/// Wait for the next frame of stream, false if none came in time
+/// </summary>
+static bool WaitForFrame(QFrameStreamSource& source, int stream)
+{
+	QElapsedTimer timer;
+	timer.start();
+
+	while (!timer.hasExpired(Timeout))
+	{
+		if (source.wait(Timeout) & stream)
+			return true;
+	}
+
+	return false;
+}
+
+
+/// <summary>
+/// Client of its own reading a server's depth frames straight off the socket, as fast as
+/// it can or Delay ms apart. Notes when every frame of Time 1 to PacedCount arrived, and
+/// the newest warm-up frame (Time 0 and below) it saw.
+/// </summary>
+class RawClient : public QThread
+{
+public:
+	RawClient(quint16 port, int delay, const QElapsedTimer& clock) :
+		Port(port),
+		Delay(delay),
+		Clock(clock),
+		Received(PacedCount + 1, -1),
+		Connected(false)
+	{
+		Warmup.store(1);
+	}
+
+	void stop()
+	{
+		Socket.shutdown();
+	}
+
+	quint16					Port;
+	int						Delay;
+	const QElapsedTimer&	Clock;
+	std::vector<qint64>		Received;		// ns on Clock, by Time, -1 for a frame that never came
+	bool					Connected;
+	QAtomicInt				Warmup;			// Time of the newest warm-up frame, 1 before the first
+
+protected:
+	void run() Q_DECL_OVERRIDE
+	{
+		Request request;
+		request.Magic = RequestMagic;
+		request.Version = Version;
+		request.Streams = QFrameSource::DepthStream;
+		request.Reserved = 0;
+
+		const QFrameStreamSocket::Buffer part = { &request, sizeof(request) };
+		Connected = Socket.connect("127.0.0.1", Port) && Socket.send(&part, 1);
+
+		FrameHeader header;
+		std::vector<unsigned char> payload;
+
+		while (Connected && Socket.receive(&header, sizeof(header)))
+		{
+			payload.resize(header.Size);
+			if (!Socket.receive(payload.data(), static_cast<int>(header.Size)))
+				break;
+
+			if (header.Time <= 0)
+				Warmup.storeRelease(static_cast<int>(header.Time));
+			else if (header.Time <= PacedCount)
+				Received[header.Time] = Clock.nsecsElapsed();
+
+			if (header.Time == PacedCount)
+				break;
+
+			if (Delay > 0)
+				QThread::msleep(Delay);
+		}
+	}
+
+private:
+	QFrameStreamSocket		Socket;
+};
+
+
+/// <summary>
+/// Every frame is read before the next one is sent: each arrives exactly as sent, none is
+/// lost, and the time from send to decoded frame is the latency of the link
+/// </summary>
+static void Lockstep()
+{
+	QFrameStreamServer server;
+	CHECK(server.listen(0));
+
+	QFrameStreamSource source;
+	source.setServer("127.0.0.1", server.port());
+	CHECK(source.open(QFrameSource::DepthStream | QFrameSource::InfraredStream));
+	CHECK(WaitForClients(server, 1));
+
+	QKinectDepthFrame sent;
+	QKinectDepthFrame depth;
+	QKinectInfraredFrame infrared;
+	int wrong = 0;
+	qint64 total = 0;
+	qint64 worst = 0;
+
+	QElapsedTimer elapsed;
+	elapsed.start();
+
+	for (int n = 1; n <= LockstepCount; ++n)
+	{
+		MakeDepth(sent, n);
+
+		const qint64 start = elapsed.nsecsElapsed();
+		server.sendDepth(sent);
+
+		if (!CHECK(WaitForFrame(source, QFrameSource::DepthStream)) || !CHECK(source.readDepth(depth)))
+			break;
+
+		const qint64 latency = elapsed.nsecsElapsed() - start;
+		total += latency;
+		worst = qMax(worst, latency);
+
+		wrong += depth.Buffer != sent.Buffer || depth.Time != n || depth.Width != DepthWidth || depth.Height != DepthHeight;
+	}
+
+	const double seconds = elapsed.nsecsElapsed() / 1e9;
+	std::cerr << "lockstep: " << LockstepCount << " depth frames, " << LockstepCount / seconds << " frames/s, latency mean "
+		<< total / 1e6 / LockstepCount << " ms, worst " << worst / 1e6 << " ms" << std::endl;
+
+	CHECK_EQUAL(wrong, 0);
+	CHECK_EQUAL(source.lostCount(), Q_UINT64_C(0));
+	CHECK_EQUAL(source.replacedCount(), Q_UINT64_C(0));
+
+	// infrared takes the same coder, on its own stream
+	QKinectInfraredFrame ir;
+	ir.Width = DepthWidth;
+	ir.Height = DepthHeight;
+	ir.Time = 7;
+	ir.Buffer = sent.Buffer;
+	server.sendInfrared(ir);
+
+	if (CHECK(WaitForFrame(source, QFrameSource::InfraredStream)) && CHECK(source.readInfrared(infrared)))
+		CHECK(infrared.Buffer == ir.Buffer && infrared.Time == 7);
+}
+
+
+/// <summary>
+/// Color goes out at full size when it fits colorSize() and downscaled otherwise
+/// </summary>
+static void Color()
+{
+	QFrameStreamServer server;
+	CHECK(server.listen(0));
+	server.setColorSize(QSize(128, 96));
+
+	QFrameStreamSource source;
+	source.setServer("127.0.0.1", server.port());
+	CHECK(source.open(QFrameSource::ColorStream));
+	CHECK(WaitForClients(server, 1));
+
+	QFramePool pool(2, 128 * 96 * QKinectColorFrame::Channels);
+	QKinectColorFrame sent;
+	sent.Buffer = pool.acquire();
+	sent.Format = QKinectColorFrame::Bgra;
+	sent.Width = 128;
+	sent.Height = 96;
+	sent.Time = 3;
+
+	for (int i = 0; i < sent.Buffer.size(); ++i)
+		sent.Buffer.data()[i] = static_cast<unsigned char>(i * 13);
+
+	QFramePool received(2);
+	QKinectColorFrame color;
+	server.sendColor(sent);
+
+	if (CHECK(WaitForFrame(source, QFrameSource::ColorStream)) && CHECK(source.readColor(color, received)))
+	{
+		CHECK(color.Width == 128 && color.Height == 96 && color.Time == 3);
+		CHECK(memcmp(color.Buffer.data(), sent.Buffer.data(), sent.Buffer.size()) == 0);
+	}
+
+	server.setColorSize(QSize(64, 48));
+	server.sendColor(sent);
+
+	if (CHECK(WaitForFrame(source, QFrameSource::ColorStream)) && CHECK(source.readColor(color, received)))
+		CHECK(color.Width == 64 && color.Height == 48);
+}
+
+
+/// <summary>
+/// A client that stops reading holds the server's buffers, never the grabber's: full size
+/// color frames are copied out before they are queued, so the grabber's pool stays full
+/// however far the client's connection is stuck
+/// </summary>
+static void StalledClient()
+{
+	QFrameStreamServer server;
+	CHECK(server.listen(0));
+	server.setColorSize(QSize());
+
+	QFrameStreamSocket client;
+	Request request;
+	request.Magic = RequestMagic;
+	request.Version = Version;
+	request.Streams = QFrameSource::ColorStream;
+	request.Reserved = 0;
+
+	const QFrameStreamSocket::Buffer part = { &request, sizeof(request) };
+	CHECK(client.connect("127.0.0.1", server.port()) && client.send(&part, 1));
+	CHECK(WaitForClients(server, 1));
+
+	// larger than the socket buffers: the first frame blocks its write, the next ones wait
+	// behind it and replace each other
+	QFramePool pool(3, 1920 * 1080 * QKinectColorFrame::Channels);
+
+	QElapsedTimer timer;
+	timer.start();
+
+	while (server.droppedCount() < 2 && !timer.hasExpired(Timeout))
+	{
+		QKinectColorFrame frame;
+		frame.Buffer = pool.acquire();
+		frame.Format = QKinectColorFrame::Bgra;
+		frame.Width = 1920;
+		frame.Height = 1080;
+		server.sendColor(frame);
+
+		QThread::msleep(1);
+	}
+
+	CHECK(server.droppedCount() >= 2);
+	CHECK_EQUAL(server.sentCount(), Q_UINT64_C(0));
+	CHECK_EQUAL(pool.available(), 3);
+
+	server.close();
+	client.close();
+}
+
+
+/// <summary>
+/// Frames sent faster than the client reads them: the newest one always arrives, every
+/// frame the server encoded was either written or dropped, and the frames the client
+/// reads are whole
+/// </summary>
+static void Flood()
+{
+	QFrameStreamServer server;
+	CHECK(server.listen(0));
+
+	QFrameStreamSource source;
+	source.setServer("127.0.0.1", server.port());
+	CHECK(source.open(QFrameSource::DepthStream));
+	CHECK(WaitForClients(server, 1));
+
+	QKinectDepthFrame depth;
+	std::vector<QKinectDepthFrame> frames(FloodCount + 1);
+	for (int n = 1; n <= FloodCount; ++n)
+		MakeDepth(frames[n], n);
+
+	QElapsedTimer elapsed;
+	elapsed.start();
+
+	for (int n = 1; n <= FloodCount; ++n)
+		server.sendDepth(frames[n]);
+
+	int wrong = 0;
+	qint64 last = 0;
+
+	while (last < FloodCount && WaitForFrame(source, QFrameSource::DepthStream))
+	{
+		if (!CHECK(source.readDepth(depth)))
+			break;
+
+		wrong += depth.Time <= last || depth.Time > FloodCount || depth.Buffer != frames[depth.Time].Buffer;
+		last = depth.Time;
+	}
+
+	const double seconds = elapsed.nsecsElapsed() / 1e9;
+	std::cerr << "flood: " << FloodCount << " depth frames in " << seconds * 1e3 << " ms, " << source.receivedCount()
+		<< " received, " << server.droppedCount() << " dropped by the server" << std::endl;
+
+	CHECK_EQUAL(last, FloodCount);
+	CHECK_EQUAL(wrong, 0);
+	CHECK_EQUAL(source.receivedCount() + server.droppedCount(), static_cast<quint64>(FloodCount));
+	CHECK_EQUAL(server.sentCount() + server.droppedCount(), static_cast<quint64>(FloodCount));
+	CHECK(source.lostCount() <= server.droppedCount());
+}
+
+
+/// <summary>
+/// A server of our own sends frames whose header does not fit their format or payload:
+/// each is refused, and the connection still delivers the good frame after them
+/// </summary>
+static void MalformedHeaders()
+{
+	QFrameStreamSocket listener;
+	CHECK(listener.listen(0));
+
+	QFrameStreamSource source;
+	source.setServer("127.0.0.1", listener.localPort());
+	CHECK(source.open(QFrameSource::ColorStream | QFrameSource::DepthStream));
+
+	QFrameStreamSocket peer;
+	Request request;
+	if (!CHECK(listener.accept(peer, Timeout)) || !CHECK(peer.receive(&request, sizeof(request))))
+		return;
+
+	QKinectDepthFrame frame;
+	MakeDepth(frame, 1);
+	std::vector<unsigned char> coded;
+	QDepthCodec().encode(frame.Buffer.data(), DepthPixels, coded);
+
+	std::vector<unsigned char> pixels(16 * 8 * QKinectColorFrame::Channels, 0x80);
+
+	struct Case
+	{
+		quint32		Stream;
+		quint32		Format;
+		qint32		Width;
+		qint32		Height;
+		bool		Valid;
+	};
+
+	const Case cases[] =
+	{
+		{ QFrameSource::DepthStream, QFrameRecording::Gray16Rvl, -DepthWidth, -DepthHeight, false },	// same count, negative sides
+		{ QFrameSource::DepthStream, QFrameRecording::Gray16Rvl, 0, DepthHeight, false },
+		{ QFrameSource::DepthStream, QFrameRecording::Gray16Rvl, DepthWidth, DepthHeight - 1, false },	// other count than coded
+		{ QFrameSource::DepthStream, QFrameRecording::Gray16Rvl, DepthPixels, 1, false },				// too wide
+		{ QFrameSource::DepthStream, QFrameRecording::Gray16, DepthWidth, DepthHeight, false },
+		{ QFrameSource::ColorStream, QFrameRecording::Bgra32, 16, 16, false },							// larger than the payload
+		{ QFrameSource::ColorStream, QFrameRecording::Bgra32, 16, 4, false },							// smaller than the payload
+		{ QFrameSource::ColorStream, QFrameRecording::Bgra32, -16, -8, false },
+		{ QFrameSource::ColorStream, QFrameRecording::Bgra32, 65536 + 16, 8, false },					// 16 once truncated to 16 bits
+		{ QFrameSource::ColorStream, QFrameRecording::Bgra32, 16, 8, true },
+		{ QFrameSource::DepthStream, QFrameRecording::Gray16Rvl, DepthWidth, DepthHeight, true }
+	};
+
+	QFramePool pool(2);
+	QKinectColorFrame color;
+	QKinectDepthFrame depth;
+	quint32 sequence = 0;
+
+	for (const Case& c : cases)
+	{
+		const bool isColor = c.Stream == QFrameSource::ColorStream;
+
+		FrameHeader header;
+		header.Magic = FrameMagic;
+		header.Stream = c.Stream;
+		header.Format = c.Format;
+		header.Size = static_cast<quint32>(isColor ? pixels.size() : coded.size());
+		header.Width = c.Width;
+		header.Height = c.Height;
+		header.Time = sequence;
+		header.Sequence = sequence++;
+		header.Reserved = 0;
+
+		const QFrameStreamSocket::Buffer parts[] =
+		{
+			{ &header, sizeof(header) },
+			{ isColor ? pixels.data() : coded.data(), static_cast<int>(header.Size) }
+		};
+
+		if (!CHECK(peer.send(parts, 2)) || !CHECK(WaitForFrame(source, c.Stream)))
+			return;
+
+		const bool read = isColor ? source.readColor(color, pool) : source.readDepth(depth);
+		if (!CHECK_EQUAL(read, c.Valid))
+			std::cerr << "  case " << (&c - cases) << std::endl;
+	}
+
+	CHECK(depth.Buffer == frame.Buffer);
+	CHECK(color.Width == 16 && color.Height == 8);
+	CHECK(source.isConnected());
+}
+
+
+/// <summary>
+/// Several clients, the last one slow to read: every frame is either written to a client or
+/// dropped for it, the slow client only loses frames of its own and the fast ones get every
+/// frame at the same latency as if it were not there
+/// </summary>
+static void SlowClient()
+{
+	QFrameStreamServer server;
+	CHECK(server.listen(0));
+
+	QElapsedTimer clock;
+	clock.start();
+
+	std::vector<RawClient*> clients;
+	for (int c = 0; c < ClientCount; ++c)
+	{
+		clients.push_back(new RawClient(server.port(), c + 1 == ClientCount ? SlowClientDelay : 0, clock));
+		clients.back()->start();
+	}
+
+	CHECK(WaitForClients(server, ClientCount));
+
+	// a connection takes frames once the client's request arrived: send warm-up frames until
+	// every client has the newest one, nothing is left waiting for any of them after that
+	QKinectDepthFrame frame;
+	bool ready = false;
+
+	for (int n = 0; n > -Timeout / FramePace && !ready; --n)
+	{
+		MakeDepth(frame, 0);
+		frame.Time = n;
+		server.sendDepth(frame);
+
+		QElapsedTimer waited;
+		waited.start();
+
+		do
+		{
+			QThread::msleep(1);
+
+			ready = true;
+			for (RawClient* client : clients)
+				ready &= client->Warmup.loadAcquire() == n;
+		}
+		while (!ready && !waited.hasExpired(FramePace + SlowClientDelay));
+	}
+
+	CHECK(ready);
+
+	const quint64 sentBefore = server.sentCount();
+	const quint64 droppedBefore = server.droppedCount();
+
+	std::vector<QKinectDepthFrame> frames(PacedCount + 1);
+	std::vector<qint64> sentAt(PacedCount + 1);
+	for (int n = 1; n <= PacedCount; ++n)
+		MakeDepth(frames[n], n);
+
+	for (int n = 1; n <= PacedCount; ++n)
+	{
+		const qint64 due = clock.nsecsElapsed() + FramePace * Q_INT64_C(1000000);
+
+		sentAt[n] = clock.nsecsElapsed();
+		server.sendDepth(frames[n]);
+
+		const qint64 left = due - clock.nsecsElapsed();
+		if (left > 0)
+			QThread::usleep(static_cast<unsigned long>(left / 1000));
+	}
+
+	// the newest frame always goes out, every client stops once it has it
+	for (RawClient* client : clients)
+	{
+		if (!CHECK(client->wait(Timeout + PacedCount * SlowClientDelay)))
+		{
+			client->stop();
+			client->wait();
+		}
+	}
+
+	quint64 received = 0;
+	quint64 missed = 0;
+
+	for (int c = 0; c < ClientCount; ++c)
+	{
+		const RawClient& client = *clients[c];
+		const bool slow = c + 1 == ClientCount;
+
+		int count = 0;
+		qint64 total = 0;
+		qint64 worst = 0;
+
+		for (int n = 1; n <= PacedCount; ++n)
+		{
+			if (client.Received[n] < 0)
+				continue;
+
+			const qint64 latency = client.Received[n] - sentAt[n];
+			total += latency;
+			worst = qMax(worst, latency);
+			++count;
+		}
+
+		std::cerr << (slow ? "slow" : "fast") << " client " << c << ": " << count << " of " << PacedCount << " frames, latency mean "
+			<< (count ? total / 1e6 / count : 0.) << " ms, worst " << worst / 1e6 << " ms" << std::endl;
+
+		CHECK(client.Connected);
+		CHECK(client.Received[PacedCount] >= 0);
+
+		if (slow)
+		{
+			CHECK(count < PacedCount);
+		}
+		else
+		{
+			// no frame of a fast client waits for the slow one to read
+			CHECK_EQUAL(count, PacedCount);
+			CHECK(count > 0 && total / count < SlowClientDelay * Q_INT64_C(1000000));
+		}
+
+		received += count;
+		missed += PacedCount - count;
+	}
+
+	// what each client did not get the server dropped for it, nothing went missing
+	CHECK_EQUAL(server.sentCount() - sentBefore, received);
+	CHECK_EQUAL(server.droppedCount() - droppedBefore, missed);
+
+	server.close();
+	for (RawClient* client : clients)
+		delete client;
+}
+
+
+int main()
+{
+	Lockstep();
+	Color();
+	StalledClient();
+	Flood();
+	SlowClient();
+	MalformedHeaders();
+
+	return TestCheck::result();
+}
@@ -0,0 +1,275 @@
+#include "stdafx.h"
+#include "QFrameSynchronizer.h"
+#include "TestCheck.h"
+#include <vector>
+#include <random>
+#include <algorithm>
+
+
+// Sensor tick at 30 Hz, in RelativeTime ticks of 100 ns
+#define FramePeriod 333333
+
+// Tolerance the sets are matched with, 10 ms
+#define SetTolerance 100000
+
+// Ticks of the synthetic streams
+#define TickCount 3000
+
+
+struct Timestamp
+{
+	QFrameSource::Stream	Stream;
+	qint64					Time;
+};
+
+
+/// <summary>
+/// Timestamps of color, depth and infrared at 30 Hz, each within jitter of its tick and
+/// arriving in a random order per tick. dropped[t] is the stream missing from tick t, if any.
+/// </summary>
+static std::vector<Timestamp> SyntheticStreams(qint64 jitter, const std::vector<int>& dropped, quint32 seed)
+{
+	const QFrameSource::Stream streams[] = { QFrameSource::ColorStream, QFrameSource::DepthStream, QFrameSource::InfraredStream };
+
+	std::mt19937 random(seed);
+	std::uniform_int_distribution<qint64> offset(-jitter, jitter);
+	std::vector<Timestamp> timestamps;
+
+	for (int t = 0; t < TickCount; ++t)
+	{
+		std::vector<Timestamp> tick;
+		for (int s = 0; s < 3; ++s)
+		{
+			if (dropped[t] != streams[s])
+			{
+				const Timestamp timestamp = { streams[s], Q_INT64_C(1000000) + t * FramePeriod + offset(random) };
+				tick.push_back(timestamp);
+			}
+		}
+
+		std::shuffle(tick.begin(), tick.end(), random);
+		timestamps.insert(timestamps.end(), tick.begin(), tick.end());
+	}
+
+	return timestamps;
+}
+
+static QFrameSynchronizer ColorDepthInfrared(qint64 tolerance)
+{
+	QFrameSynchronizer synchronizer;
+	synchronizer.setStreams(QFrameSource::ColorStream | QFrameSource::DepthStream | QFrameSource::InfraredStream);
+	synchronizer.setTolerance(tolerance);
+	return synchronizer;
+}
+
+
+/// <summary>
+/// Every tick of three jittered streams is one set, completed by its last frame whatever
+/// the order the frames arrive in
+/// </summary>
+static void CompleteSets()
+{
+	const std::vector<Timestamp> timestamps = SyntheticStreams(SetTolerance / 2, std::vector<int>(TickCount, QFrameSource::NoStream), 1);
+	QFrameSynchronizer synchronizer = ColorDepthInfrared(SetTolerance);
+
+	for (size_t i = 0; i < timestamps.size(); ++i)
+	{
+		const bool completed = synchronizer.add(timestamps[i].Stream, timestamps[i].Time);
+		if (!CHECK_EQUAL(completed, i % 3 == 2))
+			break;
+	}
+
+	CHECK_EQUAL(synchronizer.completeCount(), static_cast<quint64>(TickCount));
+	CHECK_EQUAL(synchronizer.incompleteCount(), Q_UINT64_C(0));
+	CHECK_EQUAL(synchronizer.pendingStreams(), static_cast<int>(QFrameSource::NoStream));
+}
+
+
+/// <summary>
+/// A dropped frame leaves its tick incomplete, counted once when the next tick breaks it,
+/// and does not take the next tick with it
+/// </summary>
+static void DroppedFrames()
+{
+	const int streams[] = { QFrameSource::ColorStream, QFrameSource::DepthStream, QFrameSource::InfraredStream };
+
+	std::mt19937 random(2);
+	std::uniform_int_distribution<int> drop(0, 9);
+	std::uniform_int_distribution<int> stream(0, 2);
+
+	// the last tick is kept, nothing would break its set
+	std::vector<int> dropped(TickCount, QFrameSource::NoStream);
+	quint64 droppedTicks = 0;
+	for (int t = 0; t + 1 < TickCount; ++t)
+	{
+		if (drop(random) == 0)
+		{
+			dropped[t] = streams[stream(random)];
+			++droppedTicks;
+		}
+	}
+
+	const std::vector<Timestamp> timestamps = SyntheticStreams(SetTolerance / 2, dropped, 3);
+	QFrameSynchronizer synchronizer = ColorDepthInfrared(SetTolerance);
+
+	quint64 completed = 0;
+	for (const Timestamp& timestamp : timestamps)
+		completed += synchronizer.add(timestamp.Stream, timestamp.Time);
+
+	CHECK(droppedTicks > 100);
+	CHECK_EQUAL(completed, TickCount - droppedTicks);
+	CHECK_EQUAL(synchronizer.completeCount(), TickCount - droppedTicks);
+	CHECK_EQUAL(synchronizer.incompleteCount(), droppedTicks);
+}
+
+
+/// <summary>
+/// The spread of the whole set counts, up to and including the tolerance, and a frame
+/// that breaks a set starts the next one
+/// </summary>
+static void Tolerance()
+{
+	QFrameSynchronizer synchronizer = ColorDepthInfrared(1000);
+
+	// exactly the tolerance apart, earliest frame last
+	CHECK(!synchronizer.add(QFrameSource::DepthStream, 10500));
+	CHECK(!synchronizer.add(QFrameSource::ColorStream, 11000));
+	CHECK(synchronizer.add(QFrameSource::InfraredStream, 10000));
+
+	// each frame within the tolerance of the first, but not of each other
+	CHECK(!synchronizer.add(QFrameSource::ColorStream, 20000));
+	CHECK(!synchronizer.add(QFrameSource::DepthStream, 20600));
+	CHECK(!synchronizer.add(QFrameSource::InfraredStream, 19400));
+	CHECK_EQUAL(synchronizer.incompleteCount(), Q_UINT64_C(1));
+	CHECK_EQUAL(synchronizer.pendingStreams(), static_cast<int>(QFrameSource::InfraredStream));
+
+	// the infrared frame that broke the set completes the next one
+	CHECK(!synchronizer.add(QFrameSource::ColorStream, 19500));
+	CHECK(synchronizer.add(QFrameSource::DepthStream, 20400));
+	CHECK_EQUAL(synchronizer.completeCount(), Q_UINT64_C(2));
+
+	// a zero tolerance takes only identical times, a negative one is zero
+	QFrameSynchronizer exact = ColorDepthInfrared(-5);
+	CHECK_EQUAL(exact.tolerance(), Q_INT64_C(0));
+	CHECK(!exact.add(QFrameSource::ColorStream, 500));
+	CHECK(!exact.add(QFrameSource::DepthStream, 500));
+	CHECK(exact.add(QFrameSource::InfraredStream, 500));
+	CHECK(!exact.add(QFrameSource::ColorStream, 600));
+	CHECK(!exact.add(QFrameSource::DepthStream, 601));
+	CHECK_EQUAL(exact.incompleteCount(), Q_UINT64_C(1));
+}
+
+
+/// <summary>
+/// A stream repeating before the set is complete breaks it, its new frame starting the next
+/// </summary>
+static void RepeatedStream()
+{
+	QFrameSynchronizer synchronizer = ColorDepthInfrared(SetTolerance);
+
+	CHECK(!synchronizer.add(QFrameSource::DepthStream, 0));
+	CHECK(!synchronizer.add(QFrameSource::ColorStream, 10));
+	CHECK(!synchronizer.add(QFrameSource::DepthStream, 20));
+	CHECK_EQUAL(synchronizer.incompleteCount(), Q_UINT64_C(1));
+	CHECK_EQUAL(synchronizer.pendingStreams(), static_cast<int>(QFrameSource::DepthStream));
+
+	CHECK(!synchronizer.add(QFrameSource::ColorStream, 30));
+	CHECK(synchronizer.add(QFrameSource::InfraredStream, 40));
+	CHECK_EQUAL(synchronizer.completeCount(), Q_UINT64_C(1));
+}
+
+
+/// <summary>
+/// Streams that are not enabled are ignored, a single stream completes a set per frame,
+/// and reset() and setStreams() drop the pending set
+/// </summary>
+static void Streams()
+{
+	QFrameSynchronizer synchronizer = ColorDepthInfrared(SetTolerance);
+
+	CHECK(!synchronizer.add(QFrameSource::ColorStream, 0));
+	CHECK(!synchronizer.add(QFrameSource::BodyStream, 5 * SetTolerance));
+	CHECK_EQUAL(synchronizer.pendingStreams(), static_cast<int>(QFrameSource::ColorStream));
+	CHECK_EQUAL(synchronizer.incompleteCount(), Q_UINT64_C(0));
+
+	synchronizer.reset();
+	CHECK_EQUAL(synchronizer.pendingStreams(), static_cast<int>(QFrameSource::NoStream));
+
+	// the depth frame before reset() must not count towards the set after it
+	CHECK(!synchronizer.add(QFrameSource::DepthStream, 0));
+	synchronizer.reset();
+	CHECK(!synchronizer.add(QFrameSource::ColorStream, 0));
+	CHECK(!synchronizer.add(QFrameSource::InfraredStream, 0));
+	CHECK(synchronizer.add(QFrameSource::DepthStream, 0));
+	CHECK_EQUAL(synchronizer.completeCount(), Q_UINT64_C(1));
+
+	synchronizer.reset();
+	CHECK_EQUAL(synchronizer.completeCount(), Q_UINT64_C(0));
+	CHECK_EQUAL(synchronizer.incompleteCount(), Q_UINT64_C(0));
+
+	// flags that are not streams are dropped
+	synchronizer.setStreams(QFrameSource::DepthStream | 0x100);
+	CHECK_EQUAL(synchronizer.streams(), static_cast<int>(QFrameSource::DepthStream));
+
+	for (int i = 0; i < 10; ++i)
+		CHECK(synchronizer.add(QFrameSource::DepthStream, i * FramePeriod));
+	CHECK(!synchronizer.add(QFrameSource::ColorStream, 0));
+	CHECK_EQUAL(synchronizer.completeCount(), Q_UINT64_C(10));
+	CHECK_EQUAL(synchronizer.incompleteCount(), Q_UINT64_C(0));
+
+	// no streams, no sets
+	synchronizer.setStreams(QFrameSource::NoStream);
+	CHECK(!synchronizer.add(QFrameSource::DepthStream, 0));
+	CHECK_EQUAL(synchronizer.completeCount(), Q_UINT64_C(10));
+}
+
+
+/// <summary>
+/// Every frame is numbered with its set: frames of one tick share a number whatever their
+/// order, the frame that breaks a set takes the next one, and reset() starts over at 0
+/// </summary>
+static void SetNumbers()
+{
+	const std::vector<Timestamp> timestamps = SyntheticStreams(SetTolerance / 2, std::vector<int>(TickCount, QFrameSource::NoStream), 4);
+	QFrameSynchronizer synchronizer = ColorDepthInfrared(SetTolerance);
+
+	for (size_t i = 0; i < timestamps.size(); ++i)
+	{
+		synchronizer.add(timestamps[i].Stream, timestamps[i].Time);
+		if (!CHECK_EQUAL(synchronizer.currentSet(), static_cast<qint64>(i / 3)))
+			break;
+	}
+
+	synchronizer.reset();
+	CHECK_EQUAL(synchronizer.currentSet(), Q_INT64_C(0));
+
+	CHECK(!synchronizer.add(QFrameSource::DepthStream, 0));
+	CHECK(!synchronizer.add(QFrameSource::ColorStream, 10));
+	CHECK_EQUAL(synchronizer.currentSet(), Q_INT64_C(0));
+
+	// the repeated depth frame breaks set 0 and starts set 1, a stream that is not enabled changes nothing
+	CHECK(!synchronizer.add(QFrameSource::DepthStream, FramePeriod));
+	CHECK_EQUAL(synchronizer.currentSet(), Q_INT64_C(1));
+	CHECK(!synchronizer.add(QFrameSource::BodyStream, FramePeriod));
+	CHECK_EQUAL(synchronizer.currentSet(), Q_INT64_C(1));
+	CHECK(!synchronizer.add(QFrameSource::ColorStream, FramePeriod));
+	CHECK(synchronizer.add(QFrameSource::InfraredStream, FramePeriod));
+	CHECK_EQUAL(synchronizer.currentSet(), Q_INT64_C(1));
+
+	// the set after a complete one
+	CHECK(!synchronizer.add(QFrameSource::InfraredStream, 2 * FramePeriod));
+	CHECK_EQUAL(synchronizer.currentSet(), Q_INT64_C(2));
+}
+
+
+int main()
+{
+	CompleteSets();
+	DroppedFrames();
+	Tolerance();
+	RepeatedStream();
+	Streams();
+	SetNumbers();
+
+	return TestCheck::result();
+}
@@ -0,0 +1,137 @@
+#include "stdafx.h"
+#include "QInfraredToneMapper.h"
+#include "TestCheck.h"
+#include <vector>
+#include <algorithm>
+#include <climits>
+
+
+// The SDK sample's constants the grabber used before the lookup table
+#define InfraredSourceValueMaximum static_cast<float>(USHRT_MAX)
+#define InfraredOutputValueMinimum 0.01f
+#define InfraredOutputValueMaximum 1.0f
+#define InfraredSceneValueAverage 0.08f
+#define InfraredSceneStandardDeviations 3.0f
+
+// Bytes after every row that map() must leave alone
+#define GuardBytes 13
+#define Guard 0xA5
+
+
+/// <summary>
+/// The per pixel code the table replaced, in its order and precision
+/// </summary>
+static unsigned char InfraredReference(unsigned short infra, float average, float deviations)
+{
+	float intensityRatio = static_cast<float>(infra) / InfraredSourceValueMaximum;
+	intensityRatio /= average * deviations;
+	intensityRatio = std::min(InfraredOutputValueMaximum, intensityRatio);
+	intensityRatio = std::max(InfraredOutputValueMinimum, intensityRatio);
+	return static_cast<unsigned char>(intensityRatio * 255.0f);
+}
+
+/// <summary>
+/// Every entry of the table is the reference's byte
+/// </summary>
+static bool TableMatches(const QInfraredToneMapper& mapper, float average, float deviations)
+{
+	for (int v = 0; v <= USHRT_MAX; ++v)
+	{
+		const unsigned char expected = InfraredReference(static_cast<unsigned short>(v), average, deviations);
+		if (mapper.table()[v] != expected)
+		{
+			std::cerr << "  average " << average << ", deviations " << deviations << ": value " << v
+				<< " maps to " << int(mapper.table()[v]) << " instead of " << int(expected) << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/// <summary>
+/// Without adaptation the table is the SDK sample's formula for every one of the 65536
+/// inputs, and map() gives it pixel for pixel into padded rows
+/// </summary>
+static void FixedTable()
+{
+	QInfraredToneMapper mapper;
+	CHECK(!mapper.adaptive());
+	CHECK_EQUAL(mapper.sceneAverage(), InfraredSceneValueAverage);
+	CHECK_EQUAL(mapper.standardDeviations(), InfraredSceneStandardDeviations);
+	CHECK(TableMatches(mapper, InfraredSceneValueAverage, InfraredSceneStandardDeviations));
+
+	const int width = 256;
+	const int height = 256;
+	const int stride = width + GuardBytes;
+
+	std::vector<unsigned short> frame(width * height);
+	for (int v = 0; v <= USHRT_MAX; ++v)
+		frame[v] = static_cast<unsigned short>(v);
+
+	std::vector<unsigned char> image(height * stride, Guard);
+	mapper.map(frame.data(), width, height, image.data(), stride);
+
+	for (int y = 0; y < height; ++y)
+	{
+		for (int x = 0; x < stride; ++x)
+		{
+			const unsigned char expected = x < width ?
+				InfraredReference(frame[y * width + x], InfraredSceneValueAverage, InfraredSceneStandardDeviations) : Guard;
+
+			if (!CHECK_EQUAL(int(image[y * stride + x]), int(expected)))
+			{
+				std::cerr << "  pixel " << x << ", " << y << std::endl;
+				return;
+			}
+		}
+	}
+
+	// a fixed table is never rebuilt by mapping
+	CHECK_EQUAL(mapper.rebuildCount(), 1);
+}
+
+
+/// <summary>
+/// Other fixed averages and deviations follow the same formula, and turning adaptation
+/// off again goes back to the fixed table
+/// </summary>
+static void OtherParameters()
+{
+	QInfraredToneMapper mapper;
+
+	mapper.setSceneAverage(0.2f);
+	CHECK(TableMatches(mapper, 0.2f, InfraredSceneStandardDeviations));
+
+	mapper.setStandardDeviations(1.5f);
+	CHECK(TableMatches(mapper, 0.2f, 1.5f));
+
+	mapper.setStandardDeviations(InfraredSceneStandardDeviations);
+	mapper.setSceneAverage(InfraredSceneValueAverage);
+	CHECK(TableMatches(mapper, InfraredSceneValueAverage, InfraredSceneStandardDeviations));
+
+	// a dark scene moves the adaptive table away from the fixed one
+	std::vector<unsigned short> dark(512 * 424, 600);
+	std::vector<unsigned char> image(dark.size());
+
+	const int fixedRebuilds = mapper.rebuildCount();
+	mapper.setAdaptive(true);
+	for (int i = 0; i < 8; ++i)
+		mapper.map(dark.data(), 512, 424, image.data(), 512);
+
+	CHECK(mapper.rebuildCount() > fixedRebuilds);
+	CHECK(image[0] > InfraredReference(600, InfraredSceneValueAverage, InfraredSceneStandardDeviations));
+
+	mapper.setAdaptive(false);
+	CHECK(TableMatches(mapper, InfraredSceneValueAverage, InfraredSceneStandardDeviations));
+}
+
+
+int main()
+{
+	FixedTable();
+	OtherParameters();
+
+	return TestCheck::result();
+}
@@ -0,0 +1,143 @@
+#include "stdafx.h"
+#include "QKinectGrabber.h"
+#include "QSyntheticFrameSource.h"
+#include "TestCheck.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+
+// How long the grabber runs, in ms
+#define RunTime 2000
+
+// Rate of the fake sensor
+#define FrameRate 30.0
+
+// Largest share of one core the whole process may use while grabbing at FrameRate
+#define MaxCpuShare 0.25
+
+
+/// <summary>
+/// Synthetic source counting how the grabber drives it: every wait(), the ones that came
+/// back without a stream, and every read with and without a frame
+/// </summary>
+class CountingSource : public QSyntheticFrameSource
+{
+public:
+	CountingSource() : Waits(0), EmptyWaits(0), Reads(0), EmptyReads(0) {}
+
+	int wait(unsigned long timeoutMs) Q_DECL_OVERRIDE
+	{
+		const int streams = QSyntheticFrameSource::wait(timeoutMs);
+		++Waits;
+		if (streams == NoStream)
+			++EmptyWaits;
+		return streams;
+	}
+
+	bool readDepth(QKinectDepthFrame& frame) Q_DECL_OVERRIDE
+	{
+		return count(QSyntheticFrameSource::readDepth(frame));
+	}
+
+	bool readInfrared(QKinectInfraredFrame& frame) Q_DECL_OVERRIDE
+	{
+		return count(QSyntheticFrameSource::readInfrared(frame));
+	}
+
+	// only touched by the grabber thread, read after it stopped
+	int		Waits;
+	int		EmptyWaits;
+	int		Reads;
+	int		EmptyReads;
+
+private:
+	bool count(bool read)
+	{
+		++Reads;
+		if (!read)
+			++EmptyReads;
+		return read;
+	}
+};
+
+
+/// <summary>
+/// CPU time used by every thread of the process so far, in ns
+/// </summary>
+static qint64 ProcessCpuTime()
+{
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+	const quint64 kernelTicks = (static_cast<quint64>(kernel.dwHighDateTime) << 32) | kernel.dwLowDateTime;
+	const quint64 userTicks = (static_cast<quint64>(user.dwHighDateTime) << 32) | user.dwLowDateTime;
+	return static_cast<qint64>((kernelTicks + userTicks) * 100);
+#else
+	timespec time;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+	return time.tv_sec * Q_INT64_C(1000000000) + time.tv_nsec;
+#endif
+}
+
+
+/// <summary>
+/// With depth and infrared at 30 Hz the grabber thread sleeps in wait() between frames:
+/// it wakes once per frame, only reads the streams that have one and, as the frames come
+/// faster than the wait timeout, never wakes for nothing. The process stays well below a core.
+/// </summary>
+static void WaitsForFrames()
+{
+	CountingSource source;
+	source.setDepthSize(512, 424);
+	source.setFrameRate(QFrameSource::DepthStream, FrameRate);
+	source.setFrameRate(QFrameSource::InfraredStream, FrameRate);
+	source.setPaced(true);
+
+	QKinectGrabber grabber;
+	grabber.setFrameSource(&source);
+	grabber.setUseDepthFrame(true);
+	grabber.setUseInfraredFrame(true);
+	grabber.setStatisticsInterval(0);
+
+	QElapsedTimer wall;
+	wall.start();
+	const qint64 cpuStart = ProcessCpuTime();
+
+	grabber.start();
+	QThread::msleep(RunTime);
+	grabber.stop();
+
+	const double cpu = (ProcessCpuTime() - cpuStart) / 1e6;
+	const double elapsed = static_cast<double>(wall.elapsed());
+
+	const int frames = source.Reads - source.EmptyReads;
+	const int expected = static_cast<int>(2 * FrameRate * RunTime / 1000);
+
+	std::cout << frames << " frames in " << source.Waits << " waits, " << source.EmptyWaits << " empty, "
+		<< "cpu " << cpu << " ms in " << elapsed << " ms" << std::endl;
+
+	CHECK(frames > expected * 3 / 4);
+	CHECK(frames <= expected + 4);
+	CHECK_EQUAL(source.EmptyReads, 0);
+
+	// a wait per frame at most, depth and infrared often come together; the one empty wait is stop() waking it
+	CHECK(source.Waits <= frames + 1);
+	CHECK(source.EmptyWaits <= 1);
+
+	CHECK(cpu < MaxCpuShare * elapsed);
+}
+
+
+int main(int argc, char* argv[])
+{
+	QCoreApplication app(argc, argv);
+
+	WaitsForFrames();
+
+	return TestCheck::result();
+}
@@ -0,0 +1,352 @@
+#include "stdafx.h"
+#include "QPlaybackFrameSource.h"
+#include "QFrameRecorder.h"
+#include "QFramePool.h"
+#include "TestCheck.h"
+#include <QDir>
+#include <QFile>
+#include <vector>
+
+
+// Sensor tick at 30 Hz, in RelativeTime ticks of 100 ns
+#define FramePeriod 333333
+
+// Frame sets of the recorded session
+#define SessionFrames 30
+
+// Frame size of every stream of the session
+#define FrameWidth 8
+#define FrameHeight 6
+
+// How long a wait() that must not see a frame gets, in ms
+#define IdleWait 30
+
+static const int AllImages = QFrameSource::ColorStream | QFrameSource::DepthStream | QFrameSource::InfraredStream;
+
+
+static qint64 FrameTime(int t)
+{
+	return Q_INT64_C(10000000) + t * FramePeriod;
+}
+
+/// <summary>
+/// Pixels of set t, the set's number in every one of them
+/// </summary>
+static std::vector<unsigned short> Gray16(int t)
+{
+	return std::vector<unsigned short>(FrameWidth * FrameHeight, static_cast<unsigned short>(1000 + t));
+}
+
+static std::vector<unsigned char> Bgra(int t)
+{
+	return std::vector<unsigned char>(FrameWidth * FrameHeight * 4, static_cast<unsigned char>(t));
+}
+
+/// <summary>
+/// Record SessionFrames sets of every stream, each set at one time
+/// </summary>
+static bool RecordSession(const QString& fileName)
+{
+	QFrameRecorder recorder;
+	if (!CHECK(recorder.open(fileName, 1024 * 1024, 64 * 1024)))
+		return false;
+
+	for (int t = 0; t < SessionFrames; ++t)
+	{
+		const std::vector<unsigned char> color = Bgra(t);
+		const std::vector<unsigned short> gray = Gray16(t);
+		QKinectBodyFrame body = QKinectBodyFrame();
+		body.Time = FrameTime(t);
+
+		recorder.write(QFrameSource::ColorStream, QFrameRecording::Bgra32, FrameWidth, FrameHeight, FrameTime(t), color.data(), static_cast<int>(color.size()));
+		recorder.write(QFrameSource::DepthStream, QFrameRecording::Gray16, FrameWidth, FrameHeight, FrameTime(t), gray.data(), static_cast<int>(gray.size() * 2));
+		recorder.write(QFrameSource::InfraredStream, QFrameRecording::Gray16, FrameWidth, FrameHeight, FrameTime(t), gray.data(), static_cast<int>(gray.size() * 2));
+		recorder.write(QFrameSource::BodyStream, QFrameRecording::BodyFrame, QKinectBodyFrame::BodyCount, QKinectBodyFrame::JointCount, FrameTime(t), &body, sizeof(body));
+	}
+
+	recorder.close();
+	return CHECK_EQUAL(recorder.frameCount(), static_cast<quint64>(4 * SessionFrames));
+}
+
+
+/// <summary>
+/// Frames the source hands out for the streams of one wait(), checked to be of set t
+/// </summary>
+struct Reads
+{
+	QKinectColorFrame		Color;
+	QKinectDepthFrame		Depth;
+	QKinectInfraredFrame	Infrared;
+	QKinectBodyFrame		Body;
+	QFramePool				Pool;
+
+	Reads() : Pool(2, 0) {}
+
+	bool set(QPlaybackFrameSource& source, int streams, int t)
+	{
+		bool matches = true;
+
+		if (streams & QFrameSource::ColorStream)
+		{
+			matches = CHECK(source.readColor(Color, Pool)) && CHECK_EQUAL(Color.Time, FrameTime(t)) &&
+				CHECK_EQUAL(Color.Format, QKinectColorFrame::Bgra) && CHECK_EQUAL(static_cast<int>(Color.Buffer.data()[5]), t) && matches;
+		}
+
+		if (streams & QFrameSource::DepthStream)
+			matches = CHECK(source.readDepth(Depth)) && CHECK_EQUAL(Depth.Time, FrameTime(t)) && CHECK(Depth.Buffer == Gray16(t)) && matches;
+
+		if (streams & QFrameSource::InfraredStream)
+			matches = CHECK(source.readInfrared(Infrared)) && CHECK_EQUAL(Infrared.Time, FrameTime(t)) && CHECK(Infrared.Buffer == Gray16(t)) && matches;
+
+		if (streams & QFrameSource::BodyStream)
+			matches = CHECK(source.readBody(Body)) && CHECK_EQUAL(Body.Time, FrameTime(t)) && matches;
+
+		if (!matches)
+			std::cerr << "  set " << t << std::endl;
+
+		return matches;
+	}
+};
+
+
+/// <summary>
+/// Steps the source once from its own thread, after the test blocked in wait()
+/// </summary>
+class Stepper : public QThread
+{
+public:
+	Stepper(QPlaybackFrameSource& source) : Source(source) {}
+
+protected:
+	void run() Q_DECL_OVERRIDE
+	{
+		QThread::msleep(IdleWait);
+		Source.step();
+	}
+
+private:
+	QPlaybackFrameSource&	Source;
+};
+
+
+/// <summary>
+/// AsFastAsPossible hands out every set in order, one per wait(), only of the streams
+/// opened; at the end it idles, and starts over when looping
+/// </summary>
+static void AsFastAsPossible(const QString& fileName)
+{
+	QPlaybackFrameSource source;
+	if (!CHECK(source.load(fileName)))
+		return;
+
+	source.setPacing(QPlaybackFrameSource::AsFastAsPossible);
+	CHECK(source.open(AllImages));
+
+	Reads reads;
+	for (int t = 0; t < SessionFrames; ++t)
+	{
+		CHECK_EQUAL(source.position(), FrameTime(t));
+
+		const int streams = source.wait(1000);
+		if (!CHECK_EQUAL(streams, AllImages) || !reads.set(source, streams, t))
+			return;
+
+		// nothing is read twice
+		CHECK(!source.readDepth(reads.Depth));
+	}
+
+	CHECK(source.atEnd());
+	CHECK_EQUAL(source.deliveredCount(), static_cast<quint64>(3 * SessionFrames));
+	CHECK_EQUAL(source.skippedCount(), Q_UINT64_C(0));
+	CHECK_EQUAL(source.wait(IdleWait), static_cast<int>(QFrameSource::NoStream));
+
+	source.setLoop(true);
+	CHECK_EQUAL(source.wait(1000), AllImages);
+	CHECK(reads.set(source, AllImages, 0));
+
+	source.close();
+}
+
+
+/// <summary>
+/// Stepped hands out nothing until step(), then one set per tick stepped, wherever seek()
+/// left the position
+/// </summary>
+static void Stepped(const QString& fileName)
+{
+	QPlaybackFrameSource source;
+	if (!CHECK(source.load(fileName)))
+		return;
+
+	source.setPacing(QPlaybackFrameSource::Stepped);
+	CHECK(source.open(QFrameSource::DepthStream | QFrameSource::BodyStream));
+
+	Reads reads;
+	CHECK_EQUAL(source.wait(IdleWait), static_cast<int>(QFrameSource::NoStream));
+	CHECK(!source.readDepth(reads.Depth));
+
+	source.step();
+	CHECK_EQUAL(source.wait(1000), static_cast<int>(QFrameSource::DepthStream | QFrameSource::BodyStream));
+	CHECK(reads.set(source, QFrameSource::DepthStream | QFrameSource::BodyStream, 0));
+	CHECK_EQUAL(source.wait(IdleWait), static_cast<int>(QFrameSource::NoStream));
+
+	source.step(2);
+	CHECK_EQUAL(source.wait(1000), static_cast<int>(QFrameSource::DepthStream | QFrameSource::BodyStream));
+	CHECK(reads.set(source, QFrameSource::DepthStream, 1));
+	CHECK_EQUAL(source.wait(1000), static_cast<int>(QFrameSource::DepthStream | QFrameSource::BodyStream));
+	CHECK(reads.set(source, QFrameSource::DepthStream, 2));
+	CHECK_EQUAL(source.wait(IdleWait), static_cast<int>(QFrameSource::NoStream));
+
+	// the body frame of set 1 was never read and is replaced, not queued
+	CHECK(reads.set(source, QFrameSource::BodyStream, 2));
+
+	// a step taken from another thread wakes a wait() already blocked
+	Stepper stepper(source);
+	stepper.start();
+	CHECK_EQUAL(source.wait(5000), static_cast<int>(QFrameSource::DepthStream | QFrameSource::BodyStream));
+	CHECK(reads.set(source, QFrameSource::DepthStream, 3));
+	stepper.wait();
+
+	// back to set 20, on to the end
+	source.seek(FrameTime(20));
+	CHECK_EQUAL(source.position(), FrameTime(20));
+	source.step(SessionFrames);
+	for (int t = 20; t < SessionFrames; ++t)
+	{
+		if (!CHECK_EQUAL(source.wait(1000), static_cast<int>(QFrameSource::DepthStream | QFrameSource::BodyStream)) ||
+			!reads.set(source, QFrameSource::DepthStream, t))
+		{
+			return;
+		}
+	}
+
+	CHECK(source.atEnd());
+	CHECK_EQUAL(source.wait(IdleWait), static_cast<int>(QFrameSource::NoStream));
+	source.close();
+}
+
+
+/// <summary>
+/// seek() lands on the first frame at or after the time, between frames too, and clamps
+/// to the recording at both ends; the frames it skipped are not handed out
+/// </summary>
+static void Seek(const QString& fileName)
+{
+	QPlaybackFrameSource source;
+	if (!CHECK(source.load(fileName)))
+		return;
+
+	source.setPacing(QPlaybackFrameSource::AsFastAsPossible);
+	CHECK(source.open(AllImages));
+
+	Reads reads;
+	const int targets[] = { 7, 0, 29, 12, 12 };
+
+	for (int t : targets)
+	{
+		// a pending frame from before the seek is dropped
+		if (!source.atEnd())
+			source.wait(1000);
+
+		source.seek(FrameTime(t) - FramePeriod / 2);
+		CHECK(!source.readColor(reads.Color, reads.Pool));
+		CHECK_EQUAL(source.position(), FrameTime(t));
+		CHECK(!source.atEnd());
+
+		if (!CHECK_EQUAL(source.wait(1000), AllImages) || !reads.set(source, AllImages, t))
+			return;
+	}
+
+	// exactly on a set
+	source.seek(FrameTime(5));
+	CHECK_EQUAL(source.wait(1000), AllImages);
+	CHECK(reads.set(source, AllImages, 5));
+
+	// before the start, and past the end
+	source.seek(0);
+	CHECK_EQUAL(source.position(), FrameTime(0));
+	source.seek(FrameTime(SessionFrames));
+	CHECK(source.atEnd());
+	CHECK_EQUAL(source.wait(IdleWait), static_cast<int>(QFrameSource::NoStream));
+
+	source.close();
+}
+
+
+/// <summary>
+/// Chunks shorter than their frame, raw and compressed alike, are not read, with a
+/// warning; the complete frames after them are
+/// </summary>
+static void ShortChunks(const QString& fileName)
+{
+	{
+		QFrameRecorder recorder;
+		if (!CHECK(recorder.open(fileName, 1024 * 1024, 64 * 1024)))
+			return;
+
+		const std::vector<unsigned char> color = Bgra(0);
+		const std::vector<unsigned short> gray = Gray16(0);
+		const int graySize = static_cast<int>(gray.size() * 2);
+
+		// a pixel short each
+		recorder.write(QFrameSource::ColorStream, QFrameRecording::Bgra32, FrameWidth, FrameHeight, FrameTime(0), color.data(), static_cast<int>(color.size()) - 4);
+		recorder.write(QFrameSource::DepthStream, QFrameRecording::Gray16, FrameWidth, FrameHeight, FrameTime(0), gray.data(), graySize - 2);
+		recorder.write(QFrameSource::InfraredStream, QFrameRecording::Gray16, FrameWidth, FrameHeight, FrameTime(0), gray.data(), graySize - 2);
+
+		recorder.write(QFrameSource::ColorStream, QFrameRecording::Yuy2, FrameWidth, FrameHeight, FrameTime(1), color.data(), FrameWidth * FrameHeight * 2 - 2);
+		recorder.write(QFrameSource::DepthStream, QFrameRecording::Gray16, FrameWidth, FrameHeight, FrameTime(1), gray.data(), 0);
+		recorder.write(QFrameSource::InfraredStream, QFrameRecording::Gray16, FrameWidth, FrameHeight, FrameTime(1), gray.data(), 1);
+
+		const std::vector<unsigned char> complete = Bgra(2);
+		const std::vector<unsigned short> completeGray = Gray16(2);
+		recorder.write(QFrameSource::ColorStream, QFrameRecording::Bgra32, FrameWidth, FrameHeight, FrameTime(2), complete.data(), static_cast<int>(complete.size()));
+		recorder.write(QFrameSource::DepthStream, QFrameRecording::Gray16, FrameWidth, FrameHeight, FrameTime(2), completeGray.data(), graySize);
+		recorder.write(QFrameSource::InfraredStream, QFrameRecording::Gray16, FrameWidth, FrameHeight, FrameTime(2), completeGray.data(), graySize);
+		recorder.close();
+	}
+
+	QPlaybackFrameSource source;
+	if (!CHECK(source.load(fileName)))
+		return;
+
+	source.setPacing(QPlaybackFrameSource::AsFastAsPossible);
+
+	for (int raw = 0; raw < 2; ++raw)
+	{
+		source.setRawColor(raw != 0);
+		source.seek(0);
+		CHECK(source.open(AllImages));
+
+		Reads reads;
+		for (int t = 0; t < 2; ++t)
+		{
+			CHECK_EQUAL(source.wait(1000), AllImages);
+			CHECK(!source.readColor(reads.Color, reads.Pool));
+			CHECK(!source.readDepth(reads.Depth));
+			CHECK(!source.readInfrared(reads.Infrared));
+		}
+
+		CHECK_EQUAL(source.wait(1000), AllImages);
+		CHECK(reads.set(source, AllImages, 2));
+		source.close();
+	}
+}
+
+
+int main()
+{
+	const QString fileName = QDir::temp().filePath("QPlaybackFrameSourceTest.qkrec");
+
+	if (RecordSession(fileName))
+	{
+		AsFastAsPossible(fileName);
+		Stepped(fileName);
+		Seek(fileName);
+	}
+
+	ShortChunks(fileName);
+
+	QFile::remove(fileName);
+
+	return TestCheck::result();
+}
@@ -0,0 +1,136 @@
+#include "stdafx.h"
+#include "QTripleBuffer.h"
+#include "TestCheck.h"
+#include <vector>
+#include <thread>
+#include <atomic>
+
+
+// Values per frame, large enough for a torn read to span many cache lines
+#define FrameValues 4096
+
+// Frames the producer publishes
+#define FrameCount 200000
+
+
+/// <summary>
+/// Frame n holds n in every value, so a frame partly overwritten by a later one shows
+/// two different values
+/// </summary>
+struct Frame
+{
+	std::vector<quint32> Values;
+};
+
+
+static void SingleThreaded()
+{
+	QTripleBuffer<int> buffer;
+	buffer.initialize([](int& value) { value = -1; });
+
+	CHECK(!buffer.fetch());
+
+	buffer.writeBuffer() = 1;
+	buffer.publish();
+	buffer.writeBuffer() = 2;
+	buffer.publish();
+
+	// only the newest frame is handed out, and only once
+	CHECK(buffer.fetch());
+	CHECK_EQUAL(buffer.readBuffer(), 2);
+	CHECK(!buffer.fetch());
+	CHECK_EQUAL(buffer.readBuffer(), 2);
+
+	buffer.writeBuffer() = 3;
+	buffer.publish();
+	CHECK(buffer.fetch());
+	CHECK_EQUAL(buffer.readBuffer(), 3);
+}
+
+
+/// <summary>
+/// A producer publishes as fast as it can while a consumer on another thread fetches:
+/// every frame fetched is whole and stays so while the consumer holds it, is newer than
+/// the one before, and the last one is seen
+/// </summary>
+static void Concurrent()
+{
+	QTripleBuffer<Frame> buffer;
+	buffer.initialize([](Frame& frame) { frame.Values.assign(FrameValues, 0); });
+
+	std::atomic<bool> done(false);
+
+	std::thread producer([&]()
+	{
+		for (quint32 n = 1; n <= FrameCount; ++n)
+		{
+			Frame& frame = buffer.writeBuffer();
+			for (int i = 0; i < FrameValues; ++i)
+				frame.Values[i] = n;
+
+			buffer.publish();
+
+			// on a single core the consumer would otherwise only run once per time slice
+			if (n % 256 == 0)
+				std::this_thread::yield();
+		}
+
+		done.store(true);
+	});
+
+	quint32 last = 0;
+	quint64 fetched = 0;
+	quint64 torn = 0;
+	quint64 backwards = 0;
+
+	for (;;)
+	{
+		// the last frame may be published between the fetch and the look at done
+		const bool finished = done.load();
+
+		if (buffer.fetch())
+		{
+			const Frame& frame = buffer.readBuffer();
+			const quint32 n = frame.Values[0];
+
+			// the slot is the consumer's until the next fetch, the producer running now must not touch it
+			std::this_thread::yield();
+
+			for (int i = 1; i < FrameValues; ++i)
+			{
+				if (frame.Values[i] != n)
+				{
+					++torn;
+					break;
+				}
+			}
+
+			if (n <= last)
+				++backwards;
+
+			last = n;
+			++fetched;
+		}
+		else if (finished)
+		{
+			break;
+		}
+	}
+
+	producer.join();
+
+	std::cout << "fetched " << fetched << " of " << FrameCount << " frames" << std::endl;
+
+	CHECK_EQUAL(torn, Q_UINT64_C(0));
+	CHECK_EQUAL(backwards, Q_UINT64_C(0));
+	CHECK_EQUAL(last, static_cast<quint32>(FrameCount));
+	CHECK(fetched > 0);
+}
+
+
+int main()
+{
+	SingleThreaded();
+	Concurrent();
+	return TestCheck::result();
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <iostream>
+
+
+/// <summary>
+/// Checks for the tests in this directory. Every test is a plain executable run by
+/// ctest: a failed check prints the expression and where it is, the test goes on, and
+/// main() returns TestCheck::result(), non-zero after any failure.
+/// </summary>
+namespace TestCheck
+{
+	inline int& failures()
+	{
+		static int count = 0;
+		return count;
+	}
+
+	inline bool check(bool passed, const char* expression, const char* file, int line)
+	{
+		if (!passed)
+		{
+			std::cerr << file << ":" << line << ": <Error> check failed: " << expression << std::endl;
+			++failures();
+		}
+
+		return passed;
+	}
+
+	template <typename Actual, typename Expected>
+	bool checkEqual(const Actual& actual, const Expected& expected, const char* expression, const char* file, int line)
+	{
+		if (actual == expected)
+			return true;
+
+		std::cerr << file << ":" << line << ": <Error> check failed: " << expression
+			<< " (" << actual << " != " << expected << ")" << std::endl;
+		++failures();
+		return false;
+	}
+
+	inline int result()
+	{
+		if (failures() > 0)
+			std::cerr << failures() << " check(s) failed" << std::endl;
+
+		return failures() > 0 ? 1 : 0;
+	}
+}
+
+#define CHECK(expression) TestCheck::check((expression), #expression, __FILE__, __LINE__)
+#define CHECK_EQUAL(actual, expected) TestCheck::checkEqual((actual), (expected), #actual " == " #expected, __FILE__, __LINE__)